@@ -3,10 +3,15 @@
 #include <optional>
 #include <glog/logging.h>
 #include <cmath>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
 
 #include "layout.h"
 #include "poly_line_cell.h"
+#include "routing/parallel.h"
 #include "routing/routing_grid.h"
 #include "routing/routing_via_info.h"
 #include "geometry/point.h"
@@ -27,11 +32,27 @@ using routing::RoutingViaInfo;
 Layout *PolyLineInflator::Inflate(
     const routing::RoutingGrid &routing_grid,
     const PolyLineCell &poly_line_cell) {
-  std::unique_ptr<Layout> layout(new Layout(physical_db_));
-  for (const auto &poly_line : poly_line_cell.poly_lines()) {
+  return Inflate(routing_grid, poly_line_cell, routing::NumWorkerThreads());
+}
+
+Layout *PolyLineInflator::Inflate(
+    const routing::RoutingGrid &routing_grid,
+    const PolyLineCell &poly_line_cell,
+    size_t num_threads) {
+  // Inflation is independent for each PolyLine, so it's done in parallel. The
+  // Layout is then assembled in order.
+  std::vector<std::optional<Polygon>> polygons(
+      poly_line_cell.poly_lines().size());
+  routing::RunInParallel(polygons.size(), num_threads, [&](size_t i) {
+    const auto &poly_line = poly_line_cell.poly_lines()[i];
     LOG_IF(FATAL, !poly_line) << "poly_line is nullptr?!";
+    polygons[i] = InflatePolyLine(*poly_line);
+  });
 
-    std::optional<Polygon> polygon = InflatePolyLine(*poly_line);
+  std::unique_ptr<Layout> layout(new Layout(physical_db_));
+  for (size_t i = 0; i < polygons.size(); ++i) {
+    const auto &poly_line = poly_line_cell.poly_lines()[i];
+    std::optional<Polygon> &polygon = polygons[i];
 
     if (VLOG_IS_ON(12)) {
       LOG(INFO) << "inflating: " << poly_line->Describe() << " into: ";
@@ -49,13 +70,26 @@ Layout *PolyLineInflator::Inflate(
     layout->set_active_layer(poly_line->layer());
     layout->AddPolygon(*polygon);
   }
+
+  // Most vias share a handful of layer pairs, so look each pair up once.
+  std::map<std::pair<geometry::Layer, geometry::Layer>,
+           const RoutingViaInfo*> via_infos;
+  auto get_via_info = [&](const geometry::Layer &bottom,
+                          const geometry::Layer &top) -> const RoutingViaInfo& {
+    auto it = via_infos.find({bottom, top});
+    if (it == via_infos.end()) {
+      it = via_infos.insert({
+          {bottom, top},
+          &routing_grid.GetRoutingViaInfoOrDie(bottom, top)}).first;
+    }
+    return *it->second;
+  };
+
   for (const auto &via : poly_line_cell.vias()) {
+    const RoutingViaInfo &info = get_via_info(
+        via->bottom_layer(), via->top_layer());
     Rectangle rectangle;
-    InflateVia(
-        routing_grid.GetRoutingViaInfoOrDie(
-            via->bottom_layer(), via->top_layer()),
-        *via,
-        &rectangle);
+    InflateVia(info, *via, &rectangle);
     layout->set_active_layer(rectangle.layer());
     layout->AddRectangle(rectangle);
 
@@ -64,8 +98,6 @@ Layout *PolyLineInflator::Inflate(
       const geometry::Layer &above = via->top_layer();
       if (!above)
         continue;
-      const auto &info = routing_grid.GetRoutingViaInfoOrDie(
-          via->bottom_layer(), via->top_layer());
       const auto &above_info = routing_grid.GetRoutingLayerInfoOrDie(above);
       auto &pin_layer = above_info.pin_layer();
       if (!pin_layer)
@@ -163,8 +195,78 @@ std::optional<Polygon> PolyLineInflator::InflatePoint(
 //                        |
 //                        original vector, reversed
 //
+size_t PolyLineInflator::ShapeKeyHash::operator()(const ShapeKey &key) const {
+  size_t hash = key.size();
+  for (int64_t value : key) {
+    // The boost::hash_combine recipe.
+    hash ^= std::hash<int64_t>()(value) + 0x9e3779b97f4a7c15 +
+        (hash << 6) + (hash >> 2);
+  }
+  return hash;
+}
+
+std::optional<PolyLineInflator::ShapeKey> PolyLineInflator::MakeShapeKey(
+    const PolyLine &polyline) {
+  ShapeKey key;
+  key.reserve(2 + 3 * polyline.segments().size());
+  key.push_back(polyline.overhang_start());
+  key.push_back(polyline.overhang_end());
+  Point last = polyline.start();
+  for (const LineSegment &segment : polyline.segments()) {
+    if (segment.end.x() != last.x() && segment.end.y() != last.y()) {
+      return std::nullopt;
+    }
+    Point relative = segment.end - polyline.start();
+    key.push_back(relative.x());
+    key.push_back(relative.y());
+    key.push_back(segment.width);
+    last = segment.end;
+  }
+  return key;
+}
+
+size_t PolyLineInflator::num_memoised_shapes() const {
+  std::shared_lock mu(inflated_shapes_lock_);
+  return inflated_shapes_.size();
+}
+
 std::optional<Polygon> PolyLineInflator::InflatePolyLine(
     const PolyLine &polyline) {
+  std::optional<ShapeKey> key = MakeShapeKey(polyline);
+  if (!key) {
+    return InflatePolyLineUncached(polyline);
+  }
+
+  std::optional<Polygon> polygon;
+  bool found = false;
+  {
+    std::shared_lock mu(inflated_shapes_lock_);
+    auto it = inflated_shapes_.find(*key);
+    if (it != inflated_shapes_.end()) {
+      polygon = it->second;
+      found = true;
+    }
+  }
+  if (!found) {
+    // The shape is always inflated at the origin, so that the result doesn't
+    // depend on which of the equivalent lines got here first.
+    PolyLine at_origin(polyline);
+    at_origin.Translate(-polyline.start());
+    polygon = InflatePolyLineUncached(at_origin);
+    std::unique_lock mu(inflated_shapes_lock_);
+    inflated_shapes_.insert({*key, polygon});
+  }
+
+  if (polygon) {
+    polygon->Translate(polyline.start());
+    polygon->set_net(polyline.net());
+    polygon->set_is_connectable(polyline.is_connectable());
+  }
+  return polygon;
+}
+
+std::optional<Polygon> PolyLineInflator::InflatePolyLineUncached(
+    const PolyLine &polyline) {
   if (polyline.segments().empty()) {
     int64_t half_side = static_cast<int64_t>(
         std::max(polyline.overhang_start(), polyline.overhang_end()));
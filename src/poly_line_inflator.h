@@ -5,6 +5,7 @@
 #include <vector>
 #include <memory>
 #include <optional>
+#include <shared_mutex>
 #include <unordered_map>
 
 #include "layout.h"
@@ -22,14 +23,24 @@ namespace routing {
 class RoutingGrid;
 }  // namespace routing
 
+// Inflated PolyLines are memoised: rectilinear PolyLines which differ only by
+// translation (same segments relative to their start, same widths, same
+// overhangs) are inflated once and the resulting polygon is copied and moved
+// into place for the rest. Inflate() and InflatePolyLine() are safe to call
+// concurrently on the same inflator.
 class PolyLineInflator {
  public:
   PolyLineInflator(const PhysicalPropertiesDatabase &physical_db)
       : physical_db_(physical_db) {}
 
-  // Return a laid-out version of the poly_line diagram.
+  // Return a laid-out version of the poly_line diagram. The PolyLines are
+  // inflated from up to num_threads threads; callers that are already running
+  // in parallel should pass 1.
   Layout *Inflate(const routing::RoutingGrid &routing_grid,
                   const PolyLineCell &poly_line_cell);
+  Layout *Inflate(const routing::RoutingGrid &routing_grid,
+                  const PolyLineCell &poly_line_cell,
+                  size_t num_threads);
 
   void InflateVia(const routing::RoutingViaInfo &info,
                   const AbstractVia &via,
@@ -46,13 +57,37 @@ class PolyLineInflator {
   std::optional<geometry::Polygon> InflatePoint(
       const geometry::Point &point, int64_t horizontal, int64_t vertical);
 
+  size_t num_memoised_shapes() const;
+
  private:
+  // The shape of a PolyLine independent of its position: its overhangs,
+  // followed by the end (relative to the start) and width of each segment.
+  typedef std::vector<int64_t> ShapeKey;
+
+  struct ShapeKeyHash {
+    size_t operator()(const ShapeKey &key) const;
+  };
+
+  // Returns std::nullopt if the line has a segment that is not horizontal or
+  // vertical, since the inflated shapes of those depend on rounding at their
+  // absolute position.
+  static std::optional<ShapeKey> MakeShapeKey(const geometry::PolyLine &line);
+
+  // The inflation itself, without memoisation.
+  std::optional<geometry::Polygon> InflatePolyLineUncached(
+      const geometry::PolyLine &line);
+
   static void AppendIntersections(
     const std::vector<geometry::Line> &shifted_lines,
     geometry::Polygon *polygon);
 
   // Provides some defaults and rules.
   const PhysicalPropertiesDatabase &physical_db_;
+
+  // Inflated shapes by ShapeKey, with their PolyLines' start at the origin.
+  std::unordered_map<ShapeKey, std::optional<geometry::Polygon>, ShapeKeyHash>
+      inflated_shapes_;
+  mutable std::shared_mutex inflated_shapes_lock_;
 };
 
 }  // namespace bfg
@@ -2,6 +2,10 @@
 #include <gmock/gmock.h>
 
 #include <glog/logging.h>
+#include <absl/strings/str_cat.h>
+
+#include <optional>
+#include <vector>
 
 #include "geometry/line.h"
 #include "geometry/line_segment.h"
@@ -283,5 +287,43 @@ TEST(PolyLineInflatorTest, TODO_ThisShouldNotBreak4) {
   });
 }
 
+TEST(PolyLineInflatorTest, MemoisedShapesMatchFreshInflation) {
+  PolyLine line = PolyLine({-665, 1713}, {
+      LineSegment {{-665, 1475}, 170},
+      LineSegment {{-580, 1475}, 184},
+      LineSegment {{590, 1475}, 170},
+      LineSegment {{675, 1475}, 170},
+      LineSegment {{675, 1405}, 170},
+      LineSegment {{675, 1240}, 171}
+  });
+  line.set_overhang_start(20);
+  line.set_overhang_end(35);
+
+  PhysicalPropertiesDatabase db;
+  PolyLineInflator memoising(db);
+
+  for (const geometry::Point &offset : std::vector<geometry::Point>{
+           {0, 0}, {12345, -6789}, {-3, 7}, {1000001, 1000001}}) {
+    PolyLine moved = line;
+    moved.Translate(offset);
+    moved.set_net(absl::StrCat("net", offset.x()));
+
+    PolyLineInflator fresh(db);
+    std::optional<geometry::Polygon> expected = fresh.InflatePolyLine(moved);
+    std::optional<geometry::Polygon> actual = memoising.InflatePolyLine(moved);
+    ASSERT_TRUE(expected.has_value());
+    ASSERT_TRUE(actual.has_value());
+    EXPECT_THAT(actual->vertices(),
+                testing::ContainerEq(expected->vertices()));
+    EXPECT_EQ(moved.net(), actual->net());
+  }
+  EXPECT_EQ(1, memoising.num_memoised_shapes());
+
+  // Diagonal segments aren't memoised.
+  PolyLine diagonal = PolyLine({0, 0}, {LineSegment {{100, 100}, 50}});
+  EXPECT_TRUE(memoising.InflatePolyLine(diagonal).has_value());
+  EXPECT_EQ(1, memoising.num_memoised_shapes());
+}
+
 }  // namespace
 }  // namespace bfg
@@ -0,0 +1,608 @@
+// Load generator for router_service_bin.
+//
+// Runs --concurrency clients against a router service, each either replaying a
+// recorded request log (--replay) or generating random NetRouteOrders on grids
+// of its own, and reports the latency of each RPC, overall throughput and how
+// much the server's memory grew.
+//
+// A request log has one call per line, as JSON:
+//
+//   {"rpc": "AddRoutes", "request": { "grid_id": 1, "net_route_orders": ... }}
+//
+// where "request" is in the same form given to grpcurl in
+// router_service_test_*.sh. The supported RPCs are CreateRoutingGrid,
+// AddRoutes, AddRoutesStreaming, AddBlockages (one batch per line),
+// QueryRoutingGrid and DeleteRoutingGrid. Since every client creates its own
+// grids, the grid_id in a logged request is taken to mean the nth grid created
+// by the log itself, counting from 1, as if it were replayed against a fresh
+// server.
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_format.h>
+#include <google/protobuf/struct.pb.h>
+#include <google/protobuf/util/json_util.h>
+
+#include "c_make_header.h"
+
+#include "services/router_service.grpc.pb.h"
+
+DEFINE_string(server, "localhost:8222", "Address of the router service");
+DEFINE_int32(concurrency, 4, "Number of clients making calls at once");
+DEFINE_string(replay, "",
+    "Path to a request log to replay. If empty, a synthetic workload is "
+    "generated instead.");
+DEFINE_int32(replay_iterations, 1,
+    "Number of times each client replays the whole request log");
+DEFINE_int32(num_requests, 100,
+    "Synthetic workload: total number of AddRoutes calls across all clients");
+DEFINE_int32(nets_per_request, 8,
+    "Synthetic workload: NetRouteOrders in each AddRoutes call");
+DEFINE_int32(points_per_net, 2,
+    "Synthetic workload: points to connect in each NetRouteOrder");
+DEFINE_int32(requests_per_grid, 10,
+    "Synthetic workload: AddRoutes calls made on each grid before it is "
+    "deleted and a new one created");
+DEFINE_int64(grid_size, 10000,
+    "Synthetic workload: width and height of each grid");
+DEFINE_bool(stream, false,
+    "Synthetic workload: use AddRoutesStreaming instead of AddRoutes");
+DEFINE_uint64(seed, 0, "Synthetic workload: random seed");
+DEFINE_int32(server_pid, 0,
+    "If given, the server's resident set size is read from /proc before and "
+    "after the run.");
+
+namespace bfg {
+namespace {
+
+using router_service::AddBlockagesReply;
+using router_service::AddBlockagesRequest;
+using router_service::AddRoutesReply;
+using router_service::AddRoutesRequest;
+using router_service::AddRoutesStreamReply;
+using router_service::CreateRoutingGridReply;
+using router_service::CreateRoutingGridRequest;
+using router_service::DeleteRoutingGridReply;
+using router_service::DeleteRoutingGridRequest;
+using router_service::QueryRoutingGridReply;
+using router_service::QueryRoutingGridRequest;
+using router_service::QueryServiceReply;
+using router_service::QueryServiceRequest;
+using router_service::RouterService;
+
+// One call from a request log.
+struct LoggedCall {
+  std::string rpc;
+  // Exactly one of these is used, according to rpc.
+  CreateRoutingGridRequest create_routing_grid;
+  AddRoutesRequest add_routes;
+  AddBlockagesRequest add_blockages;
+  QueryRoutingGridRequest query_routing_grid;
+  DeleteRoutingGridRequest delete_routing_grid;
+};
+
+// Collects the latency and outcome of every call, by RPC.
+class LatencyRecorder {
+ public:
+  struct Summary {
+    size_t num_calls;
+    size_t num_errors;
+    double p50_ms;
+    double p95_ms;
+    double p99_ms;
+    double max_ms;
+  };
+
+  void Record(const std::string &rpc, double latency_ms, bool ok) {
+    std::lock_guard<std::mutex> lock(lock_);
+    latencies_ms_[rpc].push_back(latency_ms);
+    if (!ok) {
+      errors_[rpc]++;
+    }
+  }
+
+  // Times fn, which returns whether the call succeeded.
+  bool Time(const std::string &rpc, const std::function<bool()> &fn) {
+    auto start = std::chrono::steady_clock::now();
+    bool ok = fn();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    Record(rpc, elapsed.count(), ok);
+    return ok;
+  }
+
+  std::map<std::string, Summary> Summarise() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    std::map<std::string, Summary> summaries;
+    for (const auto &entry : latencies_ms_) {
+      std::vector<double> sorted = entry.second;
+      std::sort(sorted.begin(), sorted.end());
+      auto errors_it = errors_.find(entry.first);
+      summaries[entry.first] = {
+          .num_calls = sorted.size(),
+          .num_errors = errors_it == errors_.end() ? 0 : errors_it->second,
+          .p50_ms = Percentile(sorted, 0.50),
+          .p95_ms = Percentile(sorted, 0.95),
+          .p99_ms = Percentile(sorted, 0.99),
+          .max_ms = sorted.empty() ? 0.0 : sorted.back()
+      };
+    }
+    return summaries;
+  }
+
+ private:
+  // Nearest-rank percentile of already-sorted values.
+  static double Percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) {
+      return 0.0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+  }
+
+  mutable std::mutex lock_;
+  std::map<std::string, std::vector<double>> latencies_ms_;
+  std::map<std::string, size_t> errors_;
+};
+
+absl::StatusOr<std::vector<LoggedCall>> ReadRequestLog(
+    const std::string &path) {
+  std::ifstream in(path);
+  if (!in) {
+    return absl::NotFoundError(absl::StrCat("Could not open ", path));
+  }
+  std::vector<LoggedCall> calls;
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(in, line)) {
+    ++line_number;
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+    // The envelope is parsed generically first, and the request is then
+    // re-parsed as the message the RPC expects.
+    google::protobuf::Struct envelope;
+    auto parsed = google::protobuf::util::JsonStringToMessage(line, &envelope);
+    if (!parsed.ok()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "%s:%d: %s", path, line_number, parsed.ToString()));
+    }
+    const auto &fields = envelope.fields();
+    auto rpc_it = fields.find("rpc");
+    auto request_it = fields.find("request");
+    if (rpc_it == fields.end() || request_it == fields.end()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "%s:%d: expected \"rpc\" and \"request\" fields", path,
+          line_number));
+    }
+    std::string request_json;
+    parsed = google::protobuf::util::MessageToJsonString(
+        request_it->second, &request_json);
+    if (!parsed.ok()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "%s:%d: %s", path, line_number, parsed.ToString()));
+    }
+
+    LoggedCall call;
+    call.rpc = rpc_it->second.string_value();
+    google::protobuf::Message *request = nullptr;
+    if (call.rpc == "CreateRoutingGrid") {
+      request = &call.create_routing_grid;
+    } else if (call.rpc == "AddRoutes" || call.rpc == "AddRoutesStreaming") {
+      request = &call.add_routes;
+    } else if (call.rpc == "AddBlockages") {
+      request = &call.add_blockages;
+    } else if (call.rpc == "QueryRoutingGrid") {
+      request = &call.query_routing_grid;
+    } else if (call.rpc == "DeleteRoutingGrid") {
+      request = &call.delete_routing_grid;
+    } else {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "%s:%d: unsupported rpc \"%s\"", path, line_number, call.rpc));
+    }
+    parsed = google::protobuf::util::JsonStringToMessage(request_json, request);
+    if (!parsed.ok()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "%s:%d: %s", path, line_number, parsed.ToString()));
+    }
+    calls.push_back(std::move(call));
+  }
+  return calls;
+}
+
+// Each client makes its calls through its own Client, serially.
+class Client {
+ public:
+  Client(std::shared_ptr<grpc::Channel> channel, LatencyRecorder *recorder)
+      : stub_(RouterService::NewStub(channel)),
+        recorder_(recorder) {}
+
+  std::optional<int64_t> CreateRoutingGrid(
+      const CreateRoutingGridRequest &request) {
+    CreateRoutingGridReply reply;
+    bool ok = recorder_->Time("CreateRoutingGrid", [&]() {
+      grpc::ClientContext context;
+      return stub_->CreateRoutingGrid(&context, request, &reply).ok() &&
+          reply.status().code() == router_service::StatusCode::OK;
+    });
+    return ok ? std::optional<int64_t>(reply.grid_id()) : std::nullopt;
+  }
+
+  void AddRoutes(const AddRoutesRequest &request) {
+    recorder_->Time("AddRoutes", [&]() {
+      grpc::ClientContext context;
+      AddRoutesReply reply;
+      return stub_->AddRoutes(&context, request, &reply).ok() &&
+          reply.status().code() == router_service::StatusCode::OK;
+    });
+  }
+
+  // Also records the time to the first result separately, since that is what
+  // streaming is for.
+  void AddRoutesStreaming(const AddRoutesRequest &request) {
+    auto start = std::chrono::steady_clock::now();
+    recorder_->Time("AddRoutesStreaming", [&]() {
+      grpc::ClientContext context;
+      auto reader = stub_->AddRoutesStreaming(&context, request);
+      AddRoutesStreamReply reply;
+      bool all_ok = true;
+      bool first = true;
+      while (reader->Read(&reply)) {
+        if (first) {
+          std::chrono::duration<double, std::milli> elapsed =
+              std::chrono::steady_clock::now() - start;
+          recorder_->Record(
+              "AddRoutesStreaming (first result)", elapsed.count(), true);
+          first = false;
+        }
+        all_ok = all_ok &&
+            reply.status().code() == router_service::StatusCode::OK;
+      }
+      return reader->Finish().ok() && all_ok;
+    });
+  }
+
+  void AddBlockages(const AddBlockagesRequest &request) {
+    recorder_->Time("AddBlockages", [&]() {
+      grpc::ClientContext context;
+      auto stream = stub_->AddBlockages(&context);
+      stream->Write(request);
+      stream->WritesDone();
+      AddBlockagesReply reply;
+      bool all_ok = true;
+      while (stream->Read(&reply)) {
+        all_ok = all_ok &&
+            reply.status().code() == router_service::StatusCode::OK;
+      }
+      return stream->Finish().ok() && all_ok;
+    });
+  }
+
+  void QueryRoutingGrid(const QueryRoutingGridRequest &request) {
+    recorder_->Time("QueryRoutingGrid", [&]() {
+      grpc::ClientContext context;
+      QueryRoutingGridReply reply;
+      return stub_->QueryRoutingGrid(&context, request, &reply).ok() &&
+          reply.status().code() == router_service::StatusCode::OK;
+    });
+  }
+
+  void DeleteRoutingGrid(int64_t grid_id) {
+    DeleteRoutingGridRequest request;
+    request.set_grid_id(grid_id);
+    recorder_->Time("DeleteRoutingGrid", [&]() {
+      grpc::ClientContext context;
+      DeleteRoutingGridReply reply;
+      return stub_->DeleteRoutingGrid(&context, request, &reply).ok() &&
+          reply.status().code() == router_service::StatusCode::OK;
+    });
+  }
+
+  // Not timed.
+  std::optional<QueryServiceReply> QueryService() {
+    grpc::ClientContext context;
+    QueryServiceReply reply;
+    if (!stub_->QueryService(&context, QueryServiceRequest(), &reply).ok()) {
+      return std::nullopt;
+    }
+    return reply;
+  }
+
+ private:
+  std::unique_ptr<RouterService::Stub> stub_;
+  LatencyRecorder *recorder_;
+};
+
+void ReplayLog(const std::vector<LoggedCall> &calls, Client *client) {
+  // The grid IDs this client was given, in the order the log created them.
+  std::vector<int64_t> grid_ids;
+  auto map_grid_id = [&](int64_t logged_id) -> std::optional<int64_t> {
+    if (logged_id < 1 || logged_id > static_cast<int64_t>(grid_ids.size())) {
+      return std::nullopt;
+    }
+    return grid_ids[logged_id - 1];
+  };
+
+  for (int32_t i = 0; i < FLAGS_replay_iterations; ++i) {
+    grid_ids.clear();
+    for (const LoggedCall &call : calls) {
+      if (call.rpc == "CreateRoutingGrid") {
+        // A failure still takes up a slot, so that later IDs line up.
+        grid_ids.push_back(
+            client->CreateRoutingGrid(call.create_routing_grid).value_or(-1));
+        continue;
+      }
+
+      int64_t logged_id = 0;
+      if (call.rpc == "AddRoutes" || call.rpc == "AddRoutesStreaming") {
+        logged_id = call.add_routes.grid_id();
+      } else if (call.rpc == "AddBlockages") {
+        logged_id = call.add_blockages.grid_id();
+      } else if (call.rpc == "QueryRoutingGrid") {
+        logged_id = call.query_routing_grid.grid_id();
+      } else if (call.rpc == "DeleteRoutingGrid") {
+        logged_id = call.delete_routing_grid.grid_id();
+      }
+      std::optional<int64_t> grid_id = map_grid_id(logged_id);
+      if (!grid_id) {
+        LOG(WARNING) << "Skipping " << call.rpc << " on grid " << logged_id
+                     << ", which the log did not create";
+        continue;
+      }
+
+      if (call.rpc == "AddRoutes" || call.rpc == "AddRoutesStreaming") {
+        AddRoutesRequest request = call.add_routes;
+        request.set_grid_id(*grid_id);
+        if (call.rpc == "AddRoutes") {
+          client->AddRoutes(request);
+        } else {
+          client->AddRoutesStreaming(request);
+        }
+      } else if (call.rpc == "AddBlockages") {
+        AddBlockagesRequest request = call.add_blockages;
+        request.set_grid_id(*grid_id);
+        client->AddBlockages(request);
+      } else if (call.rpc == "QueryRoutingGrid") {
+        QueryRoutingGridRequest request = call.query_routing_grid;
+        request.set_grid_id(*grid_id);
+        client->QueryRoutingGrid(request);
+      } else if (call.rpc == "DeleteRoutingGrid") {
+        client->DeleteRoutingGrid(*grid_id);
+      }
+    }
+  }
+}
+
+CreateRoutingGridRequest MakeSyntheticGridRequest() {
+  CreateRoutingGridRequest request;
+  request.set_predefined_technology(router_service::TECHNOLOGY_SKY130);
+
+  auto add_layer = [&](const std::string &name,
+                       router_service::RoutingLayerDirection direction,
+                       int64_t offset) {
+    router_service::RoutingLayerDefinition *layer =
+        request.mutable_grid_definition()->add_layers();
+    layer->set_name(name);
+    layer->set_direction(direction);
+    layer->mutable_area()->mutable_lower_left()->set_x(0);
+    layer->mutable_area()->mutable_lower_left()->set_y(0);
+    layer->mutable_area()->mutable_upper_right()->set_x(FLAGS_grid_size);
+    layer->mutable_area()->mutable_upper_right()->set_y(FLAGS_grid_size);
+    layer->set_offset(offset);
+  };
+  add_layer("met1.drawing",
+            router_service::RoutingLayerDirection::TRACK_DIRECTION_HORIZONTAL,
+            330);
+  add_layer("met2.drawing",
+            router_service::RoutingLayerDirection::TRACK_DIRECTION_VERTICAL,
+            50);
+
+  router_service::RoutingViaDefinition *via =
+      request.mutable_grid_definition()->add_vias();
+  via->set_between_layer("met1.drawing");
+  via->set_and_layer("met2.drawing");
+  via->set_cost(0.5);
+  return request;
+}
+
+AddRoutesRequest MakeSyntheticRoutesRequest(
+    int64_t grid_id, int64_t *next_net, std::mt19937_64 *generator) {
+  std::uniform_int_distribution<int64_t> coordinate(0, FLAGS_grid_size);
+  AddRoutesRequest request;
+  request.set_grid_id(grid_id);
+  for (int32_t i = 0; i < FLAGS_nets_per_request; ++i) {
+    router_service::NetRouteOrder *order = request.add_net_route_orders();
+    order->set_net(absl::StrCat("net_", (*next_net)++));
+    for (int32_t j = 0; j < FLAGS_points_per_net; ++j) {
+      router_service::PointOnLayer *point = order->add_points();
+      point->mutable_point()->set_x(coordinate(*generator));
+      point->mutable_point()->set_y(coordinate(*generator));
+      point->set_layer_name("met1.drawing");
+    }
+  }
+  return request;
+}
+
+void RunSyntheticWorkload(size_t client_index,
+                          std::atomic<int64_t> *requests_left,
+                          Client *client) {
+  std::mt19937_64 generator(FLAGS_seed + client_index);
+  const CreateRoutingGridRequest grid_request = MakeSyntheticGridRequest();
+
+  std::optional<int64_t> grid_id;
+  int32_t requests_on_grid = 0;
+  int64_t next_net = 0;
+  while (requests_left->fetch_sub(1) > 0) {
+    if (grid_id && requests_on_grid >= FLAGS_requests_per_grid) {
+      client->DeleteRoutingGrid(*grid_id);
+      grid_id.reset();
+    }
+    if (!grid_id) {
+      grid_id = client->CreateRoutingGrid(grid_request);
+      requests_on_grid = 0;
+      next_net = 0;
+      if (!grid_id) {
+        continue;
+      }
+    }
+    AddRoutesRequest request =
+        MakeSyntheticRoutesRequest(*grid_id, &next_net, &generator);
+    if (FLAGS_stream) {
+      client->AddRoutesStreaming(request);
+    } else {
+      client->AddRoutes(request);
+    }
+    ++requests_on_grid;
+  }
+  if (grid_id) {
+    client->DeleteRoutingGrid(*grid_id);
+  }
+}
+
+// Returns VmRSS from /proc/<pid>/status, in kB.
+std::optional<int64_t> ReadResidentSetSizeKb(int32_t pid) {
+  std::ifstream in(absl::StrCat("/proc/", pid, "/status"));
+  std::string key;
+  while (in >> key) {
+    if (key == "VmRSS:") {
+      int64_t kb;
+      in >> kb;
+      return kb;
+    }
+    in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+  return std::nullopt;
+}
+
+void Report(const LatencyRecorder &recorder,
+            double elapsed_s,
+            const std::optional<QueryServiceReply> &service_before,
+            const std::optional<QueryServiceReply> &service_after,
+            const std::optional<int64_t> &rss_before_kb,
+            const std::optional<int64_t> &rss_after_kb) {
+  std::cout << absl::StrFormat("%-36s %8s %7s %10s %10s %10s %10s",
+                               "rpc", "calls", "errors", "p50 ms", "p95 ms",
+                               "p99 ms", "max ms") << std::endl;
+  size_t total_calls = 0;
+  for (const auto &entry : recorder.Summarise()) {
+    const LatencyRecorder::Summary &summary = entry.second;
+    std::cout << absl::StrFormat(
+        "%-36s %8d %7d %10.2f %10.2f %10.2f %10.2f",
+        entry.first, summary.num_calls, summary.num_errors, summary.p50_ms,
+        summary.p95_ms, summary.p99_ms, summary.max_ms) << std::endl;
+    if (entry.first.find('(') == std::string::npos) {
+      total_calls += summary.num_calls;
+    }
+  }
+  std::cout << absl::StrFormat(
+      "%d calls in %.2f s: %.2f calls/s", total_calls, elapsed_s,
+      elapsed_s > 0 ? total_calls / elapsed_s : 0.0) << std::endl;
+
+  if (service_before && service_after) {
+    std::cout << absl::StrFormat(
+        "Resident sessions: %d -> %d; spilled sessions: %d -> %d; "
+        "resident session memory: %+d bytes",
+        service_before->num_resident_sessions(),
+        service_after->num_resident_sessions(),
+        service_before->num_spilled_sessions(),
+        service_after->num_spilled_sessions(),
+        service_after->resident_memory_bytes() -
+            service_before->resident_memory_bytes()) << std::endl;
+  }
+  if (rss_before_kb && rss_after_kb) {
+    std::cout << absl::StrFormat(
+        "Server RSS: %d kB -> %d kB (%+d kB)", *rss_before_kb, *rss_after_kb,
+        *rss_after_kb - *rss_before_kb) << std::endl;
+  }
+}
+
+}  // namespace
+}  // namespace bfg
+
+int main(int argc, char **argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  std::string version =
+      "BFG Router Service Bench v" xstr(bfg_VERSION_MAJOR) "."
+      xstr(bfg_VERSION_MINOR);
+  std::cout << version << std::endl;
+
+  std::vector<bfg::LoggedCall> calls;
+  if (!FLAGS_replay.empty()) {
+    auto read = bfg::ReadRequestLog(FLAGS_replay);
+    if (!read.ok()) {
+      LOG(ERROR) << read.status();
+      return EXIT_FAILURE;
+    }
+    calls = std::move(*read);
+    LOG(INFO) << "Replaying " << calls.size() << " calls from "
+              << FLAGS_replay;
+  }
+
+  // Clients share one channel, as they would in a real deployment; gRPC
+  // multiplexes their calls over it.
+  std::shared_ptr<grpc::Channel> channel = grpc::CreateChannel(
+      FLAGS_server, grpc::InsecureChannelCredentials());
+  bfg::LatencyRecorder recorder;
+  bfg::Client probe(channel, &recorder);
+
+  std::optional<bfg::QueryServiceReply> service_before = probe.QueryService();
+  std::optional<int64_t> rss_before_kb;
+  if (FLAGS_server_pid > 0) {
+    rss_before_kb = bfg::ReadResidentSetSizeKb(FLAGS_server_pid);
+  }
+
+  std::atomic<int64_t> requests_left = FLAGS_num_requests;
+  std::vector<std::thread> threads;
+  threads.reserve(FLAGS_concurrency);
+  auto start = std::chrono::steady_clock::now();
+  for (int32_t i = 0; i < FLAGS_concurrency; ++i) {
+    threads.emplace_back([&, i]() {
+      bfg::Client client(channel, &recorder);
+      if (FLAGS_replay.empty()) {
+        bfg::RunSyntheticWorkload(i, &requests_left, &client);
+      } else {
+        bfg::ReplayLog(calls, &client);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::optional<bfg::QueryServiceReply> service_after = probe.QueryService();
+  std::optional<int64_t> rss_after_kb;
+  if (FLAGS_server_pid > 0) {
+    rss_after_kb = bfg::ReadResidentSetSizeKb(FLAGS_server_pid);
+  }
+
+  bfg::Report(recorder, elapsed.count(), service_before, service_after,
+              rss_before_kb, rss_after_kb);
+  return EXIT_SUCCESS;
+}
@@ -3,11 +3,16 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
 
 #include <absl/status/status.h>
+#include <absl/strings/str_cat.h>
 #include <google/protobuf/text_format.h>
 #include <grpcpp/ext/proto_server_reflection_plugin.h>
 #include <grpcpp/grpcpp.h>
@@ -24,55 +29,52 @@
 #include "vlsir/tech.pb.h"
 #include "services/router_service.grpc.pb.h"
 
+DEFINE_string(session_spill_dir, "",
+    "Directory to spill idle router sessions to. If empty, sessions are never "
+    "spilled.");
+DEFINE_int64(session_memory_budget_mb, 0,
+    "Approximate memory, in MiB, that resident router sessions may use before "
+    "the least recently used are spilled to --session_spill_dir. If less than "
+    "or equal to 0 there is no limit.");
+
 namespace bfg {
 
 grpc::Status RouterServiceImpl::CreateRoutingGrid(
     grpc::ServerContext *context,
     const CreateRoutingGridRequest *request,
     CreateRoutingGridReply *reply) {
-  PhysicalPropertiesDatabase physical_db;
-
   LOG(INFO) << "CreateRoutingGrid request";
-  std::string tech_proto_source;
-  switch (request->predefined_technology()) {
-    case router_service::TECHNOLOGY_SKY130:
-      LOG(INFO) << "Loading sky130";
-      physical_db.LoadTechnologyFromFile("../sky130.technology.pb");
-      SetUpSky130(&physical_db);
-      break;
-    case router_service::TECHNOLOGY_GF180MCU:
-      LOG(INFO) << "Loading gf180mcu";
-      physical_db.LoadTechnologyFromFile("../gf180mcu.technology.pb");
-      SetUpGf180Mcu(&physical_db);
-      break;
-    case router_service::TECHNOLOGY_OTHER:
-      // Fallthrough intended.
-    default:
-      // Do nothing.
-      break;
-  }
+  std::shared_ptr<const PhysicalPropertiesDatabase> physical_db =
+      GetTechnology(request->predefined_technology());
 
-  RouterSession *session = new RouterSession(physical_db);
+  // The grid is built before the session is published, so that the (slow)
+  // ConnectLayers() doesn't hold up other requests.
+  auto session = std::make_shared<RouterSession>(std::move(physical_db));
 
   // Define grid with router and ConnectLayers().
   absl::Status set_up =
       session->SetUpRoutingGrid(request->grid_definition());
 
   if (!set_up.ok()) {
-    delete session;
     reply->mutable_status()->set_code(
         router_service::StatusCode::OTHER_ERROR);
     reply->mutable_status()->set_message(std::string(set_up.message()));
     return grpc::Status::OK;
   }
 
-  RouterServiceImpl::UUID next_uuid = NextUUID();
-  auto insertion_it = sessions_.insert({
-      next_uuid,
-      std::move(std::unique_ptr<RouterSession>(session))
-  });
+  RouterServiceImpl::UUID next_uuid;
+  {
+    std::unique_lock lock(sessions_lock_);
+    next_uuid = NextUUID();
+    if (!FLAGS_session_spill_dir.empty()) {
+      session->set_checkpoint_path(absl::StrCat(
+          FLAGS_session_spill_dir, "/session_", next_uuid));
+    }
+    sessions_.insert({next_uuid, std::move(session)});
+  }
   reply->set_grid_id(next_uuid);
 
+  EnforceMemoryBudget();
   return grpc::Status::OK;
 }
 
@@ -80,23 +82,107 @@ grpc::Status RouterServiceImpl::AddRoutes(
     grpc::ServerContext *context,
     const AddRoutesRequest *request,
     AddRoutesReply *reply) {
-  RouterSession *session = GetSession(request->grid_id());
+  std::shared_ptr<RouterSession> session = GetSession(request->grid_id());
   if (!session) {
     reply->mutable_status()->set_code(
         router_service::StatusCode::GRID_NOT_FOUND);
     return grpc::Status::OK;
   }
-  absl::Status add = session->AddRoutes(*request);
-  //if (!add.ok()) {
-  //  // Some error.
-  //  reply->mutable_status()->set_code(
-  //      router_service::StatusCode::OTHER_ERROR);
-  //  reply->mutable_status()->set_message(std::string(add.message()));
-  //  return grpc::Status::OK;
-  //}
-  session->ExportRoutes(reply);
+  // Routes are exported by the same call so that the session can't be spilled
+  // between routing and exporting.
+  absl::Status exported = session->AddRoutes(*request, reply);
+  if (!exported.ok()) {
+    reply->mutable_status()->set_code(
+        router_service::StatusCode::OTHER_ERROR);
+    reply->mutable_status()->set_message(std::string(exported.message()));
+    return grpc::Status::OK;
+  }
 
   reply->mutable_status()->set_code(router_service::StatusCode::OK);
+  EnforceMemoryBudget();
+  return grpc::Status::OK;
+}
+
+grpc::Status RouterServiceImpl::AddRoutesStreaming(
+    grpc::ServerContext *context,
+    const AddRoutesRequest *request,
+    grpc::ServerWriter<AddRoutesStreamReply> *writer) {
+  std::shared_ptr<RouterSession> session = GetSession(request->grid_id());
+  if (!session) {
+    AddRoutesStreamReply reply;
+    reply.mutable_status()->set_code(
+        router_service::StatusCode::GRID_NOT_FOUND);
+    writer->Write(reply);
+    return grpc::Status::OK;
+  }
+
+  // Failures are reported net by net in the stream itself.
+  session->AddRoutesStreaming(
+      *request, [&](const AddRoutesStreamReply &reply) {
+        if (!writer->Write(reply)) {
+          LOG(WARNING) << "Could not stream result for net "
+                       << std::quoted(reply.net())
+                       << "; has the client gone away?";
+        }
+      }).IgnoreError();
+  EnforceMemoryBudget();
+  return grpc::Status::OK;
+}
+
+grpc::Status RouterServiceImpl::AddBlockages(
+    grpc::ServerContext *context,
+    grpc::ServerReaderWriter<AddBlockagesReply, AddBlockagesRequest> *stream) {
+  std::shared_ptr<RouterSession> session;
+  int64_t grid_id = 0;
+  int64_t num_batches = 0;
+  int64_t num_blockages = 0;
+
+  AddBlockagesRequest batch;
+  while (stream->Read(&batch)) {
+    AddBlockagesReply reply;
+    if (!session) {
+      grid_id = batch.grid_id();
+      session = GetSession(grid_id);
+      if (!session) {
+        reply.mutable_status()->set_code(
+            router_service::StatusCode::GRID_NOT_FOUND);
+        stream->Write(reply);
+        return grpc::Status::OK;
+      }
+    }
+
+    // A bad batch is rejected on its own; the client can carry on with the
+    // rest of the stream.
+    absl::StatusOr<size_t> added;
+    if (batch.grid_id() == grid_id) {
+      added = session->AddBlockages(batch);
+    } else {
+      added = absl::InvalidArgumentError(absl::StrCat(
+          "Batch is for grid ", batch.grid_id(), " but the stream is for grid ",
+          grid_id));
+    }
+    if (added.ok()) {
+      ++num_batches;
+      num_blockages += *added;
+      reply.mutable_status()->set_code(router_service::StatusCode::OK);
+    } else {
+      reply.mutable_status()->set_code(
+          router_service::StatusCode::INVALID_ARGUMENT);
+      reply.mutable_status()->set_message(
+          std::string(added.status().message()));
+    }
+    reply.set_num_batches_applied(num_batches);
+    reply.set_num_blockages_applied(num_blockages);
+    if (!stream->Write(reply)) {
+      LOG(WARNING) << "Could not acknowledge blockage batch; has the client "
+                   << "gone away?";
+      break;
+    }
+  }
+
+  LOG(INFO) << "Added " << num_blockages << " blockages in " << num_batches
+            << " batches";
+  EnforceMemoryBudget();
   return grpc::Status::OK;
 }
 
@@ -104,13 +190,23 @@ grpc::Status RouterServiceImpl::QueryRoutingGrid(
     grpc::ServerContext *context,
     const QueryRoutingGridRequest *request,
     QueryRoutingGridReply *reply) {
-  RouterSession *session = GetSession(request->grid_id());
+  std::shared_ptr<RouterSession> session = GetSession(request->grid_id());
   if (!session) {
     reply->mutable_status()->set_code(
         router_service::StatusCode::GRID_NOT_FOUND);
     return grpc::Status::OK;
   }
 
+  absl::Status result = session->QueryRoutingGrid(*request, reply);
+  if (!result.ok()) {
+    reply->Clear();
+    reply->mutable_status()->set_code(
+        absl::IsInvalidArgument(result) ?
+            router_service::StatusCode::INVALID_ARGUMENT :
+            router_service::StatusCode::OTHER_ERROR);
+    reply->mutable_status()->set_message(std::string(result.message()));
+    return grpc::Status::OK;
+  }
   reply->mutable_status()->set_code(router_service::StatusCode::OK);
   return grpc::Status::OK;
 }
@@ -119,43 +215,178 @@ grpc::Status RouterServiceImpl::DeleteRoutingGrid(
     grpc::ServerContext *context,
     const DeleteRoutingGridRequest *request,
     DeleteRoutingGridReply *reply) {
-  size_t num_removed = sessions_.erase(request->grid_id());
-  if (num_removed < 1) {
-    reply->mutable_status()->set_code(
-        router_service::StatusCode::GRID_NOT_FOUND);
-    return grpc::Status::OK;
+  // Calls still using the session keep their own reference to it, so it is
+  // only destroyed once the last of them finishes. That must happen outside
+  // the lock, since tearing down a big grid is slow.
+  std::shared_ptr<RouterSession> removed;
+  {
+    std::unique_lock lock(sessions_lock_);
+    auto it = sessions_.find(request->grid_id());
+    if (it == sessions_.end()) {
+      reply->mutable_status()->set_code(
+          router_service::StatusCode::GRID_NOT_FOUND);
+      return grpc::Status::OK;
+    }
+    removed = std::move(it->second);
+    sessions_.erase(it);
+  }
+
+  reply->mutable_status()->set_code(router_service::StatusCode::OK);
+  return grpc::Status::OK;
+}
+
+RouterServiceImpl::RouterServiceImpl()
+    : highest_index_(0) {
+  // Every technology gets its entry up front, so that the map itself is never
+  // modified once requests start arriving.
+  for (router_service::PredefinedTechnology technology : {
+           router_service::TECHNOLOGY_OTHER,
+           router_service::TECHNOLOGY_SKY130,
+           router_service::TECHNOLOGY_GF180MCU}) {
+    technologies_.try_emplace(technology);
+  }
+}
+
+std::shared_ptr<const PhysicalPropertiesDatabase>
+RouterServiceImpl::GetTechnology(
+    router_service::PredefinedTechnology technology) {
+  auto it = technologies_.find(technology);
+  if (it == technologies_.end()) {
+    it = technologies_.find(router_service::TECHNOLOGY_OTHER);
   }
+  CachedTechnology &cached = it->second;
 
-  sessions_.erase(request->grid_id());
+  // Concurrent first requests for the same technology wait here for a single
+  // load.
+  std::call_once(cached.loaded, [&]() {
+    auto physical_db = std::make_shared<PhysicalPropertiesDatabase>();
+    switch (it->first) {
+      case router_service::TECHNOLOGY_SKY130:
+        LOG(INFO) << "Loading sky130";
+        physical_db->LoadTechnologyFromFile("../sky130.technology.pb");
+        SetUpSky130(physical_db.get());
+        break;
+      case router_service::TECHNOLOGY_GF180MCU:
+        LOG(INFO) << "Loading gf180mcu";
+        physical_db->LoadTechnologyFromFile("../gf180mcu.technology.pb");
+        SetUpGf180Mcu(physical_db.get());
+        break;
+      case router_service::TECHNOLOGY_OTHER:
+        // Fallthrough intended.
+      default:
+        // Do nothing.
+        break;
+    }
+    cached.physical_db = std::move(physical_db);
+  });
+  return cached.physical_db;
+}
 
+grpc::Status RouterServiceImpl::QueryService(
+    grpc::ServerContext *context,
+    const QueryServiceRequest *request,
+    QueryServiceReply *reply) {
+  int64_t num_resident = 0;
+  int64_t num_spilled = 0;
+  int64_t resident_memory = 0;
+  {
+    std::shared_lock lock(sessions_lock_);
+    for (const auto &entry : sessions_) {
+      const RouterSession &session = *entry.second;
+      if (session.resident()) {
+        ++num_resident;
+        resident_memory += session.memory_usage();
+      } else {
+        ++num_spilled;
+      }
+    }
+  }
+  reply->set_num_resident_sessions(num_resident);
+  reply->set_num_spilled_sessions(num_spilled);
+  reply->set_resident_memory_bytes(resident_memory);
   reply->mutable_status()->set_code(router_service::StatusCode::OK);
   return grpc::Status::OK;
 }
 
 // Other.
-RouterSession *RouterServiceImpl::GetSession(
-    const RouterServiceImpl::UUID &uuid) {
+std::shared_ptr<RouterSession> RouterServiceImpl::GetSession(
+    const RouterServiceImpl::UUID &uuid) const EXCLUDES(sessions_lock_) {
+  std::shared_lock lock(sessions_lock_);
   auto it = sessions_.find(uuid);
   if (it == sessions_.end()) {
     return nullptr;
   }
-  return it->second.get();
+  return it->second;
 }
 
-routing::RoutingGrid *RouterServiceImpl::GetGrid(
-    const RouterServiceImpl::UUID &uuid) {
-  RouterSession *session = GetSession(uuid);
-  if (!session) {
-    return nullptr;
+size_t RouterServiceImpl::NumSessions() const EXCLUDES(sessions_lock_) {
+  std::shared_lock lock(sessions_lock_);
+  return sessions_.size();
+}
+
+void RouterServiceImpl::EnforceMemoryBudget() EXCLUDES(sessions_lock_) {
+  if (FLAGS_session_memory_budget_mb <= 0 || FLAGS_session_spill_dir.empty()) {
+    return;
+  }
+  // If another call is already evicting sessions there's no need to wait for
+  // it.
+  std::unique_lock<std::mutex> evicting(eviction_lock_, std::try_to_lock);
+  if (!evicting.owns_lock()) {
+    return;
+  }
+
+  std::vector<std::shared_ptr<RouterSession>> resident;
+  size_t usage = 0;
+  {
+    std::shared_lock lock(sessions_lock_);
+    for (const auto &entry : sessions_) {
+      if (entry.second->resident()) {
+        resident.push_back(entry.second);
+        usage += entry.second->memory_usage();
+      }
+    }
+  }
+  size_t budget = static_cast<size_t>(FLAGS_session_memory_budget_mb) << 20;
+  if (usage <= budget) {
+    return;
+  }
+
+  // Least recently used first.
+  std::sort(resident.begin(), resident.end(),
+            [](const std::shared_ptr<RouterSession> &lhs,
+               const std::shared_ptr<RouterSession> &rhs) {
+    return lhs->last_used() < rhs->last_used();
+  });
+
+  size_t num_spilled = 0;
+  for (const std::shared_ptr<RouterSession> &session : resident) {
+    if (usage <= budget) {
+      break;
+    }
+    size_t freed = session->memory_usage();
+    absl::Status spilled = session->Spill();
+    if (!spilled.ok()) {
+      // Sessions that are in use are skipped.
+      LOG_IF(WARNING, !absl::IsUnavailable(spilled))
+          << "Could not spill session: " << spilled;
+      continue;
+    }
+    usage -= std::min(usage, freed);
+    ++num_spilled;
   }
-  return session->routing_grid();
+  LOG(INFO) << "Spilled " << num_spilled << " sessions; resident sessions "
+            << "now use ~" << usage << " of " << budget << " bytes";
 }
 
-const RouterServiceImpl::UUID RouterServiceImpl::NextUUID() const { 
+// UUIDs are not reused, even after the session they named is deleted, so
+// that a stale ID can't find its way to someone else's grid.
+const RouterServiceImpl::UUID RouterServiceImpl::NextUUID()
+    REQUIRES(sessions_lock_) {
   RouterServiceImpl::UUID next = highest_index_ + 1;
   while (sessions_.find(next) != sessions_.end()) {
     next++;
   }
+  highest_index_ = next;
   return next;
 }
 
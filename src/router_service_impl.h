@@ -1,7 +1,10 @@
 #ifndef ROUTER_SERVICE_IMPL_H_
 #define ROUTER_SERVICE_IMPL_H_
 
+#include <map>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 
 #include <google/protobuf/text_format.h>
 #include <grpcpp/ext/proto_server_reflection_plugin.h>
@@ -21,17 +24,34 @@ using router_service::CreateRoutingGridRequest;
 using router_service::CreateRoutingGridReply;
 using router_service::AddRoutesRequest;
 using router_service::AddRoutesReply;
+using router_service::AddRoutesStreamReply;
+using router_service::AddBlockagesRequest;
+using router_service::AddBlockagesReply;
 using router_service::QueryRoutingGridRequest;
 using router_service::QueryRoutingGridReply;
 using router_service::DeleteRoutingGridRequest;
 using router_service::DeleteRoutingGridReply;
+using router_service::QueryServiceRequest;
+using router_service::QueryServiceReply;
 
 // Manages RoutingGrids.
+//
+// gRPC's synchronous server calls the handlers from many threads at once.
+// The session table is guarded by a reader-writer lock, which is only held
+// long enough to find, insert or remove an entry, so calls against different
+// grids run in parallel. Sessions are reference counted: a handler holds its
+// own reference to the session for the duration of the call, so deleting a
+// grid while another call is using it only drops it from the table. Mutating
+// calls on the same session are serialised by the session itself.
+//
+// If --session_spill_dir and --session_memory_budget_mb are given, the least
+// recently used idle sessions are spilled to disk whenever the resident ones
+// are estimated to use more than the budget. They are restored by the next
+// call that needs them.
 class RouterServiceImpl final :
   public bfg::router_service::RouterService::Service {
  public:
-  RouterServiceImpl()
-      : highest_index_(0) {}
+  RouterServiceImpl();
 
   // TODO(aryap): Can we find a portable UUID library?
   typedef int64_t UUID;
@@ -47,6 +67,16 @@ class RouterServiceImpl final :
       const AddRoutesRequest *request,
       AddRoutesReply *reply) override;
 
+  grpc::Status AddRoutesStreaming(
+      grpc::ServerContext *context,
+      const AddRoutesRequest *request,
+      grpc::ServerWriter<AddRoutesStreamReply> *writer) override;
+
+  grpc::Status AddBlockages(
+      grpc::ServerContext *context,
+      grpc::ServerReaderWriter<AddBlockagesReply, AddBlockagesRequest> *stream)
+      override;
+
   grpc::Status QueryRoutingGrid(
       grpc::ServerContext *context,
       const QueryRoutingGridRequest *request,
@@ -57,16 +87,46 @@ class RouterServiceImpl final :
       const DeleteRoutingGridRequest *request,
       DeleteRoutingGridReply *reply) override;
 
+  grpc::Status QueryService(
+      grpc::ServerContext *context,
+      const QueryServiceRequest *request,
+      QueryServiceReply *reply) override;
+
   // Other.
-  RouterSession *GetSession(const UUID &uuid);
-  routing::RoutingGrid *GetGrid(const UUID &uuid);
+  //
+  // Returns nullptr if there is no session with the given UUID. The session
+  // stays alive for as long as the caller holds on to it, even if it is
+  // deleted in the meantime.
+  std::shared_ptr<RouterSession> GetSession(const UUID &uuid) const;
+
+  size_t NumSessions() const;
 
  private:
-  const UUID NextUUID() const;
+  // A predefined technology, loaded on first use and shared, read-only, by
+  // every session that uses it.
+  struct CachedTechnology {
+    std::once_flag loaded;
+    std::shared_ptr<const PhysicalPropertiesDatabase> physical_db;
+  };
+
+  std::shared_ptr<const PhysicalPropertiesDatabase> GetTechnology(
+      router_service::PredefinedTechnology technology);
+
+  const UUID NextUUID();
+
+  void EnforceMemoryBudget();
+
+  std::mutex eviction_lock_;
+
+  mutable std::shared_mutex sessions_lock_;
 
   UUID highest_index_;
 
-  std::map<UUID, std::unique_ptr<RouterSession>> sessions_;
+  std::map<UUID, std::shared_ptr<RouterSession>> sessions_;
+
+  // All entries are created by the constructor.
+  std::map<router_service::PredefinedTechnology, CachedTechnology>
+      technologies_;
 };
 
 }  // namespace bfg
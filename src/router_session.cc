@@ -1,9 +1,18 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
 #include <iomanip>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
 #include <string>
 #include <sstream>
+#include <vector>
 
+#include <absl/cleanup/cleanup.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
 #include <absl/status/status.h>
@@ -11,20 +20,102 @@
 #include "equivalent_nets.h"
 #include "geometry/layer.h"
 #include "geometry/point.h"
+#include "geometry/polygon.h"
 #include "geometry/port.h"
+#include "geometry/rectangle.h"
+#include "geometry/shape_collection.h"
+#include "layout.h"
 #include "router_session.h"
+#include "routing/route_manager.h"
 #include "routing/routing_path.h"
 #include "routing/routing_blockage_cache.h"
+#include "routing/routing_grid_snapshot.h"
 
 #include "services/router_service.grpc.pb.h"
 
 namespace bfg {
 
+RouterSession::~RouterSession() {
+  if (checkpoint_path_) {
+    std::remove(GridSnapshotPath().c_str());
+  }
+}
+
+std::string RouterSession::GridSnapshotPath() const {
+  return absl::StrCat(*checkpoint_path_, ".grid");
+}
+
+absl::Status RouterSession::Spill() EXCLUDES(lock_) {
+  std::unique_lock<std::mutex> lock(lock_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return absl::UnavailableError("Session is in use");
+  }
+  if (!checkpoint_path_) {
+    return absl::FailedPreconditionError("Session has no checkpoint path");
+  }
+  if (!routing_grid_) {
+    // Already spilled.
+    return absl::OkStatus();
+  }
+
+  absl::Status saved = routing::RoutingGridSnapshot::Save(
+      *routing_grid_, 0, GridSnapshotPath());
+  if (!saved.ok()) {
+    return saved;
+  }
+
+  LOG(INFO) << "Spilled session to " << *checkpoint_path_ << " ("
+            << routing_grid_->paths().size() << " paths, ~"
+            << memory_usage_ << " bytes freed)";
+  {
+    std::unique_lock<std::shared_mutex> grid_lock(grid_lock_);
+    routing_grid_.reset();
+  }
+  resident_ = false;
+  memory_usage_ = 0;
+  return absl::OkStatus();
+}
+
+absl::Status RouterSession::EnsureResident() REQUIRES(lock_) {
+  if (routing_grid_) {
+    return absl::OkStatus();
+  }
+  return Restore();
+}
+
+absl::Status RouterSession::Restore() REQUIRES(lock_) {
+  auto start = std::chrono::steady_clock::now();
+
+  auto grid = std::make_unique<routing::RoutingGrid>(*physical_db_);
+  absl::Status loaded = routing::RoutingGridSnapshot::Load(
+      GridSnapshotPath(), std::nullopt, grid.get());
+  if (!loaded.ok()) {
+    return loaded;
+  }
+
+  size_t num_paths = grid->paths().size();
+  {
+    std::unique_lock<std::shared_mutex> grid_lock(grid_lock_);
+    routing_grid_ = std::move(grid);
+  }
+  resident_ = true;
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  LOG(INFO) << "Restored session from " << *checkpoint_path_ << " ("
+            << num_paths << " paths) in " << elapsed.count() << " ms";
+  return absl::OkStatus();
+}
+
+void RouterSession::Touch() REQUIRES(lock_) {
+  memory_usage_ = routing_grid_ ? routing_grid_->ApproximateMemoryUsage() : 0;
+  last_used_ = std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
 absl::StatusOr<geometry::Port> RouterSession::PointAndLayerToPort(
     const std::string &net,
     const router_service::PointOnLayer &point_on_layer) const {
-  auto layer =
-      routing_grid_->physical_db().FindLayer(point_on_layer.layer_name());
+  auto layer = physical_db_->FindLayer(point_on_layer.layer_name());
   if (!layer) {
     return absl::InvalidArgumentError(absl::StrCat(
         "Could not convert point in requested route to port: (",
@@ -38,7 +129,22 @@ absl::StatusOr<geometry::Port> RouterSession::PointAndLayerToPort(
 }
 
 absl::Status RouterSession::AddRoutes(
-    const router_service::AddRoutesRequest &request) {
+    const router_service::AddRoutesRequest &request,
+    router_service::AddRoutesReply *reply) EXCLUDES(lock_) {
+  std::lock_guard<std::mutex> lock(lock_);
+  absl::Status resident = EnsureResident();
+  if (!resident.ok()) {
+    return resident;
+  }
+  absl::Status routed = AddRoutesInternal(request);
+  LOG_IF(WARNING, !routed.ok()) << "Not all routes were added: " << routed;
+  ExportRoutesInternal(reply);
+  Touch();
+  return absl::OkStatus();
+}
+
+absl::Status RouterSession::AddRoutesInternal(
+    const router_service::AddRoutesRequest &request) REQUIRES(lock_) {
   // We will have a list of nets to route with 2+ points:
   //  - Connect first two points with shortest path AddRouteBetween(...),
   //  give them the net label.
@@ -69,34 +175,225 @@ absl::Status RouterSession::AddRoutes(
   return absl::OkStatus();
 }
 
-void RouterSession::ExportRoutes(router_service::AddRoutesReply *reply) const {
-  for (routing::RoutingPath *path : routing_grid_->paths()) {
-    router_service::Route *route = reply->add_routes();
-    route->set_net(path->nets().primary());
+void RouterSession::PathToRoute(const routing::RoutingPath &path,
+                                router_service::Route *route) const {
+  route->set_net(path.nets().primary());
 
-    std::vector<geometry::Point> points;
-    std::vector<geometry::Layer> layers;
-    path->ToPointsAndLayers(&points, &layers);
+  std::vector<geometry::Point> points;
+  std::vector<geometry::Layer> layers;
+  path.ToPointsAndLayers(&points, &layers);
 
-    for (const geometry::Point &point : points) {
-      router_service::Point *point_pb = route->add_points();
-      point_pb->set_x(point.x());
-      point_pb->set_y(point.y());
+  for (const geometry::Point &point : points) {
+    router_service::Point *point_pb = route->add_points();
+    point_pb->set_x(point.x());
+    point_pb->set_y(point.y());
+  }
+
+  for (const geometry::Layer &layer : layers) {
+    auto maybe_name = physical_db_->GetLayerName(layer);
+    if (maybe_name) {
+      route->add_layers(*maybe_name);
+    } else {
+      route->add_layers(absl::StrFormat("unknown_%d", layer));
+    }
+  }
+}
+
+absl::Status RouterSession::AddRoutesStreaming(
+    const router_service::AddRoutesRequest &request,
+    const std::function<void(
+        const router_service::AddRoutesStreamReply&)> &emit) EXCLUDES(lock_) {
+  std::lock_guard<std::mutex> lock(lock_);
+  absl::Status resident = EnsureResident();
+  if (!resident.ok()) {
+    return resident;
+  }
+  absl::Status routed = AddRoutesThroughRouteManager(request, emit);
+  Touch();
+  return routed;
+}
+
+absl::Status RouterSession::AddRoutesThroughRouteManager(
+    const router_service::AddRoutesRequest &request,
+    const std::function<void(
+        const router_service::AddRoutesStreamReply&)> &emit) REQUIRES(lock_) {
+
+  std::mutex emit_lock;
+  auto emit_serially = [&](const router_service::AddRoutesStreamReply &reply) {
+    std::lock_guard<std::mutex> emit_mu(emit_lock);
+    emit(reply);
+  };
+
+  // The session has no layout of its own, so there are no connectable shapes
+  // for the RouteManager to block off.
+  Layout layout(*physical_db_);
+  routing::RouteManager route_manager(&layout, routing_grid_.get());
+
+  std::atomic<size_t> num_failed = 0;
+  size_t num_orders = 0;
+
+  // The RouteManager refers to ports by pointer, so they must outlive it.
+  std::vector<std::unique_ptr<geometry::Port>> ports;
+  for (const router_service::NetRouteOrder &net_route_order :
+       request.net_route_orders()) {
+    if (net_route_order.points_size() < 2) {
+      // Nothing to do.
+      continue;
+    }
+    ++num_orders;
+
+    std::vector<geometry::Port*> order_ports;
+    absl::Status converted = absl::OkStatus();
+    for (const router_service::PointOnLayer &point_on_layer :
+         net_route_order.points()) {
+      auto port = PointAndLayerToPort(net_route_order.net(), point_on_layer);
+      if (!port.ok()) {
+        converted = port.status();
+        break;
+      }
+      order_ports.push_back(
+          ports.emplace_back(new geometry::Port(*port)).get());
+    }
+    if (!converted.ok()) {
+      router_service::AddRoutesStreamReply reply;
+      reply.set_net(net_route_order.net());
+      reply.mutable_status()->set_code(
+          router_service::StatusCode::INVALID_ARGUMENT);
+      reply.mutable_status()->set_message(std::string(converted.message()));
+      emit_serially(reply);
+      ++num_failed;
+      continue;
     }
 
-    for (const geometry::Layer &layer : layers) {
-      auto maybe_name = physical_db_.GetLayerName(layer);
-      if (maybe_name) {
-        route->add_layers(*maybe_name);
-      } else {
-        route->add_layers(absl::StrFormat("unknown_%d", layer));
+    route_manager.ConnectMultiplePorts(
+        order_ports, EquivalentNets({net_route_order.net()})).IgnoreError();
+  }
+
+  route_manager.set_on_order_complete(
+      [&](const routing::RouteManager::OrderAndResult &order_and_result) {
+        router_service::AddRoutesStreamReply reply;
+        reply.set_net(order_and_result.order.net().primary());
+        if (!order_and_result.result.ok()) {
+          reply.mutable_status()->set_code(
+              router_service::StatusCode::OTHER_ERROR);
+          reply.mutable_status()->set_message(
+              std::string(order_and_result.result.status().message()));
+          ++num_failed;
+        } else {
+          reply.mutable_status()->set_code(router_service::StatusCode::OK);
+          for (const routing::RoutingPath *path : *order_and_result.result) {
+            PathToRoute(*path, reply.add_routes());
+          }
+        }
+        emit_serially(reply);
+      });
+
+  route_manager.Solve().IgnoreError();
+
+  if (num_failed > 0) {
+    return absl::InternalError(absl::StrFormat(
+        "%d of %d nets could not be routed", num_failed.load(), num_orders));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status RouterSession::ExportRoutes(router_service::AddRoutesReply *reply)
+    EXCLUDES(lock_) {
+  std::lock_guard<std::mutex> lock(lock_);
+  absl::Status resident = EnsureResident();
+  if (!resident.ok()) {
+    return resident;
+  }
+  ExportRoutesInternal(reply);
+  Touch();
+  return absl::OkStatus();
+}
+
+void RouterSession::ExportRoutesInternal(
+    router_service::AddRoutesReply *reply) const REQUIRES(lock_) {
+  for (routing::RoutingPath *path : routing_grid_->paths()) {
+    PathToRoute(*path, reply->add_routes());
+  }
+}
+
+absl::StatusOr<size_t> RouterSession::AddBlockages(
+    const router_service::AddBlockagesRequest &batch) EXCLUDES(lock_) {
+  std::lock_guard<std::mutex> lock(lock_);
+  absl::Status resident = EnsureResident();
+  if (!resident.ok()) {
+    return resident;
+  }
+  absl::StatusOr<size_t> added = AddBlockagesInternal(batch);
+  Touch();
+  return added;
+}
+
+absl::StatusOr<size_t> RouterSession::AddBlockagesInternal(
+    const router_service::AddBlockagesRequest &batch) REQUIRES(lock_) {
+  // The padding is given per blockage but applied per call, so shapes are
+  // grouped by it. Everything is checked before anything is added.
+  std::map<int64_t, geometry::ShapeCollection> shapes_by_padding;
+  for (const router_service::Blockage &blockage_pb : batch.blockages()) {
+    auto layer = physical_db_->FindLayer(blockage_pb.layer_name());
+    if (!layer) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Unknown layer for blockage: \"%s\"", blockage_pb.layer_name()));
+    }
+    if (blockage_pb.padding() < 0) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Blockage padding must not be negative: %d", blockage_pb.padding()));
+    }
+    geometry::ShapeCollection &shapes =
+        shapes_by_padding[blockage_pb.padding()];
+
+    switch (blockage_pb.shape_case()) {
+      case router_service::Blockage::kRectangle: {
+        const router_service::Rectangle &rectangle_pb =
+            blockage_pb.rectangle();
+        geometry::Point lower_left = {
+            rectangle_pb.lower_left().x(), rectangle_pb.lower_left().y()};
+        geometry::Point upper_right = {
+            rectangle_pb.upper_right().x(), rectangle_pb.upper_right().y()};
+        if (lower_left.x() > upper_right.x() ||
+            lower_left.y() > upper_right.y()) {
+          return absl::InvalidArgumentError(
+              "Blockage rectangle upper right is below or left of lower left");
+        }
+        shapes.rectangles().emplace_back(new geometry::Rectangle(
+            lower_left, upper_right, *layer, blockage_pb.net()));
+        break;
+      }
+      case router_service::Blockage::kPolygon: {
+        if (blockage_pb.polygon().vertices_size() < 3) {
+          return absl::InvalidArgumentError(
+              "Blockage polygon must have at least 3 vertices");
+        }
+        geometry::Polygon *polygon = new geometry::Polygon();
+        for (const router_service::Point &point_pb :
+             blockage_pb.polygon().vertices()) {
+          polygon->AddVertex({point_pb.x(), point_pb.y()});
+        }
+        polygon->set_layer(*layer);
+        polygon->set_net(blockage_pb.net());
+        shapes.polygons().emplace_back(polygon);
+        break;
       }
+      default:
+        return absl::InvalidArgumentError("Blockage has no shape");
     }
   }
+
+  size_t num_added = 0;
+  for (const auto &entry : shapes_by_padding) {
+    const geometry::ShapeCollection &shapes = entry.second;
+    routing_grid_->AddBlockages(shapes, entry.first);
+    num_added += shapes.rectangles().size() + shapes.polygons().size();
+  }
+  return num_added;
 }
 
 absl::Status RouterSession::PerformNetRouteOrder(
-    const router_service::NetRouteOrder &request) {
+    const router_service::NetRouteOrder &request) REQUIRES(lock_) {
   LOG(INFO) << "Routing net " << std::quoted(request.net());
 
   if (request.points_size() < 2) {
@@ -144,7 +441,14 @@ absl::Status RouterSession::PerformNetRouteOrder(
 }
 
 absl::Status RouterSession::SetUpRoutingGrid(
-    const router_service::RoutingGridDefinition &grid_definition) {
+    const router_service::RoutingGridDefinition &grid_definition)
+    EXCLUDES(lock_) {
+  std::lock_guard<std::mutex> lock(lock_);
+  absl::Status resident = EnsureResident();
+  if (!resident.ok()) {
+    return resident;
+  }
+  absl::Cleanup touch = [&]() { Touch(); };
   router_service::Status result;
   if (grid_definition.layers_size() < 2) {
     return absl::InvalidArgumentError("Too few grid definitions");
@@ -238,5 +542,80 @@ absl::Status RouterSession::SetUpRoutingGrid(
   return absl::OkStatus();
 }
 
+absl::Status RouterSession::QueryRoutingGrid(
+    const router_service::QueryRoutingGridRequest &request,
+    router_service::QueryRoutingGridReply *reply) const EXCLUDES(grid_lock_) {
+  // Bigger maps are no more useful and would take a while to send.
+  static constexpr int32_t kMaxCongestionMapSide = 1024;
+
+  int32_t columns = request.congestion_map_columns();
+  int32_t rows = request.congestion_map_rows();
+  bool want_congestion_map = columns != 0 || rows != 0;
+  if (want_congestion_map && (
+          columns <= 0 || rows <= 0 ||
+          columns > kMaxCongestionMapSide || rows > kMaxCongestionMapSide)) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Congestion map must have between 1 and %d columns and rows",
+        kMaxCongestionMapSide));
+  }
+
+  std::shared_lock<std::shared_mutex> grid_lock(grid_lock_);
+  if (!routing_grid_) {
+    reply->set_spilled(true);
+    return absl::OkStatus();
+  }
+
+  routing::RoutingGrid::Statistics statistics =
+      routing_grid_->GetStatistics();
+  for (const auto &entry : statistics.layers) {
+    router_service::LayerStatistics *layer_pb = reply->add_layers();
+    std::optional<std::string> name = physical_db_->GetLayerName(entry.first);
+    layer_pb->set_layer_name(name ? *name : absl::StrCat(entry.first));
+    layer_pb->set_num_vertices(entry.second.num_vertices);
+    layer_pb->set_num_edges(entry.second.num_edges);
+    layer_pb->set_num_tracks(entry.second.num_tracks);
+  }
+  reply->set_num_paths(statistics.num_paths);
+  reply->set_total_wirelength(statistics.total_wirelength);
+  reply->set_memory_bytes(statistics.approximate_memory_usage);
+
+  if (!want_congestion_map) {
+    return absl::OkStatus();
+  }
+
+  std::optional<geometry::Rectangle> area;
+  if (request.has_congestion_map_area()) {
+    const router_service::Rectangle &area_pb = request.congestion_map_area();
+    if (area_pb.upper_right().x() <= area_pb.lower_left().x() ||
+        area_pb.upper_right().y() <= area_pb.lower_left().y()) {
+      return absl::InvalidArgumentError(
+          "Congestion map area must have its upper right corner above and to "
+          "the right of its lower left");
+    }
+    area = geometry::Rectangle(
+        {area_pb.lower_left().x(), area_pb.lower_left().y()},
+        {area_pb.upper_right().x(), area_pb.upper_right().y()});
+  } else {
+    area = routing_grid_->GetBounds();
+  }
+  if (!area) {
+    return absl::FailedPreconditionError(
+        "Grid has no routing layers to make a congestion map of");
+  }
+
+  router_service::CongestionMap *map_pb = reply->mutable_congestion_map();
+  router_service::Rectangle *area_pb = map_pb->mutable_area();
+  area_pb->mutable_lower_left()->set_x(area->lower_left().x());
+  area_pb->mutable_lower_left()->set_y(area->lower_left().y());
+  area_pb->mutable_upper_right()->set_x(area->upper_right().x());
+  area_pb->mutable_upper_right()->set_y(area->upper_right().y());
+  map_pb->set_columns(columns);
+  map_pb->set_rows(rows);
+  for (double utilisation :
+       routing_grid_->GetCongestionMap(*area, columns, rows)) {
+    map_pb->add_utilisation(utilisation);
+  }
+  return absl::OkStatus();
+}
 
 }  // namespace bfg
@@ -1,8 +1,15 @@
 #ifndef ROUTER_SESSION_H_
 #define ROUTER_SESSION_H_
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
+#include <string>
+#include <utility>
 
 #include <absl/status/status.h>
 #include <absl/status/statusor.h>
@@ -10,6 +17,7 @@
 #include "geometry/port.h"
 
 #include "routing/routing_grid.h"
+#include "routing/routing_path.h"
 #include "physical_properties_database.h"
 
 #include "vlsir/tech.pb.h"
@@ -17,32 +25,134 @@
 
 namespace bfg {
 
+// A RoutingGrid and the calls that have been made against it.
+//
+// The RouterService may call into the same session from several threads at
+// once. Calls that change the grid, and those that read back its routes, are
+// serialised by lock_.
+//
+// If given a checkpoint path, the session can be spilled to disk while it is
+// idle, and is restored by the next call that needs its grid. The grid, routes
+// and all, is saved with a RoutingGridSnapshot, so a restored session has
+// exactly the routes it had before it was spilled.
 class RouterSession {
  public:
-  RouterSession(PhysicalPropertiesDatabase &physical_db)
-      : physical_db_(physical_db) {
-    routing_grid_.reset(new routing::RoutingGrid(physical_db_));
+  // The PhysicalPropertiesDatabase is shared with other sessions using the
+  // same technology.
+  explicit RouterSession(
+      std::shared_ptr<const PhysicalPropertiesDatabase> physical_db)
+      : physical_db_(std::move(physical_db)),
+        resident_(true),
+        memory_usage_(0),
+        last_used_(0) {
+    routing_grid_.reset(new routing::RoutingGrid(*physical_db_));
   }
 
-  routing::RoutingGrid *routing_grid() { return routing_grid_.get(); }
+  ~RouterSession();
 
-  absl::Status AddRoutes(const router_service::AddRoutesRequest &request);
+  // nullptr while the session is spilled.
+  routing::RoutingGrid *routing_grid() { return routing_grid_.get(); }
 
-  void ExportRoutes(router_service::AddRoutesReply *reply) const;
-
-  absl::Status PerformNetRouteOrder(
-      const router_service::NetRouteOrder &request);
+  // Routes the request and then fills in the reply with every route in the
+  // grid. The session is held throughout, so it can't be spilled in between.
+  // Nets that can't be routed are logged and left out; errors returned are
+  // for the grid as a whole.
+  absl::Status AddRoutes(const router_service::AddRoutesRequest &request,
+                         router_service::AddRoutesReply *reply);
+
+  // Routes the request's orders through a RouteManager, in parallel if --jobs
+  // allows, and calls emit with each net's result as soon as it has been
+  // installed. Only the routes added by this call are emitted. emit is never
+  // called by two threads at once.
+  absl::Status AddRoutesStreaming(
+      const router_service::AddRoutesRequest &request,
+      const std::function<void(
+          const router_service::AddRoutesStreamReply&)> &emit);
+
+  absl::Status ExportRoutes(router_service::AddRoutesReply *reply);
+
+  // Adds the batch's shapes to the grid as permanent blockages, through the
+  // bulk path. If any blockage in the batch is invalid none are added.
+  // Returns the number added.
+  absl::StatusOr<size_t> AddBlockages(
+      const router_service::AddBlockagesRequest &batch);
 
   absl::Status SetUpRoutingGrid(
       const router_service::RoutingGridDefinition &grid_definition);
 
+  // Fills in the reply with the grid's statistics and, if asked for, its
+  // congestion map. This does not wait for other calls on the session, so it
+  // can be polled while routing is in progress. Neither the statistics nor the
+  // congestion map visit every vertex; see RoutingGrid::GetCongestionMap. A
+  // spilled session is not restored; the reply just says that it is spilled.
+  absl::Status QueryRoutingGrid(
+      const router_service::QueryRoutingGridRequest &request,
+      router_service::QueryRoutingGridReply *reply) const;
+
+  // Enables spilling. The grid snapshot is written to a file starting with the
+  // given path, which is removed with the session.
+  void set_checkpoint_path(const std::string &checkpoint_path) {
+    checkpoint_path_ = checkpoint_path;
+  }
+
+  // Writes the session out and frees its grid. Returns UnavailableError,
+  // without waiting, if another call is using the session.
+  absl::Status Spill();
+
+  bool resident() const { return resident_; }
+
+  // As of the end of the last call, so that these can be read without waiting
+  // for the session.
+  size_t memory_usage() const { return memory_usage_; }
+  int64_t last_used() const { return last_used_; }
+
  private:
+  std::string GridSnapshotPath() const;
+
+  absl::Status EnsureResident();
+  absl::Status Restore();
+
+  void Touch();
+
+  absl::Status AddRoutesInternal(
+      const router_service::AddRoutesRequest &request);
+
+  absl::Status AddRoutesThroughRouteManager(
+      const router_service::AddRoutesRequest &request,
+      const std::function<void(
+          const router_service::AddRoutesStreamReply&)> &emit);
+
+  void ExportRoutesInternal(router_service::AddRoutesReply *reply) const;
+
+  absl::StatusOr<size_t> AddBlockagesInternal(
+      const router_service::AddBlockagesRequest &batch);
+
+  absl::Status PerformNetRouteOrder(
+      const router_service::NetRouteOrder &request);
+
   absl::StatusOr<geometry::Port> PointAndLayerToPort(
       const std::string &net,
       const router_service::PointOnLayer &point_on_layer) const;
 
-  PhysicalPropertiesDatabase physical_db_;
+  void PathToRoute(const routing::RoutingPath &path,
+                   router_service::Route *route) const;
+
+  mutable std::mutex lock_;
+
+  // Calls holding lock_ can use routing_grid_ freely. Replacing it also needs
+  // grid_lock_, so that QueryRoutingGrid can read it without lock_.
+  mutable std::shared_mutex grid_lock_;
+
+  std::shared_ptr<const PhysicalPropertiesDatabase> physical_db_;
   std::unique_ptr<routing::RoutingGrid> routing_grid_;
+
+  std::optional<std::string> checkpoint_path_;
+
+  std::atomic<bool> resident_;
+  std::atomic<size_t> memory_usage_;
+
+  // In std::chrono::steady_clock ticks.
+  std::atomic<int64_t> last_used_;
 };
 
 }  // namespace bfg
@@ -0,0 +1,57 @@
+#ifndef ROUTING_PARALLEL_H_
+#define ROUTING_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+DECLARE_int32(jobs);
+
+namespace bfg {
+namespace routing {
+
+// The number of threads to use for parallel work, as given by --jobs, or the
+// number of hardware threads if that isn't set.
+inline size_t NumWorkerThreads() {
+  if (FLAGS_jobs > 0) {
+    return FLAGS_jobs;
+  }
+  return std::max(1U, std::thread::hardware_concurrency());
+}
+
+// Calls fn(i) for each i in [0, num_items), from up to num_threads threads
+// (including this one). Items are handed out in order.
+template<typename F>
+void RunInParallel(size_t num_items, size_t num_threads, const F &fn) {
+  num_threads = std::min(num_threads, num_items);
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < num_items; ++i) {
+      fn(i);
+    }
+    return;
+  }
+  std::atomic<size_t> next(0);
+  auto work = [&]() {
+    for (size_t i = next++; i < num_items; i = next++) {
+      fn(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace routing
+}  // namespace bfg
+
+#endif  // ROUTING_PARALLEL_H_
@@ -3,6 +3,7 @@
 #include <thread>
 #include <functional>
 #include <shared_mutex>
+#include <set>
 #include <sstream>
 #include <absl/strings/str_cat.h>
 #include <glog/logging.h>
@@ -136,14 +137,25 @@ absl::StatusOr<int64_t> RouteManager::ConnectToNet(
   return order.id();
 }
 
+void RouteManager::RecordResult(const OrderAndResult &order_and_result) {
+  {
+    std::unique_lock mu(results_lock_);
+    results_[order_and_result.order.id()] = order_and_result;
+  }
+  // The callback is made outside of the lock so that it can be slow, and so
+  // that it can call GetOrderAndResult.
+  if (on_order_complete_) {
+    on_order_complete_(order_and_result);
+  }
+}
+
 absl::Status RouteManager::RunAllSerial() {
   // Accumulate errors.
-  std::unique_lock mu(results_lock_);
   std::vector<absl::Status> statuses;
   for (const NetRouteOrder &order : orders_) {
     LOG(INFO) << "Serial dispatch; routing " << std::endl << order.Describe();
     auto result = RunOrder(order);
-    results_[order.id()] = { .order = order, .result = result };
+    RecordResult({ .order = order, .result = result });
     statuses.push_back(result.status());
   }
   return SummariseStatuses(statuses);
@@ -169,8 +181,7 @@ absl::Status RouteManager::RunAllParallel() {
                   << order.Describe();
         auto result = RunOrder(order);
         statuses[i] = result.status();
-        std::unique_lock mu(results_lock_);
-        results_[order.id()] = { .order = order, .result = result };
+        RecordResult({ .order = order, .result = result });
       });
       ++i;
     }
@@ -416,6 +427,16 @@ absl::StatusOr<std::vector<NetRouteOrder>> RouteManager::Solve(
   // TODO(aryap): Solve should return consolidated orders so that callers can
   // determine if any of their requests were merged.
 
+  // Work out how every port reaches the grid up front, so that retries and
+  // orders sharing ports don't repeat it.
+  std::set<const geometry::Port*> all_ports;
+  for (const NetRouteOrder &order : orders_) {
+    for (const std::set<const geometry::Port*> &node : order.nodes()) {
+      all_ports.insert(node.begin(), node.end());
+    }
+  }
+  routing_grid_->PrecomputePinAccess(geometry::Port::MakePortSet(all_ports));
+
   if (force_serial || GetConcurrency() == 1) {
     RunAllSerial().IgnoreError();
   } else {
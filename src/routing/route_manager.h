@@ -1,6 +1,7 @@
 #ifndef ROUTE_MANAGER_H_
 #define ROUTE_MANAGER_H_
 
+#include <functional>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -105,6 +106,11 @@ class RouteManager {
     absl::StatusOr<std::vector<RoutingPath*>> result;
   };
 
+  // Called with each order and its result as soon as the order has been
+  // routed, before the rest are finished. When solving in parallel this is
+  // called from the worker threads, possibly at the same time.
+  typedef std::function<void(const OrderAndResult&)> OrderCallback;
+
   static absl::Status SummariseStatuses(
       const std::vector<absl::Status> &statuses);
 
@@ -190,6 +196,10 @@ class RouteManager {
     return auto_cancel_layers_;
   }
 
+  void set_on_order_complete(const OrderCallback &on_order_complete) {
+    on_order_complete_ = on_order_complete;
+  }
+
  private:
   static constexpr size_t kNumRetries = 2;
 
@@ -223,6 +233,8 @@ class RouteManager {
 
   void MaybeAutoCancelBlockages(const EquivalentNets &for_nets);
 
+  void RecordResult(const OrderAndResult &order_and_result);
+
   Layout *layout_;
   RoutingGrid *routing_grid_;
   RoutingBlockageCache root_blockage_cache_;
@@ -242,6 +254,8 @@ class RouteManager {
   bool auto_cancel_blockages_;
   std::vector<std::string> auto_cancel_layers_;
 
+  OrderCallback on_order_complete_;
+
   int64_t next_id_;
 
   FRIEND_TEST(RouteManagerTest, ConsolidateOrders);
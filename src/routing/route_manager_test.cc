@@ -1,6 +1,7 @@
 #include "route_manager.h"
 
 #include <memory>
+#include <set>
 
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
@@ -9,6 +10,7 @@
 #include "../design_database.h"
 #include "../physical_properties_database.h"
 #include "routing_grid.h"
+#include "routing_test_grid.h"
 #include "../geometry/port.h"
 #include "../geometry/point.h"
 #include "../dev_pdk_setup.h"
@@ -150,5 +152,45 @@ TEST_F(RouteManagerTest, MergeAndReplaceEquivalentNets) {
   EXPECT_EQ(d, route_manager_->routed_nets_by_port_[p4.get()]);
 }
 
+TEST_F(RouteManagerTest, OnOrderCompleteCalledForEachOrder) {
+  physical_db_.LoadTechnologyFromFile("test_data/sky130.technology.pb");
+  bfg::SetUpSky130(&physical_db_);
+
+  grid_ = MakeTestRoutingGrid(physical_db_);
+  route_manager_.reset(new RouteManager(layout_.get(), grid_.get()));
+
+  geometry::Layer met1 = physical_db_.GetLayer("met1.drawing");
+  std::unique_ptr<geometry::Port> p1(
+      new geometry::Port({340, 510}, 100, 100, met1, "a"));
+  std::unique_ptr<geometry::Port> p2(
+      new geometry::Port({2380, 510}, 100, 100, met1, "a"));
+  std::unique_ptr<geometry::Port> p3(
+      new geometry::Port({340, 2210}, 100, 100, met1, "b"));
+  std::unique_ptr<geometry::Port> p4(
+      new geometry::Port({2380, 2210}, 100, 100, met1, "b"));
+
+  int64_t first = *route_manager_->Connect(*p1, *p2, EquivalentNets("a"));
+  int64_t second = *route_manager_->Connect(*p3, *p4, EquivalentNets("b"));
+
+  std::set<int64_t> completed;
+  size_t num_paths = 0;
+  route_manager_->set_on_order_complete(
+      [&](const RouteManager::OrderAndResult &order_and_result) {
+        // The result must already be visible by the time we are told about it.
+        EXPECT_TRUE(route_manager_->GetOrderAndResult(
+            order_and_result.order.id()).ok());
+        ASSERT_TRUE(order_and_result.result.ok())
+            << order_and_result.result.status();
+        completed.insert(order_and_result.order.id());
+        num_paths += order_and_result.result->size();
+      });
+
+  route_manager_->SolveSerially().IgnoreError();
+
+  EXPECT_EQ(std::set<int64_t>({first, second}), completed);
+  EXPECT_EQ(2, num_paths);
+  EXPECT_EQ(2, grid_->paths().size());
+}
+
 }  // namespace routing
 }  // namespace bfg
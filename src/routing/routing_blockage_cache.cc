@@ -1,12 +1,19 @@
 #include "routing_blockage_cache.h"
 
+#include <algorithm>
 #include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <sstream>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
 
 #include <absl/status/status.h>
 
+#include "routing_blockage_hit_cache.h"
 #include "routing_grid.h"
 #include "routing_vertex.h"
 #include "routing_track_direction.h"
@@ -17,30 +24,6 @@
 namespace bfg {
 namespace routing {
 
-size_t RoutingBlockageCache::CountCancellations(
-    const std::set<SourceBlockage> blockage_set,
-    const std::set<const CancellationList*> cancellations_list) {
-  size_t count = 0;
-  for (const CancellationList *cancellations : cancellations_list) {
-    for (const SourceBlockage &cancelled : *cancellations) {
-      // A SourceBlockage is a pointer to either a Rectangle or a Polygon
-      // RoutingGridBlockage.
-      if (blockage_set.find(cancelled) != blockage_set.end()) {
-        count++;
-      }
-    }
-  }
-  return count;
-}
-
-size_t RoutingBlockageCache::CountUncancelledBlockages(
-    const std::set<SourceBlockage> blockage_set,
-    const std::set<const CancellationList*> cancellations_list) {
-  size_t num_blockages = blockage_set.size();
-  size_t num_cancelled = CountCancellations(blockage_set, cancellations_list);
-  return num_blockages - num_cancelled;
-}
-
 // TODO(aryap): We have to factor out of the ApplyBlockage et. al. functions
 // all the stuff that needs to be checked to determine:
 //  - if the blockage overlaps a vertex (so the vertex can be used to
@@ -58,19 +41,19 @@ size_t RoutingBlockageCache::CountUncancelledBlockages(
 //  vertices are typically created for (permanent) blockages and for connection
 //  to ports.
 template<typename T>
-void RoutingBlockageCache::ApplyBlockageToOneVertex(
+RoutingBlockageHitSet::VertexHit
+RoutingBlockageCache::TestBlockageAgainstOneVertex(
     const RoutingGridBlockage<T> &blockage,
     const RoutingVertex *vertex,
-    std::optional<RoutingTrackDirection> access_direction) {
-  const geometry::Layer &layer = blockage.shape().layer();
+    std::optional<RoutingTrackDirection> access_direction) const {
+  RoutingBlockageHitSet::VertexHit hit;
+  hit.vertex = vertex;
 
   // Check if the blockage overlaps the vertex completely:
-  if (blockage.IntersectsPoint(vertex->centre(), 0)) {
-    blocked_vertices_[vertex].AddUser(blockage);
-    //VLOG(16) << "Blockage: " << blockage.shape()
-    //         << " intersects " << vertex->centre()
-    //         << " with margin " << 0;
-  }
+  hit.intersects = blockage.IntersectsPoint(vertex->centre(), 0);
+  //VLOG(16) << "Blockage: " << blockage.shape()
+  //         << " intersects " << vertex->centre()
+  //         << " with margin " << 0;
 
   // If it doesn't, check if there are viable directions the vertex can
   // still be used in:
@@ -81,67 +64,206 @@ void RoutingBlockageCache::ApplyBlockageToOneVertex(
       std::set<RoutingTrackDirection>{*access_direction} :
       RoutingTrackDirectionUtility::kAllDirections;
 
-  const std::string &net = blockage.shape().net();
   for (const auto &direction : test_directions) {
     // We use the RoutingGridBlockage to do a hit test; set
     // exceptional_nets = nullopt so that no exception is made.
     if (blockage.Blocks(*vertex, std::nullopt, direction)) {
-      blocked_vertices_[vertex].AddInhibitor(direction, blockage);
+      hit.blocked_directions.push_back(direction);
       //VLOG(16) << "Blockage: " << blockage.shape()
       //         << " blocks " << vertex->centre()
       //         << " with padding=" << blockage.padding() << " in "
       //         << direction << " direction";
-      continue;
     }
   }
+  return hit;
 }
 
-RoutingBlockageCache::RoutingBlockageCache(const RoutingGrid &grid)
-    : grid_(grid),
-      search_window_margin_(grid.FigureSearchWindowMargin()) {}
+geometry::Rectangle RoutingBlockageCache::HitRegion(
+    const geometry::Rectangle &bounding_box, int64_t padding) const {
+  // Vertices are searched for within search_window_margin_ of the padded
+  // shape, and off-grid vertices within a radius of its centre (see
+  // DeterminePossiblyAffectedVertices). Edges and vias are blocked within
+  // their own width and spacing of the padded shape, which the grid's search
+  // margin bounds.
+  int64_t margin = padding + search_window_margin_ +
+      grid_.FigureSearchWindowMargin();
+  geometry::Rectangle region = bounding_box.WithPadding(margin);
+  int64_t radius = std::max(bounding_box.Width(), bounding_box.Height()) +
+      padding + search_window_margin_;
+  const geometry::Point centre = bounding_box.centre();
+  region.ExpandToCover(
+      geometry::Rectangle(centre - geometry::Point(radius, radius),
+                          centre + geometry::Point(radius, radius)));
+  return region;
+}
 
-std::vector<RoutingBlockageCache::SourceBlockage>
-RoutingBlockageCache::BlockagesMatching(
-    const EquivalentNets &nets,
-    const std::optional<std::string> &layer_name) const {
-  std::vector<SourceBlockage> matching = parent_ ?
-      parent_->get().BlockagesMatching(nets, layer_name) :
-      std::vector<SourceBlockage>();
+template<typename T>
+std::shared_ptr<const RoutingBlockageHitSet>
+RoutingBlockageCache::FindOrComputeHits(
+    const RoutingGridBlockage<T> &blockage,
+    const std::set<geometry::Layer> &blocked_layers,
+    int64_t padding) const {
+  const T &shape = blockage.shape();
+  RoutingBlockageHitCache &hit_cache = grid_.blockage_hit_cache();
+  std::string key = RoutingBlockageHitCache::MakeKey(
+      shape,
+      blocked_layers,
+      padding,
+      search_window_margin_);
+  std::shared_ptr<const RoutingBlockageHitSet> found = hit_cache.Find(key);
+  if (found) {
+    return found;
+  }
+  size_t computed_at = hit_cache.Position();
 
-  std::optional<geometry::Layer> layer;
-  if (layer_name) {
-    const PhysicalPropertiesDatabase &db = grid_.physical_db();
-    layer = db.GetLayer(*layer_name);
+  auto hits = std::make_shared<RoutingBlockageHitSet>();
+
+  // Find possibly-affected vertices.
+  std::vector<const RoutingVertex*> vertices =
+      DeterminePossiblyAffectedVertices(shape, blocked_layers, padding);
+  for (const RoutingVertex *vertex : vertices) {
+    RoutingBlockageHitSet::VertexHit hit =
+        TestBlockageAgainstOneVertex(blockage, vertex, std::nullopt);
+    if (hit.intersects || !hit.blocked_directions.empty()) {
+      hits->vertices.push_back(std::move(hit));
+    }
   }
 
-  for (const auto &blockage : polygon_blockages_) {
-    if (layer && blockage->shape().layer() != layer) {
-      continue;
+  // Edge blockages are much simpler; we only need the shape and a net, and to
+  // ask tracks (mostly) what edges are affected:
+  hits->edges = DetermineAffectedEdges(shape, blocked_layers, padding);
+
+  hit_cache.Insert(
+      key, HitRegion(shape.GetBoundingBox(), padding), hits, computed_at);
+  return hits;
+}
+
+void RoutingBlockageCache::ApplyHits(
+    const RoutingBlockageHitSet &hits,
+    const geometry::Layer &layer,
+    NetId net,
+    BlockageId id) {
+  for (const RoutingBlockageHitSet::VertexHit &hit : hits.vertices) {
+    std::vector<VertexHit> &entry = blocked_vertices_[hit.vertex];
+    if (hit.intersects) {
+      // Users are not specific to any direction.
+      entry.push_back(VertexHit {
+          VertexHit::kUser,
+          RoutingTrackDirection::kTrackHorizontal,
+          net,
+          id,
+          layer});
     }
-    if (nets.ContainsAny(blockage->shape().net())) {
-      matching.push_back(blockage.get());
+    for (const RoutingTrackDirection &direction : hit.blocked_directions) {
+      entry.push_back(VertexHit {
+          VertexHit::kInhibitor, direction, net, id, layer});
     }
   }
-  for (const auto &blockage : rectangle_blockages_) {
-    if (layer && blockage->shape().layer() != layer) {
-      continue;
-    }
-    if (nets.ContainsAny(blockage->shape().net())) {
-      matching.push_back(blockage.get());
+  for (const RoutingEdge *edge : hits.edges) {
+    blocked_edges_[edge].push_back(EdgeHit {net, id});
+  }
+}
+
+RoutingBlockageCache::RoutingBlockageCache(const RoutingGrid &grid)
+    : grid_(grid),
+      search_window_margin_(grid.FigureSearchWindowMargin()),
+      depth_(0),
+      cancelled_(1),
+      net_names_({""}),
+      net_ids_({{"", kNoNet}}) {}
+
+RoutingBlockageCache::RoutingBlockageCache(
+    const RoutingGrid &grid, const RoutingBlockageCache &parent)
+    : grid_(grid),
+      search_window_margin_(0),
+      parent_(parent),
+      depth_(parent.depth_ + 1),
+      cancelled_(depth_ + 1),
+      net_names_({""}),
+      net_ids_({{"", kNoNet}}) {}
+
+RoutingBlockageCache::NetId RoutingBlockageCache::InternNet(
+    const std::string &net) {
+  auto it = net_ids_.find(net);
+  if (it != net_ids_.end()) {
+    return it->second;
+  }
+  NetId id = net_names_.size();
+  net_names_.push_back(net);
+  net_ids_[net] = id;
+  return id;
+}
+
+RoutingBlockageCache::BlockageId RoutingBlockageCache::TakeOwnership(
+    RoutingGridBlockage<geometry::Rectangle> *blockage) {
+  rectangle_blockages_.emplace_back(blockage);
+  rectangle_blockage_index_.Insert(blockage, blockage->PaddedBoundingBox());
+  BlockageId id = blockages_.size();
+  blockages_.push_back(blockage);
+  blockage_ids_[blockage] = id;
+  return id;
+}
+
+RoutingBlockageCache::BlockageId RoutingBlockageCache::TakeOwnership(
+    RoutingGridBlockage<geometry::Polygon> *blockage) {
+  polygon_blockages_.emplace_back(blockage);
+  polygon_blockage_index_.Insert(blockage, blockage->PaddedBoundingBox());
+  BlockageId id = blockages_.size();
+  blockages_.push_back(blockage);
+  blockage_ids_[blockage] = id;
+  return id;
+}
+
+bool RoutingBlockageCache::IsCancelled(
+    const RoutingBlockageCache &querier, size_t distance, BlockageId id) {
+  // The querier's mask for the owner is at index distance, the querier's
+  // parent's is at distance - 1, and so on up to the owner's own at 0.
+  const RoutingBlockageCache *cache = &querier;
+  for (size_t level = distance + 1; level > 0; --level) {
+    if (cache->cancelled_[level - 1].Contains(id)) {
+      return true;
     }
+    cache = cache->ParentOrNull();
   }
+  return false;
+}
 
+std::vector<RoutingBlockageCache::BlockageId>
+RoutingBlockageCache::BlockagesMatching(
+    const EquivalentNets &nets,
+    const std::optional<geometry::Layer> &layer) const {
+  std::vector<BlockageId> matching;
+  for (BlockageId id = 0; id < blockages_.size(); ++id) {
+    std::visit([&](const auto *blockage) {
+      if (layer && blockage->shape().layer() != *layer) {
+        return;
+      }
+      if (nets.ContainsAny(blockage->shape().net())) {
+        matching.push_back(id);
+      }
+    }, blockages_[id]);
+  }
   return matching;
 }
 
 void RoutingBlockageCache::CancelBlockages(
     const EquivalentNets &on_nets,
     const std::optional<std::string> &restrict_to_layer) {
-  // Retrieve all blockages pertaining to any of the given nets.
-  std::vector<SourceBlockage> matching = BlockagesMatching(
-      on_nets, restrict_to_layer);
-  for (const auto &blockage : matching) {
-    cancelled_blockages_.push_back(blockage);
+  std::optional<geometry::Layer> layer;
+  if (restrict_to_layer) {
+    const PhysicalPropertiesDatabase &db = grid_.physical_db();
+    layer = db.GetLayer(*restrict_to_layer);
+  }
+
+  // Retrieve all blockages pertaining to any of the given nets, here and in
+  // every ancestor.
+  size_t level = 0;
+  for (const RoutingBlockageCache *owner = this;
+       owner != nullptr;
+       owner = owner->ParentOrNull(), ++level) {
+    for (BlockageId id : owner->BlockagesMatching(on_nets, layer)) {
+      cancelled_[level].Insert(id);
+    }
   }
 }
 
@@ -153,31 +275,18 @@ void RoutingBlockageCache::AddBlockage(
       grid_.physical_db().GetAccessibleLayersForPin(rectangle.layer()) :
       std::set<geometry::Layer>({rectangle.layer()});
 
-  // Find possibly-affected vertices.
-  std::vector<const RoutingVertex*> vertices =
-      DeterminePossiblyAffectedVertices(
-          rectangle, blocked_layers, padding);
-
   // FIXME(aryap): This should be the worst-case across all blocked layers.
   int64_t min_separation = grid_.GetMinSeparation(rectangle.layer());
 
   RoutingGridBlockage<geometry::Rectangle> *blockage =
       new RoutingGridBlockage<geometry::Rectangle>(
           grid_, rectangle, blocked_layers, padding + min_separation);
-  for (const RoutingVertex *vertex : vertices) {
-    ApplyBlockageToOneVertex(*blockage, vertex, std::nullopt);
-  }
+  BlockageId id = TakeOwnership(blockage);
+  NetId net = InternNet(rectangle.net());
 
-  // Edge blockages are much simpler; we only need the shape and a net, and to
-  // ask tracks (mostly) what edges are affected:
-  std::vector<const RoutingEdge*> edges =
-      DetermineAffectedEdges(rectangle, blocked_layers, padding);
-  for (const RoutingEdge *edge : edges) {
-    blocked_edges_[edge].sources[rectangle.net()].insert(blockage);
-  }
-
-  // Take ownership of the RoutingGridBlockage.
-  rectangle_blockages_.emplace_back(blockage);
+  std::shared_ptr<const RoutingBlockageHitSet> hits =
+      FindOrComputeHits(*blockage, blocked_layers, padding);
+  ApplyHits(*hits, rectangle.layer(), net, id);
 }
 
 void RoutingBlockageCache::AddBlockage(
@@ -185,34 +294,26 @@ void RoutingBlockageCache::AddBlockage(
     int64_t padding) {
   std::set<geometry::Layer> blocked_layers = {polygon.layer()};
 
-  std::vector<const RoutingVertex*> vertices =
-      DeterminePossiblyAffectedVertices(polygon, blocked_layers, padding);
-
   int64_t min_separation = grid_.GetMinSeparation(polygon.layer());
 
   RoutingGridBlockage<geometry::Polygon> *blockage =
       new RoutingGridBlockage<geometry::Polygon>(
           grid_, polygon, blocked_layers, padding + min_separation);
+  BlockageId id = TakeOwnership(blockage);
+  NetId net = InternNet(polygon.net());
 
-  for (const RoutingVertex *vertex : vertices) {
-    ApplyBlockageToOneVertex(*blockage, vertex, std::nullopt);
-  }
-
-  std::vector<const RoutingEdge*> edges =
-      DetermineAffectedEdges(polygon, blocked_layers, padding);
-  for (const RoutingEdge *edge : edges) {
-    blocked_edges_[edge].sources[polygon.net()].insert(blockage);
-  }
-
-  polygon_blockages_.emplace_back(blockage);
+  std::shared_ptr<const RoutingBlockageHitSet> hits =
+      FindOrComputeHits(*blockage, blocked_layers, padding);
+  ApplyHits(*hits, polygon.layer(), net, id);
 }
 
 RoutingGridBlockage<geometry::Rectangle>*
 RoutingBlockageCache::FindBlockageByShape(
     const geometry::Rectangle &rectangle) const {
-  for (const auto &blockage : rectangle_blockages_) {
+  for (auto *blockage : rectangle_blockage_index_.FindOverlapping(
+           rectangle.GetBoundingBox())) {
     if (blockage->shape() == rectangle) {
-      return blockage.get();
+      return blockage;
     }
   }
   return nullptr;
@@ -221,9 +322,10 @@ RoutingBlockageCache::FindBlockageByShape(
 RoutingGridBlockage<geometry::Polygon>*
 RoutingBlockageCache::FindBlockageByShape(
     const geometry::Polygon &polygon) const {
-  for (const auto &blockage : polygon_blockages_) {
+  for (auto *blockage : polygon_blockage_index_.FindOverlapping(
+           polygon.GetBoundingBox())) {
     if (blockage->shape() == polygon) {
-      return blockage.get();
+      return blockage;
     }
   }
   return nullptr;
@@ -242,120 +344,39 @@ bool RoutingBlockageCache::AvailableForAll(
 bool RoutingBlockageCache::IsEdgeBlocked(
     const RoutingEdge &edge,
     const EquivalentNets &for_nets) const {
-  return IsEdgeBlocked(edge, for_nets, {});
-}
-
-bool RoutingBlockageCache::IsEdgeBlocked(
-    const RoutingEdge &edge,
-    const EquivalentNets &for_nets,
-    const std::set<const CancellationList*> &more_cancellations) const {
   if (!edge.AvailableForNets(for_nets)) {
     return true;
   }
-
-  // If more_cancellations is given, we have to consider both it and
-  // cancelled_blockages_ when making exceptions.
-  //
-  // In C++26 you can use ranges to concat these things under views, but we are
-  // plebs and must do a heinous other thing. We will pass a container of
-  // pointers to containers of cancellations. How bout that?!
-  std::set<const CancellationList*> all_cancellations(
-      more_cancellations.begin(), more_cancellations.end());
-  all_cancellations.insert(&cancelled_blockages_);
-
-  if (parent_ &&
-      parent_->get().IsEdgeBlocked(edge, for_nets, all_cancellations)) {
-    return true;
-  }
-  auto entry = blocked_edges_.find(&edge);
-  if (entry == blocked_edges_.end()) {
-    return false;
-  }
-  const EdgeBlockages &blockages = entry->second;
-  for (const auto &entry : blockages.sources) {
-    const std::string &net = entry.first;
-
-    // TODO(aryap): Exception checking (cancelled blockages) goes here. This
-    // entry should only be considered if the blockages set is non-empty (after
-    // removing cancellations).
-    size_t num_applicable = CountUncancelledBlockages(
-        entry.second, all_cancellations);
-    if (num_applicable == 0) {
-      continue;
-    }
-
-    if (net == "" || !for_nets.Contains(net)) {
-      // There exists a blockage which isn't excluded, or there are blockages
-      // with no nets, which cannot be excluded.
+  size_t distance = 0;
+  for (const RoutingBlockageCache *cache = this;
+       cache != nullptr;
+       cache = cache->ParentOrNull(), ++distance) {
+    if (cache->HasEdgeHit(edge, for_nets, *this, distance)) {
       return true;
     }
   }
   return false;
 }
 
-bool RoutingBlockageCache::VertexBlockages::IsBlockedByUsers(
-    const EquivalentNets &exceptional_nets,
-    const std::optional<geometry::Layer> &on_layer,
-    const std::set<const CancellationList*> &cancellations) const {
-  for (const auto &by_net_entry : users_) {
-    const std::string &net = by_net_entry.first;
-
-    // If there is any non-empty set of blockages on a layer matching *on_layer,
-    // we test for net exceptions:
-    for (const auto &by_layer_entry : by_net_entry.second) {
-      const geometry::Layer &layer = by_layer_entry.first;
-      if (on_layer && layer != *on_layer) {
-        continue;
-      }
-
-      size_t num_applicable = CountUncancelledBlockages(
-          by_layer_entry.second, cancellations);
-      if (num_applicable == 0) {
-        continue;
-      }
-
-      // By this point we have a non-excluded layer and a non-empty set of
-      // blockages. Therefore we check if the nets are exceptionally allowed.
-      // Otherwise, it's an applicable blockage.
-      if (net == "" || !exceptional_nets.Contains(net)) {
-        // There exists a blockage which isn't excluded, or there are blockages
-        // with no nets, which cannot be excluded.
-        return true;
-      }
-
-      // If we got here and no layer was specified then we tested the net it
-      // didn't result in a block, therefore there is no way the next iteration
-      // will yield anything different. So we can just break:
-      if (!on_layer) {
-        break;
-      }
-    }
+bool RoutingBlockageCache::HasEdgeHit(
+    const RoutingEdge &edge,
+    const EquivalentNets &for_nets,
+    const RoutingBlockageCache &querier,
+    size_t distance) const {
+  auto entry = blocked_edges_.find(&edge);
+  if (entry == blocked_edges_.end()) {
+    return false;
   }
-  return false;
-}
-
-bool RoutingBlockageCache::VertexBlockages::IsInhibitedInDirection(
-    const std::optional<RoutingTrackDirection> &direction_or_any,
-    const std::optional<geometry::Layer> &layer_or_any,
-    const std::set<const CancellationList*> &cancellations) const {
-  for (const auto &[direction, by_layer] : inhibitors_) {
-    if (direction_or_any && direction != *direction_or_any) {
+  for (const EdgeHit &hit : entry->second) {
+    if (hit.net != kNoNet && for_nets.Contains(net_names_[hit.net])) {
       continue;
     }
-
-    for (const auto &[layer, blockages] : by_layer) {
-      if (layer_or_any && layer != *layer_or_any) {
-        continue;
-      }
-
-      size_t num_applicable = CountUncancelledBlockages(
-          blockages, cancellations);
-      if (num_applicable == 0) {
-        continue;
-      }
-
-      return true;
+    if (IsCancelled(querier, distance, hit.blockage)) {
+      continue;
     }
+    // There exists a blockage which isn't excluded, or there are blockages
+    // with no nets, which cannot be excluded.
+    return true;
   }
   return false;
 }
@@ -374,8 +395,21 @@ bool RoutingBlockageCache::IsVertexBlocked(
     const EquivalentNets &for_nets,
     const std::optional<RoutingTrackDirection> &direction_or_any,
     const std::optional<geometry::Layer> &layer_or_any) const {
-  return IsVertexBlocked(
-      vertex, for_nets, direction_or_any, layer_or_any, {});
+  if (!grid_.vertex_availability().AvailableForAll(
+          vertex, for_nets, layer_or_any)) {
+    return true;
+  }
+  size_t distance = 0;
+  for (const RoutingBlockageCache *cache = this;
+       cache != nullptr;
+       cache = cache->ParentOrNull(), ++distance) {
+    if (cache->HasVertexHit(
+            vertex, for_nets, direction_or_any, layer_or_any, *this,
+            distance)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 bool RoutingBlockageCache::AvailableForNetsOnAnyLayer(
@@ -392,44 +426,42 @@ bool RoutingBlockageCache::AvailableForNetsOnAnyLayer(
   return false;
 }
 
-bool RoutingBlockageCache::IsVertexBlocked(
+// Any specified parameters narrow the space for checked blockages, so if
+// for_nets is empty and no direction or layer is specified, ANY uncancelled
+// hit counts.
+bool RoutingBlockageCache::HasVertexHit(
     const RoutingVertex &vertex,
     const EquivalentNets &for_nets,
     const std::optional<RoutingTrackDirection> &direction_or_any,
     const std::optional<geometry::Layer> &layer_or_any,
-    const std::set<const CancellationList*> &more_cancellations) const {
-  if (!vertex.AvailableForAll(for_nets, layer_or_any)) {
-    return true;
-  }
-
-  std::set<const CancellationList*> all_cancellations(
-      more_cancellations.begin(), more_cancellations.end());
-  all_cancellations.insert(&cancelled_blockages_);
-
-  if (parent_ &&
-      parent_->get().IsVertexBlocked(vertex,
-                                     for_nets,
-                                     direction_or_any,
-                                     layer_or_any, 
-                                     all_cancellations)) {
-    return true;
-  }
-
+    const RoutingBlockageCache &querier,
+    size_t distance) const {
   auto entry = blocked_vertices_.find(&vertex);
   if (entry == blocked_vertices_.end()) {
     return false;
   }
-  
-  const VertexBlockages &blockages = entry->second;
-  if (blockages.IsBlockedByUsers(for_nets, layer_or_any, all_cancellations)) {
-    return true;
-  }
-  
-  if (blockages.IsInhibitedInDirection(
-          direction_or_any, layer_or_any, all_cancellations)) {
+  for (const VertexHit &hit : entry->second) {
+    if (layer_or_any && hit.layer != *layer_or_any) {
+      continue;
+    }
+    switch (hit.kind) {
+      case VertexHit::kUser:
+        // Users can be excepted by net, but blockages with no net cannot.
+        if (hit.net != kNoNet && for_nets.Contains(net_names_[hit.net])) {
+          continue;
+        }
+        break;
+      case VertexHit::kInhibitor:
+        if (direction_or_any && hit.direction != *direction_or_any) {
+          continue;
+        }
+        break;
+    }
+    if (IsCancelled(querier, distance, hit.blockage)) {
+      continue;
+    }
     return true;
   }
-
   return false;
 }
 
@@ -485,13 +517,16 @@ absl::Status RoutingBlockageCache::ValidAgainstKnownBlockages(
       return status;
     }
   }
-  for (const auto &blockage : rectangle_blockages_) {
+  geometry::Rectangle search_box = grid_.BlockageSearchBox(edge);
+  for (const auto *blockage :
+           rectangle_blockage_index_.FindOverlapping(search_box)) {
     if (blockage->Blocks(edge, exceptional_nets)) {
       return absl::ResourceExhaustedError(
           absl::StrCat("Blocked by ", blockage->shape().Describe()));
     }
   }
-  for (const auto &blockage : polygon_blockages_) {
+  for (const auto *blockage :
+           polygon_blockage_index_.FindOverlapping(search_box)) {
     if (blockage->Blocks(edge, exceptional_nets)) {
       return absl::ResourceExhaustedError(
           absl::StrCat("Blocked by ", blockage->shape().Describe()));
@@ -511,13 +546,16 @@ absl::Status RoutingBlockageCache::ValidAgainstKnownBlockages(
       return status;
     }
   }
-  for (const auto &blockage : rectangle_blockages_) {
+  geometry::Rectangle search_box = grid_.BlockageSearchBox(vertex);
+  for (const auto *blockage :
+           rectangle_blockage_index_.FindOverlapping(search_box)) {
     if (blockage->Blocks(vertex, exceptional_nets, access_direction)) {
       return absl::ResourceExhaustedError(
           absl::StrCat("Blocked by ", blockage->shape().Describe()));
     }
   }
-  for (const auto &blockage : polygon_blockages_) {
+  for (const auto *blockage :
+           polygon_blockage_index_.FindOverlapping(search_box)) {
     if (blockage->Blocks(vertex, exceptional_nets, access_direction)) {
       return absl::ResourceExhaustedError(
           absl::StrCat("Blocked by ", blockage->shape().Describe()));
@@ -536,13 +574,15 @@ absl::Status RoutingBlockageCache::ValidAgainstKnownBlockages(
       return status;
     }
   }
-  for (const auto &blockage : rectangle_blockages_) {
+  for (const auto *blockage :
+           rectangle_blockage_index_.FindOverlapping(footprint)) {
     if (blockage->Blocks(footprint, exceptional_nets)) {
       return absl::ResourceExhaustedError(
           absl::StrCat("Blocked by ", blockage->shape().Describe()));
     }
   }
-  for (const auto &blockage : polygon_blockages_) {
+  for (const auto *blockage :
+           polygon_blockage_index_.FindOverlapping(footprint)) {
     if (blockage->Blocks(footprint, exceptional_nets)) {
       return absl::ResourceExhaustedError(
           absl::StrCat("Blocked by ", blockage->shape().Describe()));
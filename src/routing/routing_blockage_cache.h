@@ -1,13 +1,22 @@
 #ifndef ROUTING_BLOCKAGE_CACHE_H_
 #define ROUTING_BLOCKAGE_CACHE_H_
 
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <set>
 #include <optional>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
 
 #include <absl/status/status.h>
+#include <glog/logging.h>
 
 #include "../equivalent_nets.h"
+#include "routing_blockage_hit_cache.h"
+#include "routing_blockage_index.h"
 #include "routing_vertex.h"
 #include "routing_track_direction.h"
 #include "routing_grid_blockage.h"
@@ -35,8 +44,8 @@ class RoutingGrid;
 // affected vertices and edges is costly, and it is often repeated. So for a
 // given shape and padding we have to cache the affected vertices (including
 // access directions) and edges. Vertices on the grid are efficiently searched
-// because RoutingGridGeometry maps to their indices. Off-grid vertices are
-// efficiently searched with a k-d tree.
+// because RoutingGridGeometry maps to their indices. Off-grid vertices and
+// the blockages themselves are efficiently searched with spatial indices.
 //
 // A typical use case for this class is that, when routing many nets, a single
 // set of ports exists in the design and must be tested for blockage. However,
@@ -62,6 +71,15 @@ class RoutingGrid;
 // It also means that the parent must outlive the child, since the child has
 // pointers to the parent's data. It also means that child Caches operate in a
 // significant different mode to parent Caches.
+//
+// Since IsVertexBlocked and IsEdgeBlocked are asked in the innermost loop of
+// path search, the per-vertex and per-edge entries are kept flat: each is a
+// short list of (kind, direction, layer, net, blockage) hits, with nets
+// interned to small integers and blockages numbered in the order each cache
+// learns of them. Cancellations are then just bits. A cache at depth d (the
+// root has depth 0) keeps one bitmask for its own blockages and one for each
+// of its d ancestors', so that a query only has to test the bits of the caches
+// between the one asked and the one that owns the hit.
 class RoutingBlockageCache {
  public:
   // This is similar to the identically-named function in RoutingGrid.
@@ -107,10 +125,7 @@ class RoutingBlockageCache {
   RoutingBlockageCache(const RoutingGrid &grid);
 
   RoutingBlockageCache(const RoutingGrid &grid,
-                       const RoutingBlockageCache &parent)
-      : grid_(grid),
-        parent_(parent),
-        search_window_margin_(0) {}
+                       const RoutingBlockageCache &parent);
 
   void AddBlockage(const geometry::Rectangle &rectangle,
                    int64_t padding,
@@ -121,16 +136,23 @@ class RoutingBlockageCache {
 
   template<typename T>
   void CancelBlockage(const T &shape) {
-    // Find matching rectangle/polygon in blockages list. Extract a pointer to
-    // the blockage. Store that in the list of cancelled blockages. This way we
-    // only pay the rectangle(/polygon)-matching cost up front.
-    RoutingGridBlockage<T> *blockage;
-    if (parent_) {
-      blockage = parent_->get().FindBlockageByShape(shape);
-      cancelled_blockages_.emplace_back(blockage);
+    // Find the matching rectangle/polygon in this cache and in each of its
+    // ancestors, and set its bit in the cancellation mask for that level. This
+    // way we only pay the rectangle(/polygon)-matching cost up front.
+    size_t level = 0;
+    for (const RoutingBlockageCache *owner = this;
+         owner != nullptr;
+         owner = owner->ParentOrNull(), ++level) {
+      const RoutingGridBlockage<T> *blockage =
+          owner->FindBlockageByShape(shape);
+      if (!blockage) {
+        continue;
+      }
+      auto it = owner->blockage_ids_.find(blockage);
+      LOG_IF(FATAL, it == owner->blockage_ids_.end())
+          << "Blockage was indexed but not numbered";
+      cancelled_[level].Insert(it->second);
     }
-    blockage = FindBlockageByShape(shape);
-    cancelled_blockages_.emplace_back(blockage);
   }
 
   // If for_nets is empty, no exceptions are made for blocking nets, and so this
@@ -193,111 +215,127 @@ class RoutingBlockageCache {
   typedef std::variant<
       const RoutingGridBlockage<geometry::Rectangle>*,
       const RoutingGridBlockage<geometry::Polygon>*> SourceBlockage;
-  typedef std::vector<SourceBlockage> CancellationList;
-
-  static size_t CountCancellations(
-      const std::set<SourceBlockage> blockage_set,
-      const std::set<const CancellationList*> cancellations_list);
-  static size_t CountUncancelledBlockages(
-      const std::set<SourceBlockage> blockage_set,
-      const std::set<const CancellationList*> cancellations_list);
 
-  // Vertices are blocked in the following interesting ways:
-  //   - blockages on nets that are near enough to prevent a via being placed at
-  //   the vertex, but might allow the vertex to be used to reach that net;
-  //   - blockages that prevent the vertex for being used for anything but a
-  //   given net (usually because they intersect).
-  //
-  // (This is also captured in RoutingVertex itself.)
-  class VertexBlockages {
-   public:
-    template<typename T>
-    void AddUser(const T& blockage) {
-      const std::string &net = blockage.shape().net();
-      SourceBlockage container = &blockage;
-      const geometry::Layer &layer = blockage.shape().layer();
-      users_[net][layer].insert(container);
-    }
+  // Blockages are numbered densely, per cache, in the order they are added.
+  typedef uint32_t BlockageId;
 
-    template<typename T>
-    void AddInhibitor(const RoutingTrackDirection &blocked_direction,
-                      const T &blockage) {
-      SourceBlockage container = &blockage;
-      const geometry::Layer &layer = blockage.shape().layer();
-      inhibitors_[blocked_direction][layer].insert(container);
-    }
+  // Nets are interned per cache. The empty net, which cannot be excepted, is
+  // always 0.
+  typedef uint32_t NetId;
+  static constexpr NetId kNoNet = 0;
 
-    // Any specified parameters narrow the space for checked blockages, so if
-    // exceptional_nets is empty and no layer is specified, ANY blockage counts
-    // return true.
-    bool IsBlockedByUsers(
-        const EquivalentNets &exceptional_nets,
-        const std::optional<geometry::Layer> &layer_or_any,
-        const std::set<const CancellationList*> &cancellations) const;
-
-    // Similarly, if a parameter is std::nullopt, any direction (respectively
-    // layer) is checked for a blockage, and any of those will cause this to
-    // return true.
-    bool IsInhibitedInDirection(
-        const std::optional<RoutingTrackDirection> &direction_or_any,
-        const std::optional<geometry::Layer> &layer_or_any,
-        const std::set<const CancellationList*> &cancellations) const;
-
-    // An "inhibitor" entry indicates the direction and layer in which a vertex
-    // cannot accomodate a via, and set of blockages which cause this.
-    const std::map<RoutingTrackDirection,
-        std::map<geometry::Layer, std::set<SourceBlockage>>> &inhibitors()
-        const {
-      return inhibitors_;
+  // A set of BlockageIds, one bit each.
+  class BlockageMask {
+   public:
+    void Insert(BlockageId id) {
+      size_t word = id / 64;
+      if (word >= words_.size()) {
+        words_.resize(word + 1, 0);
+      }
+      words_[word] |= uint64_t{1} << (id % 64);
     }
 
-    // A "user" entry tracks sets of blockages that intersect with a vertex on a
-    // given (net, layer) pair.
-    const std::map<std::string,
-        std::map<geometry::Layer, std::set<SourceBlockage>>> &users() const {
-      return users_;
+    bool Contains(BlockageId id) const {
+      size_t word = id / 64;
+      return word < words_.size() && (words_[word] >> (id % 64)) & 1;
     }
 
    private:
-    // Maps the direction which is disallowed to the set of blockages causing
-    // the inhibition.
-    std::map<RoutingTrackDirection,
-        std::map<geometry::Layer, std::set<SourceBlockage>>> inhibitors_;
-
-    // Overlapping blockages and their nets.
-    std::map<std::string,
-        std::map<geometry::Layer, std::set<SourceBlockage>>> users_;
+    std::vector<uint64_t> words_;
   };
 
-  struct EdgeBlockages {
-    // If a single blockage with a blocks the edge, the edge can act as a
-    // connector to that blockage and inherits the net itself. Otherwise, it is
-    // not usable. All the blockages without a net ("") will end up under the
-    // same entry.
-    std::map<std::string, std::set<SourceBlockage>> sources;
+  // Vertices are blocked in the following interesting ways:
+  //   - blockages on nets that are near enough to prevent a via being placed at
+  //   the vertex, but might allow the vertex to be used to reach that net
+  //   ("inhibitors", which are specific to a direction);
+  //   - blockages that prevent the vertex for being used for anything but a
+  //   given net, usually because they intersect ("users").
+  //
+  // (This is also captured in RoutingVertex itself.)
+  struct VertexHit {
+    enum Kind : uint8_t {
+      kUser,
+      kInhibitor
+    };
+    Kind kind;
+    // Only meaningful for inhibitors.
+    RoutingTrackDirection direction;
+    NetId net;
+    BlockageId blockage;
+    geometry::Layer layer;
   };
 
-  std::vector<SourceBlockage> BlockagesMatching(
-      const EquivalentNets &nets,
-      const std::optional<std::string> &layer_name) const;
+  // If a single blockage with a blocks the edge, the edge can act as a
+  // connector to that blockage and inherits the net itself. Otherwise, it is
+  // not usable.
+  struct EdgeHit {
+    NetId net;
+    BlockageId blockage;
+  };
 
-  bool IsVertexBlocked(
+  const RoutingBlockageCache *ParentOrNull() const {
+    return parent_ ? &parent_->get() : nullptr;
+  }
+
+  NetId InternNet(const std::string &net);
+
+  BlockageId TakeOwnership(RoutingGridBlockage<geometry::Rectangle> *blockage);
+  BlockageId TakeOwnership(RoutingGridBlockage<geometry::Polygon> *blockage);
+
+  // True if the given blockage, which belongs to the cache `distance` levels
+  // above the querier, has been cancelled by the querier or any cache between
+  // it and the owner.
+  static bool IsCancelled(const RoutingBlockageCache &querier,
+                          size_t distance,
+                          BlockageId id);
+
+  // These only consider the hits stored in this cache, and not those of the
+  // parent or the grid itself. The querier is the cache whose public method
+  // was called, and distance is how far above it this one is.
+  bool HasVertexHit(
       const RoutingVertex &vertex,
       const EquivalentNets &for_nets,
       const std::optional<RoutingTrackDirection> &direction_or_any,
       const std::optional<geometry::Layer> &layer_or_any,
-      const std::set<const CancellationList*> &more_cancellations) const;
+      const RoutingBlockageCache &querier,
+      size_t distance) const;
 
-  bool IsEdgeBlocked(
+  bool HasEdgeHit(
       const RoutingEdge &edge,
       const EquivalentNets &for_nets,
-      const std::set<const CancellationList*> &more_cancellations) const;
+      const RoutingBlockageCache &querier,
+      size_t distance) const;
+
+  // Only this cache's own blockages are considered.
+  std::vector<BlockageId> BlockagesMatching(
+      const EquivalentNets &nets,
+      const std::optional<geometry::Layer> &layer) const;
 
   template<typename T>
-  void ApplyBlockageToOneVertex(
+  RoutingBlockageHitSet::VertexHit TestBlockageAgainstOneVertex(
       const RoutingGridBlockage<T> &blockage,
       const RoutingVertex *vertex,
-      std::optional<RoutingTrackDirection> access_direction = std::nullopt);
+      std::optional<RoutingTrackDirection> access_direction = std::nullopt)
+      const;
+
+  // Hit-tests are shared through the grid's RoutingBlockageHitCache, so the
+  // geometry is only examined if no other cache has seen the same shape (or
+  // if the grid has since changed near it).
+  template<typename T>
+  std::shared_ptr<const RoutingBlockageHitSet> FindOrComputeHits(
+      const RoutingGridBlockage<T> &blockage,
+      const std::set<geometry::Layer> &blocked_layers,
+      int64_t padding) const;
+
+  // The region in which a change to the grid could change the hit-test of a
+  // shape with the given bounding box.
+  geometry::Rectangle HitRegion(const geometry::Rectangle &bounding_box,
+                                int64_t padding) const;
+
+  void ApplyHits(const RoutingBlockageHitSet &hits,
+                 const geometry::Layer &layer,
+                 NetId net,
+                 BlockageId id);
 
   std::vector<const RoutingVertex*> DeterminePossiblyAffectedVertices(
       const geometry::Rectangle &rectangle,
@@ -339,14 +377,26 @@ class RoutingBlockageCache {
   // If available, queries are forwarded to a parent RoutingBlockageCache.
   std::optional<std::reference_wrapper<const RoutingBlockageCache>> parent_;
 
-  // A regular list of blocked vertices.
-  std::map<const RoutingVertex*, VertexBlockages> blocked_vertices_;
+  // The number of ancestors this cache has.
+  size_t depth_;
+
+  // The hits on each blocked vertex and edge, in no particular order.
+  std::unordered_map<const RoutingVertex*, std::vector<VertexHit>>
+      blocked_vertices_;
+  std::unordered_map<const RoutingEdge*, std::vector<EdgeHit>> blocked_edges_;
 
-  // A regular list of blocked edges.
-  std::map<const RoutingEdge*, EdgeBlockages> blocked_edges_;
+  // Cancelled blockages should be treated as non-existent. cancelled_[k] holds
+  // the blockages of the ancestor k levels up that are cancelled by this cache;
+  // cancelled_[0] are our own. There are depth_ + 1 entries.
+  std::vector<BlockageMask> cancelled_;
 
-  // Cancelled blockages should be treated as non-existent.
-  CancellationList cancelled_blockages_;
+  // Interned nets: net_names_[id] is the name of net id.
+  std::vector<std::string> net_names_;
+  std::unordered_map<std::string, NetId> net_ids_;
+
+  // Every blockage owned by this cache, by BlockageId, and the reverse.
+  std::vector<SourceBlockage> blockages_;
+  std::unordered_map<SourceBlockage, BlockageId> blockage_ids_;
 
   // A master list of all blockages we know about.
   //
@@ -356,6 +406,13 @@ class RoutingBlockageCache {
       polygon_blockages_;
   std::vector<std::unique_ptr<RoutingGridBlockage<geometry::Rectangle>>>
       rectangle_blockages_;
+
+  // Spatial indices over the same blockages, for finding those near a given
+  // vertex, edge or shape.
+  RoutingBlockageIndex<RoutingGridBlockage<geometry::Polygon>>
+      polygon_blockage_index_;
+  RoutingBlockageIndex<RoutingGridBlockage<geometry::Rectangle>>
+      rectangle_blockage_index_;
 };
 
 }  // namespace routing
@@ -1,5 +1,8 @@
 #include "routing_blockage_cache.h"
 
+#include <set>
+#include <vector>
+
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
@@ -244,6 +247,172 @@ TEST_F(RoutingBlockageCacheTest, RectangleBlockageCancelled_1) {
   }
 }
 
+
+TEST_F(RoutingBlockageCacheTest, ChildCancellationsDoNotAffectParent) {
+  geometry::Rectangle hazard({0, -240}, {1500, 240});
+  geometry::Layer met1 = design_db_.physical_db().GetLayer("met1.drawing");
+  hazard.set_layer(met1);
+  cache_->AddBlockage(hazard, 0);
+
+  RoutingBlockageCache child(*routing_grid_, *cache_);
+  RoutingBlockageCache grandchild(*routing_grid_, child);
+
+  std::vector<RoutingVertex*> expected_blocked;
+  for (RoutingVertex *vertex : routing_grid_->vertices()) {
+    if (vertex->centre().y() == 170) {
+      expected_blocked.push_back(vertex);
+    }
+  }
+  ASSERT_FALSE(expected_blocked.empty());
+
+  child.CancelBlockage(hazard);
+
+  for (const RoutingVertex *vertex : expected_blocked) {
+    EXPECT_TRUE(
+        cache_->IsVertexBlocked(*vertex, {}, std::nullopt, std::nullopt));
+    EXPECT_FALSE(
+        child.IsVertexBlocked(*vertex, {}, std::nullopt, std::nullopt));
+    // Cancellations are inherited by the child's own children.
+    EXPECT_FALSE(
+        grandchild.IsVertexBlocked(*vertex, {}, std::nullopt, std::nullopt));
+  }
+}
+
+TEST_F(RoutingBlockageCacheTest, CancelBlockagesByNet) {
+  geometry::Layer met1 = design_db_.physical_db().GetLayer("met1.drawing");
+  geometry::Rectangle a({0, -240}, {1500, 240});
+  a.set_layer(met1);
+  a.set_net("a");
+  geometry::Rectangle b({0, 950}, {1500, 1430});
+  b.set_layer(met1);
+  b.set_net("b");
+  cache_->AddBlockage(a, 0);
+
+  RoutingBlockageCache child(*routing_grid_, *cache_);
+  child.AddBlockage(b, 0);
+
+  std::vector<RoutingVertex*> near_a;
+  std::vector<RoutingVertex*> near_b;
+  for (RoutingVertex *vertex : routing_grid_->vertices()) {
+    if (vertex->centre().y() == 170) {
+      near_a.push_back(vertex);
+    } else if (vertex->centre().y() == 1190) {
+      near_b.push_back(vertex);
+    }
+  }
+  ASSERT_FALSE(near_a.empty());
+  ASSERT_FALSE(near_b.empty());
+
+  // The parent's blockage is on net "a", so "b" is no exception.
+  for (const RoutingVertex *vertex : near_a) {
+    EXPECT_TRUE(child.IsVertexBlocked(
+        *vertex, EquivalentNets("b"), std::nullopt, std::nullopt));
+  }
+
+  child.CancelBlockages(EquivalentNets("a"));
+  for (const RoutingVertex *vertex : near_a) {
+    EXPECT_FALSE(
+        child.IsVertexBlocked(*vertex, {}, std::nullopt, std::nullopt));
+    EXPECT_TRUE(
+        cache_->IsVertexBlocked(*vertex, {}, std::nullopt, std::nullopt));
+  }
+  for (const RoutingVertex *vertex : near_b) {
+    EXPECT_TRUE(
+        child.IsVertexBlocked(*vertex, {}, std::nullopt, std::nullopt));
+  }
+
+  child.CancelBlockages(EquivalentNets("b"), "met1.drawing");
+  for (const RoutingVertex *vertex : near_b) {
+    EXPECT_FALSE(
+        child.IsVertexBlocked(*vertex, {}, std::nullopt, std::nullopt));
+  }
+}
+
+
+TEST_F(RoutingBlockageCacheTest, HitTestsAreSharedBetweenCaches) {
+  geometry::Rectangle hazard({0, -240}, {1500, 240});
+  geometry::Layer met1 = design_db_.physical_db().GetLayer("met1.drawing");
+  hazard.set_layer(met1);
+  hazard.set_net("a");
+  RoutingBlockageCache first(*routing_grid_);
+  first.AddBlockage(hazard, 0);
+
+  const RoutingBlockageHitCache &hit_cache =
+      routing_grid_->blockage_hit_cache();
+  EXPECT_EQ(0, hit_cache.num_hits());
+  EXPECT_EQ(1, hit_cache.Size());
+
+  // A different shape with the same geometry, seen by a different cache on the
+  // same grid, doesn't need to be hit-tested again.
+  geometry::Rectangle copy({0, -240}, {1500, 240});
+  copy.set_layer(met1);
+  copy.set_net("b");
+  RoutingBlockageCache other(*routing_grid_);
+  other.AddBlockage(copy, 0);
+  EXPECT_EQ(1, hit_cache.num_hits());
+
+  for (const RoutingVertex *vertex : routing_grid_->vertices()) {
+    EXPECT_EQ(
+        first.IsVertexBlocked(*vertex, {}, std::nullopt, std::nullopt),
+        other.IsVertexBlocked(*vertex, {}, std::nullopt, std::nullopt));
+  }
+
+  // A new vertex near the shape means the hit-test has to be redone.
+  RoutingVertex *vertex = new RoutingVertex({700, 300});
+  vertex->AddConnectedLayer(met1);
+  routing_grid_->AddVertex(vertex);
+
+  RoutingBlockageCache another(*routing_grid_);
+  another.AddBlockage(copy, 0);
+  EXPECT_EQ(1, hit_cache.num_hits());
+}
+
+TEST_F(RoutingBlockageCacheTest, HitTestsAreRedoneAfterTrackAddsEdge) {
+  geometry::Rectangle hazard({0, -240}, {1500, 240});
+  geometry::Layer met1 = design_db_.physical_db().GetLayer("met1.drawing");
+  hazard.set_layer(met1);
+  hazard.set_net("a");
+  RoutingBlockageCache first(*routing_grid_);
+  first.AddBlockage(hazard, 0);
+
+  const RoutingBlockageHitCache &hit_cache =
+      routing_grid_->blockage_hit_cache();
+  ASSERT_EQ(1, hit_cache.Size());
+
+  // The first met1 track runs through the hazard.
+  RoutingTrack *track = nullptr;
+  for (RoutingVertex *vertex : routing_grid_->vertices()) {
+    if (vertex->centre().y() == 170 && vertex->horizontal_track()) {
+      track = vertex->horizontal_track();
+      break;
+    }
+  }
+  ASSERT_NE(nullptr, track);
+  std::vector<RoutingVertex*> on_track = track->VerticesInSpan(
+      {0, 170}, {1500, 170});
+  ASSERT_LE(2, on_track.size());
+
+  // The track creates the edge itself, as it does when healing around a
+  // blocked vertex, without going through the grid.
+  std::set<RoutingEdge*> before = track->edges();
+  RoutingBlockageCache no_blockages(*routing_grid_);
+  ASSERT_TRUE(track->MaybeAddEdgeBetween(
+      on_track.front(), on_track.back(), no_blockages));
+  RoutingEdge *new_edge = nullptr;
+  for (RoutingEdge *edge : track->edges()) {
+    if (before.find(edge) == before.end()) {
+      new_edge = edge;
+    }
+  }
+  ASSERT_NE(nullptr, new_edge);
+
+  size_t hits = hit_cache.num_hits();
+  RoutingBlockageCache second(*routing_grid_);
+  second.AddBlockage(hazard, 0);
+  EXPECT_EQ(hits, hit_cache.num_hits());
+  EXPECT_TRUE(second.IsEdgeBlocked(*new_edge, {}));
+}
+
 }  // namespace
 }  // namespace routing
 }  // namespace bfg
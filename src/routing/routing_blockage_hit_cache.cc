@@ -0,0 +1,184 @@
+#include "routing_blockage_hit_cache.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "../geometry/layer.h"
+#include "../geometry/point.h"
+#include "../geometry/polygon.h"
+#include "../geometry/rectangle.h"
+
+namespace bfg {
+namespace routing {
+
+namespace {
+
+void AppendInt(int64_t value, std::string *key) {
+  key->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendPoint(const geometry::Point &point, std::string *key) {
+  AppendInt(point.x(), key);
+  AppendInt(point.y(), key);
+}
+
+// Everything but the shape's points.
+std::string MakeKeyPrefix(char kind,
+                          const geometry::Layer &layer,
+                          const std::set<geometry::Layer> &blocked_layers,
+                          int64_t padding,
+                          int64_t search_window_margin) {
+  std::string key(1, kind);
+  AppendInt(layer, &key);
+  AppendInt(padding, &key);
+  AppendInt(search_window_margin, &key);
+  AppendInt(blocked_layers.size(), &key);
+  for (const geometry::Layer &blocked_layer : blocked_layers) {
+    AppendInt(blocked_layer, &key);
+  }
+  return key;
+}
+
+}   // namespace
+
+std::string RoutingBlockageHitCache::MakeKey(
+    const geometry::Rectangle &rectangle,
+    const std::set<geometry::Layer> &blocked_layers,
+    int64_t padding,
+    int64_t search_window_margin) {
+  std::string key = MakeKeyPrefix('R',
+                                  rectangle.layer(),
+                                  blocked_layers,
+                                  padding,
+                                  search_window_margin);
+  AppendPoint(rectangle.lower_left(), &key);
+  AppendPoint(rectangle.upper_right(), &key);
+  return key;
+}
+
+std::string RoutingBlockageHitCache::MakeKey(
+    const geometry::Polygon &polygon,
+    const std::set<geometry::Layer> &blocked_layers,
+    int64_t padding,
+    int64_t search_window_margin) {
+  std::string key = MakeKeyPrefix('P',
+                                  polygon.layer(),
+                                  blocked_layers,
+                                  padding,
+                                  search_window_margin);
+  for (const geometry::Point &point : polygon.vertices()) {
+    AppendPoint(point, &key);
+  }
+  return key;
+}
+
+bool RoutingBlockageHitCache::ChangedSince(
+    const geometry::Rectangle &region, size_t position) const {
+  if (position < num_dropped_regions_) {
+    return true;
+  }
+  for (size_t i = position - num_dropped_regions_;
+       i < dirty_regions_.size();
+       ++i) {
+    if (dirty_regions_[i].Overlaps(region)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::shared_ptr<const RoutingBlockageHitSet> RoutingBlockageHitCache::Find(
+    const std::string &key) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    ++num_misses_;
+    return nullptr;
+  }
+  Entry &entry = it->second;
+  if (ChangedSince(entry.region, entry.validated_to)) {
+    entries_.erase(it);
+    ++num_misses_;
+    return nullptr;
+  }
+  entry.validated_to = num_dropped_regions_ + dirty_regions_.size();
+  ++num_hits_;
+  return entry.hits;
+}
+
+size_t RoutingBlockageHitCache::Position() {
+  std::lock_guard<std::mutex> lock(lock_);
+  active_ = true;
+  return num_dropped_regions_ + dirty_regions_.size();
+}
+
+void RoutingBlockageHitCache::Insert(
+    const std::string &key,
+    const geometry::Rectangle &region,
+    std::shared_ptr<const RoutingBlockageHitSet> hits,
+    size_t computed_at) {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (ChangedSince(region, computed_at)) {
+    // The grid changed under the hit-test, so the result might be missing
+    // something.
+    return;
+  }
+  entries_[key] = Entry {
+      region, hits, num_dropped_regions_ + dirty_regions_.size()};
+}
+
+void RoutingBlockageHitCache::Invalidate(const geometry::Rectangle &region) {
+  if (!active_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(lock_);
+  // Even with no entries, hit sets being computed now need to see this.
+  dirty_regions_.push_back(region);
+  if (dirty_regions_.size() > kMaxDirtyRegions) {
+    Sweep();
+  }
+}
+
+void RoutingBlockageHitCache::Sweep() {
+  size_t position = num_dropped_regions_ + dirty_regions_.size();
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    if (ChangedSince(it->second.region, it->second.validated_to)) {
+      it = entries_.erase(it);
+      continue;
+    }
+    it->second.validated_to = position;
+    ++it;
+  }
+  num_dropped_regions_ = position;
+  dirty_regions_.clear();
+}
+
+void RoutingBlockageHitCache::Clear() {
+  std::lock_guard<std::mutex> lock(lock_);
+  entries_.clear();
+  active_ = false;
+  // Anything being computed now is against the old grid.
+  num_dropped_regions_ += dirty_regions_.size() + 1;
+  dirty_regions_.clear();
+}
+
+size_t RoutingBlockageHitCache::Size() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return entries_.size();
+}
+
+size_t RoutingBlockageHitCache::num_hits() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return num_hits_;
+}
+
+size_t RoutingBlockageHitCache::num_misses() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return num_misses_;
+}
+
+}  // namespace routing
+}  // namespace bfg
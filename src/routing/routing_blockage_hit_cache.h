@@ -0,0 +1,159 @@
+#ifndef ROUTING_BLOCKAGE_HIT_CACHE_H_
+#define ROUTING_BLOCKAGE_HIT_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "routing_track_direction.h"
+#include "../geometry/layer.h"
+#include "../geometry/polygon.h"
+#include "../geometry/rectangle.h"
+
+namespace bfg {
+namespace routing {
+
+class RoutingEdge;
+class RoutingVertex;
+
+// The result of hit-testing one shape, with some padding, against the vertices
+// and edges of a RoutingGrid: which vertices the shape overlaps, in which
+// directions it prevents a via at each vertex, and which edges it blocks.
+//
+// None of this depends on the net of the shape, or on which blockages are
+// cancelled, so the same hit set can be shared by every RoutingBlockageCache
+// that sees the same shape.
+struct RoutingBlockageHitSet {
+  struct VertexHit {
+    const RoutingVertex *vertex;
+    // The shape overlaps the centre of the vertex.
+    bool intersects;
+    // The shape is too close for a via at the vertex in these directions.
+    std::vector<RoutingTrackDirection> blocked_directions;
+  };
+
+  std::vector<VertexHit> vertices;
+  std::vector<const RoutingEdge*> edges;
+};
+
+// A content-addressed memo of RoutingBlockageHitSets, owned by a RoutingGrid so
+// that it is shared by the root RoutingBlockageCache, all of its children and
+// the caches of successive RouteManagers on the same grid. Re-routing after a
+// rip-up then doesn't repeat any geometric tests for shapes that haven't
+// changed.
+//
+// Entries are keyed by the shape's geometry and layer, the layers it blocks,
+// and the padding and search margin used. Two shapes with the same content
+// share an entry no matter where they live in memory. The grid clears the
+// cache when its RoutingGridGeometries change.
+//
+// Hit sets point into the grid, so they go stale when the grid's vertices or
+// edges change. Rather than throw everything away whenever that happens (which
+// is often: every off-grid connection adds vertices and edges), the grid
+// reports the region around each structural change with Invalidate(). That
+// includes every vertex and edge created or freed, whether by the grid or by
+// one of its RoutingTracks. Each entry remembers the region in which a change
+// could alter its result, and is discarded on lookup if any change reported
+// since it was last validated overlaps that region.
+//
+// Since freeing a vertex or edge always invalidates the region around it, and
+// every hit set containing it covers that region, no entry still pointing at
+// the old object can be found once its memory is reused.
+//
+// Changes are numbered in the order they are reported. A caller computing a
+// new hit set must take Position() before it starts and give it to Insert(),
+// so that changes made while it was computing are not missed.
+//
+// All methods are thread-safe.
+class RoutingBlockageHitCache {
+ public:
+  // After this many unexamined changes, Invalidate() sweeps every entry so that
+  // the change log can be emptied.
+  static constexpr size_t kMaxDirtyRegions = 1 << 14;
+
+  RoutingBlockageHitCache()
+      : active_(false),
+        num_dropped_regions_(0),
+        num_hits_(0),
+        num_misses_(0) {}
+
+  RoutingBlockageHitCache(const RoutingBlockageHitCache &other) = delete;
+  RoutingBlockageHitCache &operator=(
+      const RoutingBlockageHitCache &other) = delete;
+
+  static std::string MakeKey(const geometry::Rectangle &rectangle,
+                             const std::set<geometry::Layer> &blocked_layers,
+                             int64_t padding,
+                             int64_t search_window_margin);
+  static std::string MakeKey(const geometry::Polygon &polygon,
+                             const std::set<geometry::Layer> &blocked_layers,
+                             int64_t padding,
+                             int64_t search_window_margin);
+
+  // Returns nullptr if there is no valid entry for the key.
+  std::shared_ptr<const RoutingBlockageHitSet> Find(const std::string &key);
+
+  // The number of changes reported so far.
+  size_t Position();
+
+  // Store the hit set for the given key, which was computed from the grid as
+  // it was at the given Position(). Any change to the grid overlapping region
+  // will invalidate it. If there has already been such a change since
+  // computed_at, the hit set is not stored.
+  void Insert(const std::string &key,
+              const geometry::Rectangle &region,
+              std::shared_ptr<const RoutingBlockageHitSet> hits,
+              size_t computed_at);
+
+  // Tell the cache that the grid's vertices or edges within the given region
+  // have changed. This is called for every vertex and edge the grid creates,
+  // so until the first hit set is computed it returns without locking.
+  void Invalidate(const geometry::Rectangle &region);
+
+  void Clear();
+
+  size_t Size() const;
+  size_t num_hits() const;
+  size_t num_misses() const;
+
+ private:
+  struct Entry {
+    geometry::Rectangle region;
+    std::shared_ptr<const RoutingBlockageHitSet> hits;
+    // The Position() up to which this entry has been checked.
+    size_t validated_to;
+  };
+
+  // True if any change since the given position overlaps the region, or if
+  // changes since then have been dropped from the log.
+  bool ChangedSince(const geometry::Rectangle &region, size_t position) const;
+
+  void Sweep();
+
+  mutable std::mutex lock_;
+
+  // Set by the first call to Position(), and reset by Clear(). Until then
+  // there are no entries and no hit sets being computed, so there is nothing
+  // to invalidate.
+  std::atomic<bool> active_;
+
+  std::unordered_map<std::string, Entry> entries_;
+
+  // Regions of the grid that have changed, in order. The first has position
+  // num_dropped_regions_.
+  std::vector<geometry::Rectangle> dirty_regions_;
+  size_t num_dropped_regions_;
+
+  size_t num_hits_;
+  size_t num_misses_;
+};
+
+}  // namespace routing
+}  // namespace bfg
+
+#endif  // ROUTING_BLOCKAGE_HIT_CACHE_H_
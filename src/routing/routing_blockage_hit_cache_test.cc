@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "routing_blockage_hit_cache.h"
+#include "../geometry/point.h"
+#include "../geometry/polygon.h"
+#include "../geometry/rectangle.h"
+
+namespace bfg {
+namespace routing {
+namespace {
+
+std::shared_ptr<const RoutingBlockageHitSet> MakeHits() {
+  return std::make_shared<RoutingBlockageHitSet>();
+}
+
+TEST(RoutingBlockageHitCacheTest, MakeKey_DependsOnContentNotIdentity) {
+  geometry::Rectangle a({0, 0}, {100, 100});
+  a.set_layer(1);
+  a.set_net("a");
+  geometry::Rectangle b({0, 0}, {100, 100});
+  b.set_layer(1);
+  b.set_net("b");
+
+  // Nets don't matter.
+  EXPECT_EQ(RoutingBlockageHitCache::MakeKey(a, {1}, 10, 5),
+            RoutingBlockageHitCache::MakeKey(b, {1}, 10, 5));
+
+  // Everything else does.
+  std::string key = RoutingBlockageHitCache::MakeKey(a, {1}, 10, 5);
+  EXPECT_NE(key, RoutingBlockageHitCache::MakeKey(a, {1, 2}, 10, 5));
+  EXPECT_NE(key, RoutingBlockageHitCache::MakeKey(a, {1}, 11, 5));
+  EXPECT_NE(key, RoutingBlockageHitCache::MakeKey(a, {1}, 10, 6));
+  b.set_layer(2);
+  EXPECT_NE(key, RoutingBlockageHitCache::MakeKey(b, {1}, 10, 5));
+  geometry::Rectangle c({0, 0}, {100, 101});
+  c.set_layer(1);
+  EXPECT_NE(key, RoutingBlockageHitCache::MakeKey(c, {1}, 10, 5));
+
+  // Nor is a polygon the same as a rectangle with the same points.
+  geometry::Polygon polygon({{0, 0}, {100, 100}});
+  polygon.set_layer(1);
+  EXPECT_NE(key, RoutingBlockageHitCache::MakeKey(polygon, {1}, 10, 5));
+}
+
+TEST(RoutingBlockageHitCacheTest, FindAfterInsert) {
+  RoutingBlockageHitCache cache;
+  EXPECT_EQ(nullptr, cache.Find("x"));
+  EXPECT_EQ(1, cache.num_misses());
+
+  auto hits = MakeHits();
+  cache.Insert(
+      "x", geometry::Rectangle({0, 0}, {10, 10}), hits, cache.Position());
+  EXPECT_EQ(hits, cache.Find("x"));
+  EXPECT_EQ(1, cache.num_hits());
+  EXPECT_EQ(nullptr, cache.Find("y"));
+}
+
+TEST(RoutingBlockageHitCacheTest, Invalidate_OnlyOverlappingEntries) {
+  RoutingBlockageHitCache cache;
+  cache.Insert("near", geometry::Rectangle({0, 0}, {10, 10}), MakeHits(),
+               cache.Position());
+  cache.Insert("far", geometry::Rectangle({100, 100}, {110, 110}), MakeHits(),
+               cache.Position());
+
+  // Touching counts.
+  cache.Invalidate(geometry::Rectangle({10, 10}, {20, 20}));
+
+  EXPECT_EQ(nullptr, cache.Find("near"));
+  EXPECT_NE(nullptr, cache.Find("far"));
+  EXPECT_EQ(1, cache.Size());
+}
+
+TEST(RoutingBlockageHitCacheTest, Invalidate_DoesNotAffectLaterEntries) {
+  RoutingBlockageHitCache cache;
+  cache.Insert("old", geometry::Rectangle({0, 0}, {10, 10}), MakeHits(),
+               cache.Position());
+  cache.Invalidate(geometry::Rectangle({0, 0}, {10, 10}));
+  cache.Insert("new", geometry::Rectangle({0, 0}, {10, 10}), MakeHits(),
+               cache.Position());
+
+  EXPECT_EQ(nullptr, cache.Find("old"));
+  EXPECT_NE(nullptr, cache.Find("new"));
+}
+
+TEST(RoutingBlockageHitCacheTest, Invalidate_ManyChangesAreSwept) {
+  RoutingBlockageHitCache cache;
+  cache.Insert("near", geometry::Rectangle({0, 0}, {10, 10}), MakeHits(),
+               cache.Position());
+  cache.Insert("far", geometry::Rectangle({-20, -20}, {-10, -10}), MakeHits(),
+               cache.Position());
+
+  cache.Invalidate(geometry::Rectangle({5, 5}, {5, 5}));
+  for (size_t i = 0; i < RoutingBlockageHitCache::kMaxDirtyRegions; ++i) {
+    cache.Invalidate(geometry::Rectangle({1000, 1000}, {1001, 1001}));
+  }
+
+  EXPECT_EQ(1, cache.Size());
+  EXPECT_NE(nullptr, cache.Find("far"));
+}
+
+TEST(RoutingBlockageHitCacheTest, Insert_DroppedIfChangedWhileComputing) {
+  RoutingBlockageHitCache cache;
+  geometry::Rectangle region({0, 0}, {100, 100});
+
+  size_t computed_at = cache.Position();
+  cache.Invalidate(geometry::Rectangle({50, 50}, {60, 60}));
+  cache.Insert("changed", region, MakeHits(), computed_at);
+  EXPECT_EQ(nullptr, cache.Find("changed"));
+
+  // Changes elsewhere don't matter.
+  computed_at = cache.Position();
+  cache.Invalidate(geometry::Rectangle({500, 500}, {600, 600}));
+  cache.Insert("unchanged", region, MakeHits(), computed_at);
+  EXPECT_NE(nullptr, cache.Find("unchanged"));
+}
+
+TEST(RoutingBlockageHitCacheTest, Clear) {
+  RoutingBlockageHitCache cache;
+  cache.Insert("x", geometry::Rectangle({0, 0}, {10, 10}), MakeHits(),
+               cache.Position());
+  cache.Clear();
+  EXPECT_EQ(0, cache.Size());
+  EXPECT_EQ(nullptr, cache.Find("x"));
+}
+
+}  // namespace
+}  // namespace routing
+}  // namespace bfg
@@ -0,0 +1,312 @@
+#ifndef ROUTING_BLOCKAGE_INDEX_H_
+#define ROUTING_BLOCKAGE_INDEX_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "../geometry/point.h"
+#include "../geometry/rectangle.h"
+
+namespace bfg {
+namespace routing {
+
+// A bulk-loaded R-tree of pointers to blockages (we do not take ownership!),
+// keyed by a bounding box for each, for finding the blockages which might
+// interfere with some other thing (a vertex, an edge, a footprint) without
+// testing every one.
+//
+// The tree is packed with the Sort-Tile-Recursive (STR) method: entries are
+// sorted into vertical slices by x, each slice is sorted by y and then cut into
+// leaves of kNodeCapacity entries. The leaves are grouped into parents the same
+// way until there is a single root. Every level is stored contiguously, so the
+// tree is just a few flat arrays.
+//
+// As with RoutingVertexSpatialIndex, blockages inserted since the last build go
+// into a small unsorted overflow list and erased ones are left as tombstones,
+// and the tree is repacked (on the mutating side) once either grows too big.
+//
+// Results are returned in insertion order so that callers iterating over them
+// see the same order they would have seen scanning the blockages in a list.
+//
+// Queries are const and may be run concurrently. Mutations are not safe to run
+// concurrently with anything else.
+template<typename T>
+class RoutingBlockageIndex {
+ public:
+  static constexpr size_t kNodeCapacity = 16;
+
+  RoutingBlockageIndex()
+      : next_sequence_(0),
+        num_live_(0),
+        num_tombstones_(0) {}
+
+  // Both the blockage and its box must be given again to Erase(), so the box
+  // should be something the caller can recompute (see
+  // RoutingGrid::BlockageSearchBox).
+  void Insert(T *item, const geometry::Rectangle &box) {
+    overflow_.push_back(MakeEntry(item, box));
+    ++num_live_;
+    MaybeRebuild();
+  }
+
+  void Erase(T *item, const geometry::Rectangle &box) {
+    for (auto it = overflow_.begin(); it != overflow_.end(); ++it) {
+      if (it->item == item) {
+        overflow_.erase(it);
+        --num_live_;
+        return;
+      }
+    }
+    Entry probe = MakeBox(box);
+    bool found = false;
+    VisitPacked(probe, [&](Entry *entry) {
+      if (found || entry->item != item)
+        return;
+      entry->item = nullptr;
+      found = true;
+    });
+    if (!found)
+      return;
+    --num_live_;
+    ++num_tombstones_;
+    MaybeRebuild();
+  }
+
+  void Clear() {
+    entries_.clear();
+    levels_.clear();
+    overflow_.clear();
+    num_live_ = 0;
+    num_tombstones_ = 0;
+  }
+
+  // Appends every blockage whose box overlaps the given box (inclusive of the
+  // boundaries) to *found, in insertion order.
+  void FindOverlapping(const geometry::Rectangle &box,
+                       std::vector<T*> *found) const {
+    Entry probe = MakeBox(box);
+    std::vector<const Entry*> hits;
+    VisitPacked(probe, [&](const Entry *entry) { hits.push_back(entry); });
+    for (const Entry &entry : overflow_) {
+      if (entry.item && Overlaps(entry, probe)) {
+        hits.push_back(&entry);
+      }
+    }
+    std::sort(hits.begin(), hits.end(), [](const Entry *lhs, const Entry *rhs) {
+      return lhs->sequence < rhs->sequence;
+    });
+    found->reserve(found->size() + hits.size());
+    for (const Entry *entry : hits) {
+      found->push_back(entry->item);
+    }
+  }
+
+  std::vector<T*> FindOverlapping(const geometry::Rectangle &box) const {
+    std::vector<T*> found;
+    FindOverlapping(box, &found);
+    return found;
+  }
+
+  // Pack everything, including the overflow list, into the tree and drop
+  // tombstones.
+  void Rebuild() {
+    std::vector<Entry> entries;
+    entries.reserve(num_live_);
+    for (const Entry &entry : entries_) {
+      if (entry.item)
+        entries.push_back(entry);
+    }
+    entries.insert(entries.end(), overflow_.begin(), overflow_.end());
+    overflow_.clear();
+    num_tombstones_ = 0;
+    levels_.clear();
+    entries_ = std::move(entries);
+    if (entries_.empty())
+      return;
+
+    // The leaves.
+    std::vector<Node> level = Pack(&entries_);
+    // And the parents of those, etc.
+    while (level.size() > 1) {
+      std::vector<Node> parents = Pack(&level);
+      levels_.push_back(std::move(level));
+      level = std::move(parents);
+    }
+    levels_.push_back(std::move(level));
+  }
+
+  size_t Size() const { return num_live_; }
+
+ private:
+  struct Box {
+    int64_t min_x;
+    int64_t min_y;
+    int64_t max_x;
+    int64_t max_y;
+  };
+
+  struct Entry : public Box {
+    T *item;
+    // Order of insertion.
+    uint64_t sequence;
+  };
+
+  struct Node : public Box {
+    // Children are [first, first + count) in the next level down, or in
+    // entries_ for leaves.
+    size_t first;
+    size_t count;
+  };
+
+  // The overflow list is scanned in every query, so we repack once it gets
+  // bigger than this (or bigger than some fraction of the packed entries).
+  static constexpr size_t kMinOverflowBeforeRebuild = 64;
+
+  static Entry MakeBox(const geometry::Rectangle &box) {
+    Entry entry;
+    entry.min_x = box.lower_left().x();
+    entry.min_y = box.lower_left().y();
+    entry.max_x = box.upper_right().x();
+    entry.max_y = box.upper_right().y();
+    entry.item = nullptr;
+    entry.sequence = 0;
+    return entry;
+  }
+
+  Entry MakeEntry(T *item, const geometry::Rectangle &box) {
+    Entry entry = MakeBox(box);
+    entry.item = item;
+    entry.sequence = next_sequence_++;
+    return entry;
+  }
+
+  static bool Overlaps(const Box &lhs, const Box &rhs) {
+    return lhs.min_x <= rhs.max_x && rhs.min_x <= lhs.max_x &&
+           lhs.min_y <= rhs.max_y && rhs.min_y <= lhs.max_y;
+  }
+
+  static int64_t CentreX(const Box &box) {
+    return box.min_x + (box.max_x - box.min_x) / 2;
+  }
+  static int64_t CentreY(const Box &box) {
+    return box.min_y + (box.max_y - box.min_y) / 2;
+  }
+
+  // Sort-Tile-Recursive: reorder *children in place so that each consecutive
+  // run of kNodeCapacity makes a compact node, and return those nodes.
+  template<typename C>
+  static std::vector<Node> Pack(std::vector<C> *children) {
+    size_t num_children = children->size();
+    size_t num_nodes = (num_children + kNodeCapacity - 1) / kNodeCapacity;
+    size_t num_slices = static_cast<size_t>(
+        std::ceil(std::sqrt(static_cast<double>(num_nodes))));
+    size_t slice_size = num_slices * kNodeCapacity;
+
+    std::sort(children->begin(), children->end(),
+              [](const C &lhs, const C &rhs) {
+                return CentreX(lhs) < CentreX(rhs);
+              });
+    for (size_t begin = 0; begin < num_children; begin += slice_size) {
+      size_t end = std::min(begin + slice_size, num_children);
+      std::sort(children->begin() + begin, children->begin() + end,
+                [](const C &lhs, const C &rhs) {
+                  return CentreY(lhs) < CentreY(rhs);
+                });
+    }
+
+    std::vector<Node> nodes;
+    nodes.reserve(num_nodes);
+    for (size_t first = 0; first < num_children; first += kNodeCapacity) {
+      Node node;
+      node.min_x = std::numeric_limits<int64_t>::max();
+      node.min_y = std::numeric_limits<int64_t>::max();
+      node.max_x = std::numeric_limits<int64_t>::min();
+      node.max_y = std::numeric_limits<int64_t>::min();
+      node.first = first;
+      node.count = std::min(kNodeCapacity, num_children - first);
+      for (size_t i = first; i < first + node.count; ++i) {
+        const C &child = (*children)[i];
+        node.min_x = std::min(node.min_x, child.min_x);
+        node.min_y = std::min(node.min_y, child.min_y);
+        node.max_x = std::max(node.max_x, child.max_x);
+        node.max_y = std::max(node.max_y, child.max_y);
+      }
+      nodes.push_back(node);
+    }
+    return nodes;
+  }
+
+  void MaybeRebuild() {
+    size_t threshold = std::max(kMinOverflowBeforeRebuild, entries_.size() / 4);
+    if (overflow_.size() > threshold || num_tombstones_ > threshold) {
+      Rebuild();
+    }
+  }
+
+  // Calls visitor with every live packed entry overlapping the probe box.
+  template<typename V, typename F>
+  static void VisitPackedImpl(
+      const std::vector<std::vector<Node>> &levels,
+      V &entries,
+      const Box &probe,
+      F visitor) {
+    if (levels.empty())
+      return;
+    // Stack of (level, node index).
+    std::vector<std::pair<size_t, size_t>> stack;
+    size_t root_level = levels.size() - 1;
+    for (size_t i = 0; i < levels[root_level].size(); ++i) {
+      stack.emplace_back(root_level, i);
+    }
+    while (!stack.empty()) {
+      auto [level, index] = stack.back();
+      stack.pop_back();
+      const Node &node = levels[level][index];
+      if (!Overlaps(node, probe))
+        continue;
+      for (size_t i = node.first; i < node.first + node.count; ++i) {
+        if (level == 0) {
+          auto &entry = entries[i];
+          if (entry.item && Overlaps(entry, probe)) {
+            visitor(&entry);
+          }
+        } else {
+          stack.emplace_back(level - 1, i);
+        }
+      }
+    }
+  }
+
+  template<typename F>
+  void VisitPacked(const Box &probe, F visitor) {
+    VisitPackedImpl(levels_, entries_, probe, visitor);
+  }
+
+  template<typename F>
+  void VisitPacked(const Box &probe, F visitor) const {
+    VisitPackedImpl(levels_, entries_, probe, visitor);
+  }
+
+  // Packed leaf entries, in STR order.
+  std::vector<Entry> entries_;
+
+  // levels_[0] are the leaves, whose children are in entries_; levels_[k]
+  // nodes have children in levels_[k - 1]. levels_.back() is the root level.
+  std::vector<std::vector<Node>> levels_;
+
+  // Entries inserted since the last rebuild.
+  std::vector<Entry> overflow_;
+
+  uint64_t next_sequence_;
+  size_t num_live_;
+  size_t num_tombstones_;
+};
+
+}  // namespace routing
+}  // namespace bfg
+
+#endif  // ROUTING_BLOCKAGE_INDEX_H_
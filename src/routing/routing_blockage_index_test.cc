@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <cstdlib>
+#include <vector>
+
+#include "routing_blockage_index.h"
+#include "../geometry/point.h"
+#include "../geometry/rectangle.h"
+
+namespace bfg {
+namespace routing {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+// The index does not care what it points to.
+struct FakeBlockage {
+  int id;
+};
+
+TEST(RoutingBlockageIndexTest, EmptyIndex_FindsNothing) {
+  RoutingBlockageIndex<FakeBlockage> index;
+  EXPECT_EQ(index.Size(), 0);
+  EXPECT_THAT(index.FindOverlapping({{0, 0}, {100, 100}}), IsEmpty());
+}
+
+TEST(RoutingBlockageIndexTest, FindOverlapping_IncludesBoundaries) {
+  RoutingBlockageIndex<FakeBlockage> index;
+  FakeBlockage a{0};
+  index.Insert(&a, {{0, 0}, {10, 10}});
+
+  EXPECT_THAT(index.FindOverlapping({{10, 10}, {20, 20}}), ElementsAre(&a));
+  EXPECT_THAT(index.FindOverlapping({{-5, 3}, {0, 4}}), ElementsAre(&a));
+  EXPECT_THAT(index.FindOverlapping({{2, 2}, {3, 3}}), ElementsAre(&a));
+  EXPECT_THAT(index.FindOverlapping({{11, 0}, {20, 10}}), IsEmpty());
+  EXPECT_THAT(index.FindOverlapping({{0, -10}, {10, -1}}), IsEmpty());
+}
+
+TEST(RoutingBlockageIndexTest, FindOverlapping_ReturnsInsertionOrder) {
+  RoutingBlockageIndex<FakeBlockage> index;
+  FakeBlockage a{0};
+  FakeBlockage b{1};
+  FakeBlockage c{2};
+  index.Insert(&c, {{100, 100}, {200, 200}});
+  index.Insert(&a, {{0, 0}, {150, 150}});
+  index.Insert(&b, {{50, 50}, {60, 60}});
+
+  EXPECT_THAT(index.FindOverlapping({{0, 0}, {1000, 1000}}),
+              ElementsAre(&c, &a, &b));
+
+  // Packing the tree reorders the entries internally, but not the results.
+  index.Rebuild();
+  EXPECT_THAT(index.FindOverlapping({{0, 0}, {1000, 1000}}),
+              ElementsAre(&c, &a, &b));
+}
+
+TEST(RoutingBlockageIndexTest, Erase_BeforeAndAfterRebuild) {
+  RoutingBlockageIndex<FakeBlockage> index;
+  FakeBlockage a{0};
+  FakeBlockage b{1};
+  FakeBlockage c{2};
+  index.Insert(&a, {{0, 0}, {10, 10}});
+  index.Insert(&b, {{0, 0}, {10, 10}});
+  index.Rebuild();
+  index.Insert(&c, {{0, 0}, {10, 10}});
+  EXPECT_EQ(index.Size(), 3);
+
+  // c has not been packed yet.
+  index.Erase(&c, {{0, 0}, {10, 10}});
+  EXPECT_EQ(index.Size(), 2);
+  EXPECT_THAT(index.FindOverlapping({{5, 5}, {5, 5}}), ElementsAre(&a, &b));
+
+  // a has.
+  index.Erase(&a, {{0, 0}, {10, 10}});
+  EXPECT_EQ(index.Size(), 1);
+  EXPECT_THAT(index.FindOverlapping({{5, 5}, {5, 5}}), ElementsAre(&b));
+
+  // Erasing something that isn't there does nothing.
+  index.Erase(&a, {{0, 0}, {10, 10}});
+  EXPECT_EQ(index.Size(), 1);
+
+  index.Rebuild();
+  EXPECT_THAT(index.FindOverlapping({{5, 5}, {5, 5}}), ElementsAre(&b));
+}
+
+TEST(RoutingBlockageIndexTest, Clear) {
+  RoutingBlockageIndex<FakeBlockage> index;
+  FakeBlockage a{0};
+  index.Insert(&a, {{0, 0}, {10, 10}});
+  index.Rebuild();
+  index.Clear();
+  EXPECT_EQ(index.Size(), 0);
+  EXPECT_THAT(index.FindOverlapping({{0, 0}, {10, 10}}), IsEmpty());
+}
+
+TEST(RoutingBlockageIndexTest, ManyBlockages_AgreesWithBruteForce) {
+  RoutingBlockageIndex<FakeBlockage> index;
+  std::srand(42);
+
+  static constexpr int kNumBlockages = 2000;
+  std::vector<FakeBlockage> blockages(kNumBlockages);
+  std::vector<geometry::Rectangle> boxes;
+  for (int i = 0; i < kNumBlockages; ++i) {
+    blockages[i].id = i;
+    int64_t x = std::rand() % 10000;
+    int64_t y = std::rand() % 10000;
+    geometry::Rectangle box(
+        {x, y}, {x + std::rand() % 200, y + std::rand() % 200});
+    boxes.push_back(box);
+    // This crosses the rebuild threshold many times.
+    index.Insert(&blockages[i], box);
+  }
+
+  // Erase every third one, some of which will be in the overflow list.
+  std::vector<bool> erased(kNumBlockages, false);
+  for (int i = 0; i < kNumBlockages; i += 3) {
+    index.Erase(&blockages[i], boxes[i]);
+    erased[i] = true;
+  }
+
+  for (int q = 0; q < 200; ++q) {
+    int64_t x = std::rand() % 10000;
+    int64_t y = std::rand() % 10000;
+    geometry::Rectangle query(
+        {x, y}, {x + std::rand() % 500, y + std::rand() % 500});
+
+    std::vector<FakeBlockage*> expected;
+    for (int i = 0; i < kNumBlockages; ++i) {
+      if (erased[i])
+        continue;
+      const geometry::Rectangle &box = boxes[i];
+      if (box.lower_left().x() <= query.upper_right().x() &&
+          query.lower_left().x() <= box.upper_right().x() &&
+          box.lower_left().y() <= query.upper_right().y() &&
+          query.lower_left().y() <= box.upper_right().y()) {
+        expected.push_back(&blockages[i]);
+      }
+    }
+    EXPECT_EQ(expected, index.FindOverlapping(query));
+  }
+}
+
+}  // namespace
+}  // namespace routing
+}  // namespace bfg
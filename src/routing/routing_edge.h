@@ -122,6 +122,8 @@ class RoutingEdge {
   // Need some function of the distance between the two vertices (like of
   // length, sheet resistance). This also needs to be computed only once...
   double cost_;
+
+  friend class RoutingGridSnapshot;
 };
 
 std::ostream &operator<<(std::ostream &os, const RoutingEdge &edge);
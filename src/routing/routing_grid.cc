@@ -1,7 +1,9 @@
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <deque>
 #include <functional>
+#include <iterator>
 #include <limits>
 #include <map>
 #include <map>
@@ -11,6 +13,7 @@
 #include <ostream>
 #include <queue>
 #include <sstream>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -18,6 +21,7 @@
 #include <absl/status/status.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_join.h>
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include "../equivalent_nets.h"
@@ -28,6 +32,7 @@
 #include "../physical_properties_database.h"
 #include "../poly_line_cell.h"
 #include "../poly_line_inflator.h"
+#include "parallel.h"
 #include "routing_blockage_cache.h"
 #include "routing_edge.h"
 #include "routing_grid.h"
@@ -121,6 +126,7 @@ void RoutingGrid::ForgetBlockage(
       rectangle_blockages_.begin(), rectangle_blockages_.end(), predicate);
   if (it == rectangle_blockages_.end())
     return;
+  rectangle_blockage_index_.Erase(blockage, blockage->PaddedBoundingBox());
   rectangle_blockages_.erase(it);
 }
 
@@ -135,9 +141,26 @@ void RoutingGrid::ForgetBlockage(
       polygon_blockages_.begin(), polygon_blockages_.end(), predicate);
   if (it == polygon_blockages_.end())
     return;
+  polygon_blockage_index_.Erase(blockage, blockage->PaddedBoundingBox());
   polygon_blockages_.erase(it);
 }
 
+template<>
+void RoutingGrid::RememberBlockage(
+    RoutingGridBlockage<geometry::Rectangle> *blockage) {
+  rectangle_blockages_.emplace_back(blockage);
+  rectangle_blockage_index_.Insert(blockage, blockage->PaddedBoundingBox());
+  InvalidatePinAccess(blockage->PaddedBoundingBox());
+}
+
+template<>
+void RoutingGrid::RememberBlockage(
+    RoutingGridBlockage<geometry::Polygon> *blockage) {
+  polygon_blockages_.emplace_back(blockage);
+  polygon_blockage_index_.Insert(blockage, blockage->PaddedBoundingBox());
+  InvalidatePinAccess(blockage->PaddedBoundingBox());
+}
+
 template<typename T>
 std::set<RoutingVertex*> RoutingGrid::BlockingOffGridVertices(
     const T &shape) const {
@@ -245,7 +268,8 @@ template<typename T>
 void RoutingGrid::AddOffGridVerticesForBlockage(
     const RoutingGridGeometry &grid_geometry,
     const RoutingGridBlockage<T> &blockage,
-    bool is_temporary) {
+    bool is_temporary,
+    std::set<const RoutingVertex*> *added_vertices) {
   auto tracks_and_positions =
       grid_geometry.CandidateVertexPositionsOnCrossedTracks(
           blockage.shape());
@@ -274,6 +298,9 @@ void RoutingGrid::AddOffGridVerticesForBlockage(
                               &blockage_cache,
                               blockage.shape().layer());
       AddOffGridVertex(new_vertex);
+      if (added_vertices) {
+        added_vertices->insert(new_vertex);
+      }
 
       ApplyExistingBlockages(new_vertex, is_temporary);
     }
@@ -323,14 +350,17 @@ absl::Status RoutingGrid::ValidAgainstKnownBlockages(
     const RoutingEdge &edge,
     const std::optional<EquivalentNets> &exceptional_nets) const
     REQUIRES_SHARED(lock_) {
+  geometry::Rectangle search_box = BlockageSearchBox(edge);
   // *snicker* Cute opportunity for std::any_of here:
-  for (const auto &blockage : rectangle_blockages_) {
+  for (const auto *blockage :
+           rectangle_blockage_index_.FindOverlapping(search_box)) {
     if (blockage->Blocks(edge, exceptional_nets)) {
       return absl::ResourceExhaustedError(
           absl::StrCat("Blocked by ", blockage->shape().Describe()));
     }
   }
-  for (const auto &blockage : polygon_blockages_) {
+  for (const auto *blockage :
+           polygon_blockage_index_.FindOverlapping(search_box)) {
     if (blockage->Blocks(edge, exceptional_nets)) {
       return absl::ResourceExhaustedError(
           absl::StrCat("Blocked by ", blockage->shape().Describe()));
@@ -344,14 +374,17 @@ absl::Status RoutingGrid::ValidAgainstKnownBlockages(
     const std::optional<EquivalentNets> &exceptional_nets,
     const std::optional<RoutingTrackDirection> &access_direction) const
     REQUIRES_SHARED(lock_) {
+  geometry::Rectangle search_box = BlockageSearchBox(vertex);
   // *snicker* Cute opportunity for std::any_of here:
-  for (const auto &blockage : rectangle_blockages_) {
+  for (const auto *blockage :
+           rectangle_blockage_index_.FindOverlapping(search_box)) {
     if (blockage->Blocks(vertex, exceptional_nets, access_direction)) {
       return absl::ResourceExhaustedError(
           absl::StrCat("Blocked by ", blockage->shape().Describe()));
     }
   }
-  for (const auto &blockage : polygon_blockages_) {
+  for (const auto *blockage :
+           polygon_blockage_index_.FindOverlapping(search_box)) {
     if (blockage->Blocks(vertex, exceptional_nets, access_direction)) {
       return absl::ResourceExhaustedError(
           absl::StrCat("Blocked by ", blockage->shape().Describe()));
@@ -364,13 +397,17 @@ absl::Status RoutingGrid::ValidAgainstKnownBlockages(
     const geometry::Rectangle &footprint,
     const std::optional<EquivalentNets> &exceptional_nets) const
     REQUIRES_SHARED(lock_) {
-  for (const auto &blockage : rectangle_blockages_) {
+  // Indexed blockage boxes already include their padding, so the footprint
+  // itself is the search box.
+  for (const auto *blockage :
+           rectangle_blockage_index_.FindOverlapping(footprint)) {
     if (blockage->Blocks(footprint, exceptional_nets)) {
       return absl::ResourceExhaustedError(
           absl::StrCat("Blocked by ", blockage->shape().Describe()));
     }
   }
-  for (const auto &blockage : polygon_blockages_) {
+  for (const auto *blockage :
+           polygon_blockage_index_.FindOverlapping(footprint)) {
     if (blockage->Blocks(footprint, exceptional_nets)) {
       return absl::ResourceExhaustedError(
           absl::StrCat("Blocked by ", blockage->shape().Describe()));
@@ -436,24 +473,11 @@ absl::Status RoutingGrid::ValidAgainstInstalledPaths(
     const geometry::Rectangle &footprint,
     const std::optional<EquivalentNets> &for_nets) const {
   const geometry::Layer &footprint_layer = footprint.layer();
-  // In this case we have to do labourious check for proximity to all used paths
-  // and vertices.
-  std::set<const RoutingEdge*> used_edges;
-  std::vector<std::pair<const RoutingVertex*, const RoutingTrackDirection>>
-      used_vertices_and_directions;
-  for (const RoutingPath *path : paths_) {
-    for (const RoutingEdge *edge : path->edges()) {
-      if (edge->EffectiveLayer() != footprint_layer) {
-        continue;
-      }
-      used_edges.insert(edge);
-      const RoutingTrackDirection &direction = edge->Direction();
-      used_vertices_and_directions.push_back(
-          {edge->first(), direction});
-      used_vertices_and_directions.push_back(
-          {edge->second(), direction});
-    }
+  auto it = installed_footprints_.find(footprint_layer);
+  if (it == installed_footprints_.end()) {
+    return absl::OkStatus();
   }
+  const InstalledFootprints &installed = it->second;
 
   // TODO(aryap): We have fragmented sources for this information. Some
   // places I've used the PhysicalPropertiesDatabase, others the copies of
@@ -472,10 +496,13 @@ absl::Status RoutingGrid::ValidAgainstInstalledPaths(
   // int64_t min_separation = routing_layer_info->get().min_separation();
   int64_t min_separation = physical_db_.Rules(footprint_layer).min_separation;
 
-  // Check proximity to all installed edges:
-  for (const RoutingEdge *used : used_edges) {
-    if (used->EffectiveLayer() != footprint_layer)
-      continue;
+  // Anything closer than min_separation to the footprint overlaps this box, so
+  // only those installed edges and vertices need to be checked.
+  geometry::Rectangle search_box = footprint.WithPadding(min_separation);
+
+  // Check proximity to nearby installed edges:
+  for (const RoutingEdge *used :
+           installed.edge_index.FindOverlapping(search_box)) {
     auto existing_footprint = EdgeWireFootprint(*used);
     if (!existing_footprint)
       continue;
@@ -497,9 +524,10 @@ absl::Status RoutingGrid::ValidAgainstInstalledPaths(
     }
   }
 
-  for (const auto &pair : used_vertices_and_directions) {
-    const RoutingVertex *const other = pair.first;
-    const RoutingTrackDirection &access_direction = pair.second;
+  for (const InstalledVertex *installed_vertex :
+           installed.vertex_index.FindOverlapping(search_box)) {
+    const RoutingVertex *const other = installed_vertex->vertex;
+    const RoutingTrackDirection &access_direction = installed_vertex->direction;
 
     // Get the other vertices' footprints on the layer footprint layer we're
     // dealing with, skipping if they don't have one.
@@ -514,7 +542,7 @@ absl::Status RoutingGrid::ValidAgainstInstalledPaths(
     int64_t distance = static_cast<int64_t>(
         std::ceil(footprint.ClosestDistanceTo(*other_via_encap)));
     if (distance == 0 && for_nets &&
-        other->AvailableForNetsOnAnyLayer(*for_nets)) {
+        vertex_availability_.AvailableForNetsOnAnyLayer(*other, *for_nets)) {
       // The shapes touch and they're on the same net, so no problem.
       // NOTE(aryap): This is the same as checking
       // via_encap->Overlaps(*other_via_encap).
@@ -537,6 +565,27 @@ absl::Status RoutingGrid::ValidAgainstInstalledPaths(
   return absl::OkStatus();
 }
 
+void RoutingGrid::IndexInstalledPath(const RoutingPath &path) REQUIRES(lock_) {
+  for (const RoutingEdge *edge : path.edges()) {
+    const geometry::Layer &layer = edge->EffectiveLayer();
+    InstalledFootprints &installed = installed_footprints_[layer];
+    auto footprint = EdgeWireFootprint(*edge);
+    if (footprint) {
+      installed.edge_index.Insert(edge, *footprint);
+    }
+    const RoutingTrackDirection &direction = edge->Direction();
+    for (const RoutingVertex *vertex : {edge->first(), edge->second()}) {
+      // NOTE(aryap): This assumes that the layers a vertex connects don't
+      // change once it is in a path, since the via footprint depends on them.
+      auto via_encap = VertexFootprint(*vertex, layer, 0, std::nullopt);
+      if (!via_encap)
+        continue;
+      installed.vertices.push_back({vertex, direction});
+      installed.vertex_index.Insert(&installed.vertices.back(), *via_encap);
+    }
+  }
+}
+
 RoutingGrid::~RoutingGrid()  {
   // NOTE(aryap): The problem with doing this in ~RoutingGrid() explicitly is
   // that we can no longer rely on the ordered unwind of RoutingGrid's fields
@@ -546,16 +595,35 @@ RoutingGrid::~RoutingGrid()  {
   //
   // The reason we have to do it explicitly is because we're using raw
   // pointers, that we own. Oof.
+  auto start = std::chrono::steady_clock::now();
+  size_t num_vertices = vertices_.size();
+
   ClearAllBlockages();
 
-  for (auto entry : tracks_by_layer_) {
-    for (RoutingTrack *track : entry.second) {
-      delete track;
-    }
-  }
+  // Tracks (and with them all of their edges) are freed in bulk.
+  track_arena_.Clear();
   for (RoutingPath *path : paths_) { delete path; }
   for (RoutingEdge *edge : off_grid_edges_) { delete edge; }
-  for (RoutingVertex *vertex : vertices_) { delete vertex; }
+  for (RoutingVertex *vertex : vertices_) {
+    if (!vertex_arena_.Owns(vertex)) {
+      delete vertex;
+    }
+  }
+  vertex_arena_.Clear();
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  LOG_IF(INFO, num_vertices > 0)
+      << "RoutingGrid with " << num_vertices << " vertices destroyed in "
+      << elapsed.count() << " ms";
+}
+
+void RoutingGrid::DeleteVertex(RoutingVertex *vertex) {
+  if (vertex_arena_.Owns(vertex)) {
+    vertex_arena_.Delete(vertex);
+    return;
+  }
+  delete vertex;
 }
 
 // Return the (horizontal, vertical) routing infos.
@@ -761,32 +829,23 @@ absl::Status RoutingGrid::ConnectToSurroundingTracks(
       absl::NotFoundError(message);
 }
 
-absl::StatusOr<RoutingGrid::VertexWithLayer>
-RoutingGrid::AddAccessVerticesForPoint(
+namespace {
+
+bool NetsAreSubset(const EquivalentNets &subset,
+                   const EquivalentNets &superset) {
+  for (const std::string &net : subset.nets()) {
+    if (!superset.Contains(net))
+      return false;
+  }
+  return true;
+}
+
+}   // namespace
+
+std::vector<RoutingGrid::PinAccessOption> RoutingGrid::FindPinAccessOptions(
     const geometry::Point &point,
     const geometry::Layer &layer,
-    const EquivalentNets &for_nets,
-    const RoutingBlockageCache &blockage_cache) EXCLUDES(lock_) {
-  std::shared_lock mu(lock_);
-  // Add each of the possible on-grid access vertices for a given off-grid
-  // point to the RoutingGrid. For example, given an arbitrary point O, we must
-  // find the four nearest on-grid points A, B, C, D:
-  //
-  //        (A)
-  //     X   +       X           X
-  //      (2)| <-(1)
-  //  (B)+---O-------+
-  //         |  ^   (D)
-  //         |  (4)
-  //      (3)|
-  //     X   +       X           X
-  //        (C)
-  //
-  // If O lands on a grid column and/or row, we do not need to find a bridging
-  // vertex on that column/row.
-  //
-  // For each vertex (A, B, C, D) we create, we also have to add a bridging edge
-  // to the off-grid vertex (1, 2, 3, 4, respectively).
+    const EquivalentNets &for_nets) const REQUIRES_SHARED(lock_) {
   std::vector<std::pair<geometry::Layer, std::set<geometry::Layer>>>
       layer_access = physical_db_.FindReachableLayersByPinLayer(layer);
 
@@ -801,15 +860,7 @@ RoutingGrid::AddAccessVerticesForPoint(
     //layer_access = physical_db_.FindLayersReachableThroughOneViaFrom(layer);
   }
 
-  struct AccessOption {
-    std::optional<
-        std::reference_wrapper<const RoutingGridGeometry>> grid_geometry;
-    geometry::Layer target_layer;
-    geometry::Layer access_layer;
-    double total_via_cost;
-  };
-
-  std::vector<AccessOption> access_options;
+  std::vector<PinAccessOption> access_options;
 
   // Find usable RoutingGridGeometries (grids):
   for (const auto &entry : layer_access) {
@@ -827,81 +878,427 @@ RoutingGrid::AddAccessVerticesForPoint(
         continue;
       }
 
+      // The directions in which an off-grid vertex at the point could be
+      // accessed, as far as the grid itself is concerned.
+      RoutingVertex candidate(point);
+      candidate.AddConnectedLayer(target_layer);
+      candidate.AddConnectedLayer(access_layer);
+      std::set<RoutingTrackDirection> access_directions;
+      for (const RoutingTrackDirection &direction : {
+               RoutingTrackDirection::kTrackHorizontal,
+               RoutingTrackDirection::kTrackVertical}) {
+        absl::Status unblocked = ValidAgainstKnownBlockages(
+            candidate, for_nets, direction);
+        if (unblocked.ok()) {
+          unblocked = ValidAgainstInstalledPaths(
+              candidate, for_nets, direction);
+        }
+        if (unblocked.ok()) {
+          access_directions.insert(direction);
+        }
+      }
+
       for (const RoutingGridGeometry &grid_geometry : layer_grid_geometries) {
-        access_options.push_back(AccessOption {
-            .grid_geometry = grid_geometry,
+        access_options.push_back(PinAccessOption {
+            .grid_geometry = &grid_geometry,
             .target_layer = target_layer,
             .access_layer = access_layer,
-            .total_via_cost = *cost});
+            .total_via_cost = *cost,
+            .access_directions = access_directions});
       }
     }
   }
 
-  auto comparator = [](const AccessOption &lhs, const AccessOption &rhs) {
+  auto comparator = [](const PinAccessOption &lhs,
+                       const PinAccessOption &rhs) {
     return lhs.total_via_cost < rhs.total_via_cost;
   };
-  std::sort(access_options.begin(), access_options.end(), comparator);
+  std::stable_sort(access_options.begin(), access_options.end(), comparator);
+  return access_options;
+}
 
-  std::string error_message;
+void RoutingGrid::PrecomputePinAccess(const Layout &layout) {
+  geometry::PortSet ports = geometry::Port::MakePortSet();
+  layout.GetAllPorts(&ports);
+  PrecomputePinAccess(ports);
+}
 
-  // Now that our options are sorted by the via cost they would incur, iterate
-  // in increasing cost order until one of the options can accommodate the
-  // target point.
-  for (AccessOption &option : access_options) {
-    const geometry::Layer &target_layer = option.target_layer;
-    const geometry::Layer &access_layer = option.access_layer;
-    const RoutingGridGeometry &grid_geometry = option.grid_geometry->get();
+void RoutingGrid::PrecomputePinAccess(const geometry::PortSet &ports)
+    EXCLUDES(lock_) {
+  auto start = std::chrono::steady_clock::now();
+  std::shared_lock mu(lock_);
 
-    LOG(INFO) << "Access to " << point << " (layer " << target_layer
-              << ") from layer " << access_layer
-              << " possible through grid geometry " << &grid_geometry
-              << " with via cost " << option.total_via_cost;
+  // Ports often coincide, so each position and layer is only analysed once.
+  std::vector<const geometry::Port*> unique_ports;
+  std::set<std::pair<geometry::Point, geometry::Layer>> seen;
+  for (const geometry::Port *port : ports) {
+    if (seen.insert({port->centre(), port->layer()}).second) {
+      unique_ports.push_back(port);
+    }
+  }
 
-    // const objects are thread-compatible.
-    RoutingVertex *existing = grid_geometry.VertexAt(point);
-    if (existing) {
-      return {{existing, target_layer}};
+  auto nets_for_port = [](const geometry::Port &port) {
+    return port.net().empty() ? EquivalentNets() : EquivalentNets(port.net());
+  };
+
+  std::vector<std::vector<PinAccessOption>> results(unique_ports.size());
+  RunInParallel(unique_ports.size(), NumWorkerThreads(), [&](size_t i) {
+    const geometry::Port &port = *unique_ports[i];
+    results[i] = FindPinAccessOptions(
+        port.centre(), port.layer(), nets_for_port(port));
+  });
+
+  std::lock_guard pin_access_mu(pin_access_lock_);
+  for (size_t i = 0; i < unique_ports.size(); ++i) {
+    const geometry::Port &port = *unique_ports[i];
+    PinAccess &pin_access = pin_access_[{port.centre(), port.layer()}];
+    pin_access.nets = nets_for_port(port);
+    pin_access.options = std::move(results[i]);
+    pin_access.stale = false;
+  }
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  LOG(INFO) << "Analysed access to " << unique_ports.size() << " ports in "
+            << elapsed.count() << " ms";
+}
+
+size_t RoutingGrid::ApproximateMemoryUsage() const EXCLUDES(lock_) {
+  std::shared_lock mu(lock_);
+  // Each object is also found through a node or two in some tree-based index,
+  // which is about four pointers.
+  static constexpr size_t kIndexNodeSize = 4 * sizeof(void*);
+
+  size_t usage = vertices_.size() * (sizeof(RoutingVertex) + kIndexNodeSize);
+  usage += off_grid_edges_.size() * (sizeof(RoutingEdge) + kIndexNodeSize);
+  for (const auto &entry : tracks_by_layer_) {
+    for (const RoutingTrack *track : entry.second) {
+      usage += sizeof(RoutingTrack) +
+          track->edges().size() * (sizeof(RoutingEdge) + kIndexNodeSize);
     }
+  }
+  usage += rectangle_blockages_.size() * (
+      sizeof(RoutingGridBlockage<geometry::Rectangle>) + kIndexNodeSize);
+  usage += polygon_blockages_.size() * (
+      sizeof(RoutingGridBlockage<geometry::Polygon>) + kIndexNodeSize);
+  for (const RoutingPath *path : paths_) {
+    usage += sizeof(RoutingPath) +
+        (path->vertices().size() + path->edges().size()) * sizeof(void*);
+  }
+  return usage;
+}
 
-    std::unique_ptr<RoutingVertex> off_grid(new RoutingVertex(point));
-    off_grid->AddConnectedLayer(target_layer);
-    off_grid->AddConnectedLayer(access_layer);
-    // No need to set update_tracks_on_blockage for one-off, off-grid vertices.
+RoutingGrid::Statistics RoutingGrid::GetStatistics() const EXCLUDES(lock_) {
+  Statistics statistics;
+  {
+    std::shared_lock mu(lock_);
+    for (const auto &entry : num_vertices_by_layer_) {
+      statistics.layers[entry.first].num_vertices = entry.second;
+    }
+    for (const auto &entry : tracks_by_layer_) {
+      LayerStatistics &layer_statistics = statistics.layers[entry.first];
+      layer_statistics.num_tracks += entry.second.size();
+      for (const RoutingTrack *track : entry.second) {
+        layer_statistics.num_edges += track->edges().size();
+      }
+    }
+    for (const auto &entry : num_off_grid_edges_by_layer_) {
+      statistics.layers[entry.first].num_edges += entry.second;
+    }
+    statistics.num_paths = paths_.size();
+    statistics.total_wirelength = total_wirelength_;
+  }
+  // This takes the shared lock itself, and a second shared lock on the same
+  // thread could deadlock behind a waiting writer.
+  statistics.approximate_memory_usage = ApproximateMemoryUsage();
+  return statistics;
+}
 
-    std::set<RoutingTrackDirection> access_directions =
-        ValidAccessDirectionsForVertex(*off_grid, for_nets, blockage_cache);
-    if (access_directions.empty()) {
-      error_message = absl::StrCat(
-          error_message,
-          "; No valid access directions on layer ",
-          access_layer);
-      VLOG(15) << "Invalid off grid candidate at " << off_grid->centre();
-      continue;
+std::optional<geometry::Rectangle> RoutingGrid::GetBounds() const {
+  std::optional<geometry::Rectangle> bounds;
+  for (const auto &entry : routing_layer_info_) {
+    if (!bounds) {
+      bounds = entry.second.area();
+    } else {
+      bounds->ExpandToCover(entry.second.area());
     }
+  }
+  return bounds;
+}
 
-    mu.unlock();
-    std::unique_lock mu_write(lock_);
+std::vector<double> RoutingGrid::GetCongestionMap(
+    const geometry::Rectangle &area,
+    size_t num_columns,
+    size_t num_rows) const EXCLUDES(lock_) {
+  size_t num_regions = num_columns * num_rows;
+  if (num_regions == 0 || area.Width() == 0 || area.Height() == 0) {
+    return std::vector<double>(num_regions, 0.0);
+  }
+  // For each region, the number of vertices in it followed by the number of
+  // those that are unavailable.
+  std::vector<double> counts(2 * num_regions, 0.0);
+
+  auto region_of = [&](const geometry::Point &point) -> std::optional<size_t> {
+    if (!area.Intersects(point)) {
+      return std::nullopt;
+    }
+    // Points on the upper and right edges belong to the last region.
+    size_t column = std::min(
+        static_cast<size_t>(
+            (point.x() - area.lower_left().x()) * num_columns / area.Width()),
+        num_columns - 1);
+    size_t row = std::min(
+        static_cast<size_t>(
+            (point.y() - area.lower_left().y()) * num_rows / area.Height()),
+        num_rows - 1);
+    return row * num_columns + column;
+  };
 
-    // If ConnectToSurroundingTracks has any success, we move ownership of the
-    // off_grid vertex to the parent RoutingGrid.
-    //
-    if (!ConnectToSurroundingTracks(grid_geometry,
-                                    access_layer,
-                                    for_nets,
-                                    access_directions,
-                                    blockage_cache,
-                                    off_grid.get()).ok()) {
-      // TODO(aryap): Accumulate errors?
-      // The off-grid vertex could not be connected to any surrounding tracks.
-      mu_write.unlock();
-      mu.lock();
+  {
+    std::shared_lock mu(lock_);
+    const std::vector<RoutingVertexAvailability::TileCounts> &tiles =
+        vertex_availability_.tiles();
+    for (size_t i = 0; i < tiles.size(); ++i) {
+      if (tiles[i].num_vertices == 0) {
+        continue;
+      }
+      std::optional<size_t> region =
+          region_of(vertex_availability_.TileCentre(i));
+      if (!region) {
+        continue;
+      }
+      counts[2 * *region] += tiles[i].num_vertices;
+      counts[2 * *region + 1] += tiles[i].num_unavailable;
+    }
+  }
+
+  std::vector<double> utilisation(num_regions, 0.0);
+  for (size_t i = 0; i < num_regions; ++i) {
+    if (counts[2 * i] > 0.0) {
+      utilisation[i] = counts[2 * i + 1] / counts[2 * i];
+    }
+  }
+  return utilisation;
+}
+
+bool RoutingGrid::HasPinAccess(const geometry::Port &port) const {
+  std::lock_guard pin_access_mu(pin_access_lock_);
+  auto it = pin_access_.find({port.centre(), port.layer()});
+  return it != pin_access_.end() && !it->second.stale;
+}
+
+void RoutingGrid::InvalidatePinAccess(const geometry::Rectangle &region)
+    REQUIRES(lock_) {
+  std::lock_guard pin_access_mu(pin_access_lock_);
+  if (pin_access_.empty())
+    return;
+
+  // Access vertices connect to tracks up to two away, so anything within two
+  // pitches of the change might be affected.
+  geometry::Rectangle affected = region.WithPadding(pin_access_margin_);
+
+  // Entries are ordered by x, then y, then layer, so each column of entries
+  // inside the box is a contiguous run that can be found directly.
+  const geometry::Point &lower_left = affected.lower_left();
+  const geometry::Point &upper_right = affected.upper_right();
+  auto it = pin_access_.lower_bound(
+      {lower_left, std::numeric_limits<geometry::Layer>::min()});
+  while (it != pin_access_.end() &&
+         it->first.first.x() <= upper_right.x()) {
+    const int64_t x = it->first.first.x();
+    if (it->first.first.y() > upper_right.y()) {
+      // Skip to the next column.
+      it = pin_access_.lower_bound(
+          {geometry::Point(x + 1, lower_left.y()),
+           std::numeric_limits<geometry::Layer>::min()});
+      continue;
+    }
+    if (it->first.first.y() < lower_left.y()) {
+      it = pin_access_.lower_bound(
+          {geometry::Point(x, lower_left.y()),
+           std::numeric_limits<geometry::Layer>::min()});
       continue;
     }
+    it->second.stale = true;
+    ++it;
+  }
+}
+
+bool RoutingGrid::AccessVertexValidAgainst(
+    const RoutingVertex &vertex,
+    const EquivalentNets &for_nets,
+    const RoutingBlockageCache &blockage_cache) const REQUIRES_SHARED(lock_) {
+  // As when the vertex was made, it must be usable with a via oriented along
+  // at least one of the edges connecting it to the grid, and that edge must be
+  // usable too.
+  for (const RoutingEdge *edge : vertex.edges()) {
+    if (edge->Blocked() ||
+        !blockage_cache.ValidAgainstKnownBlockages(*edge, for_nets).ok()) {
+      continue;
+    }
+    if (blockage_cache.ValidAgainstKnownBlockages(
+            vertex, for_nets, edge->Direction()).ok()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+absl::StatusOr<RoutingGrid::VertexWithLayer>
+RoutingGrid::AddAccessVerticesForPoint(
+    const geometry::Point &point,
+    const geometry::Layer &layer,
+    const EquivalentNets &for_nets,
+    const RoutingBlockageCache &blockage_cache) EXCLUDES(lock_) {
+  std::shared_lock mu(lock_);
+  // Add each of the possible on-grid access vertices for a given off-grid
+  // point to the RoutingGrid. For example, given an arbitrary point O, we must
+  // find the four nearest on-grid points A, B, C, D:
+  //
+  //        (A)
+  //     X   +       X           X
+  //      (2)| <-(1)
+  //  (B)+---O-------+
+  //         |  ^   (D)
+  //         |  (4)
+  //      (3)|
+  //     X   +       X           X
+  //        (C)
+  //
+  // If O lands on a grid column and/or row, we do not need to find a bridging
+  // vertex on that column/row.
+  //
+  // For each vertex (A, B, C, D) we create, we also have to add a bridging edge
+  // to the off-grid vertex (1, 2, 3, 4, respectively).
+  //
+  // The options for doing so are found by FindPinAccessOptions, or taken from
+  // an earlier analysis of the same point (see PrecomputePinAccess).
+  const std::pair<geometry::Point, geometry::Layer> key = {point, layer};
+  std::vector<PinAccessOption> access_options;
+  bool from_analysis = false;
+  {
+    std::lock_guard pin_access_mu(pin_access_lock_);
+    auto it = pin_access_.find(key);
+    if (it != pin_access_.end()) {
+      const PinAccess &pin_access = it->second;
+      // An access vertex made for an earlier attempt, such as another of the
+      // candidate routes in AddBestRouteBetween, can be used again as long as
+      // no path has claimed it since and this route's temporary blockages
+      // don't get in the way.
+      if (pin_access.access_vertex &&
+          pin_access.access_vertex->vertex->Available() &&
+          pin_access.access_vertex_nets.nets() == for_nets.nets() &&
+          AccessVertexValidAgainst(
+              *pin_access.access_vertex->vertex, for_nets, blockage_cache)) {
+        return *pin_access.access_vertex;
+      }
+      if (!pin_access.stale && NetsAreSubset(pin_access.nets, for_nets)) {
+        access_options = pin_access.options;
+        from_analysis = true;
+      }
+    }
+  }
+  if (!from_analysis) {
+    access_options = FindPinAccessOptions(point, layer, for_nets);
+  }
+
+  std::string error_message;
+
+  // Now that our options are sorted by the via cost they would incur, iterate
+  // in increasing cost order until one of the options can accommodate the
+  // target point.
+  auto try_options = [&]() -> std::optional<VertexWithLayer> {
+    for (PinAccessOption &option : access_options) {
+      const geometry::Layer &target_layer = option.target_layer;
+      const geometry::Layer &access_layer = option.access_layer;
+      const RoutingGridGeometry &grid_geometry = *option.grid_geometry;
+
+      LOG(INFO) << "Access to " << point << " (layer " << target_layer
+                << ") from layer " << access_layer
+                << " possible through grid geometry " << &grid_geometry
+                << " with via cost " << option.total_via_cost;
+
+      // const objects are thread-compatible.
+      RoutingVertex *existing = grid_geometry.VertexAt(point);
+      if (existing) {
+        return {{existing, target_layer}};
+      }
+
+      std::unique_ptr<RoutingVertex> off_grid(new RoutingVertex(point));
+      off_grid->AddConnectedLayer(target_layer);
+      off_grid->AddConnectedLayer(access_layer);
+      // No need to set update_tracks_on_blockage for one-off, off-grid
+      // vertices.
+
+      // The directions valid against the grid are already known; those valid
+      // against the temporary blockages for this route are not.
+      std::set<RoutingTrackDirection> access_directions;
+      for (const RoutingTrackDirection &direction :
+               option.access_directions) {
+        if (blockage_cache.ValidAgainstKnownBlockages(
+                *off_grid, for_nets, direction).ok()) {
+          access_directions.insert(direction);
+        }
+      }
+      if (access_directions.empty()) {
+        error_message = absl::StrCat(
+            error_message,
+            "; No valid access directions on layer ",
+            access_layer);
+        VLOG(15) << "Invalid off grid candidate at " << off_grid->centre();
+        continue;
+      }
+
+      mu.unlock();
+      std::unique_lock mu_write(lock_);
 
-    RoutingVertex *vertex = off_grid.release();
+      // If ConnectToSurroundingTracks has any success, we move ownership of
+      // the off_grid vertex to the parent RoutingGrid.
+      //
+      if (!ConnectToSurroundingTracks(grid_geometry,
+                                      access_layer,
+                                      for_nets,
+                                      access_directions,
+                                      blockage_cache,
+                                      off_grid.get()).ok()) {
+        // TODO(aryap): Accumulate errors?
+        // The off-grid vertex could not be connected to any surrounding
+        // tracks.
+        mu_write.unlock();
+        mu.lock();
+        continue;
+      }
+
+      RoutingVertex *vertex = off_grid.release();
 
-    AddOffGridVertex(vertex);
-    return {{vertex, target_layer}};
+      AddOffGridVertex(vertex);
+
+      std::lock_guard pin_access_mu(pin_access_lock_);
+      auto it = pin_access_.find(key);
+      if (it == pin_access_.end()) {
+        it = pin_access_.insert(
+            {key, PinAccess{for_nets, {}, true, {}, {}}}).first;
+      }
+      if (it->second.access_vertex) {
+        pin_access_keys_by_vertex_.erase(it->second.access_vertex->vertex);
+      }
+      it->second.access_vertex = VertexWithLayer{vertex, target_layer};
+      pin_access_keys_by_vertex_[vertex] = key;
+      it->second.access_vertex_nets = for_nets;
+      return {{vertex, target_layer}};
+    }
+    return std::nullopt;
+  };
+
+  auto connection = try_options();
+  if (!connection && from_analysis) {
+    // The stored analysis might have been more conservative than necessary
+    // for these nets, so look again.
+    access_options = FindPinAccessOptions(point, layer, for_nets);
+    connection = try_options();
+  }
+  if (connection) {
+    return *connection;
   }
 
   return absl::NotFoundError(
@@ -996,7 +1393,8 @@ absl::StatusOr<RoutingVertex*> RoutingGrid::ConnectToNearestAvailableVertex(
     for (RoutingVertex *vertex : entry.second) {
       // Do not consider unavailable vertices! Unless they have connectable
       // nets!
-      if (!vertex->AvailableForNetsOnAnyLayer(for_nets)) {
+      if (!vertex_availability_.AvailableForNetsOnAnyLayer(
+              *vertex, for_nets)) {
         continue;
       }
       uint64_t vertex_cost = static_cast<uint64_t>(
@@ -1183,7 +1581,7 @@ absl::StatusOr<RoutingVertex*> RoutingGrid::ConnectToNearestAvailableVertex(
     // TODO(aryap): It's not clear if the off-grid edge will be legal. We have
     // to check with the whole grid.
 
-    off_grid_edges_.insert(edge);
+    AddOffGridEdge(edge);
     return off_grid_copy;
   }
   return absl::NotFoundError("");
@@ -1525,6 +1923,8 @@ absl::Status RoutingGrid::ConnectLayers(
   LOG(INFO) << "Drawing grid between layers " << horizontal_info.layer()
             << ", " << vertical_info.layer();
 
+  auto start = std::chrono::steady_clock::now();
+
   RoutingGridGeometry grid_geometry;
   grid_geometry.ComputeForLayers(horizontal_info, vertical_info);
 
@@ -1532,14 +1932,45 @@ absl::Status RoutingGrid::ConnectLayers(
   size_t num_x = 0;
   size_t num_y = 0;
 
-  std::map<int64_t, RoutingTrack*> vertical_tracks;
-  std::map<int64_t, RoutingTrack*> horizontal_tracks;
+  std::vector<std::vector<RoutingVertex*>> &vertices =
+      grid_geometry.vertices_by_grid_position();
 
-  // Generate tracks to hold edges and vertices in each direction.
+  // Find the grid positions inside keep-outs on either layer. No vertices are
+  // created there, and tracks with no vertices outside of them are not created
+  // at all.
+  bool any_keep_outs = !horizontal_info.keep_outs().empty() ||
+      !vertical_info.keep_outs().empty();
+  std::vector<std::vector<bool>> kept_out(
+      vertices.size(), std::vector<bool>(
+          vertices.empty() ? 0 : vertices.front().size(), false));
+  std::vector<bool> column_kept_out(kept_out.size(), any_keep_outs);
+  std::vector<bool> row_kept_out(
+      kept_out.empty() ? 0 : kept_out.front().size(), any_keep_outs);
+  if (any_keep_outs) {
+    for (size_t i = 0; i < kept_out.size(); ++i) {
+      for (size_t j = 0; j < kept_out[i].size(); ++j) {
+        geometry::Point point = grid_geometry.PointAt(i, j);
+        kept_out[i][j] = horizontal_info.IsKeptOut(point) ||
+            vertical_info.IsKeptOut(point);
+        if (!kept_out[i][j]) {
+          column_kept_out[i] = false;
+          row_kept_out[j] = false;
+        }
+      }
+    }
+  }
+
+  // Generate tracks to hold edges and vertices in each direction. Skipped
+  // tracks leave a nullptr in the RoutingGridGeometry's index.
+  size_t i = 0;
   for (int64_t x = grid_geometry.x_start();
        x <= grid_geometry.x_max();
        x += grid_geometry.x_pitch()) {
-    RoutingTrack *track = new RoutingTrack(
+    if (column_kept_out[i++]) {
+      grid_geometry.vertical_tracks_by_index().push_back(nullptr);
+      continue;
+    }
+    RoutingTrack *track = track_arena_.New(
         vertical_info.layer(),
         RoutingTrackDirection::kTrackVertical,
         grid_geometry.x_pitch(),
@@ -1549,16 +1980,23 @@ absl::Status RoutingGrid::ConnectLayers(
         vertical_info.min_separation(),
         x,
         use_linear_cost_model_);
-    vertical_tracks.insert({x, track});
+    for (const geometry::Rectangle &keep_out : vertical_info.keep_outs()) {
+      track->AddKeepOut(keep_out);
+    }
     grid_geometry.vertical_tracks_by_index().push_back(track);
     AddTrackToLayer(track, vertical_info.layer());
     num_x++;
   }
 
+  size_t j = 0;
   for (int64_t y = grid_geometry.y_start();
        y <= grid_geometry.y_max();
        y += grid_geometry.y_pitch()) {
-    RoutingTrack *track = new RoutingTrack(
+    if (row_kept_out[j++]) {
+      grid_geometry.horizontal_tracks_by_index().push_back(nullptr);
+      continue;
+    }
+    RoutingTrack *track = track_arena_.New(
         horizontal_info.layer(),
         RoutingTrackDirection::kTrackHorizontal,
         grid_geometry.y_pitch(),
@@ -1568,86 +2006,126 @@ absl::Status RoutingGrid::ConnectLayers(
         horizontal_info.min_separation(),
         y,
         use_linear_cost_model_);
-    horizontal_tracks.insert({y, track});
+    for (const geometry::Rectangle &keep_out : horizontal_info.keep_outs()) {
+      track->AddKeepOut(keep_out);
+    }
     grid_geometry.horizontal_tracks_by_index().push_back(track);
     AddTrackToLayer(track, horizontal_info.layer());
     num_y++;
   }
 
-  std::vector<std::vector<RoutingVertex*>> &vertices =
-      grid_geometry.vertices_by_grid_position();
-
-  // Generate a vertex at the intersection of every horizontal and vertical
-  // track.
-  size_t i = 0;
+  // All of the vertices for this layer pair go into a single contiguous slab,
+  // in the same order as their contextual indices. Allocating them is cheap, so
+  // it is done up front on this thread. There is a vertex at the intersection
+  // of every horizontal and vertical track, except where it would be kept out.
+  vertex_arena_.Reserve(num_x * num_y);
+  i = 0;
   for (int64_t x = grid_geometry.x_start();
        x <= grid_geometry.x_max();
-       x += grid_geometry.x_pitch()) {
-    // This (and the horizontal one) must exist by now, so we can make this
-    // fatal.
-    RoutingTrack *vertical_track = vertical_tracks.find(x)->second;
-    LOG_IF(FATAL, !vertical_track) << "Vertical routing track is nullptr";
-
-    size_t j = 0;
+       x += grid_geometry.x_pitch(), ++i) {
+    if (column_kept_out[i])
+      continue;
+    j = 0;
     for (int64_t y = grid_geometry.y_start();
          y <= grid_geometry.y_max();
-         y += grid_geometry.y_pitch()) {
-      RoutingTrack *horizontal_track = horizontal_tracks.find(y)->second;
-      LOG_IF(FATAL, !horizontal_track) << "Horizontal routing track is nullptr";
-
-      RoutingVertex *vertex = new RoutingVertex(geometry::Point(x, y));
-      // These methods will assign the respective horizontal_track and
-      // vertical_tracks of the vertex to the tracks themselves.
-      horizontal_track->AddVertex(vertex, blockage_cache);
-      vertical_track->AddVertex(vertex, blockage_cache);
-
+         y += grid_geometry.y_pitch(), ++j) {
+      if (kept_out[i][j])
+        continue;
+      RoutingVertex *vertex = vertex_arena_.New(geometry::Point(x, y));
       vertex->set_update_tracks_on_blockage(use_linear_cost_model_);
-
-      ++num_vertices;
       vertex->AddConnectedLayer(first);
       vertex->AddConnectedLayer(second);
-
-      AddVertex(vertex);
-
-      VLOG(20) << "Vertex created: " << vertex->centre() << " on layers: "
-               << absl::StrJoin(vertex->connected_layers(), ", ");
-
       vertex->set_grid_position_x(i);
       vertex->set_grid_position_y(j);
-
       vertices[i][j] = vertex;
+      ++num_vertices;
+    }
+  }
 
-      // Assign neighbours. Since we do the reciprocal relationship too, we
-      // assign up to all 8 neighbours per iteration.
-      if (i > 0) {
-        // Left neighbour.
-        RoutingVertex *neighbour = vertices[i - 1][j];
-        vertex->AddNeighbour(Compass::LEFT, neighbour);
-        neighbour->AddNeighbour(Compass::RIGHT, vertex);
-
-        if (j > 0) {
-          // Lower left neighbour.
-          RoutingVertex *neighbour = vertices[i - 1][j - 1];
-          vertex->AddNeighbour(Compass::LOWER_LEFT, neighbour);
-          neighbour->AddNeighbour(Compass::UPPER_RIGHT, vertex);
+  // Building the edges is the expensive part. Each track builds its own, but
+  // adding a vertex to a track also modifies the vertex (its edges and its
+  // horizontal or vertical track), so all of the horizontal tracks are done
+  // first and then all of the vertical ones. Within each pass every vertex
+  // belongs to exactly one track and so is only touched by one thread. Each
+  // track sees its vertices in the same order as it would if they were added
+  // one at a time.
+  size_t num_threads = NumWorkerThreads();
+  const std::vector<RoutingTrack*> &horizontal_tracks_by_index =
+      grid_geometry.horizontal_tracks_by_index();
+  RunInParallel(horizontal_tracks_by_index.size(), num_threads,
+                [&](size_t row) {
+    RoutingTrack *track = horizontal_tracks_by_index[row];
+    if (!track)
+      return;
+    for (size_t column = 0; column < vertices.size(); ++column) {
+      if (vertices[column][row]) {
+        track->AddVertex(vertices[column][row], blockage_cache);
+      }
+    }
+  });
+  const std::vector<RoutingTrack*> &vertical_tracks_by_index =
+      grid_geometry.vertical_tracks_by_index();
+  RunInParallel(vertical_tracks_by_index.size(), num_threads,
+                [&](size_t column) {
+    RoutingTrack *track = vertical_tracks_by_index[column];
+    if (!track)
+      return;
+    for (RoutingVertex *vertex : vertices[column]) {
+      if (vertex) {
+        track->AddVertex(vertex, blockage_cache);
+      }
+    }
+  });
+
+  // Assign neighbours. Every vertex only records its own, so columns can be
+  // done in parallel too. Neighbours might be missing if they were kept out, in
+  // which case AddNeighbour ignores them.
+  RunInParallel(vertices.size(), num_threads, [&](size_t column) {
+    size_t num_rows = vertices[column].size();
+    for (size_t row = 0; row < num_rows; ++row) {
+      RoutingVertex *vertex = vertices[column][row];
+      if (!vertex)
+        continue;
+      if (column > 0) {
+        vertex->AddNeighbour(Compass::LEFT, vertices[column - 1][row]);
+        if (row > 0) {
+          vertex->AddNeighbour(
+              Compass::LOWER_LEFT, vertices[column - 1][row - 1]);
         }
-
-        if (j < vertices[i].size() - 1) {
-          // Upper left neighbour.
-          RoutingVertex *neighbour = vertices[i - 1][j + 1];
-          vertex->AddNeighbour(Compass::UPPER_LEFT, neighbour);
-          neighbour->AddNeighbour(Compass::LOWER_RIGHT, vertex);
+        if (row < num_rows - 1) {
+          vertex->AddNeighbour(
+              Compass::UPPER_LEFT, vertices[column - 1][row + 1]);
+        }
+      }
+      if (column < vertices.size() - 1) {
+        vertex->AddNeighbour(Compass::RIGHT, vertices[column + 1][row]);
+        if (row > 0) {
+          vertex->AddNeighbour(
+              Compass::LOWER_RIGHT, vertices[column + 1][row - 1]);
+        }
+        if (row < num_rows - 1) {
+          vertex->AddNeighbour(
+              Compass::UPPER_RIGHT, vertices[column + 1][row + 1]);
         }
       }
-      if (j > 0) {
-        // Lower neighbour.
-        RoutingVertex *neighbour = vertices[i][j - 1];
-        vertex->AddNeighbour(Compass::LOWER, neighbour);
-        neighbour->AddNeighbour(Compass::UPPER, vertex);
+      if (row > 0) {
+        vertex->AddNeighbour(Compass::LOWER, vertices[column][row - 1]);
       }
-      j++;
+      if (row < num_rows - 1) {
+        vertex->AddNeighbour(Compass::UPPER, vertices[column][row + 1]);
+      }
+    }
+  });
+
+  // Finally, register the vertices with the grid in one pass, in order.
+  for (const auto &column : vertices) {
+    for (RoutingVertex *vertex : column) {
+      if (!vertex)
+        continue;
+      AddVertex(vertex);
+      VLOG(20) << "Vertex created: " << vertex->centre() << " on layers: "
+               << absl::StrJoin(vertex->connected_layers(), ", ");
     }
-    i++;
   }
 
   // This adds a copy of the object to our class's bookkeeping. It's kinda
@@ -1663,11 +2141,14 @@ absl::Status RoutingGrid::ConnectLayers(
     for (RoutingTrack *track : entry.second)
       num_edges += track->edges().size();
 
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
   LOG(INFO) << "Connected layer " << first << " and " << second << "; "
-            << "generated " << horizontal_tracks.size() << " horizontal and "
-            << vertical_tracks.size() << " vertical tracks, "
+            << "generated " << num_y << " horizontal and "
+            << num_x << " vertical tracks, "
             << num_vertices << " vertices and "
-            << num_edges << " edges.";
+            << num_edges << " edges in " << elapsed.count() << " ms.";
 
   if (VLOG_IS_ON(80)) {
     for (auto entry : tracks_by_layer_) {
@@ -1682,20 +2163,23 @@ absl::Status RoutingGrid::ConnectLayers(
 }
 
 bool RoutingGrid::ContainsVertex(RoutingVertex *vertex) const {
-  // Did you know? std::begin(...) and std::end(...) were introduced in C++11
-  // and have more general compatibility, such as with old C-style arrays.
-  return std::find(
-      vertices_.begin(), vertices_.end(), vertex) != vertices_.end();
+  // A vertex's contextual_index() is its position in vertices_, so we don't
+  // have to search for it.
+  size_t index = vertex->contextual_index();
+  return index < vertices_.size() && vertices_[index] == vertex;
 }
 
 void RoutingGrid::AddVertex(RoutingVertex *vertex) REQUIRES(lock_) {
   for (const geometry::Layer &layer : vertex->connected_layers()) {
     std::vector<RoutingVertex*> &available = GetAvailableVertices(layer);
     available.push_back(vertex);
+    ++num_vertices_by_layer_[layer];
   }
   DCHECK(!ContainsVertex(vertex));
   vertex->set_contextual_index(vertices_.size());
   vertices_.push_back(vertex);  // The class owns all of these.
+  vertex_availability_.Add(vertex);
+  InvalidateBlockageHits(*vertex);
 }
 
 void RoutingGrid::AddOffGridVertex(RoutingVertex *vertex) REQUIRES(lock_) {
@@ -1707,7 +2191,29 @@ void RoutingGrid::AddOffGridVertex(RoutingVertex *vertex) REQUIRES(lock_) {
 }
 
 void RoutingGrid::AddOffGridEdge(RoutingEdge *edge) REQUIRES(lock_) {
-  off_grid_edges_.insert(edge);
+  if (off_grid_edges_.insert(edge).second) {
+    ++num_off_grid_edges_by_layer_[edge->EffectiveLayer()];
+  }
+  InvalidateBlockageHits(*edge);
+}
+
+void RoutingGrid::InvalidateBlockageHits(const RoutingVertex &vertex) {
+  geometry::Rectangle region(vertex.centre(), vertex.centre());
+  for (const RoutingEdge *edge : vertex.edges()) {
+    region.ExpandToCover(
+        geometry::Rectangle(edge->first()->centre(), edge->first()->centre()));
+    region.ExpandToCover(
+        geometry::Rectangle(edge->second()->centre(),
+                            edge->second()->centre()));
+  }
+  blockage_hit_cache_.Invalidate(region);
+}
+
+void RoutingGrid::InvalidateBlockageHits(const RoutingEdge &edge) {
+  geometry::Rectangle region(edge.first()->centre(), edge.first()->centre());
+  region.ExpandToCover(
+      geometry::Rectangle(edge.second()->centre(), edge.second()->centre()));
+  blockage_hit_cache_.Invalidate(region);
 }
 
 absl::StatusOr<std::vector<RoutingPath*>> RoutingGrid::AddMultiPointRoute(
@@ -2161,6 +2667,8 @@ bool RoutingGrid::RemoveVertex(
     RoutingVertex *vertex,
     bool and_delete,
     const RoutingBlockageCache &blockage_cache) REQUIRES(lock_) {
+  InvalidateBlockageHits(*vertex);
+
   bool might_be_off_grid = false;
   if (vertex->horizontal_track()) {
     vertex->horizontal_track()->RemoveVertex(vertex, blockage_cache);
@@ -2175,6 +2683,16 @@ bool RoutingGrid::RemoveVertex(
 
   if (might_be_off_grid) {
     off_grid_vertices_.Erase(vertex);
+
+    std::lock_guard pin_access_mu(pin_access_lock_);
+    auto key_it = pin_access_keys_by_vertex_.find(vertex);
+    if (key_it != pin_access_keys_by_vertex_.end()) {
+      auto it = pin_access_.find(key_it->second);
+      if (it != pin_access_.end()) {
+        it->second.access_vertex.reset();
+      }
+      pin_access_keys_by_vertex_.erase(key_it);
+    }
   }
 
   // Check for instances of this vertex in off-grid edges:
@@ -2183,6 +2701,7 @@ bool RoutingGrid::RemoveVertex(
     if (edge->first() == vertex || edge->second() == vertex) {
       VLOG(10) << "Removing off-grid edge " << edge
                << " because it includes vertex " << vertex;
+      --num_off_grid_edges_by_layer_[edge->EffectiveLayer()];
       edge->PrepareForRemoval();
       delete edge;
       it = off_grid_edges_.erase(it);
@@ -2196,26 +2715,43 @@ bool RoutingGrid::RemoveVertex(
     if (it == available_vertices_by_layer_.end())
       continue;
     auto &available_vertices = it->second;
+    // The vertices we remove are usually off-grid vertices added recently for
+    // access to some point, so they are near the back.
     auto pos = std::find(
-        available_vertices.begin(), available_vertices.end(), vertex);
-    if (pos == available_vertices.end()) {
+        available_vertices.rbegin(), available_vertices.rend(), vertex);
+    if (pos == available_vertices.rend()) {
       // Already removed from availability list.
       continue;
     }
-    available_vertices.erase(pos);
+    // The order of this list breaks ties between equally good access
+    // candidates, so it has to be kept. Since the vertex is near the back,
+    // erasing it moves only a few others.
+    available_vertices.erase(std::next(pos).base());
   }
 
-  auto pos = std::find(vertices_.begin(), vertices_.end(), vertex);
-  LOG_IF(WARNING, pos == vertices_.end())
-      << "Did not find vertex we're removing in RoutingGrid list of "
-      << "vertices: " << vertex;
-  vertices_.erase(pos);
-  if (and_delete)
-    delete vertex;
-  // Re-assign indices to all vertices.
-  for (size_t i = 0; i < vertices_.size(); ++i) {
-    vertices_[i]->set_contextual_index(i);
+  if (!ContainsVertex(vertex)) {
+    LOG(WARNING) << "Did not find vertex we're removing in RoutingGrid list of "
+                 << "vertices: " << vertex;
+  } else {
+    // Swap the last vertex into the removed vertex's slot so that no other
+    // vertex has to be re-indexed.
+    for (const geometry::Layer &layer : vertex->connected_layers()) {
+      --num_vertices_by_layer_[layer];
+    }
+    size_t index = vertex->contextual_index();
+    size_t last_index = vertices_.size() - 1;
+    vertex_availability_.Erase(vertex);
+    if (index != last_index) {
+      RoutingVertex *last = vertices_[last_index];
+      vertices_[index] = last;
+      last->set_contextual_index(index);
+      vertex_availability_.Move(last_index, index);
+    }
+    vertices_.pop_back();
+    vertex->set_contextual_index(-1);
   }
+  if (and_delete)
+    DeleteVertex(vertex);
   return true; // TODO(aryap): Always returning true, huh...
 }
 
@@ -2386,7 +2922,12 @@ absl::Status RoutingGrid::InstallPath(
     RoutingPath *path,
     const RoutingBlockageCache &blockage_cache) EXCLUDES(lock_) {
   std::unique_lock mu(lock_);
+  return InstallPathUnderLock(path, blockage_cache);
+}
 
+absl::Status RoutingGrid::InstallPathUnderLock(
+    RoutingPath *path,
+    const RoutingBlockageCache &blockage_cache) REQUIRES(lock_) {
   if (path->Empty()) {
     return absl::InvalidArgumentError("Cannot install an empty path.");
   }
@@ -2489,14 +3030,26 @@ absl::Status RoutingGrid::InstallPath(
     }
   }
 
+  geometry::Rectangle installed_region(path->vertices().front()->centre(),
+                                       path->vertices().front()->centre());
   for (RoutingVertex *vertex : path->vertices()) {
     InstallVertexInPath(vertex, net, blockage_cache);
+    installed_region.ExpandToCover(
+        geometry::Rectangle(vertex->centre(), vertex->centre()));
   }
-  
-  paths_.push_back(path);
+  InvalidatePinAccess(installed_region);
+  IndexInstalledPath(*path);
+  AddInstalledPath(path);
   return absl::OkStatus();
 }
 
+void RoutingGrid::AddInstalledPath(RoutingPath *path) REQUIRES(lock_) {
+  for (const RoutingEdge *edge : path->edges()) {
+    total_wirelength_ += edge->Length();
+  }
+  paths_.push_back(path);
+}
+
 absl::StatusOr<RoutingPath*> RoutingGrid::ShortestPath(
     RoutingVertex *begin,
     RoutingVertex *end,
@@ -2637,10 +3190,13 @@ absl::StatusOr<RoutingPath*> RoutingGrid::ShortestPath(
   // Each vertex should have a contextual_index_ that defines its ordinal
   // position in the vertices_ vector, which is maintained by AddVertex and
   // RemoveVertex.
+  DCHECK(ContainsVertex(begin))
+      << "Start vertex " << *begin << " is not in the grid";
 
   // Prefer consistent C++/STLisms over e.g. bool seen[vertices_.size()];
-  std::vector<double> cost(vertices_.size());
-  std::vector<bool> seen(vertices_.size());
+  std::vector<double> cost(
+      vertices_.size(), std::numeric_limits<double>::max());
+  std::vector<bool> seen(vertices_.size(), false);
 
   // Records the edges to follow backward to the start, forming the shortest
   // path. If RoutingEdge* is nullptr then this is invalid. The index into this
@@ -2649,7 +3205,8 @@ absl::StatusOr<RoutingPath*> RoutingGrid::ShortestPath(
   // TODO(aryap): Apparently using pairs everywhere is bad style and I should
   // use structs:
   // https://google.github.io/styleguide/cppguide.html#Structs_vs._Classes
-  std::vector<std::pair<size_t, RoutingEdge*>> prev(vertices_.size());
+  std::vector<std::pair<size_t, RoutingEdge*>> prev(
+      vertices_.size(), {0, nullptr});
 
   // We want the lowest value at the back of the array. But in a priority_queue,
   // we want the highest value at the start of the collection so that the
@@ -2669,21 +3226,6 @@ absl::StatusOr<RoutingPath*> RoutingGrid::ShortestPath(
 
   cost[begin_index] = 0;
 
-  for (size_t i = 0; i < vertices_.size(); ++i) {
-    RoutingVertex *vertex = vertices_[i];
-    if (i != vertex->contextual_index()) {
-      std::stringstream ss;
-      ss << "Vertex " << i << " no longer matches its index "
-         << vertex->contextual_index();
-      return absl::InternalError(ss.str());
-    }
-    prev[i].second = nullptr;
-    if (i == begin_index)
-      continue;
-    cost[i] = std::numeric_limits<double>::max();
-    seen[i] = false;
-  }
-
   queue.push(begin);
   seen[begin_index] = true;
 
@@ -2863,6 +3405,8 @@ absl::StatusOr<RoutingPath*> RoutingGrid::ShortestPath(
 void RoutingGrid::ClearAllBlockages() {
   // Since these are vectors of unique_ptr, we just have to clear them to
   // invoke their destructors.
+  rectangle_blockage_index_.Clear();
+  polygon_blockage_index_.Clear();
   rectangle_blockages_.clear();
   polygon_blockages_.clear();
 }
@@ -2880,6 +3424,10 @@ RoutingGridBlockage<geometry::Rectangle> *RoutingGrid::AddBlockage(
   auto it = tracks_by_layer_.find(layer);
   if (it == tracks_by_layer_.end())
     return nullptr;
+  // As in AddBlockagesInBulk, shapes deep inside keep-outs can't affect
+  // anything.
+  if (IsEntirelyKeptOut(layer, rectangle, padding))
+    return nullptr;
 
   // TODO(aryap): RoutingTracks are equipped with min_separation, but
   // RoutingGridBlockages are not. padding is sometimes treated as a temporary
@@ -2931,7 +3479,7 @@ RoutingGridBlockage<geometry::Rectangle> *RoutingGrid::AddBlockage(
   // previously-applied blockages applied to them. That's why we don't add the
   // blockage to the list of known-blockages til last.
   ApplyBlockage(*blockage, is_temporary, blocked_vertices);
-  rectangle_blockages_.emplace_back(blockage);
+  RememberBlockage(blockage);
   return blockage;
 }
 
@@ -2941,6 +3489,8 @@ RoutingGridBlockage<geometry::Polygon> *RoutingGrid::AddBlockage(
     bool is_temporary,
     std::set<RoutingVertex*> *blocked_vertices) REQUIRES(lock_) {
   const geometry::Layer &layer = polygon.layer();
+  if (IsEntirelyKeptOut(layer, polygon.GetBoundingBox(), padding))
+    return nullptr;
 
   int64_t min_separation = physical_db_.Rules(layer).min_separation;
 
@@ -2953,7 +3503,7 @@ RoutingGridBlockage<geometry::Polygon> *RoutingGrid::AddBlockage(
   //
   // TODO(aryap): It would be easy and fast to limit the the tracks we iterate
   // over here to the window of possible conflicts, as we do with the
-  // RoutingVertexKDTree elsewhere.
+  // RoutingVertexSpatialIndex elsewhere.
   auto it = tracks_by_layer_.find(layer);
   if (it != tracks_by_layer_.end()) {
     if (is_temporary) {
@@ -2969,22 +3519,342 @@ RoutingGridBlockage<geometry::Polygon> *RoutingGrid::AddBlockage(
   }
 
   ApplyBlockage(*blockage, is_temporary, blocked_vertices);
-  polygon_blockages_.emplace_back(blockage);
+  RememberBlockage(blockage);
   return blockage;
 }
 
+namespace {
+
+// The tracks on one layer sorted by offset, so that the few a shape might
+// intersect can be found without testing all of them.
+class TracksByOffset {
+ public:
+  explicit TracksByOffset(const std::vector<RoutingTrack*> &tracks)
+      : max_reach_(0) {
+    entries_.reserve(tracks.size());
+    for (size_t i = 0; i < tracks.size(); ++i) {
+      RoutingTrack *track = tracks[i];
+      entries_.push_back({track->direction(), track->offset(), i, track});
+      max_reach_ = std::max(max_reach_, track->MaxTransverseReach());
+    }
+    std::sort(entries_.begin(), entries_.end(), &Entry::Less);
+  }
+
+  // The position of the box across the tracks, for grouping shapes that will
+  // hit the same tracks.
+  int64_t Across(const geometry::Rectangle &box) const {
+    if (entries_.empty() ||
+        entries_.front().direction ==
+            RoutingTrackDirection::kTrackVertical) {
+      return box.lower_left().x();
+    }
+    return box.lower_left().y();
+  }
+
+  // Appends to *tracks those tracks which a shape with the given bounding box
+  // and padding might intersect, in their original order. Any track not
+  // included definitely does not intersect.
+  void FindCandidates(const geometry::Rectangle &box,
+                      int64_t padding,
+                      std::vector<RoutingTrack*> *tracks) const {
+    std::vector<const Entry*> found;
+    for (RoutingTrackDirection direction : {
+             RoutingTrackDirection::kTrackHorizontal,
+             RoutingTrackDirection::kTrackVertical}) {
+      bool horizontal = direction == RoutingTrackDirection::kTrackHorizontal;
+      int64_t low = horizontal ? box.lower_left().y() : box.lower_left().x();
+      int64_t high = horizontal ?
+          box.upper_right().y() : box.upper_right().x();
+      Entry first = {direction, low - max_reach_ - padding, 0, nullptr};
+      Entry last = {direction, high + max_reach_ + padding, 0, nullptr};
+      auto begin = std::lower_bound(
+          entries_.begin(), entries_.end(), first, &Entry::Less);
+      auto end = std::upper_bound(
+          entries_.begin(), entries_.end(), last, &Entry::Less);
+      for (auto it = begin; it < end; ++it) {
+        found.push_back(&*it);
+      }
+    }
+    std::sort(found.begin(), found.end(), [](const Entry *lhs,
+                                             const Entry *rhs) {
+      return lhs->position < rhs->position;
+    });
+    for (const Entry *entry : found) {
+      tracks->push_back(entry->track);
+    }
+  }
+
+ private:
+  struct Entry {
+    static bool Less(const Entry &lhs, const Entry &rhs) {
+      return std::tie(lhs.direction, lhs.offset) <
+          std::tie(rhs.direction, rhs.offset);
+    }
+
+    RoutingTrackDirection direction;
+    int64_t offset;
+    // Position in the original list.
+    size_t position;
+    RoutingTrack *track;
+  };
+
+  std::vector<Entry> entries_;
+  int64_t max_reach_;
+};
+
+void AddPermanentBlockageToTrack(
+    RoutingTrack *track, const geometry::Rectangle &rectangle, int64_t padding) {
+  track->AddBlockage(rectangle, padding, rectangle.net(), nullptr, nullptr);
+}
+
+void AddPermanentBlockageToTrack(
+    RoutingTrack *track, const geometry::Polygon &polygon, int64_t padding) {
+  track->AddBlockage(polygon, padding, polygon.net());
+}
+
+}   // namespace
+
+void RoutingGrid::AddBlockagesInBulk(
+    const std::vector<const geometry::Rectangle*> &rectangles,
+    int64_t padding,
+    std::set<RoutingVertex*> *blocked_vertices) REQUIRES(lock_) {
+  // As in AddBlockage, rectangles on layers without tracks are ignored. So are
+  // those that can't affect anything because they are deep inside keep-outs.
+  std::vector<const geometry::Rectangle*> on_tracks;
+  on_tracks.reserve(rectangles.size());
+  for (const geometry::Rectangle *rectangle : rectangles) {
+    if (tracks_by_layer_.find(rectangle->layer()) != tracks_by_layer_.end() &&
+        !IsEntirelyKeptOut(rectangle->layer(), *rectangle, padding)) {
+      on_tracks.push_back(rectangle);
+    }
+  }
+  AddBlockagesInBulk<geometry::Rectangle>(
+      on_tracks, padding, blocked_vertices);
+}
+
+void RoutingGrid::AddBlockagesInBulk(
+    const std::vector<const geometry::Polygon*> &polygons,
+    int64_t padding,
+    std::set<RoutingVertex*> *blocked_vertices) REQUIRES(lock_) {
+  std::vector<const geometry::Polygon*> outside_keep_outs;
+  outside_keep_outs.reserve(polygons.size());
+  for (const geometry::Polygon *polygon : polygons) {
+    if (!IsEntirelyKeptOut(
+            polygon->layer(), polygon->GetBoundingBox(), padding)) {
+      outside_keep_outs.push_back(polygon);
+    }
+  }
+  AddBlockagesInBulk<geometry::Polygon>(
+      outside_keep_outs, padding, blocked_vertices);
+}
+
+bool RoutingGrid::IsEntirelyKeptOut(
+    const geometry::Layer &layer,
+    const geometry::Rectangle &bounding_box,
+    int64_t padding) const {
+  auto routing_layer_info = GetRoutingLayerInfo(layer);
+  if (!routing_layer_info || routing_layer_info->get().keep_outs().empty())
+    return false;
+
+  // A vertex or edge just outside the keep-out can still be blocked by a shape
+  // inside it, up to the width of the widest via encap or wire on the layer
+  // plus the minimum separation and padding.
+  int64_t margin = padding + GetMinSeparation(layer) + KeepOutReach(layer);
+  return routing_layer_info->get().IsKeptOut(
+      bounding_box.WithPadding(margin));
+}
+
+template<typename T>
+void RoutingGrid::AddBlockagesInBulk(
+    const std::vector<const T*> &shapes,
+    int64_t padding,
+    std::set<RoutingVertex*> *blocked_vertices) REQUIRES(lock_) {
+  if (shapes.empty()) {
+    return;
+  }
+
+  std::map<geometry::Layer, TracksByOffset> tracks_by_offset;
+  for (const auto &entry : tracks_by_layer_) {
+    tracks_by_offset.emplace(entry.first, TracksByOffset(entry.second));
+  }
+
+  // Sort the shapes by layer and then by their position across the tracks on
+  // that layer, and cut that list into stripes. Each stripe of shapes is
+  // prepared by one thread, and shapes within it will mostly be touching the
+  // same few tracks and vertices.
+  struct Key {
+    geometry::Layer layer;
+    int64_t across;
+    size_t index;
+  };
+  std::vector<Key> keys;
+  keys.reserve(shapes.size());
+  for (size_t i = 0; i < shapes.size(); ++i) {
+    const T &shape = *shapes[i];
+    auto it = tracks_by_offset.find(shape.layer());
+    geometry::Rectangle box = shape.GetBoundingBox();
+    int64_t across = it == tracks_by_offset.end() ?
+        box.lower_left().x() : it->second.Across(box);
+    keys.push_back({shape.layer(), across, i});
+  }
+  std::sort(keys.begin(), keys.end(), [](const Key &lhs, const Key &rhs) {
+    return std::tie(lhs.layer, lhs.across, lhs.index) <
+        std::tie(rhs.layer, rhs.across, rhs.index);
+  });
+
+  size_t num_threads = NumWorkerThreads();
+  // Several stripes per thread so that the work is evenly spread even if some
+  // stripes are much more expensive than others.
+  static constexpr size_t kStripesPerThread = 8;
+  size_t stripe_size = std::max(
+      size_t{1}, shapes.size() / (num_threads * kStripesPerThread));
+  size_t num_stripes = (shapes.size() + stripe_size - 1) / stripe_size;
+
+  std::vector<PendingBlockage<T>> pending(shapes.size());
+  RunInParallel(num_stripes, num_threads, [&](size_t stripe) {
+    std::vector<RoutingTrack*> candidate_tracks;
+    size_t end = std::min((stripe + 1) * stripe_size, keys.size());
+    for (size_t i = stripe * stripe_size; i < end; ++i) {
+      size_t index = keys[i].index;
+      const T &shape = *shapes[index];
+      candidate_tracks.clear();
+      auto it = tracks_by_offset.find(shape.layer());
+      if (it != tracks_by_offset.end()) {
+        it->second.FindCandidates(
+            shape.GetBoundingBox(), padding, &candidate_tracks);
+      }
+      PrepareBlockage(shape, padding, candidate_tracks, &pending[index]);
+    }
+  });
+
+  // Everything that changes the grid happens here, in the original order of
+  // the shapes.
+  std::set<const RoutingVertex*> new_vertices;
+  for (PendingBlockage<T> &blockage : pending) {
+    CommitBlockage(&blockage, padding, &new_vertices, blocked_vertices);
+  }
+}
+
+template<typename T>
+void RoutingGrid::PrepareBlockage(
+    const T &shape,
+    int64_t padding,
+    const std::vector<RoutingTrack*> &candidate_tracks,
+    PendingBlockage<T> *pending) const REQUIRES_SHARED(lock_) {
+  const geometry::Layer &layer = shape.layer();
+  pending->shape = &shape;
+  pending->blockage.reset(new RoutingGridBlockage<T>(
+      *this, shape, padding + GetMinSeparation(layer)));
+  pending->tracks = candidate_tracks;
+
+  // The rest mirrors ApplyBlockage.
+  auto routing_layer_info = GetRoutingLayerInfo(layer);
+  std::optional<RoutingTrackDirection> access_direction = std::nullopt;
+  if (routing_layer_info) {
+    access_direction = routing_layer_info->get().direction();
+  }
+
+  std::set<RoutingVertex*> blocked_off_grid = BlockingOffGridVertices(shape);
+  for (const RoutingGridGeometry &grid_geometry :
+           FindRoutingGridGeometriesUsingLayer(layer)) {
+    std::set<RoutingVertex*> vertices;
+    grid_geometry.EnvelopingVertices(shape, &vertices);
+    vertices.insert(blocked_off_grid.begin(), blocked_off_grid.end());
+
+    for (RoutingVertex *vertex : vertices) {
+      if (pending->hits.find(vertex) != pending->hits.end()) {
+        continue;
+      }
+      pending->hits[vertex] = TestBlockageAgainstOneVertex(
+          *pending->blockage, *vertex, access_direction);
+    }
+    pending->vertices_by_geometry.emplace_back(vertices.begin(),
+                                               vertices.end());
+  }
+}
+
+template<typename T>
+void RoutingGrid::CommitBlockage(
+    PendingBlockage<T> *pending,
+    int64_t padding,
+    std::set<const RoutingVertex*> *new_vertices,
+    std::set<RoutingVertex*> *blocked_vertices) REQUIRES(lock_) {
+  const T &shape = *pending->shape;
+  const geometry::Layer &layer = shape.layer();
+
+  for (RoutingTrack *track : pending->tracks) {
+    AddPermanentBlockageToTrack(track, shape, padding);
+  }
+
+  // The rest mirrors ApplyBlockage.
+  const RoutingGridBlockage<T> &blockage = *pending->blockage;
+  auto routing_layer_info = GetRoutingLayerInfo(layer);
+  std::optional<RoutingTrackDirection> access_direction = std::nullopt;
+  if (routing_layer_info) {
+    access_direction = routing_layer_info->get().direction();
+  }
+
+  std::vector<std::reference_wrapper<const RoutingGridGeometry>>
+      grid_geometries = FindRoutingGridGeometriesUsingLayer(layer);
+  DCHECK_EQ(grid_geometries.size(), pending->vertices_by_geometry.size());
+
+  for (size_t i = 0; i < grid_geometries.size(); ++i) {
+    const RoutingGridGeometry &grid_geometry = grid_geometries[i];
+    std::vector<RoutingVertex*> &vertices = pending->vertices_by_geometry[i];
+
+    // Off-grid vertices created for blockages committed before this one (or
+    // for this one, on a previous grid geometry) did not exist when the
+    // blockage was prepared.
+    if (!new_vertices->empty()) {
+      for (RoutingVertex *vertex : BlockingOffGridVertices(shape)) {
+        if (new_vertices->find(vertex) == new_vertices->end()) {
+          continue;
+        }
+        if (pending->hits.find(vertex) == pending->hits.end()) {
+          pending->hits[vertex] = TestBlockageAgainstOneVertex(
+              blockage, *vertex, access_direction);
+        }
+        vertices.push_back(vertex);
+      }
+      std::sort(vertices.begin(), vertices.end());
+      vertices.erase(std::unique(vertices.begin(), vertices.end()),
+                     vertices.end());
+    }
+
+    for (RoutingVertex *vertex : vertices) {
+      bool any_access;
+      ApplyVertexBlockageHit(
+          blockage, pending->hits[vertex], false, vertex, &any_access);
+      if (!any_access && blocked_vertices) {
+        blocked_vertices->insert(vertex);
+      }
+    }
+
+    if (shape.net() != "") {
+      AddOffGridVerticesForBlockage(
+          grid_geometry, blockage, false, new_vertices);
+    }
+  }
+
+  RememberBlockage(pending->blockage.release());
+}
+
 void RoutingGrid::ApplyExistingBlockages(
     RoutingVertex *vertex,
     bool is_temporary,
     std::optional<RoutingTrackDirection> access_direction) {
-  for (const auto &blockage : rectangle_blockages_) {
+  // Blockages further away than this have no effect on the vertex.
+  geometry::Rectangle search_box = BlockageSearchBox(*vertex);
+  for (auto *blockage :
+           rectangle_blockage_index_.FindOverlapping(search_box)) {
     ApplyBlockageToOneVertex(*blockage,
                              is_temporary,
                              vertex,
                              nullptr,
                              access_direction);
   }
-  for (const auto &blockage : polygon_blockages_) {
+  for (auto *blockage :
+           polygon_blockage_index_.FindOverlapping(search_box)) {
     ApplyBlockageToOneVertex(*blockage,
                              is_temporary,
                              vertex,
@@ -3019,11 +3889,62 @@ void RoutingGrid::ApplyBlockageToOneVertex(
     RoutingVertex *vertex,
     bool *any_access_out,
     std::optional<RoutingTrackDirection> access_direction) {
-  // Empty.
-  RoutingBlockageCache blockage_cache(*this);
+  VertexBlockageHit hit = TestBlockageAgainstOneVertex(
+      blockage, *vertex, access_direction);
+  ApplyVertexBlockageHit(blockage, hit, is_temporary, vertex, any_access_out);
+}
 
+template<typename T>
+RoutingGrid::VertexBlockageHit RoutingGrid::TestBlockageAgainstOneVertex(
+    const RoutingGridBlockage<T> &blockage,
+    const RoutingVertex &vertex,
+    std::optional<RoutingTrackDirection> access_direction) const {
   // TODO(aryap): Speed this up by returning early if the blockage is really far
   // from the vertex. Like > 2 pitches.
+  VertexBlockageHit hit;
+  // Check if the blockage overlaps the vertex completely:
+  if (blockage.IntersectsPoint(vertex.centre(), 0)) {
+    hit.intersects = true;
+    VLOG(16) << "Blockage: " << blockage.shape()
+             << " intersects " << vertex.centre()
+             << " with margin " << 0;
+    return hit;
+  }
+
+  // If it doesn't, check if there are viable directions the vertex can
+  // still be used in:
+  //
+  // NOTE(aryap): Yikes. This will make a copy of kAllDirections.
+  std::set<RoutingTrackDirection> test_directions = access_direction ?
+      std::set<RoutingTrackDirection>{*access_direction} :
+      RoutingTrackDirectionUtility::kAllDirections;
+
+  for (const auto &direction : test_directions) {
+    // We use the RoutingGridBlockage to do a hit test; set
+    // exceptional_nets = nullopt so that no exception is made.
+    if (blockage.Blocks(vertex, std::nullopt, direction)) {
+      ++hit.num_blocked_directions;
+      VLOG(16) << "Blockage: " << blockage.shape()
+               << " blocks " << vertex.centre()
+               << " with padding=" << blockage.padding() << " in "
+               << direction << " direction";
+      continue;
+    }
+    hit.available_directions.insert(direction);
+  }
+  return hit;
+}
+
+template<typename T>
+void RoutingGrid::ApplyVertexBlockageHit(
+    const RoutingGridBlockage<T> &blockage,
+    const VertexBlockageHit &hit,
+    bool is_temporary,
+    RoutingVertex *vertex,
+    bool *any_access_out) {
+  // Empty.
+  RoutingBlockageCache blockage_cache(*this);
+
   // TODO(aryap): Doesn't this need to be temporary and rewindable like all
   // the other effects of blockages?
   //
@@ -3037,10 +3958,9 @@ void RoutingGrid::ApplyBlockageToOneVertex(
   // rules for connecting to a vertex on that path when it was created,
   // don't we?
   const geometry::Layer &layer = blockage.shape().layer();
+  const std::string &net = blockage.shape().net();
   bool any_access = false;
-  // Check if the blockage overlaps the vertex completely:
-  if (blockage.IntersectsPoint(vertex->centre(), 0)) {
-    const std::string &net = blockage.shape().net();
+  if (hit.intersects) {
     if (net != "") {
       vertex->AddUsingNet(net, is_temporary, &blockage_cache, layer);
       // See note above.
@@ -3049,41 +3969,17 @@ void RoutingGrid::ApplyBlockageToOneVertex(
       // See note above.
       //vertex->SetForcedBlocked(true, is_temporary, &blockage_cache, layer);
     }
-    VLOG(16) << "Blockage: " << blockage.shape()
-             << " intersects " << vertex->centre()
-             << " with margin " << 0;
   } else {
-    // If it doesn't, check if there are viable directions the vertex can
-    // still be used in:
-    //
-    // NOTE(aryap): Yikes. This will make a copy of kAllDirections.
-    std::set<RoutingTrackDirection> test_directions = access_direction ?
-        std::set<RoutingTrackDirection>{*access_direction} :
-        RoutingTrackDirectionUtility::kAllDirections;
-
-    std::set<RoutingTrackDirection> available_directions;
-
-    const std::string &net = blockage.shape().net();
-    for (const auto &direction : test_directions) {
-      // We use the RoutingGridBlockage to do a hit test; set
-      // exceptional_nets = nullopt so that no exception is made.
-      if (blockage.Blocks(*vertex, std::nullopt, direction)) {
-        if (net != "") {
-          vertex->AddBlockingNet(net, is_temporary, &blockage_cache, layer);
-        }
-        VLOG(16) << "Blockage: " << blockage.shape()
-                 << " blocks " << vertex->centre()
-                 << " with padding=" << blockage.padding() << " in "
-                 << direction << " direction";
-        continue;
+    if (net != "") {
+      for (size_t i = 0; i < hit.num_blocked_directions; ++i) {
+        vertex->AddBlockingNet(net, is_temporary, &blockage_cache, layer);
       }
-      available_directions.insert(direction);
     }
-
-    if (available_directions.size() == 1) {
+    if (hit.available_directions.size() == 1) {
       any_access = true;
-      vertex->SetForcedEncapDirection(layer, *available_directions.begin());
-    } else if (available_directions.size() > 1) {
+      vertex->SetForcedEncapDirection(
+          layer, *hit.available_directions.begin());
+    } else if (hit.available_directions.size() > 1) {
       any_access = true;
     }
   }
@@ -3160,6 +4056,8 @@ absl::Status RoutingGrid::AddRoutingViaInfo(
     return absl::InvalidArgumentError(ss.str());
   }
   via_infos_[first][second] = info;
+  BuildViaStackTable();
+  UpdateSearchMargins();
   return absl::OkStatus();
 }
 
@@ -3197,6 +4095,14 @@ absl::Status RoutingGrid::AddRoutingLayerInfo(const RoutingLayerInfo &info) {
     return absl::InvalidArgumentError(ss.str());
   }
   routing_layer_info_.insert({layer, info});
+  UpdateSearchMargins();
+
+  // Congestion is counted in tiles about a pitch on a side.
+  int64_t min_pitch = info.pitch();
+  for (const auto &entry : routing_layer_info_) {
+    min_pitch = std::min(min_pitch, entry.second.pitch());
+  }
+  vertex_availability_.SetTiling(*GetBounds(), min_pitch, vertices_);
   return absl::OkStatus();
 }
 
@@ -3217,8 +4123,13 @@ const RoutingLayerInfo &RoutingGrid::GetRoutingLayerInfoOrDie(
 }
 
 int64_t RoutingGrid::FigureSearchWindowMargin() const {
+  return search_window_margin_;
+}
+
+void RoutingGrid::UpdateSearchMargins() {
   int64_t max_diameter = 0;
   int64_t min_separation = 0;
+  keep_out_reach_by_layer_.clear();
   for (const auto &outer : via_infos_) {
     auto maybe_outer_info = GetRoutingLayerInfo(outer.first);
     if (maybe_outer_info) {
@@ -3233,13 +4144,58 @@ int64_t RoutingGrid::FigureSearchWindowMargin() const {
       }
       max_diameter = std::max(
           max_diameter, inner.second.MaxEncapLength());
+      for (const geometry::Layer &layer : {outer.first, inner.first}) {
+        int64_t &reach = keep_out_reach_by_layer_[layer];
+        reach = std::max(reach, inner.second.MaxEncapSide());
+      }
     }
   }
-  return max_diameter / 2 + min_separation;
+  search_window_margin_ = max_diameter / 2 + min_separation;
+
+  max_wire_width_ = 0;
+  pin_access_margin_ = 0;
+  for (const auto &entry : routing_layer_info_) {
+    max_wire_width_ = std::max(max_wire_width_, entry.second.wire_width());
+    // Access vertices connect to tracks up to two away.
+    pin_access_margin_ = std::max(pin_access_margin_, 2 * entry.second.pitch());
+    int64_t &reach = keep_out_reach_by_layer_[entry.first];
+    reach = std::max(reach, entry.second.wire_width());
+  }
+}
+
+int64_t RoutingGrid::KeepOutReach(const geometry::Layer &layer) const {
+  auto it = keep_out_reach_by_layer_.find(layer);
+  return it == keep_out_reach_by_layer_.end() ? 0 : it->second;
+}
+
+geometry::Rectangle RoutingGrid::BlockageSearchBox(
+    const RoutingVertex &vertex) const {
+  int64_t margin = search_window_margin_;
+  const geometry::Point &centre = vertex.centre();
+  return geometry::Rectangle(centre - geometry::Point(margin, margin),
+                             centre + geometry::Point(margin, margin));
+}
+
+geometry::Rectangle RoutingGrid::BlockageSearchBox(
+    const RoutingEdge &edge) const {
+  int64_t margin = search_window_margin_ + max_wire_width_;
+  const geometry::Point &first = edge.first()->centre();
+  const geometry::Point &second = edge.second()->centre();
+  geometry::Point lower_left(std::min(first.x(), second.x()) - margin,
+                             std::min(first.y(), second.y()) - margin);
+  geometry::Point upper_right(std::max(first.x(), second.x()) + margin,
+                              std::max(first.y(), second.y()) + margin);
+  return geometry::Rectangle(lower_left, upper_right);
 }
 
 void RoutingGrid::AddTrackToLayer(
     RoutingTrack *track, const geometry::Layer &layer) {
+  // Edges the track creates and frees on its own, e.g. while healing around
+  // blocked vertices, change the grid as much as those made here.
+  track->set_on_edge_changed([this](const RoutingEdge &edge) {
+    InvalidateBlockageHits(edge);
+  });
+
   // Create the first vector of tracks.
   auto it = tracks_by_layer_.find(layer);
   if (it == tracks_by_layer_.end()) {
@@ -3523,30 +4479,93 @@ bool RoutingGrid::AreLayersConnectableByVia(
   return false;
 }
 
+void RoutingGrid::BuildViaStackTable() {
+  std::set<geometry::Layer> layers;
+  for (const auto &outer : via_infos_) {
+    layers.insert(outer.first);
+    for (const auto &inner : outer.second) {
+      layers.insert(inner.first);
+    }
+  }
+  via_stack_index_by_layer_.clear();
+  via_stacks_.clear();
+  num_via_stack_layers_ = layers.size();
+  if (layers.empty()) {
+    return;
+  }
+
+  via_stack_min_layer_ = *layers.begin();
+  via_stack_index_by_layer_.resize(*layers.rbegin() - via_stack_min_layer_ + 1,
+                                   -1);
+  std::vector<geometry::Layer> layers_by_index(layers.begin(), layers.end());
+  for (size_t i = 0; i < layers_by_index.size(); ++i) {
+    via_stack_index_by_layer_[layers_by_index[i] - via_stack_min_layer_] = i;
+  }
+
+  // The search is symmetric, so each unordered pair is only searched once.
+  via_stacks_.resize(num_via_stack_layers_ * num_via_stack_layers_);
+  for (size_t i = 0; i < num_via_stack_layers_; ++i) {
+    for (size_t j = i; j < num_via_stack_layers_; ++j) {
+      auto vias = PhysicalPropertiesDatabase::FindViaStackImpl(
+          layers_by_index[i],
+          layers_by_index[j],
+          [&](const geometry::Layer &layer) {
+            return LayersReachableByVia(layer);
+          },
+          [&](const geometry::Layer &lhs, const geometry::Layer &rhs) {
+            return GetRoutingViaInfoOrDie(lhs, rhs);
+          });
+      if (!vias)
+        continue;
+      double cost = 0.0;
+      for (const RoutingViaInfo &info : *vias) {
+        cost += info.cost();
+      }
+      via_stacks_[i * num_via_stack_layers_ + j] = ViaStack{*vias, cost};
+      via_stacks_[j * num_via_stack_layers_ + i] =
+          via_stacks_[i * num_via_stack_layers_ + j];
+    }
+  }
+}
+
+const RoutingGrid::ViaStack *RoutingGrid::LookUpViaStack(
+    const geometry::Layer &lhs, const geometry::Layer &rhs) const {
+  auto index = [&](const geometry::Layer &layer) -> int64_t {
+    if (layer < via_stack_min_layer_ ||
+        layer - via_stack_min_layer_ >=
+            static_cast<int64_t>(via_stack_index_by_layer_.size())) {
+      return -1;
+    }
+    return via_stack_index_by_layer_[layer - via_stack_min_layer_];
+  };
+  int64_t i = index(lhs);
+  int64_t j = index(rhs);
+  if (i < 0 || j < 0) {
+    return nullptr;
+  }
+  const std::optional<ViaStack> &stack =
+      via_stacks_[i * num_via_stack_layers_ + j];
+  return stack ? &*stack : nullptr;
+}
+
 std::optional<double> RoutingGrid::FindViaStackCost(
     const geometry::Layer &lhs, const geometry::Layer &rhs) const {
-  auto maybe_stack = FindViaStack(lhs, rhs);
-  if (!maybe_stack)
+  if (lhs == rhs)
+    return 0.0;
+  const ViaStack *stack = LookUpViaStack(lhs, rhs);
+  if (!stack)
     return std::nullopt;
-  const std::vector<RoutingViaInfo> &via_stack = *maybe_stack;
-  double total_cost = 0.0;
-  for (const RoutingViaInfo &info : via_stack) {
-    total_cost += info.cost();
-  }
-  return total_cost;
+  return stack->cost;
 }
 
 std::optional<std::vector<RoutingViaInfo>> RoutingGrid::FindViaStack(
     const geometry::Layer &lhs, const geometry::Layer &rhs) const {
-  return PhysicalPropertiesDatabase::FindViaStackImpl(
-      lhs,
-      rhs,
-      [&](const geometry::Layer &layer) {
-        return LayersReachableByVia(layer);
-      },
-      [&](const geometry::Layer &lhs, const geometry::Layer &rhs) {
-        return GetRoutingViaInfoOrDie(lhs, rhs);
-      });
+  if (lhs == rhs)
+    return std::vector<RoutingViaInfo>();
+  const ViaStack *stack = LookUpViaStack(lhs, rhs);
+  if (!stack)
+    return std::nullopt;
+  return stack->vias;
 }
 
 // This is actually our first sketch of a DRC check.
@@ -3693,10 +4712,48 @@ void RoutingGrid::ApplyDumbHackToPatchNearbyVerticesOnSameNetButDifferentLayer(
   }
 }
 
+std::vector<std::pair<size_t, size_t>> RoutingGrid::ExportChunks() const {
+  // Paths are converted independently of each other, apart from reading the
+  // (fixed) state of the vertices they share, so they can be split into
+  // contiguous runs for separate threads. Each thread gets a few runs so that
+  // a handful of long paths don't hold everything up.
+  static constexpr size_t kChunksPerThread = 4;
+  size_t num_chunks = std::min(
+      paths_.size(), NumWorkerThreads() * kChunksPerThread);
+  std::vector<std::pair<size_t, size_t>> chunks;
+  for (size_t i = 0; i < num_chunks; ++i) {
+    chunks.emplace_back(paths_.size() * i / num_chunks,
+                        paths_.size() * (i + 1) / num_chunks);
+  }
+  return chunks;
+}
+
+PolyLineCell *RoutingGrid::CreatePolyLineCell(size_t begin, size_t end) const {
+  std::unique_ptr<PolyLineCell> cell(new PolyLineCell());
+  for (size_t i = begin; i < end; ++i) {
+    paths_[i]->ToPolyLinesAndVias(&cell->poly_lines(), &cell->vias());
+  }
+  return cell.release();
+}
+
 PolyLineCell *RoutingGrid::CreatePolyLineCell() const {
+  std::vector<std::pair<size_t, size_t>> chunks = ExportChunks();
+  std::vector<std::unique_ptr<PolyLineCell>> chunk_cells(chunks.size());
+  RunInParallel(chunks.size(), NumWorkerThreads(), [&](size_t i) {
+    chunk_cells[i].reset(
+        CreatePolyLineCell(chunks[i].first, chunks[i].second));
+  });
+
+  // Concatenating the chunks in order gives exactly what converting the paths
+  // one after the other would have.
   std::unique_ptr<PolyLineCell> cell(new PolyLineCell());
-  for (RoutingPath *path : paths_) {
-    path->ToPolyLinesAndVias(&cell->poly_lines(), &cell->vias());
+  for (auto &chunk_cell : chunk_cells) {
+    std::move(chunk_cell->poly_lines().begin(),
+              chunk_cell->poly_lines().end(),
+              std::back_inserter(cell->poly_lines()));
+    std::move(chunk_cell->vias().begin(),
+              chunk_cell->vias().end(),
+              std::back_inserter(cell->vias()));
   }
 
   //ApplyDumbHackToPatchNearbyVerticesOnSameNetButDifferentLayer(cell.get());
@@ -3705,13 +4762,34 @@ PolyLineCell *RoutingGrid::CreatePolyLineCell() const {
 }
 
 Layout *RoutingGrid::GenerateLayout() const {
+  auto start = std::chrono::steady_clock::now();
+
+  // Each chunk of paths is converted and inflated into its own Layout, and the
+  // Layouts are merged at the end. The chunks are the unit of parallelism, so
+  // each is inflated on its own thread; they share one inflator so that shapes
+  // memoised for one chunk are reused by the others.
+  std::vector<std::pair<size_t, size_t>> chunks = ExportChunks();
+  std::vector<std::unique_ptr<Layout>> chunk_layouts(chunks.size());
   PolyLineInflator inflator(physical_db_);
-  std::unique_ptr<PolyLineCell> grid_lines(CreatePolyLineCell());
-  std::unique_ptr<bfg::Layout> grid_layout(
-      inflator.Inflate(*this, *grid_lines));
+  RunInParallel(chunks.size(), NumWorkerThreads(), [&](size_t i) {
+    std::unique_ptr<PolyLineCell> grid_lines(
+        CreatePolyLineCell(chunks[i].first, chunks[i].second));
+    chunk_layouts[i].reset(inflator.Inflate(*this, *grid_lines, 1));
+  });
+
+  std::unique_ptr<bfg::Layout> grid_layout(new Layout(physical_db_));
+  for (const auto &chunk_layout : chunk_layouts) {
+    grid_layout->AddLayout(*chunk_layout);
+  }
   for (const std::string &net : global_nets_) {
     grid_layout->AddGlobalNet(net);
   }
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  LOG_IF(INFO, !paths_.empty())
+      << "Exported " << paths_.size() << " paths in " << chunks.size()
+      << " chunks in " << elapsed.count() << " ms";
   return grid_layout.release();
 }
 
@@ -3739,6 +4817,9 @@ absl::Status RoutingGrid::AddRoutingGridGeometry(
     return absl::InvalidArgumentError(ss.str());
   }
   grid_geometry_by_layers_[first][second] = grid_geometry;
+
+  // Hit-tests against the old set of geometries are no longer useful.
+  blockage_hit_cache_.Clear();
   return absl::OkStatus();
 }
 
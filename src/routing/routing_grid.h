@@ -4,6 +4,8 @@
 #include <deque>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <shared_mutex>
@@ -22,14 +24,18 @@
 #include "../layout.h"
 #include "../physical_properties_database.h"
 #include "../poly_line_cell.h"
+#include "routing_blockage_hit_cache.h"
+#include "routing_blockage_index.h"
 #include "routing_edge.h"
 #include "routing_grid_geometry.h"
 #include "routing_grid_blockage.h"
 #include "routing_layer_info.h"
+#include "routing_object_arena.h"
 #include "routing_track.h"
 #include "routing_track_blockage.h"
 #include "routing_vertex.h"
-#include "routing_vertex_kd_tree.h"
+#include "routing_vertex_availability.h"
+#include "routing_vertex_spatial_index.h"
 #include "routing_via_info.h"
 
 // Placeholder thread-safety annotations in case a supporting compiler is not
@@ -105,7 +111,13 @@ class RoutingGrid {
   RoutingGrid(
       const PhysicalPropertiesDatabase &physical_db)
       : physical_db_(physical_db),
-        use_linear_cost_model_(false) {}
+        via_stack_min_layer_(0),
+        num_via_stack_layers_(0),
+        search_window_margin_(0),
+        max_wire_width_(0),
+        pin_access_margin_(0),
+        use_linear_cost_model_(false),
+        total_wirelength_(0.0) {}
 
   ~RoutingGrid();
 
@@ -183,6 +195,20 @@ class RoutingGrid {
       const EquivalentNets &usable_nets,
       const geometry::ShapeCollection &avoid);
 
+  // Works out how each of the given ports can reach the grid: the layers,
+  // grid geometries and access directions that would be tried, in order of
+  // via cost, when a route starts or ends at the port. This doesn't change the
+  // grid, so it is done in parallel with up to --jobs threads.
+  //
+  // Routes to and from the ports then start from the stored analysis, and
+  // reuse the access vertex made for a port on any earlier attempt. Analyses
+  // near new blockages and installed paths are redone when next needed.
+  void PrecomputePinAccess(const geometry::PortSet &ports);
+  void PrecomputePinAccess(const Layout &layout);
+
+  // Whether there is an up-to-date pin-access analysis for the port.
+  bool HasPinAccess(const geometry::Port &port) const;
+
   void AddVertex(RoutingVertex *vertex);
 
   void AddOffGridVertex(RoutingVertex *vertex);
@@ -201,8 +227,13 @@ class RoutingGrid {
   }
 
   // Caller takes ownership.
+  //
+  // Paths are converted in parallel (with up to --jobs threads), but the
+  // result is the same as converting them one at a time, in order.
   PolyLineCell *CreatePolyLineCell() const;
 
+  // As above, paths are converted and inflated in parallel, into a Layout per
+  // chunk of paths, and these are merged into the result.
   Layout *GenerateLayout() const;
   // Generates the layout and adds it to the given layout:
   void ExportToLayout(
@@ -225,17 +256,50 @@ class RoutingGrid {
       bool is_temporary = false,
       std::set<RoutingVertex*> *changed_out = nullptr) {
     std::unique_lock mu(lock_);
-    for (const auto &rectangle : shapes.rectangles()) {
-      AddBlockage(*rectangle, padding, is_temporary, changed_out);
-    }
-    for (const auto &polygon : shapes.polygons()) {
-      AddBlockage(*polygon, padding, is_temporary, changed_out);
+    if (is_temporary) {
+      for (const auto &rectangle : shapes.rectangles()) {
+        AddBlockage(*rectangle, padding, is_temporary, changed_out);
+      }
+      for (const auto &polygon : shapes.polygons()) {
+        AddBlockage(*polygon, padding, is_temporary, changed_out);
+      }
+    } else {
+      // Permanent blockages are hit-tested in bulk.
+      std::vector<const geometry::Rectangle*> rectangles;
+      rectangles.reserve(shapes.rectangles().size());
+      for (const auto &rectangle : shapes.rectangles()) {
+        rectangles.push_back(&*rectangle);
+      }
+      AddBlockagesInBulk(rectangles, padding, changed_out);
+
+      std::vector<const geometry::Polygon*> polygons;
+      polygons.reserve(shapes.polygons().size());
+      for (const auto &polygon : shapes.polygons()) {
+        polygons.push_back(&*polygon);
+      }
+      AddBlockagesInBulk(polygons, padding, changed_out);
     }
     for (const auto &port : shapes.ports()) {
       AddBlockage(*port, padding);
     }
   }
 
+  // Equivalent to calling AddBlockage(shape, padding, false, blocked_vertices)
+  // for each of the shapes in turn, but faster. The parts of that work which
+  // only read the grid (finding the tracks and vertices each blockage could
+  // affect and hit-testing it against the latter) are done for all the shapes
+  // first, in parallel (up to --jobs threads), with the shapes grouped by layer
+  // and by where they fall across the tracks on that layer. The results are
+  // then applied to the grid serially, in the original order.
+  void AddBlockagesInBulk(
+      const std::vector<const geometry::Rectangle*> &rectangles,
+      int64_t padding = 0,
+      std::set<RoutingVertex*> *blocked_vertices = nullptr);
+  void AddBlockagesInBulk(
+      const std::vector<const geometry::Polygon*> &polygons,
+      int64_t padding = 0,
+      std::set<RoutingVertex*> *blocked_vertices = nullptr);
+
   RoutingGridBlockage<geometry::Rectangle> *AddBlockage(
       const geometry::Rectangle &rectangle,
       int64_t padding = 0,
@@ -501,10 +565,64 @@ class RoutingGrid {
   // be detected. If it is too large, we will waste cycles.
   int64_t FigureSearchWindowMargin() const;
 
+  // Blockages are indexed by their bounding boxes padded by their own padding
+  // (see RoutingGridBlockage::PaddedBoundingBox). These are the boxes that
+  // must be searched for such blockages to find all those that could
+  // possibly block the given vertex or edge: they cover the biggest via
+  // footprint at the vertex or at either end of the edge, and the widest wire.
+  geometry::Rectangle BlockageSearchBox(const RoutingVertex &vertex) const;
+  geometry::Rectangle BlockageSearchBox(const RoutingEdge &edge) const;
+
   int64_t GetMinSeparation(const geometry::Layer &layer) const {
     return physical_db_.Rules(layer).min_separation;
   }
 
+  // A rough estimate of the memory held by the grid's own objects (vertices,
+  // edges, tracks, blockages and paths) and the containers indexing them, for
+  // budgeting. Shapes and net names are not counted.
+  size_t ApproximateMemoryUsage() const;
+
+  struct LayerStatistics {
+    // Vertices are counted on every layer they connect to, so vias count on
+    // both.
+    size_t num_vertices = 0;
+    // Edges are counted on their EffectiveLayer(), off-grid edges included.
+    size_t num_edges = 0;
+    size_t num_tracks = 0;
+  };
+
+  struct Statistics {
+    std::map<geometry::Layer, LayerStatistics> layers;
+    size_t num_paths = 0;
+    // The sum of the lengths of the edges in all installed paths.
+    double total_wirelength = 0.0;
+    size_t approximate_memory_usage = 0;
+  };
+
+  // Only takes the grid's shared lock, so it can be polled while routing is
+  // in progress. The result may then be slightly stale. The counts are kept up
+  // to date as the grid changes, so this only visits each track and path.
+  Statistics GetStatistics() const;
+
+  // The smallest rectangle covering the area of every routing layer, if there
+  // are any.
+  std::optional<geometry::Rectangle> GetBounds() const;
+
+  // Divides area into a grid of num_columns x num_rows regions and gives, for
+  // each, the fraction of the vertices in it that are used or blocked. Regions
+  // are listed row by row, starting from the lower left; empty regions have
+  // utilisation 0.
+  //
+  // The map is made from the per-tile counts kept by vertex_availability_ (see
+  // RoutingVertexAvailability::SetTiling), not from the vertices themselves,
+  // so it costs one pass over the tiles whatever the size of the grid. Each
+  // tile is placed in a region by its centre, so region boundaries are only as
+  // accurate as the tiles, which are about a routing pitch on a side on small
+  // grids and at most 1/1024th of the grid on large ones.
+  std::vector<double> GetCongestionMap(const geometry::Rectangle &area,
+                                       size_t num_columns,
+                                       size_t num_rows) const;
+
   const std::vector<RoutingPath*> &paths() const { return paths_; }
   const std::set<RoutingEdge*> &off_grid_edges() const {
     return off_grid_edges_;
@@ -531,10 +649,20 @@ class RoutingGrid {
     return grid_geometry_by_layers_;
   }
 
-  const RoutingVertexKDTree &off_grid_vertices() const {
+  const RoutingVertexSpatialIndex &off_grid_vertices() const {
     return off_grid_vertices_;
   }
 
+  const RoutingVertexAvailability &vertex_availability() const {
+    return vertex_availability_;
+  }
+
+  // Shared by every RoutingBlockageCache on this grid. It is internally
+  // synchronised, so it is available from const grids too.
+  RoutingBlockageHitCache &blockage_hit_cache() const {
+    return blockage_hit_cache_;
+  }
+
  private:
   struct CostedVertex {
     uint64_t cost;
@@ -547,6 +675,50 @@ class RoutingGrid {
     geometry::Layer layer;
   };
 
+  // One way for a port to reach the grid.
+  struct PinAccessOption {
+    const RoutingGridGeometry *grid_geometry;
+    geometry::Layer target_layer;
+    geometry::Layer access_layer;
+    double total_via_cost;
+    // The access directions that are valid against the grid's own blockages
+    // and installed paths. Temporary blockages are checked at use.
+    std::set<RoutingTrackDirection> access_directions;
+  };
+
+  struct PinAccess {
+    // The nets that were allowed near the port when it was analysed. The
+    // analysis is conservative for any superset of these.
+    EquivalentNets nets;
+    // In increasing order of via cost.
+    std::vector<PinAccessOption> options;
+    // Set when something has changed near the port since it was analysed.
+    bool stale;
+    // The off-grid vertex last made to access the port, if it still exists,
+    // and the nets it was connected for.
+    std::optional<VertexWithLayer> access_vertex;
+    EquivalentNets access_vertex_nets;
+  };
+
+  // A vertex at the end of an installed edge, and the direction of that edge,
+  // which orients its via encap.
+  struct InstalledVertex {
+    const RoutingVertex *vertex;
+    RoutingTrackDirection direction;
+  };
+
+  // The footprints of installed paths on one layer. See
+  // ValidAgainstInstalledPaths.
+  struct InstalledFootprints {
+    // Keyed by EdgeWireFootprint.
+    RoutingBlockageIndex<const RoutingEdge> edge_index;
+    // Keyed by the undirected via footprint on the layer, which covers the
+    // footprint in either direction.
+    RoutingBlockageIndex<const InstalledVertex> vertex_index;
+    // Owns the InstalledVertex entries in vertex_index.
+    std::deque<InstalledVertex> vertices;
+  };
+
   struct TemporaryBlockageInfo {
     std::vector<RoutingGridBlockage<geometry::Rectangle>*> pin_blockages;
     std::set<RoutingVertex*> blocked_vertices;
@@ -564,6 +736,87 @@ class RoutingGrid {
       bool *any_access = nullptr,
       std::optional<RoutingTrackDirection> access_direction = std::nullopt);
 
+  // The result of hit-testing a blockage against a vertex, which is everything
+  // ApplyBlockageToOneVertex needs to know to then mutate the vertex.
+  struct VertexBlockageHit {
+    // The blockage covers the vertex's centre.
+    bool intersects = false;
+    // Otherwise, the number of tested access directions that are blocked and
+    // those that are still available.
+    size_t num_blocked_directions = 0;
+    std::set<RoutingTrackDirection> available_directions;
+  };
+
+  // Takes ownership of the blockage and adds it to the list of known
+  // blockages. The opposite of ForgetBlockage.
+  template <typename T>
+  void RememberBlockage(RoutingGridBlockage<T> *blockage);
+
+  // A permanent blockage that has been hit-tested against the grid but not yet
+  // applied to it. See AddBlockagesInBulk.
+  template<typename T>
+  struct PendingBlockage {
+    const T *shape = nullptr;
+    // nullptr if the shape should be ignored.
+    std::unique_ptr<RoutingGridBlockage<T>> blockage;
+    // Tracks on the shape's layer it could intersect, in the order given in
+    // tracks_by_layer_.
+    std::vector<RoutingTrack*> tracks;
+    // The vertices the blockage could affect for each of the
+    // RoutingGridGeometrys using its layer (in the order given by
+    // FindRoutingGridGeometriesUsingLayer), sorted as they would be in a
+    // std::set.
+    std::vector<std::vector<RoutingVertex*>> vertices_by_geometry;
+    std::map<RoutingVertex*, VertexBlockageHit> hits;
+  };
+
+  // ApplyBlockageToOneVertex is TestBlockageAgainstOneVertex, which only reads,
+  // followed by ApplyVertexBlockageHit, which does the writing.
+  template<typename T>
+  VertexBlockageHit TestBlockageAgainstOneVertex(
+      const RoutingGridBlockage<T> &blockage,
+      const RoutingVertex &vertex,
+      std::optional<RoutingTrackDirection> access_direction) const;
+  template<typename T>
+  void ApplyVertexBlockageHit(
+      const RoutingGridBlockage<T> &blockage,
+      const VertexBlockageHit &hit,
+      bool is_temporary,
+      RoutingVertex *vertex,
+      bool *any_access = nullptr);
+
+  template<typename T>
+  void AddBlockagesInBulk(
+      const std::vector<const T*> &shapes,
+      int64_t padding,
+      std::set<RoutingVertex*> *blocked_vertices);
+
+  // True if a shape with the given bounding box on the given layer is so far
+  // inside one of the layer's keep-outs that, with padding, it can't reach any
+  // vertex or edge of the grid.
+  bool IsEntirelyKeptOut(const geometry::Layer &layer,
+                         const geometry::Rectangle &bounding_box,
+                         int64_t padding) const;
+
+  // Does the read-only part of AddBlockage for a single shape. Safe to call
+  // from multiple threads at once.
+  template<typename T>
+  void PrepareBlockage(
+      const T &shape,
+      int64_t padding,
+      const std::vector<RoutingTrack*> &candidate_tracks,
+      PendingBlockage<T> *pending) const;
+
+  // Does the rest. Off-grid vertices made by earlier commits in the same bulk
+  // add are collected in new_vertices. They did not exist when PrepareBlockage
+  // was called, so they are checked here.
+  template<typename T>
+  void CommitBlockage(
+      PendingBlockage<T> *pending,
+      int64_t padding,
+      std::set<const RoutingVertex*> *new_vertices,
+      std::set<RoutingVertex*> *blocked_vertices);
+
   // Gathers on-grid vertices and off-grid vertices within a given radius,
   // where the radius is given by the number of horizontal/vertical pitches on
   // on the routing grid geometry. Blockages are checked on the layer() of the
@@ -575,7 +828,8 @@ class RoutingGrid {
   void AddOffGridVerticesForBlockage(
       const RoutingGridGeometry &grid_geometry,
       const RoutingGridBlockage<T> &blockage,
-      bool is_temporary);
+      bool is_temporary,
+      std::set<const RoutingVertex*> *added_vertices = nullptr);
 
   std::set<RoutingVertex*> BlockingOffGridVertices(
       const RoutingVertex &vertex,
@@ -617,6 +871,17 @@ class RoutingGrid {
       const geometry::Rectangle &footprint,
       const std::optional<EquivalentNets> &for_nets = std::nullopt) const;
 
+  // Splits paths_ into contiguous [begin, end) ranges for exporting in
+  // parallel.
+  std::vector<std::pair<size_t, size_t>> ExportChunks() const;
+
+  // Converts paths_[begin, end) only. Caller takes ownership.
+  PolyLineCell *CreatePolyLineCell(size_t begin, size_t end) const;
+
+  // Adds the edges and vertices of a newly installed path to
+  // installed_footprints_.
+  void IndexInstalledPath(const RoutingPath &path);
+
   absl::Status ValidAgainstKnownBlockages(
       const geometry::Rectangle &footprint,
       const std::optional<EquivalentNets> &exceptional_nets = std::nullopt)
@@ -670,6 +935,25 @@ class RoutingGrid {
       const EquivalentNets &connectable_nets,
       const RoutingBlockageCache &blockage_cache);
 
+  // True if the access vertex left by an earlier call to
+  // AddAccessVerticesForPoint can still be reached through one of its edges
+  // without hitting anything in the blockage_cache, which can differ from
+  // the one it was made with.
+  bool AccessVertexValidAgainst(
+      const RoutingVertex &vertex,
+      const EquivalentNets &for_nets,
+      const RoutingBlockageCache &blockage_cache) const;
+
+  // The part of AddAccessVerticesForPoint that does not change the grid.
+  std::vector<PinAccessOption> FindPinAccessOptions(
+      const geometry::Point &point,
+      const geometry::Layer &layer,
+      const EquivalentNets &for_nets) const;
+
+  // Marks pin-access analyses that might be affected by a change in the given
+  // region as stale.
+  void InvalidatePinAccess(const geometry::Rectangle &region);
+
   absl::StatusOr<VertexWithLayer> ConnectToNearestAvailableVertex(
       const geometry::Port &port,
       const EquivalentNets &connectable_nets,
@@ -775,6 +1059,14 @@ class RoutingGrid {
       RoutingPath *path,
       const RoutingBlockageCache &blockage_cache);
 
+  // Adds the path to paths_ and to the running statistics.
+  void AddInstalledPath(RoutingPath *path);
+
+  // As InstallPath, for callers already holding the unique lock.
+  absl::Status InstallPathUnderLock(
+      RoutingPath *path,
+      const RoutingBlockageCache &blockage_cache);
+
   void InstallVertexInPath(
       RoutingVertex *vertex,
       const std::string &net,
@@ -789,6 +1081,18 @@ class RoutingGrid {
 
   void AddTrackToLayer(RoutingTrack *track, const geometry::Layer &layer);
 
+  // Report a change to the vertex or edge, and so to everything it connects
+  // to, to the blockage_hit_cache_. A vertex should be reported after it is
+  // added to its tracks, and before it is removed from them, so that the
+  // region covers the edges it splits or rejoins.
+  void InvalidateBlockageHits(const RoutingVertex &vertex);
+  void InvalidateBlockageHits(const RoutingEdge &edge);
+
+  // Vertices are either allocated in vertex_arena_ (on-grid vertices created
+  // by ConnectLayers) or individually with new (everything else). This frees
+  // the vertex whichever way is appropriate.
+  void DeleteVertex(RoutingVertex *vertex);
+
   bool PointsAreTooCloseForVias(
       const geometry::Layer &shared_layer,
       const geometry::Point &lhs,
@@ -823,6 +1127,27 @@ class RoutingGrid {
   bool AreLayersConnectableByVia(
       const geometry::Layer &lhs, const geometry::Layer &rhs) const;
 
+  struct ViaStack {
+    std::vector<RoutingViaInfo> vias;
+    double cost;
+  };
+
+  // Recomputes via_stacks_ from via_infos_.
+  void BuildViaStackTable();
+
+  // Recomputes the search margins below from via_infos_ and
+  // routing_layer_info_.
+  void UpdateSearchMargins();
+
+  // The margin IsEntirelyKeptOut adds around a shape on the given layer, less
+  // padding and min separation.
+  int64_t KeepOutReach(const geometry::Layer &layer) const;
+
+  // The precomputed via stack between two layers, or nullptr if there isn't
+  // one. Layers are the same if the stack is empty.
+  const ViaStack *LookUpViaStack(
+      const geometry::Layer &lhs, const geometry::Layer &rhs) const;
+
   // Stores the connection info between the ith (first index) and jth (second
   // index) layers. The "lesser" layer (std::less) should always be used to
   // index first, so that half of the matrix can be avoided.
@@ -834,6 +1159,10 @@ class RoutingGrid {
   // All installed paths (which we also own).
   std::vector<RoutingPath*> paths_;
 
+  // Spatial indices over the edges and vertices of paths_, by layer, so that
+  // checking a footprint against installed paths only considers those nearby.
+  std::map<geometry::Layer, InstalledFootprints> installed_footprints_;
+
   // Edges that do not fall on tracks, so we own them (until they are contained
   // in a RoutingPath).
   std::set<RoutingEdge*> off_grid_edges_;
@@ -841,9 +1170,25 @@ class RoutingGrid {
   // All Owned vertices.
   std::vector<RoutingVertex*> vertices_;
 
+  // Backing storage for the on-grid vertices created in ConnectLayers, in the
+  // order they are added to vertices_. Off-grid vertices are created all over
+  // the place with new and are not in here.
+  RoutingObjectArena<RoutingVertex> vertex_arena_;
+
+  // Backing storage for all tracks in tracks_by_layer_.
+  RoutingObjectArena<RoutingTrack> track_arena_;
+
   // The vertices we know about which are off-grid. This container does not own
   // the pointers.
-  RoutingVertexKDTree off_grid_vertices_;
+  RoutingVertexSpatialIndex off_grid_vertices_;
+
+  // Availability of every vertex in vertices_, indexed the same way, so that
+  // path search can test it without summarising each vertex's nets.
+  RoutingVertexAvailability vertex_availability_;
+
+  // Memoised blockage hit-tests. The grid tells it about every structural
+  // change (see InvalidateBlockageHits).
+  mutable RoutingBlockageHitCache blockage_hit_cache_;
 
   // All routing tracks (we own these).
   //
@@ -865,6 +1210,13 @@ class RoutingGrid {
   std::vector<std::unique_ptr<RoutingGridBlockage<geometry::Polygon>>>
       polygon_blockages_;
 
+  // Spatial indices over the blockages above, so that checking a vertex or
+  // edge against known blockages only considers the ones nearby.
+  RoutingBlockageIndex<RoutingGridBlockage<geometry::Rectangle>>
+      rectangle_blockage_index_;
+  RoutingBlockageIndex<RoutingGridBlockage<geometry::Polygon>>
+      polygon_blockage_index_;
+
   // TODO(aryap): We need to track which directions a vertex can be used in,
   // since sometimes a horizontal via encap will fit but a vertical one will
   // not.
@@ -875,15 +1227,57 @@ class RoutingGrid {
 
   const PhysicalPropertiesDatabase &physical_db_;
 
+  // The cheapest via stack between every pair of layers named in via_infos_,
+  // so that FindViaStack and FindViaStackCost don't have to search for it on
+  // every call. The table is num_via_stack_layers_ square, and layers are
+  // mapped to rows and columns by via_stack_index_by_layer_, which is indexed
+  // by the layer less via_stack_min_layer_ (-1 for layers with no vias).
+  // Rebuilt whenever a via info is added.
+  geometry::Layer via_stack_min_layer_;
+  std::vector<int64_t> via_stack_index_by_layer_;
+  size_t num_via_stack_layers_;
+  std::vector<std::optional<ViaStack>> via_stacks_;
+
+  // Margins for the searches done for every vertex, edge, blockage and
+  // installed path, which depend only on the layer and via infos. Updated by
+  // UpdateSearchMargins whenever one of those is added.
+  //
+  // See FigureSearchWindowMargin.
+  int64_t search_window_margin_;
+  // The widest wire on any layer.
+  int64_t max_wire_width_;
+  // How far a change can affect pin access; see InvalidatePinAccess.
+  int64_t pin_access_margin_;
+  // The wire width or biggest via encap on each layer, whichever is bigger.
+  std::map<geometry::Layer, int64_t> keep_out_reach_by_layer_;
+
   // The default is to use a super-linear model.
   bool use_linear_cost_model_;
 
+  // Running counts for GetStatistics, guarded by lock_. Vertices are counted
+  // on every layer they connect to when they are added.
+  std::map<geometry::Layer, size_t> num_vertices_by_layer_;
+  std::map<geometry::Layer, size_t> num_off_grid_edges_by_layer_;
+  double total_wirelength_;
+
+  // Pin-access analyses by port position and layer. See PrecomputePinAccess.
+  // Guarded by pin_access_lock_, which is always taken after lock_.
+  std::map<std::pair<geometry::Point, geometry::Layer>, PinAccess> pin_access_;
+  // The pin_access_ entry each access vertex was made for, so that removing a
+  // vertex doesn't mean searching every entry. Guarded by pin_access_lock_.
+  std::map<const RoutingVertex*, std::pair<geometry::Point, geometry::Layer>>
+      pin_access_keys_by_vertex_;
+  mutable std::mutex pin_access_lock_;
+
   mutable std::shared_mutex lock_;
 
   template<typename T>
   friend class RoutingGridBlockage;
 
   friend class RoutingPath;
+  friend class RoutingGridSnapshot;
+  friend class RoutingGridFork;
+  friend class RoutingGridForker;
 };
 
 
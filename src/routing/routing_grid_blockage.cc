@@ -128,6 +128,11 @@ bool RoutingGridBlockage<geometry::Polygon>::Blocks(
   return intersects;
 }
 
+template<typename T>
+geometry::Rectangle RoutingGridBlockage<T>::PaddedBoundingBox() const {
+  return shape_.GetBoundingBox().WithPadding(padding_);
+}
+
 template<typename T>
 void RoutingGridBlockage<T>::AddChildTrackBlockage(
     RoutingTrack *track, RoutingTrackBlockage *blockage) {
@@ -99,6 +99,10 @@ class RoutingGridBlockage {
   const T& shape() const { return shape_; }
   const int64_t &padding() const { return padding_; }
 
+  // The bounding box of the shape, inflated by padding(). Anything that does
+  // not overlap this box cannot be blocked by this blockage.
+  geometry::Rectangle PaddedBoundingBox() const;
+
  private:
   bool Blocks(
       const RoutingVertex &vertex,
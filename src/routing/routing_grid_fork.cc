@@ -0,0 +1,339 @@
+#include "routing_grid_fork.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/str_cat.h>
+#include <glog/logging.h>
+
+#include "routing_blockage_cache.h"
+#include "routing_edge.h"
+#include "routing_grid.h"
+#include "routing_path.h"
+#include "routing_vertex.h"
+#include "../equivalent_nets.h"
+#include "../geometry/layer.h"
+#include "../geometry/port.h"
+
+namespace bfg {
+namespace routing {
+
+absl::StatusOr<size_t> RoutingGridFork::AddRouteBetween(
+    RoutingVertex *begin,
+    RoutingVertex *end,
+    const EquivalentNets &nets) {
+  RoutingGrid *base = forker_.base_;
+  RoutingBlockageCache blockage_cache(*base);
+  std::shared_lock mu(base->lock_);
+  // Commits only bump the generation under the base's unique lock, so this
+  // fork can't go stale while the lock is held.
+  absl::Status not_stale = CheckNotStale();
+  if (!not_stale.ok()) {
+    return not_stale;
+  }
+  return RouteBetween(
+      begin, end, nets, std::nullopt, std::nullopt, blockage_cache);
+}
+
+absl::StatusOr<size_t> RoutingGridFork::AddRouteBetween(
+    const geometry::Port &begin,
+    const geometry::Port &end,
+    const EquivalentNets &nets) {
+  RoutingGrid *base = forker_.base_;
+  RoutingBlockageCache blockage_cache(*base);
+  std::shared_lock mu(base->lock_);
+  absl::Status not_stale = CheckNotStale();
+  if (!not_stale.ok()) {
+    return not_stale;
+  }
+
+  auto begin_access = FindAccessVertex(begin, nets, blockage_cache);
+  if (!begin_access) {
+    return absl::NotFoundError(absl::StrCat(
+        "No existing access vertex in fork for begin port ",
+        begin.Describe()));
+  }
+  auto end_access = FindAccessVertex(end, nets, blockage_cache);
+  if (!end_access) {
+    return absl::NotFoundError(absl::StrCat(
+        "No existing access vertex in fork for end port ", end.Describe()));
+  }
+  return RouteBetween(begin_access->vertex,
+                      end_access->vertex,
+                      nets,
+                      begin_access->layer,
+                      end_access->layer,
+                      blockage_cache);
+}
+
+absl::StatusOr<size_t> RoutingGridFork::RouteBetween(
+    RoutingVertex *begin,
+    RoutingVertex *end,
+    const EquivalentNets &nets,
+    const std::optional<geometry::Layer> &start_access_layer,
+    const std::optional<geometry::Layer> &end_access_layer,
+    const RoutingBlockageCache &blockage_cache) {
+  // The same search as RoutingGrid::ShortestPath(begin, end, ...), but with
+  // this fork's changes layered over the base's availability.
+  auto shortest_path = forker_.base_->ShortestPath(
+      begin,
+      [=](RoutingVertex *v) { return v == end; },   // The target.
+      nullptr,
+      [&](RoutingVertex *v) {
+        return OverlayAllows(*v, nets) &&
+            blockage_cache.AvailableForNetsOnAnyLayer(*v, nets);
+      },
+      [&](RoutingVertex *v) {
+        return OverlayAllows(*v, nets) &&
+            blockage_cache.AvailableForAll(*v, nets);
+      },
+      [&](RoutingEdge *e) {
+        return OverlayAllows(*e, nets) &&
+            blockage_cache.AvailableForAll(*e, nets);
+      },
+      true);
+  if (!shortest_path.ok()) {
+    return absl::NotFoundError(absl::StrCat(
+        "No path found in fork: ", shortest_path.status().message()));
+  }
+  std::unique_ptr<RoutingPath> routing_path(*shortest_path);
+
+  Path path = {
+      .nets = nets,
+      .begin = begin,
+      .edges = routing_path->edges(),
+      .start_access_layer = start_access_layer,
+      .end_access_layer = end_access_layer,
+      .cost = routing_path->Cost()
+  };
+  Install(std::move(path));
+  return paths_.size() - 1;
+}
+
+std::optional<RoutingGrid::VertexWithLayer>
+RoutingGridFork::FindAccessVertex(
+    const geometry::Port &port,
+    const EquivalentNets &nets,
+    const RoutingBlockageCache &blockage_cache) const {
+  const RoutingGrid &base = *forker_.base_;
+  const geometry::Point &point = port.centre();
+
+  // An access vertex the base has already made for the port, as in
+  // RoutingGrid::ConnectToGrid.
+  {
+    std::lock_guard pin_access_mu(base.pin_access_lock_);
+    auto it = base.pin_access_.find({point, port.layer()});
+    if (it != base.pin_access_.end()) {
+      const RoutingGrid::PinAccess &pin_access = it->second;
+      if (pin_access.access_vertex &&
+          pin_access.access_vertex_nets.nets() == nets.nets()) {
+        RoutingVertex *vertex = pin_access.access_vertex->vertex;
+        if (OverlayAllows(*vertex, nets) &&
+            vertex->Available() &&
+            base.AccessVertexValidAgainst(*vertex, nets, blockage_cache)) {
+          return pin_access.access_vertex;
+        }
+      }
+    }
+  }
+
+  // Otherwise a grid vertex right on the port, which is the first thing
+  // RoutingGrid::ConnectToGrid would look for.
+  for (const RoutingGrid::PinAccessOption &option :
+           base.FindPinAccessOptions(point, port.layer(), nets)) {
+    RoutingVertex *vertex = option.grid_geometry->VertexAt(point);
+    if (vertex &&
+        OverlayAllows(*vertex, nets) &&
+        blockage_cache.AvailableForNetsOnAnyLayer(*vertex, nets)) {
+      return {{vertex, option.target_layer}};
+    }
+  }
+  return std::nullopt;
+}
+
+void RoutingGridFork::Install(Path &&path) {
+  const std::string &net = path.nets.primary();
+  std::set<RoutingVertex*> vertices = {path.begin};
+  for (RoutingEdge *edge : path.edges) {
+    edge_nets_[edge] = net;
+    for (RoutingVertex *vertex : edge->SpannedVertices()) {
+      vertices.insert(vertex);
+    }
+  }
+  for (RoutingVertex *vertex : vertices) {
+    vertex_nets_[vertex].insert(net);
+    if (!vertex->horizontal_track() || !vertex->vertical_track()) {
+      continue;
+    }
+    // As in RoutingGrid::InstallVertexInPath, there isn't room for a via for
+    // another net next to an on-grid vertex in the path.
+    for (RoutingVertex *neighbour : vertex->GetNeighbours()) {
+      vertex_nets_[neighbour].insert(net);
+    }
+  }
+  paths_.push_back(std::move(path));
+}
+
+bool RoutingGridFork::OverlayAllows(
+    const RoutingVertex &vertex, const EquivalentNets &nets) const {
+  auto it = vertex_nets_.find(&vertex);
+  if (it == vertex_nets_.end()) {
+    return true;
+  }
+  for (const std::string &net : it->second) {
+    if (!nets.Contains(net)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RoutingGridFork::OverlayAllows(
+    const RoutingEdge &edge, const EquivalentNets &nets) const {
+  auto it = edge_nets_.find(&edge);
+  return it == edge_nets_.end() || nets.Contains(it->second);
+}
+
+bool RoutingGridFork::AvailableForNets(
+    const RoutingVertex &vertex, const EquivalentNets &nets) const {
+  std::shared_lock mu(forker_.base_->lock_);
+  return OverlayAllows(vertex, nets) && vertex.AvailableForAll(nets);
+}
+
+bool RoutingGridFork::AvailableForNets(
+    const RoutingEdge &edge, const EquivalentNets &nets) const {
+  std::shared_lock mu(forker_.base_->lock_);
+  return OverlayAllows(edge, nets) && edge.AvailableForNets(nets);
+}
+
+bool RoutingGridFork::Available(const RoutingVertex &vertex) const {
+  std::shared_lock mu(forker_.base_->lock_);
+  return vertex_nets_.find(&vertex) == vertex_nets_.end() &&
+      vertex.Available();
+}
+
+bool RoutingGridFork::Available(const RoutingEdge &edge) const {
+  std::shared_lock mu(forker_.base_->lock_);
+  return edge_nets_.find(&edge) == edge_nets_.end() && edge.Available();
+}
+
+double RoutingGridFork::Cost() const {
+  double cost = 0.0;
+  for (const Path &path : paths_) {
+    cost += path.cost;
+  }
+  return cost;
+}
+
+absl::Status RoutingGridFork::CheckNotStale() const {
+  if (forker_.generation_ != generation_) {
+    return absl::FailedPreconditionError(
+        "Fork is stale: the base grid has changed since it was made");
+  }
+  return absl::OkStatus();
+}
+
+std::unique_ptr<RoutingGridFork> RoutingGridForker::Fork() const {
+  return std::unique_ptr<RoutingGridFork>(
+      new RoutingGridFork(*this, generation_));
+}
+
+absl::Status RoutingGridForker::Commit(const RoutingGridFork &fork) {
+  if (&fork.forker_ != this) {
+    return absl::InvalidArgumentError("Fork was not made by this forker");
+  }
+
+  RoutingBlockageCache blockage_cache(*base_);
+  std::unique_lock mu(base_->lock_);
+  // Only one of several concurrent commits of current forks can win. The
+  // generation only changes under the unique lock, so it can't change between
+  // here and the end of the commit.
+  absl::Status not_stale = fork.CheckNotStale();
+  if (!not_stale.ok()) {
+    return not_stale;
+  }
+
+  std::vector<std::unique_ptr<RoutingPath>> paths;
+  for (const RoutingGridFork::Path &fork_path : fork.paths()) {
+    std::unique_ptr<RoutingPath> path(new RoutingPath(
+        fork_path.begin,
+        std::deque<RoutingEdge*>(fork_path.edges.begin(),
+                                 fork_path.edges.end()),
+        base_));
+    if (!fork_path.nets.Empty()) {
+      path->set_nets(fork_path.nets);
+    }
+    if (fork_path.start_access_layer) {
+      path->start_access_layers().insert(*fork_path.start_access_layer);
+    }
+    if (fork_path.end_access_layer) {
+      path->end_access_layers().insert(*fork_path.end_access_layer);
+    }
+    paths.emplace_back(std::move(path));
+  }
+
+  // Check every path before installing any of them, so that a failure leaves
+  // the base as it was. Each path must pass the checks InstallPath makes both
+  // against the base and against the paths installed ahead of it.
+  std::unordered_map<const RoutingVertex*, std::string> vertex_nets;
+  std::unordered_map<const RoutingEdge*, std::string> edge_nets;
+  for (const auto &path : paths) {
+    if (path->Empty() ||
+        path->vertices().size() != path->edges().size() + 1) {
+      return absl::InvalidArgumentError(
+          "While committing fork: fork contains a malformed path");
+    }
+    absl::Status still_good = path->CheckStillAvailable();
+    if (!still_good.ok()) {
+      return absl::Status(
+          still_good.code(),
+          absl::StrCat("While committing fork: ", still_good.message()));
+    }
+    const std::string &net = path->nets().primary();
+    for (const RoutingVertex *vertex : path->vertices()) {
+      auto it = vertex_nets.insert({vertex, net}).first;
+      if (!path->nets().Contains(it->second)) {
+        return absl::FailedPreconditionError(absl::StrCat(
+            "While committing fork: vertex ", vertex->centre().Describe(),
+            " is used by both ", it->second, " and ", net));
+      }
+    }
+    for (const RoutingEdge *edge : path->edges()) {
+      auto it = edge_nets.insert({edge, net}).first;
+      if (!path->nets().Contains(it->second)) {
+        return absl::FailedPreconditionError(absl::StrCat(
+            "While committing fork: edge ", edge->Describe(),
+            " is used by both ", it->second, " and ", net));
+      }
+    }
+  }
+
+  // The base is about to change, so every fork made so far (this one
+  // included) goes stale.
+  ++generation_;
+
+  for (auto &path : paths) {
+    absl::Status installed = base_->InstallPathUnderLock(
+        path.get(), blockage_cache);
+    // Everything InstallPath checks was checked above.
+    LOG_IF(FATAL, !installed.ok())
+        << "Could not install checked path while committing fork: "
+        << installed;
+    // The base owns installed paths.
+    path.release();
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace routing
+}  // namespace bfg
@@ -0,0 +1,179 @@
+#ifndef ROUTING_GRID_FORK_H_
+#define ROUTING_GRID_FORK_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+
+#include "../equivalent_nets.h"
+#include "../geometry/layer.h"
+#include "../geometry/port.h"
+#include "routing_blockage_cache.h"
+#include "routing_edge.h"
+#include "routing_grid.h"
+#include "routing_vertex.h"
+
+namespace bfg {
+namespace routing {
+
+class RoutingGridForker;
+
+// A what-if view of a base RoutingGrid. The fork shares the base's vertices,
+// edges, tracks and blockages read-only and keeps its own changes to them in an
+// overlay: the nets each vertex and edge is used or blocked by, and the paths
+// routed so far. Making a fork copies nothing, and each route adds only the
+// vertices and edges it touches to the overlay.
+//
+// Since the base's structure is read-only, a fork can't add the off-grid
+// vertices RoutingGrid uses to reach ports. Routes run between existing
+// vertices that already reach their ports instead, and the fork's paths are
+// legalised (and their neighbours blocked in full) when it is committed back to
+// the base; see RoutingGridForker::Commit.
+//
+// Different forks of the same base can be routed from different threads at
+// once. A single fork must only be used from one thread at a time.
+class RoutingGridFork {
+ public:
+  // A path found in the fork, as the base vertex it starts at and the base
+  // edges it follows.
+  struct Path {
+    EquivalentNets nets;
+    RoutingVertex *begin;
+    std::vector<RoutingEdge*> edges;
+    std::optional<geometry::Layer> start_access_layer;
+    std::optional<geometry::Layer> end_access_layer;
+    double cost;
+  };
+
+  // Finds the cheapest route between two vertices of the base which is
+  // available in this fork and records it in the overlay. Returns the index of
+  // the new path in paths().
+  absl::StatusOr<size_t> AddRouteBetween(RoutingVertex *begin,
+                                         RoutingVertex *end,
+                                         const EquivalentNets &nets);
+
+  // As above, between the vertices through which each port is reached. Since
+  // a fork can't add the off-grid access vertices RoutingGrid::ConnectToGrid
+  // might, this only works for ports on grid vertices or ports the base has
+  // already made access vertices for (by routing to them). Otherwise
+  // NotFoundError is returned.
+  absl::StatusOr<size_t> AddRouteBetween(const geometry::Port &begin,
+                                         const geometry::Port &end,
+                                         const EquivalentNets &nets);
+
+  // Whether the vertex or edge is available to the given nets, considering
+  // both the base and this fork's changes to it.
+  bool AvailableForNets(const RoutingVertex &vertex,
+                        const EquivalentNets &nets) const;
+  bool AvailableForNets(const RoutingEdge &edge,
+                        const EquivalentNets &nets) const;
+
+  // Whether the vertex or edge is free for any net.
+  bool Available(const RoutingVertex &vertex) const;
+  bool Available(const RoutingEdge &edge) const;
+
+  // The sum of the costs of the paths in the fork, for comparing forks.
+  double Cost() const;
+
+  const std::vector<Path> &paths() const { return paths_; }
+
+  size_t num_changed_vertices() const { return vertex_nets_.size(); }
+  size_t num_changed_edges() const { return edge_nets_.size(); }
+
+ private:
+  RoutingGridFork(const RoutingGridForker &forker, uint64_t generation)
+      : forker_(forker),
+        generation_(generation) {}
+
+  absl::Status CheckNotStale() const;
+
+  // Whether this fork's changes to the vertex or edge leave it available to
+  // the given nets. The base's own status is not checked.
+  bool OverlayAllows(const RoutingVertex &vertex,
+                     const EquivalentNets &nets) const;
+  bool OverlayAllows(const RoutingEdge &edge,
+                     const EquivalentNets &nets) const;
+
+  // The caller must hold the base's lock.
+  absl::StatusOr<size_t> RouteBetween(
+      RoutingVertex *begin,
+      RoutingVertex *end,
+      const EquivalentNets &nets,
+      const std::optional<geometry::Layer> &start_access_layer,
+      const std::optional<geometry::Layer> &end_access_layer,
+      const RoutingBlockageCache &blockage_cache);
+
+  // The base vertex through which the port can be reached, and the layer to
+  // reach it on: either an access vertex the base has already made for the
+  // port, or a grid vertex right on it. Returns nullopt if there is neither,
+  // since the fork can't add one. The caller must hold the base's lock.
+  std::optional<RoutingGrid::VertexWithLayer> FindAccessVertex(
+      const geometry::Port &port,
+      const EquivalentNets &nets,
+      const RoutingBlockageCache &blockage_cache) const;
+
+  // Records the path in the overlay, in the same way that
+  // RoutingGrid::InstallPath marks the vertices and edges it uses and the
+  // on-grid neighbours of its vertices.
+  void Install(Path &&path);
+
+  const RoutingGridForker &forker_;
+
+  // The forker's generation when this fork was made.
+  const uint64_t generation_;
+
+  // The nets using or blocking each base vertex and edge that this fork has
+  // changed. Anything not in these maps has the base's status.
+  std::unordered_map<const RoutingVertex*, std::set<std::string>> vertex_nets_;
+  std::unordered_map<const RoutingEdge*, std::string> edge_nets_;
+
+  std::vector<Path> paths_;
+
+  friend class RoutingGridForker;
+};
+
+// Makes forks of a base RoutingGrid, for trying alternative net orderings,
+// costs and so on against the same starting point and keeping the best result.
+// Forks are routed independently (and concurrently, if need be), and the one
+// that is kept is committed back to the base with Commit.
+//
+// The base must outlive the forker and must not be changed except through
+// Commit while forks are in use. Committing a fork changes the base, so every
+// other fork made before then becomes stale: routing on or committing a stale
+// fork fails. Forks made after a commit see its paths.
+class RoutingGridForker {
+ public:
+  explicit RoutingGridForker(RoutingGrid *base)
+      : base_(base),
+        generation_(0) {}
+
+  std::unique_ptr<RoutingGridFork> Fork() const;
+
+  // Installs each of the fork's paths in the base, in the order they were
+  // routed. Every path is checked against the base before any is installed, so
+  // if the commit fails the base is unchanged (and other forks stay current).
+  absl::Status Commit(const RoutingGridFork &fork);
+
+  const RoutingGrid &base() const { return *base_; }
+
+ private:
+  RoutingGrid *const base_;
+
+  // Incremented by each commit.
+  std::atomic<uint64_t> generation_;
+
+  friend class RoutingGridFork;
+};
+
+}  // namespace routing
+}  // namespace bfg
+
+#endif  // ROUTING_GRID_FORK_H_
@@ -0,0 +1,172 @@
+#include "routing_grid_fork.h"
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "parallel.h"
+#include "routing_edge.h"
+#include "routing_grid.h"
+#include "routing_path.h"
+#include "routing_test_grid.h"
+#include "routing_vertex.h"
+#include "../design_database.h"
+#include "../equivalent_nets.h"
+#include "../physical_properties_database.h"
+#include "../geometry/layer.h"
+#include "../geometry/port.h"
+#include "../geometry/rectangle.h"
+#include "../geometry/shape_collection.h"
+#include "../dev_pdk_setup.h"
+
+DECLARE_int32(jobs);
+
+namespace bfg {
+namespace routing {
+namespace {
+
+class RoutingGridForkTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    bfg::PhysicalPropertiesDatabase &physical_db = design_db_.physical_db();
+    design_db_.physical_db().LoadTechnologyFromFile(
+        "test_data/sky130.technology.pb");
+    bfg::SetUpSky130(&physical_db);
+  }
+
+  std::unique_ptr<RoutingGrid> MakeRoutingGrid() const {
+    const bfg::PhysicalPropertiesDatabase &db = design_db_.physical_db();
+    std::unique_ptr<RoutingGrid> routing_grid = MakeTestRoutingGrid(db);
+
+    geometry::ShapeCollection shapes;
+    shapes.rectangles().emplace_back(new geometry::Rectangle(
+        {1000, 1000}, {1400, 1300}, db.GetLayer("met1.drawing"), ""));
+    routing_grid->AddBlockages(shapes);
+    return routing_grid;
+  }
+
+  absl::StatusOr<size_t> Route(RoutingGridFork *fork,
+                               const std::string &net) const {
+    geometry::Layer met1 = design_db_.physical_db().GetLayer("met1.drawing");
+    // Both ports are centred on grid vertices.
+    return fork->AddRouteBetween(
+        geometry::Port({290, 460}, {390, 560}, met1, net),
+        geometry::Port({2330, 2500}, {2430, 2600}, met1, net),
+        EquivalentNets(net));
+  }
+
+  bfg::DesignDatabase design_db_;
+};
+
+TEST_F(RoutingGridForkTest, ForksAreIndependent) {
+  std::unique_ptr<RoutingGrid> base = MakeRoutingGrid();
+  std::vector<bool> base_available;
+  for (const RoutingVertex *vertex : base->vertices()) {
+    base_available.push_back(vertex->Available());
+  }
+
+  RoutingGridForker forker(base.get());
+  std::vector<std::unique_ptr<RoutingGridFork>> forks;
+  for (size_t i = 0; i < 3; ++i) {
+    forks.push_back(forker.Fork());
+  }
+
+  // Route the same endpoints on two forks at once, as different nets, and
+  // leave the third alone.
+  int32_t jobs = FLAGS_jobs;
+  FLAGS_jobs = 2;
+  std::vector<bool> routed(2, false);
+  RunInParallel(2, NumWorkerThreads(), [&](size_t i) {
+    routed[i] = Route(forks[i].get(), i == 0 ? "a" : "b").ok();
+  });
+  FLAGS_jobs = jobs;
+  ASSERT_TRUE(routed[0]);
+  ASSERT_TRUE(routed[1]);
+
+  EXPECT_TRUE(base->paths().empty());
+  EXPECT_EQ(1, forks[0]->paths().size());
+  EXPECT_EQ(1, forks[1]->paths().size());
+  EXPECT_TRUE(forks[2]->paths().empty());
+
+  // The base is untouched, and so is the fork that wasn't routed.
+  const RoutingGridFork &routed_fork = *forks[0];
+  const RoutingGridFork &untouched = *forks[2];
+  size_t num_differences = 0;
+  ASSERT_EQ(base_available.size(), base->vertices().size());
+  for (size_t i = 0; i < base->vertices().size(); ++i) {
+    const RoutingVertex &vertex = *base->vertices()[i];
+    EXPECT_EQ(base_available[i], vertex.Available()) << "at "
+                                                     << vertex.centre();
+    EXPECT_EQ(base_available[i], untouched.Available(vertex)) << "at "
+                                                             << vertex.centre();
+    if (base_available[i] != routed_fork.Available(vertex))
+      ++num_differences;
+  }
+  EXPECT_LT(0, num_differences);
+
+  // Only what the route touched is in the fork's overlay.
+  EXPECT_LE(num_differences, routed_fork.num_changed_vertices());
+  EXPECT_LT(routed_fork.num_changed_vertices(), base->vertices().size());
+
+  EquivalentNets other_net("b");
+  for (const RoutingEdge *edge : routed_fork.paths().front().edges) {
+    EXPECT_FALSE(routed_fork.AvailableForNets(*edge, other_net));
+    EXPECT_TRUE(untouched.AvailableForNets(*edge, other_net));
+  }
+}
+
+TEST_F(RoutingGridForkTest, PortsMustHaveExistingAccessVertices) {
+  std::unique_ptr<RoutingGrid> base = MakeRoutingGrid();
+  RoutingGridForker forker(base.get());
+  std::unique_ptr<RoutingGridFork> fork = forker.Fork();
+
+  // The fork can't make an off-grid vertex to reach a port between tracks.
+  geometry::Layer met1 = design_db_.physical_db().GetLayer("met1.drawing");
+  EXPECT_EQ(absl::StatusCode::kNotFound,
+            fork->AddRouteBetween(
+                geometry::Port({300, 300}, {400, 400}, met1, "a"),
+                geometry::Port({2330, 2500}, {2430, 2600}, met1, "a"),
+                EquivalentNets("a")).status().code());
+  EXPECT_TRUE(fork->paths().empty());
+
+  // Ports on grid vertices are fine.
+  EXPECT_TRUE(Route(fork.get(), "a").ok());
+}
+
+TEST_F(RoutingGridForkTest, CommitInstallsPathsAndMakesOtherForksStale) {
+  std::unique_ptr<RoutingGrid> base = MakeRoutingGrid();
+  RoutingGridForker forker(base.get());
+  std::unique_ptr<RoutingGridFork> kept = forker.Fork();
+  std::unique_ptr<RoutingGridFork> dropped = forker.Fork();
+
+  ASSERT_TRUE(Route(kept.get(), "a").ok());
+  ASSERT_TRUE(Route(dropped.get(), "a").ok());
+
+  ASSERT_TRUE(forker.Commit(*kept).ok());
+  ASSERT_EQ(1, base->paths().size());
+  EXPECT_EQ("a", base->paths().front()->nets().primary());
+
+  // The base has changed under the other fork, which can no longer be routed
+  // or committed. The committed fork can't be committed again either.
+  EXPECT_EQ(absl::StatusCode::kFailedPrecondition,
+            forker.Commit(*dropped).code());
+  EXPECT_EQ(absl::StatusCode::kFailedPrecondition,
+            Route(dropped.get(), "b").status().code());
+  EXPECT_EQ(absl::StatusCode::kFailedPrecondition,
+            forker.Commit(*kept).code());
+  EXPECT_EQ(1, base->paths().size());
+
+  // A new fork sees the committed path as part of the base.
+  std::unique_ptr<RoutingGridFork> next = forker.Fork();
+  EXPECT_EQ(0, next->num_changed_vertices());
+  EquivalentNets other_net("b");
+  for (const RoutingEdge *edge : base->paths().front()->edges()) {
+    EXPECT_FALSE(next->AvailableForNets(*edge, other_net));
+  }
+}
+
+}  // namespace
+}  // namespace routing
+}  // namespace bfg
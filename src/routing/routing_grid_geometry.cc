@@ -199,7 +199,11 @@ void RoutingGridGeometry::MapIndicesToTracks(
   for (size_t index : indices) {
     if (index >= track_container.size())
       continue;
-    tracks->insert(track_container[index]);
+    RoutingTrack *track = track_container[index];
+    // Tracks inside keep-outs are not created.
+    if (!track)
+      continue;
+    tracks->insert(track);
   }
 }
 
@@ -328,10 +332,14 @@ void RoutingGridGeometry::ComputeForLayers(
 std::set<RoutingVertex*> RoutingGridGeometry::ConnectablePerimeter(
     const geometry::Polygon &polygon) const {
   std::set<RoutingVertex*> vertices;
+  // Positions inside keep-outs have no vertex, and large keep-outs have a lot
+  // of them, so these are only counted.
+  size_t num_missing = 0;
   auto check_vertex = [&](int64_t i, int64_t j) {
     RoutingVertex *vertex = VertexAt(i, j);
     if (!vertex) {
-      LOG(WARNING) << "There is no vertex at grid " << i << ", " << j;
+      VLOG(17) << "There is no vertex at grid " << i << ", " << j;
+      ++num_missing;
       return false;
     }
     if (vertex->Available() || (
@@ -427,6 +435,10 @@ std::set<RoutingVertex*> RoutingGridGeometry::ConnectablePerimeter(
       }
     }
   }
+  if (num_missing > 0) {
+    VLOG(3) << "No vertex at " << num_missing << " grid positions around "
+            << polygon;
+  }
   return vertices;
 }
 
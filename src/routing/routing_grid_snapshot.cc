@@ -0,0 +1,1475 @@
+#include "routing_grid_snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <absl/cleanup/cleanup.h>
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/str_cat.h>
+#include <glog/logging.h>
+
+#include "routing_edge.h"
+#include "routing_grid.h"
+#include "routing_grid_blockage.h"
+#include "routing_grid_geometry.h"
+#include "routing_layer_info.h"
+#include "routing_path.h"
+#include "routing_track.h"
+#include "routing_track_blockage.h"
+#include "routing_track_direction.h"
+#include "routing_vertex.h"
+#include "routing_via_info.h"
+#include "../equivalent_nets.h"
+#include "../geometry/abstract_shape.h"
+#include "../geometry/compass.h"
+#include "../geometry/layer.h"
+#include "../geometry/point.h"
+#include "../geometry/polygon.h"
+#include "../geometry/port.h"
+#include "../geometry/rectangle.h"
+#include "../geometry/shape_collection.h"
+
+namespace bfg {
+namespace routing {
+
+namespace {
+
+constexpr char kMagic[] = "BFGRGSNP";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+constexpr size_t kHeaderSize =
+    kMagicSize + sizeof(uint32_t) + 3 * sizeof(uint64_t);
+
+// Stands in for a missing object index.
+constexpr uint64_t kNone = ~uint64_t{0};
+
+// FNV-1a.
+constexpr uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+
+uint64_t HashBytes(const char *data, size_t size, uint64_t hash) {
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Appends fixed-width little-endian values to a buffer. (All the hosts we build
+// for are little-endian, so this is a plain copy.)
+class SnapshotWriter {
+ public:
+  template<typename T>
+  void Put(const T &value) {
+    static_assert(std::is_trivially_copyable<T>::value);
+    buffer_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  void PutBool(bool value) { Put<uint8_t>(value ? 1 : 0); }
+  void PutSize(size_t value) { Put<uint64_t>(value); }
+  void PutDouble(double value) { Put<double>(value); }
+
+  void PutString(const std::string &value) {
+    PutSize(value.size());
+    buffer_.append(value);
+  }
+
+  void PutPoint(const geometry::Point &point) {
+    Put<int64_t>(point.x());
+    Put<int64_t>(point.y());
+  }
+
+  void PutRectangle(const geometry::Rectangle &rectangle) {
+    PutPoint(rectangle.lower_left());
+    PutPoint(rectangle.upper_right());
+  }
+
+  void PutDirection(const RoutingTrackDirection &direction) {
+    Put<uint8_t>(static_cast<uint8_t>(direction));
+  }
+
+  void PutLayers(const std::set<geometry::Layer> &layers) {
+    PutSize(layers.size());
+    for (const geometry::Layer &layer : layers) {
+      Put<geometry::Layer>(layer);
+    }
+  }
+
+  void PutOptionalLayer(const std::optional<geometry::Layer> &layer) {
+    PutBool(layer.has_value());
+    Put<geometry::Layer>(layer.value_or(0));
+  }
+
+  void PutOptionalString(const std::optional<std::string> &value) {
+    PutBool(value.has_value());
+    PutString(value.value_or(""));
+  }
+
+  void PutOptionalSize(const std::optional<size_t> &value) {
+    PutSize(value ? *value : kNone);
+  }
+
+  void PutShape(const geometry::Rectangle &rectangle) {
+    PutRectangle(rectangle);
+    Put<geometry::Layer>(rectangle.layer());
+    PutString(rectangle.net());
+    PutBool(rectangle.is_connectable());
+  }
+
+  void PutShape(const geometry::Polygon &polygon) {
+    PutSize(polygon.vertices().size());
+    for (const geometry::Point &point : polygon.vertices()) {
+      PutPoint(point);
+    }
+    Put<geometry::Layer>(polygon.layer());
+    PutString(polygon.net());
+    PutBool(polygon.is_connectable());
+  }
+
+  void PutRoutingLayerInfo(const RoutingLayerInfo &info) {
+    Put<geometry::Layer>(info.layer());
+    PutOptionalLayer(info.pin_layer());
+    PutRectangle(info.area());
+    Put<int64_t>(info.wire_width());
+    Put<int64_t>(info.offset());
+    PutDirection(info.direction());
+    Put<int64_t>(info.pitch());
+    Put<int64_t>(info.min_separation());
+    PutSize(info.keep_outs().size());
+    for (const geometry::Rectangle &keep_out : info.keep_outs()) {
+      PutRectangle(keep_out);
+    }
+  }
+
+  void PutRoutingViaInfo(const RoutingViaInfo &info) {
+    Put<geometry::Layer>(info.layer());
+    PutDouble(info.cost());
+    Put<int64_t>(info.width());
+    Put<int64_t>(info.height());
+    std::vector<geometry::Layer> layers = info.ConnectedLayers();
+    PutSize(layers.size());
+    for (const geometry::Layer &layer : layers) {
+      const RoutingViaEncapInfo &encap = info.Layer(layer);
+      Put<geometry::Layer>(layer);
+      Put<int64_t>(encap.overhang_length);
+      Put<int64_t>(encap.overhang_width);
+      Put<int64_t>(encap.min_area);
+    }
+  }
+
+  const std::string &buffer() const { return buffer_; }
+
+ private:
+  std::string buffer_;
+};
+
+// Reads back what SnapshotWriter wrote. Reading past the end, or reading an
+// index that is out of range, fails the reader; after that every read returns
+// zero, so callers only need to check ok() before they use what they've read
+// to index anything.
+class SnapshotReader {
+ public:
+  SnapshotReader(const char *data, size_t size)
+      : data_(data), size_(size), position_(0), ok_(true) {}
+
+  template<typename T>
+  T Get() {
+    static_assert(std::is_trivially_copyable<T>::value);
+    T value{};
+    if (!ok_ || size_ - position_ < sizeof(T)) {
+      ok_ = false;
+      return value;
+    }
+    std::memcpy(&value, data_ + position_, sizeof(T));
+    position_ += sizeof(T);
+    return value;
+  }
+
+  bool GetBool() { return Get<uint8_t>() != 0; }
+  size_t GetSize() { return Get<uint64_t>(); }
+  double GetDouble() { return Get<double>(); }
+
+  // Reads a count of things each at least min_item_size bytes long, failing if
+  // there can't be that many left.
+  size_t GetCount(size_t min_item_size = 1) {
+    size_t count = GetSize();
+    if (ok_ && count > (size_ - position_) / std::max(min_item_size, 1UL)) {
+      ok_ = false;
+      return 0;
+    }
+    return count;
+  }
+
+  // Reads an index less than limit, or kNone.
+  uint64_t GetIndex(size_t limit) {
+    uint64_t index = Get<uint64_t>();
+    if (index != kNone && index >= limit) {
+      ok_ = false;
+      return kNone;
+    }
+    return index;
+  }
+
+  std::string GetString() {
+    size_t size = GetCount();
+    if (!ok_) {
+      return "";
+    }
+    std::string value(data_ + position_, size);
+    position_ += size;
+    return value;
+  }
+
+  geometry::Point GetPoint() {
+    int64_t x = Get<int64_t>();
+    int64_t y = Get<int64_t>();
+    return geometry::Point(x, y);
+  }
+
+  geometry::Rectangle GetRectangle() {
+    geometry::Point lower_left = GetPoint();
+    geometry::Point upper_right = GetPoint();
+    return geometry::Rectangle(lower_left, upper_right);
+  }
+
+  RoutingTrackDirection GetDirection() {
+    uint8_t value = Get<uint8_t>();
+    switch (value) {
+      case static_cast<uint8_t>(RoutingTrackDirection::kTrackHorizontal):
+        return RoutingTrackDirection::kTrackHorizontal;
+      case static_cast<uint8_t>(RoutingTrackDirection::kTrackVertical):
+        return RoutingTrackDirection::kTrackVertical;
+      default:
+        ok_ = false;
+        return RoutingTrackDirection::kTrackHorizontal;
+    }
+  }
+
+  std::set<geometry::Layer> GetLayers() {
+    std::set<geometry::Layer> layers;
+    size_t count = GetCount(sizeof(geometry::Layer));
+    for (size_t i = 0; i < count; ++i) {
+      layers.insert(Get<geometry::Layer>());
+    }
+    return layers;
+  }
+
+  std::optional<geometry::Layer> GetOptionalLayer() {
+    bool has_value = GetBool();
+    geometry::Layer layer = Get<geometry::Layer>();
+    if (!has_value) {
+      return std::nullopt;
+    }
+    return layer;
+  }
+
+  std::optional<std::string> GetOptionalString() {
+    bool has_value = GetBool();
+    std::string value = GetString();
+    if (!has_value) {
+      return std::nullopt;
+    }
+    return value;
+  }
+
+  std::optional<size_t> GetOptionalSize() {
+    uint64_t value = GetSize();
+    if (value == kNone) {
+      return std::nullopt;
+    }
+    return value;
+  }
+
+  void GetShapeAttributes(geometry::AbstractShape *shape) {
+    shape->set_layer(Get<geometry::Layer>());
+    shape->set_net(GetString());
+    shape->set_is_connectable(GetBool());
+  }
+
+  geometry::Rectangle GetShapeRectangle() {
+    geometry::Rectangle rectangle = GetRectangle();
+    GetShapeAttributes(&rectangle);
+    return rectangle;
+  }
+
+  geometry::Polygon GetShapePolygon() {
+    std::vector<geometry::Point> points;
+    size_t count = GetCount(2 * sizeof(int64_t));
+    points.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      points.push_back(GetPoint());
+    }
+    geometry::Polygon polygon(points);
+    GetShapeAttributes(&polygon);
+    return polygon;
+  }
+
+  RoutingLayerInfo GetRoutingLayerInfo() {
+    RoutingLayerInfo info;
+    info.set_layer(Get<geometry::Layer>());
+    info.set_pin_layer(GetOptionalLayer());
+    info.set_area(GetRectangle());
+    info.set_wire_width(Get<int64_t>());
+    info.set_offset(Get<int64_t>());
+    info.set_direction(GetDirection());
+    info.set_pitch(Get<int64_t>());
+    info.set_min_separation(Get<int64_t>());
+    size_t num_keep_outs = GetCount(4 * sizeof(int64_t));
+    for (size_t i = 0; i < num_keep_outs; ++i) {
+      info.AddKeepOut(GetRectangle());
+    }
+    return info;
+  }
+
+  RoutingViaInfo GetRoutingViaInfo() {
+    RoutingViaInfo info;
+    info.set_layer(Get<geometry::Layer>());
+    info.set_cost(GetDouble());
+    info.set_width(Get<int64_t>());
+    info.set_height(Get<int64_t>());
+    size_t num_layers = GetCount(sizeof(geometry::Layer));
+    if (num_layers > 2) {
+      ok_ = false;
+      return info;
+    }
+    for (size_t i = 0; i < num_layers; ++i) {
+      geometry::Layer layer = Get<geometry::Layer>();
+      RoutingViaEncapInfo encap;
+      encap.overhang_length = Get<int64_t>();
+      encap.overhang_width = Get<int64_t>();
+      encap.min_area = Get<int64_t>();
+      info.AddRoutingViaEncapInfo(layer, encap);
+    }
+    return info;
+  }
+
+  bool AtEnd() const { return position_ == size_; }
+  bool ok() const { return ok_; }
+
+ private:
+  const char *data_;
+  size_t size_;
+  size_t position_;
+  bool ok_;
+};
+
+// A read-only mapping of a whole file.
+class MappedFile {
+ public:
+  MappedFile() : data_(nullptr), size_(0) {}
+  ~MappedFile() {
+    if (data_) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+  }
+
+  MappedFile(const MappedFile &other) = delete;
+  MappedFile &operator=(const MappedFile &other) = delete;
+
+  absl::Status Open(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return absl::NotFoundError(
+          absl::StrCat("Could not open snapshot ", path));
+    }
+    absl::Cleanup close_fd = [fd]() { close(fd); };
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      return absl::InternalError(
+          absl::StrCat("Could not stat snapshot ", path));
+    }
+    size_ = info.st_size;
+    if (size_ == 0) {
+      return absl::OkStatus();
+    }
+    void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      size_ = 0;
+      return absl::InternalError(
+          absl::StrCat("Could not map snapshot ", path));
+    }
+    data_ = static_cast<const char*>(data);
+    return absl::OkStatus();
+  }
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char *data_;
+  size_t size_;
+};
+
+struct Header {
+  uint32_t version;
+  uint64_t inputs_hash;
+  uint64_t body_size;
+  uint64_t checksum;
+};
+
+absl::StatusOr<Header> ReadHeader(std::string_view image,
+                                  const std::string &name) {
+  if (image.size() < kHeaderSize ||
+      std::memcmp(image.data(), kMagic, kMagicSize) != 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat(name, " is not a RoutingGrid snapshot"));
+  }
+  SnapshotReader reader(image.data() + kMagicSize, kHeaderSize - kMagicSize);
+  Header header;
+  header.version = reader.Get<uint32_t>();
+  header.inputs_hash = reader.Get<uint64_t>();
+  header.body_size = reader.Get<uint64_t>();
+  header.checksum = reader.Get<uint64_t>();
+  if (header.version != RoutingGridSnapshot::kVersion) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Snapshot ", name, " has version ", header.version,
+                     " but only version ", RoutingGridSnapshot::kVersion,
+                     " is supported"));
+  }
+  return header;
+}
+
+}   // namespace
+
+RoutingGridSnapshot::InputsHasher::InputsHasher()
+    : value_(kHashSeed) {}
+
+void RoutingGridSnapshot::InputsHasher::AddBytes(const std::string &bytes) {
+  // Prefix with the length so that consecutive inputs can't run together.
+  uint64_t size = bytes.size();
+  value_ = HashBytes(
+      reinterpret_cast<const char*>(&size), sizeof(size), value_);
+  value_ = HashBytes(bytes.data(), bytes.size(), value_);
+}
+
+void RoutingGridSnapshot::InputsHasher::Add(const RoutingLayerInfo &info) {
+  SnapshotWriter writer;
+  writer.PutRoutingLayerInfo(info);
+  AddBytes(writer.buffer());
+}
+
+void RoutingGridSnapshot::InputsHasher::Add(
+    const geometry::Layer &lhs,
+    const geometry::Layer &rhs,
+    const RoutingViaInfo &info) {
+  SnapshotWriter writer;
+  writer.Put<geometry::Layer>(lhs);
+  writer.Put<geometry::Layer>(rhs);
+  writer.PutRoutingViaInfo(info);
+  AddBytes(writer.buffer());
+}
+
+void RoutingGridSnapshot::InputsHasher::Add(
+    const geometry::ShapeCollection &shapes, int64_t padding) {
+  SnapshotWriter writer;
+  writer.Put<int64_t>(padding);
+  writer.PutSize(shapes.rectangles().size());
+  for (const auto &rectangle : shapes.rectangles()) {
+    writer.PutShape(*rectangle);
+  }
+  writer.PutSize(shapes.polygons().size());
+  for (const auto &polygon : shapes.polygons()) {
+    writer.PutShape(*polygon);
+  }
+  writer.PutSize(shapes.ports().size());
+  for (const auto &port : shapes.ports()) {
+    writer.PutShape(*port);
+  }
+  AddBytes(writer.buffer());
+}
+
+void RoutingGridSnapshot::InputsHasher::Add(const std::string &value) {
+  AddBytes(value);
+}
+
+absl::Status RoutingGridSnapshot::Save(const RoutingGrid &grid,
+                                       uint64_t inputs_hash,
+                                       const std::string &path) {
+  auto image = SaveToString(grid, inputs_hash);
+  if (!image.ok()) {
+    return image.status();
+  }
+
+  // Write to a temporary file first so that a reader never sees a partial
+  // snapshot.
+  std::string temporary_path = path + ".tmp";
+  {
+    std::ofstream out(temporary_path, std::ios::out | std::ios::binary);
+    if (!out) {
+      return absl::InternalError(
+          absl::StrCat("Could not open ", temporary_path, " for writing"));
+    }
+    out.write(image->data(), image->size());
+    if (!out) {
+      return absl::InternalError(
+          absl::StrCat("Could not write snapshot to ", temporary_path));
+    }
+  }
+  if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+    return absl::InternalError(
+        absl::StrCat("Could not move snapshot into place at ", path));
+  }
+
+  LOG(INFO) << "Saved RoutingGrid snapshot with " << grid.vertices().size()
+            << " vertices to " << path << " (" << image->size() << " bytes)";
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::string> RoutingGridSnapshot::SaveToString(
+    const RoutingGrid &grid, uint64_t inputs_hash) {
+  std::shared_lock mu(grid.lock_);
+
+  std::unordered_map<const RoutingTrack*, size_t> track_indices;
+  std::vector<const RoutingTrack*> tracks;
+  for (const auto &entry : grid.tracks_by_layer_) {
+    for (const RoutingTrack *track : entry.second) {
+      track_indices[track] = tracks.size();
+      tracks.push_back(track);
+    }
+  }
+  // The first inconsistency found in the grid. Writing carries on regardless,
+  // but the image is thrown away.
+  absl::Status error;
+  auto fail = [&](const std::string &message) {
+    if (error.ok()) {
+      error = absl::InternalError(
+          absl::StrCat("Cannot save inconsistent grid: ", message));
+    }
+    return kNone;
+  };
+
+  auto track_index = [&](const RoutingTrack *track) -> uint64_t {
+    if (!track) {
+      return kNone;
+    }
+    auto it = track_indices.find(track);
+    if (it == track_indices.end()) {
+      return fail(absl::StrCat("track ", track->Describe(),
+                               " is not in the grid"));
+    }
+    return it->second;
+  };
+  auto vertex_index = [&](const RoutingVertex *vertex) -> uint64_t {
+    if (!vertex) {
+      return kNone;
+    }
+    size_t index = vertex->contextual_index();
+    if (index >= grid.vertices_.size() || grid.vertices_[index] != vertex) {
+      return fail(absl::StrCat("vertex ", vertex->centre().Describe(),
+                               " has stale contextual index ", index));
+    }
+    return index;
+  };
+
+  SnapshotWriter writer;
+
+  writer.PutBool(grid.use_linear_cost_model_);
+  writer.PutSize(grid.global_nets_.size());
+  for (const std::string &net : grid.global_nets_) {
+    writer.PutString(net);
+  }
+
+  writer.PutSize(grid.routing_layer_info_.size());
+  for (const auto &entry : grid.routing_layer_info_) {
+    writer.PutRoutingLayerInfo(entry.second);
+  }
+
+  size_t num_via_infos = 0;
+  for (const auto &outer : grid.via_infos_) {
+    num_via_infos += outer.second.size();
+  }
+  writer.PutSize(num_via_infos);
+  for (const auto &outer : grid.via_infos_) {
+    for (const auto &inner : outer.second) {
+      writer.Put<geometry::Layer>(outer.first);
+      writer.Put<geometry::Layer>(inner.first);
+      writer.PutRoutingViaInfo(inner.second);
+    }
+  }
+
+  // Blockages, so that hazards on vertices can refer to their shapes.
+  std::unordered_map<const geometry::Rectangle*, size_t> rectangle_indices;
+  writer.PutSize(grid.rectangle_blockages_.size());
+  for (const auto &blockage : grid.rectangle_blockages_) {
+    rectangle_indices[&blockage->shape()] = rectangle_indices.size();
+    writer.PutShape(blockage->shape());
+    writer.Put<int64_t>(blockage->padding());
+    writer.PutLayers(blockage->blockage_layers());
+  }
+  std::unordered_map<const geometry::Polygon*, size_t> polygon_indices;
+  writer.PutSize(grid.polygon_blockages_.size());
+  for (const auto &blockage : grid.polygon_blockages_) {
+    polygon_indices[&blockage->shape()] = polygon_indices.size();
+    writer.PutShape(blockage->shape());
+    writer.Put<int64_t>(blockage->padding());
+    writer.PutLayers(blockage->blockage_layers());
+  }
+
+  writer.PutSize(tracks.size());
+  for (const RoutingTrack *track : tracks) {
+    writer.Put<geometry::Layer>(track->layer_);
+    writer.PutDirection(track->direction_);
+    writer.Put<int64_t>(track->pitch_);
+    writer.Put<int64_t>(track->width_);
+    writer.Put<int64_t>(track->vertex_via_width_);
+    writer.Put<int64_t>(track->vertex_via_length_);
+    writer.Put<int64_t>(track->min_separation_);
+    writer.Put<int64_t>(track->offset_);
+    writer.PutBool(track->edges_only_to_neighbours_);
+    writer.PutSize(track->keep_outs_.size());
+    for (const auto &keep_out : track->keep_outs_) {
+      writer.Put<int64_t>(keep_out.first);
+      writer.Put<int64_t>(keep_out.second);
+    }
+    for (const auto *blockages : {&track->blockages_.vertex_blockages,
+                                  &track->blockages_.edge_blockages}) {
+      writer.PutSize(blockages->size());
+      for (const RoutingTrackBlockage *blockage : *blockages) {
+        writer.Put<int64_t>(blockage->start());
+        writer.Put<int64_t>(blockage->end());
+        writer.PutString(blockage->net());
+      }
+    }
+  }
+
+  auto put_hazards = [&](
+      const std::map<std::string,
+                     std::vector<RoutingVertex::NetHazardInfo>> &hazards) {
+    std::vector<std::pair<const std::string*,
+                          const RoutingVertex::NetHazardInfo*>> permanent;
+    for (const auto &entry : hazards) {
+      for (const RoutingVertex::NetHazardInfo &info : entry.second) {
+        if (!info.is_temporary) {
+          permanent.push_back({&entry.first, &info});
+        }
+      }
+    }
+    writer.PutSize(permanent.size());
+    for (const auto &entry : permanent) {
+      const RoutingVertex::NetHazardInfo &info = *entry.second;
+      writer.PutString(*entry.first);
+      writer.PutOptionalLayer(info.layer);
+      // The shape to blame, if it is one of the grid's own blockages.
+      uint8_t kind = 0;
+      uint64_t index = kNone;
+      if (std::holds_alternative<std::optional<const geometry::Rectangle*>>(
+              info.blockage)) {
+        const auto &rectangle =
+            std::get<std::optional<const geometry::Rectangle*>>(info.blockage);
+        auto it = rectangle ?
+            rectangle_indices.find(*rectangle) : rectangle_indices.end();
+        if (it != rectangle_indices.end()) {
+          kind = 1;
+          index = it->second;
+        }
+      } else {
+        const auto &polygon =
+            std::get<std::optional<const geometry::Polygon*>>(info.blockage);
+        auto it = polygon ?
+            polygon_indices.find(*polygon) : polygon_indices.end();
+        if (it != polygon_indices.end()) {
+          kind = 2;
+          index = it->second;
+        }
+      }
+      writer.Put<uint8_t>(kind);
+      writer.Put<uint64_t>(index);
+    }
+  };
+
+  std::vector<RoutingVertex*> coincident;
+  auto is_off_grid = [&](const RoutingVertex *vertex) {
+    coincident.clear();
+    grid.off_grid_vertices_.FindWithin(
+        geometry::Rectangle(vertex->centre(), vertex->centre()), &coincident);
+    return std::find(coincident.begin(), coincident.end(), vertex) !=
+        coincident.end();
+  };
+
+  writer.PutSize(grid.vertices_.size());
+  for (const RoutingVertex *vertex : grid.vertices_) {
+    writer.PutPoint(vertex->centre_);
+    writer.PutBool(grid.vertex_arena_.Owns(vertex));
+    writer.PutBool(is_off_grid(vertex));
+    writer.PutLayers(vertex->connected_layers_);
+    writer.PutDouble(vertex->cost_);
+    writer.PutBool(vertex->update_tracks_on_blockage_);
+    writer.PutOptionalSize(vertex->grid_position_x_);
+    writer.PutOptionalSize(vertex->grid_position_y_);
+    writer.Put<uint64_t>(track_index(vertex->horizontal_track_));
+    writer.Put<uint64_t>(track_index(vertex->vertical_track_));
+    writer.PutLayers(vertex->forced_blockages_);
+    put_hazards(vertex->in_use_by_nets_);
+    put_hazards(vertex->blocked_by_nearby_nets_);
+    writer.PutOptionalLayer(vertex->explicit_net_layer_);
+    writer.PutBool(vertex->explicit_net_layer_requires_encap_);
+    writer.PutOptionalString(vertex->hosts_port_);
+    writer.PutSize(vertex->forced_encap_directions_.size());
+    for (const auto &entry : vertex->forced_encap_directions_) {
+      writer.Put<geometry::Layer>(entry.first);
+      writer.PutDirection(entry.second);
+    }
+    writer.PutSize(vertex->neighbours_.size());
+    for (const auto &neighbour : vertex->neighbours_) {
+      writer.Put<uint8_t>(static_cast<uint8_t>(neighbour.position));
+      writer.Put<uint64_t>(vertex_index(neighbour.vertex));
+    }
+  }
+
+  // Edges are numbered in the order they are written, track edges first.
+  std::unordered_map<const RoutingEdge*, size_t> edge_indices;
+  auto edge_index = [&](const RoutingEdge *edge) -> uint64_t {
+    if (!edge) {
+      return kNone;
+    }
+    auto it = edge_indices.find(edge);
+    if (it == edge_indices.end()) {
+      return fail(absl::StrCat("edge ", edge->Describe(),
+                               " is not on a track or in the grid's off-grid "
+                               "edges"));
+    }
+    return it->second;
+  };
+
+  auto put_edge = [&](const RoutingEdge &edge) {
+    edge_indices[&edge] = edge_indices.size();
+    writer.Put<uint64_t>(vertex_index(edge.first_));
+    writer.Put<uint64_t>(vertex_index(edge.second_));
+    writer.PutOptionalLayer(edge.layer_);
+    writer.PutDouble(edge.cost_);
+    writer.PutBool(edge.blocked_);
+    writer.PutOptionalString(edge.in_use_by_net_);
+  };
+
+  // The vertices on each track, in order, and then the track's edges.
+  for (const RoutingTrack *track : tracks) {
+    writer.PutSize(track->vertices_by_offset_.size());
+    for (const auto &entry : track->vertices_by_offset_) {
+      writer.Put<uint64_t>(vertex_index(entry.second));
+    }
+    writer.PutSize(track->edges_.size());
+    for (const RoutingEdge *edge : track->edges_) {
+      put_edge(*edge);
+    }
+  }
+
+  writer.PutSize(grid.off_grid_edges_.size());
+  for (const RoutingEdge *edge : grid.off_grid_edges_) {
+    put_edge(*edge);
+  }
+
+  size_t num_geometries = 0;
+  for (const auto &outer : grid.grid_geometry_by_layers_) {
+    num_geometries += outer.second.size();
+  }
+  writer.PutSize(num_geometries);
+  for (const auto &outer : grid.grid_geometry_by_layers_) {
+    for (const auto &inner : outer.second) {
+      const RoutingGridGeometry &grid_geometry = inner.second;
+      writer.Put<geometry::Layer>(outer.first);
+      writer.Put<geometry::Layer>(inner.first);
+      for (const auto *tracks_by_index : {
+               &grid_geometry.horizontal_tracks_by_index(),
+               &grid_geometry.vertical_tracks_by_index()}) {
+        writer.PutSize(tracks_by_index->size());
+        for (const RoutingTrack *track : *tracks_by_index) {
+          writer.Put<uint64_t>(track_index(track));
+        }
+      }
+      const auto &vertices = grid_geometry.vertices_by_grid_position();
+      writer.PutSize(vertices.size());
+      for (const auto &column : vertices) {
+        writer.PutSize(column.size());
+        for (const RoutingVertex *vertex : column) {
+          writer.Put<uint64_t>(vertex_index(vertex));
+        }
+      }
+    }
+  }
+
+  // Installed paths, by the indices of their vertices and edges.
+  std::unordered_map<const RoutingPath*, size_t> path_indices;
+  auto put_layer_pair = [&](
+      const std::optional<RoutingPath::CostedLayerPair> &pair) {
+    writer.PutBool(pair.has_value());
+    writer.PutDouble(pair ? pair->cost : 0.0);
+    writer.Put<geometry::Layer>(pair ? pair->source : 0);
+    writer.Put<geometry::Layer>(pair ? pair->target : 0);
+  };
+  writer.PutSize(grid.paths_.size());
+  for (const RoutingPath *path : grid.paths_) {
+    path_indices[path] = path_indices.size();
+    writer.PutSize(path->vertices_.size());
+    for (const RoutingVertex *vertex : path->vertices_) {
+      writer.Put<uint64_t>(vertex_index(vertex));
+    }
+    writer.PutSize(path->edges_.size());
+    for (const RoutingEdge *edge : path->edges_) {
+      writer.Put<uint64_t>(edge_index(edge));
+    }
+    writer.PutString(path->nets_.primary());
+    writer.PutSize(path->nets_.nets().size());
+    for (const std::string &net : path->nets_.nets()) {
+      writer.PutString(net);
+    }
+    writer.PutLayers(path->start_access_layers_);
+    writer.PutLayers(path->end_access_layers_);
+    put_layer_pair(path->picked_start_layers_);
+    put_layer_pair(path->picked_end_layers_);
+    writer.PutBool(path->abbreviate_paths_);
+    writer.PutBool(path->encap_start_port_);
+    writer.PutBool(path->encap_end_port_);
+    writer.PutBool(path->legalised_);
+    writer.PutSize(path->skipped_vias_.size());
+    for (const RoutingVertex *vertex : path->skipped_vias_) {
+      writer.Put<uint64_t>(vertex_index(vertex));
+    }
+  }
+
+  // What the vertices in those paths record about them, for just those
+  // vertices.
+  std::vector<const RoutingVertex*> vertices_in_paths;
+  for (const RoutingVertex *vertex : grid.vertices_) {
+    if (!vertex->installed_in_paths_.empty() ||
+        !vertex->in_out_edges_.empty()) {
+      vertices_in_paths.push_back(vertex);
+    }
+  }
+  writer.PutSize(vertices_in_paths.size());
+  for (const RoutingVertex *vertex : vertices_in_paths) {
+    writer.Put<uint64_t>(vertex_index(vertex));
+    writer.PutSize(vertex->installed_in_paths_.size());
+    for (const auto &entry : vertex->installed_in_paths_) {
+      auto it = path_indices.find(entry.first);
+      writer.Put<uint64_t>(it == path_indices.end() ?
+          fail(absl::StrCat("vertex ", vertex->centre().Describe(),
+                            " is installed in a path the grid does not own")) :
+          it->second);
+      writer.PutSize(entry.second.size());
+      for (const RoutingEdge *edge : entry.second) {
+        writer.Put<uint64_t>(edge_index(edge));
+      }
+    }
+    writer.PutSize(vertex->in_out_edges_.size());
+    for (const auto &entry : vertex->in_out_edges_) {
+      writer.Put<uint64_t>(edge_index(entry.first));
+      writer.Put<uint64_t>(edge_index(entry.second));
+    }
+  }
+
+  if (!error.ok()) {
+    return error;
+  }
+
+  const std::string &body = writer.buffer();
+  SnapshotWriter header;
+  header.Put<uint32_t>(kVersion);
+  header.Put<uint64_t>(inputs_hash);
+  header.Put<uint64_t>(body.size());
+  header.Put<uint64_t>(HashBytes(body.data(), body.size(), kHashSeed));
+
+  std::string image;
+  image.reserve(kHeaderSize + body.size());
+  image.append(kMagic, kMagicSize);
+  image.append(header.buffer());
+  image.append(body);
+  return image;
+}
+
+absl::StatusOr<uint64_t> RoutingGridSnapshot::ReadInputsHash(
+    const std::string &path) {
+  MappedFile file;
+  absl::Status opened = file.Open(path);
+  if (!opened.ok()) {
+    return opened;
+  }
+  auto header = ReadHeader(
+      std::string_view(file.data(), file.size()), path);
+  if (!header.ok()) {
+    return header.status();
+  }
+  return header->inputs_hash;
+}
+
+absl::Status RoutingGridSnapshot::Load(
+    const std::string &path,
+    const std::optional<uint64_t> &expected_inputs_hash,
+    RoutingGrid *grid) {
+  auto start = std::chrono::steady_clock::now();
+
+  MappedFile file;
+  absl::Status opened = file.Open(path);
+  if (!opened.ok()) {
+    return opened;
+  }
+  absl::Status loaded = LoadFromBuffer(
+      std::string_view(file.data(), file.size()), path, expected_inputs_hash,
+      grid);
+  if (!loaded.ok()) {
+    return loaded;
+  }
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  LOG(INFO) << "Loaded RoutingGrid snapshot with " << grid->vertices().size()
+            << " vertices from " << path << " in " << elapsed.count() << " ms";
+  return absl::OkStatus();
+}
+
+absl::Status RoutingGridSnapshot::LoadFromString(
+    std::string_view image,
+    const std::optional<uint64_t> &expected_inputs_hash,
+    RoutingGrid *grid) {
+  return LoadFromBuffer(image, "(in memory)", expected_inputs_hash, grid);
+}
+
+absl::Status RoutingGridSnapshot::LoadFromBuffer(
+    std::string_view image,
+    const std::string &name,
+    const std::optional<uint64_t> &expected_inputs_hash,
+    RoutingGrid *grid) {
+  auto header = ReadHeader(image, name);
+  if (!header.ok()) {
+    return header.status();
+  }
+  if (expected_inputs_hash && *expected_inputs_hash != header->inputs_hash) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Snapshot ", name, " was built from different inputs"));
+  }
+  const char *body = image.data() + kHeaderSize;
+  if (image.size() - kHeaderSize != header->body_size ||
+      HashBytes(body, header->body_size, kHashSeed) != header->checksum) {
+    return absl::DataLossError(
+        absl::StrCat("Snapshot ", name, " is truncated or corrupt"));
+  }
+
+  std::unique_lock mu(grid->lock_);
+  if (!grid->vertices_.empty() ||
+      !grid->tracks_by_layer_.empty() ||
+      !grid->routing_layer_info_.empty() ||
+      !grid->via_infos_.empty()) {
+    return absl::FailedPreconditionError(
+        "Snapshots can only be loaded into an empty RoutingGrid");
+  }
+
+  SnapshotReader reader(body, header->body_size);
+  absl::Status corrupt = absl::DataLossError(
+      absl::StrCat("Snapshot ", name, " is malformed"));
+
+  // Everything is read into temporaries and checked before any of it is given
+  // to the grid, so a bad snapshot leaves the grid as it was. Objects the grid
+  // would own are still allocated from its arenas, and freed again by the
+  // cleanup below if we bail out.
+  bool use_linear_cost_model = reader.GetBool();
+  std::vector<std::string> global_nets;
+  size_t num_global_nets = reader.GetCount();
+  for (size_t i = 0; i < num_global_nets && reader.ok(); ++i) {
+    global_nets.push_back(reader.GetString());
+  }
+
+  std::map<geometry::Layer, RoutingLayerInfo> layer_infos;
+  size_t num_layer_infos = reader.GetCount();
+  for (size_t i = 0; i < num_layer_infos && reader.ok(); ++i) {
+    RoutingLayerInfo info = reader.GetRoutingLayerInfo();
+    if (!layer_infos.insert({info.layer(), info}).second) {
+      return corrupt;
+    }
+  }
+
+  std::vector<std::tuple<geometry::Layer, geometry::Layer, RoutingViaInfo>>
+      via_infos;
+  std::set<std::pair<geometry::Layer, geometry::Layer>> via_layers;
+  size_t num_via_infos = reader.GetCount();
+  for (size_t i = 0; i < num_via_infos && reader.ok(); ++i) {
+    geometry::Layer lhs = reader.Get<geometry::Layer>();
+    geometry::Layer rhs = reader.Get<geometry::Layer>();
+    if (!via_layers.insert(
+            geometry::OrderFirstAndSecondLayers(lhs, rhs)).second) {
+      return corrupt;
+    }
+    via_infos.emplace_back(lhs, rhs, reader.GetRoutingViaInfo());
+  }
+
+  // The blockages don't refer to the grid until they are remembered by it.
+  std::vector<std::unique_ptr<RoutingGridBlockage<geometry::Rectangle>>>
+      rectangle_blockages;
+  std::vector<const geometry::Rectangle*> rectangles;
+  size_t num_rectangles = reader.GetCount();
+  for (size_t i = 0; i < num_rectangles && reader.ok(); ++i) {
+    geometry::Rectangle shape = reader.GetShapeRectangle();
+    int64_t padding = reader.Get<int64_t>();
+    std::set<geometry::Layer> blockage_layers = reader.GetLayers();
+    rectangle_blockages.emplace_back(
+        new RoutingGridBlockage<geometry::Rectangle>(
+            *grid, shape, blockage_layers, padding));
+    rectangles.push_back(&rectangle_blockages.back()->shape());
+  }
+  std::vector<std::unique_ptr<RoutingGridBlockage<geometry::Polygon>>>
+      polygon_blockages;
+  std::vector<const geometry::Polygon*> polygons;
+  size_t num_polygons = reader.GetCount();
+  for (size_t i = 0; i < num_polygons && reader.ok(); ++i) {
+    geometry::Polygon shape = reader.GetShapePolygon();
+    int64_t padding = reader.Get<int64_t>();
+    std::set<geometry::Layer> blockage_layers = reader.GetLayers();
+    polygon_blockages.emplace_back(
+        new RoutingGridBlockage<geometry::Polygon>(
+            *grid, shape, blockage_layers, padding));
+    polygons.push_back(&polygon_blockages.back()->shape());
+  }
+  if (!reader.ok()) {
+    return corrupt;
+  }
+
+  // The objects made so far that the grid will own, if we get that far. Their
+  // destructors don't follow pointers to each other, so it doesn't matter that
+  // tracks and edges still refer to vertices when they are freed.
+  std::vector<RoutingTrack*> tracks;
+  std::vector<RoutingVertex*> vertices;
+  std::vector<RoutingEdge*> off_grid_edges;
+  absl::Cleanup free_unowned = [&]() {
+    for (RoutingEdge *edge : off_grid_edges) {
+      delete edge;
+    }
+    // Track edges go with their tracks.
+    for (RoutingTrack *track : tracks) {
+      grid->track_arena_.Delete(track);
+    }
+    for (RoutingVertex *vertex : vertices) {
+      grid->DeleteVertex(vertex);
+    }
+  };
+
+  size_t num_tracks = reader.GetCount();
+  tracks.reserve(num_tracks);
+  for (size_t i = 0; i < num_tracks && reader.ok(); ++i) {
+    geometry::Layer layer = reader.Get<geometry::Layer>();
+    RoutingTrackDirection direction = reader.GetDirection();
+    int64_t pitch = reader.Get<int64_t>();
+    int64_t width = reader.Get<int64_t>();
+    int64_t vertex_via_width = reader.Get<int64_t>();
+    int64_t vertex_via_length = reader.Get<int64_t>();
+    int64_t min_separation = reader.Get<int64_t>();
+    int64_t offset = reader.Get<int64_t>();
+    bool edges_only_to_neighbours = reader.GetBool();
+    RoutingTrack *track = grid->track_arena_.New(
+        layer, direction, pitch, width, vertex_via_width, vertex_via_length,
+        min_separation, offset, edges_only_to_neighbours);
+    tracks.push_back(track);
+
+    size_t num_keep_outs = reader.GetCount(2 * sizeof(int64_t));
+    for (size_t j = 0; j < num_keep_outs; ++j) {
+      int64_t low = reader.Get<int64_t>();
+      int64_t high = reader.Get<int64_t>();
+      track->keep_outs_.push_back({low, high});
+    }
+    for (auto *blockages : {&track->blockages_.vertex_blockages,
+                            &track->blockages_.edge_blockages}) {
+      size_t num_blockages = reader.GetCount(2 * sizeof(int64_t));
+      blockages->reserve(num_blockages);
+      for (size_t j = 0; j < num_blockages && reader.ok(); ++j) {
+        int64_t blockage_start = reader.Get<int64_t>();
+        int64_t blockage_end = reader.Get<int64_t>();
+        std::string net = reader.GetString();
+        if (blockage_end < blockage_start) {
+          return corrupt;
+        }
+        blockages->push_back(
+            new RoutingTrackBlockage(blockage_start, blockage_end, net));
+      }
+    }
+  }
+  if (!reader.ok()) {
+    return corrupt;
+  }
+
+  auto get_track = [&]() -> RoutingTrack* {
+    uint64_t index = reader.GetIndex(tracks.size());
+    return index == kNone ? nullptr : tracks[index];
+  };
+
+  auto get_hazards = [&](
+      std::map<std::string,
+               std::vector<RoutingVertex::NetHazardInfo>> *hazards) {
+    size_t num_hazards = reader.GetCount();
+    for (size_t i = 0; i < num_hazards && reader.ok(); ++i) {
+      std::string net = reader.GetString();
+      RoutingVertex::NetHazardInfo info;
+      info.is_temporary = false;
+      info.layer = reader.GetOptionalLayer();
+      uint8_t kind = reader.Get<uint8_t>();
+      uint64_t index = reader.GetIndex(
+          kind == 2 ? polygons.size() : rectangles.size());
+      if (kind == 1 && index != kNone) {
+        info.blockage = std::optional<const geometry::Rectangle*>(
+            rectangles[index]);
+      } else if (kind == 2 && index != kNone) {
+        info.blockage = std::optional<const geometry::Polygon*>(
+            polygons[index]);
+      } else {
+        info.blockage = std::optional<const geometry::Rectangle*>();
+      }
+      (*hazards)[net].push_back(info);
+    }
+  };
+
+  // Vertices are created in two passes: first their own state, and then (once
+  // they all exist) everything that refers to other vertices.
+  size_t num_vertices = reader.GetCount();
+  vertices.reserve(num_vertices);
+  std::vector<bool> off_grid(num_vertices, false);
+  std::vector<std::vector<std::pair<uint8_t, uint64_t>>> neighbours(
+      num_vertices);
+  grid->vertex_arena_.Reserve(num_vertices);
+  for (size_t i = 0; i < num_vertices && reader.ok(); ++i) {
+    geometry::Point centre = reader.GetPoint();
+    bool in_arena = reader.GetBool();
+    RoutingVertex *vertex = in_arena ?
+        grid->vertex_arena_.New(centre) : new RoutingVertex(centre);
+    vertices.push_back(vertex);
+    off_grid[i] = reader.GetBool();
+    vertex->connected_layers_ = reader.GetLayers();
+    if (vertex->connected_layers_.size() > 2) {
+      return corrupt;
+    }
+    vertex->cost_ = reader.GetDouble();
+    vertex->update_tracks_on_blockage_ = reader.GetBool();
+    vertex->grid_position_x_ = reader.GetOptionalSize();
+    vertex->grid_position_y_ = reader.GetOptionalSize();
+    vertex->horizontal_track_ = get_track();
+    vertex->vertical_track_ = get_track();
+    vertex->forced_blockages_ = reader.GetLayers();
+    get_hazards(&vertex->in_use_by_nets_);
+    get_hazards(&vertex->blocked_by_nearby_nets_);
+    vertex->explicit_net_layer_ = reader.GetOptionalLayer();
+    vertex->explicit_net_layer_requires_encap_ = reader.GetBool();
+    vertex->hosts_port_ = reader.GetOptionalString();
+    size_t num_encap_directions = reader.GetCount();
+    for (size_t j = 0; j < num_encap_directions && reader.ok(); ++j) {
+      geometry::Layer layer = reader.Get<geometry::Layer>();
+      vertex->forced_encap_directions_[layer] = reader.GetDirection();
+    }
+    size_t num_neighbours = reader.GetCount();
+    for (size_t j = 0; j < num_neighbours && reader.ok(); ++j) {
+      uint8_t position = reader.Get<uint8_t>();
+      uint64_t index = reader.GetIndex(num_vertices);
+      if (position > static_cast<uint8_t>(geometry::Compass::SOUTH_WEST)) {
+        return corrupt;
+      }
+      neighbours[i].push_back({position, index});
+    }
+  }
+  if (!reader.ok()) {
+    return corrupt;
+  }
+  for (size_t i = 0; i < num_vertices; ++i) {
+    for (const auto &neighbour : neighbours[i]) {
+      if (neighbour.second == kNone)
+        continue;
+      vertices[i]->AddNeighbour(
+          static_cast<geometry::Compass>(neighbour.first),
+          vertices[neighbour.second]);
+    }
+  }
+
+  // Edges, whether they are on tracks or not, connect their vertices.
+  auto get_edge = [&](RoutingEdge *edge) {
+    edge->set_layer(reader.GetOptionalLayer());
+    edge->cost_ = reader.GetDouble();
+    edge->blocked_ = reader.GetBool();
+    edge->in_use_by_net_ = reader.GetOptionalString();
+    edge->first_->AddEdge(edge);
+    edge->second_->AddEdge(edge);
+  };
+
+  // Every edge, in the order they were written, so that paths can refer to
+  // them.
+  std::vector<RoutingEdge*> edges;
+
+  for (RoutingTrack *track : tracks) {
+    size_t num_track_vertices = reader.GetCount(sizeof(uint64_t));
+    for (size_t i = 0; i < num_track_vertices && reader.ok(); ++i) {
+      uint64_t index = reader.GetIndex(num_vertices);
+      if (index == kNone) {
+        return corrupt;
+      }
+      RoutingVertex *vertex = vertices[index];
+      track->vertices_by_offset_.insert(
+          {track->ProjectOntoTrack(vertex->centre()), vertex});
+    }
+    size_t num_edges = reader.GetCount();
+    for (size_t i = 0; i < num_edges && reader.ok(); ++i) {
+      uint64_t first = reader.GetIndex(num_vertices);
+      uint64_t second = reader.GetIndex(num_vertices);
+      if (!reader.ok() || first == kNone || second == kNone) {
+        return corrupt;
+      }
+      RoutingEdge *edge = track->edge_arena_.New(
+          vertices[first], vertices[second]);
+      edge->set_track(track);
+      track->edges_.insert(edge);
+      get_edge(edge);
+      edges.push_back(edge);
+    }
+  }
+  if (!reader.ok()) {
+    return corrupt;
+  }
+
+  size_t num_off_grid_edges = reader.GetCount();
+  for (size_t i = 0; i < num_off_grid_edges && reader.ok(); ++i) {
+    uint64_t first = reader.GetIndex(num_vertices);
+    uint64_t second = reader.GetIndex(num_vertices);
+    if (!reader.ok() || first == kNone || second == kNone) {
+      return corrupt;
+    }
+    RoutingEdge *edge = new RoutingEdge(vertices[first], vertices[second]);
+    off_grid_edges.push_back(edge);
+    get_edge(edge);
+    edges.push_back(edge);
+  }
+
+  size_t num_geometries = reader.GetCount();
+  std::vector<std::tuple<geometry::Layer, geometry::Layer, RoutingGridGeometry>>
+      geometries;
+  std::set<std::pair<geometry::Layer, geometry::Layer>> geometry_layers;
+  for (size_t i = 0; i < num_geometries && reader.ok(); ++i) {
+    geometry::Layer first = reader.Get<geometry::Layer>();
+    geometry::Layer second = reader.Get<geometry::Layer>();
+    auto first_info = layer_infos.find(first);
+    auto second_info = layer_infos.find(second);
+    if (first_info == layer_infos.end() || second_info == layer_infos.end()) {
+      return corrupt;
+    }
+    // AddRoutingGridGeometry would refuse a second geometry for the same
+    // layers, so that is checked now, while we can still bail out.
+    if (!geometry_layers.insert(
+            geometry::OrderFirstAndSecondLayers(first, second)).second) {
+      return corrupt;
+    }
+    // As RoutingGrid::PickHorizontalAndVertical, which would die on a bad
+    // pair.
+    const RoutingLayerInfo *horizontal = &first_info->second;
+    const RoutingLayerInfo *vertical = &second_info->second;
+    if (horizontal->direction() != RoutingTrackDirection::kTrackHorizontal) {
+      std::swap(horizontal, vertical);
+    }
+    if (horizontal->direction() != RoutingTrackDirection::kTrackHorizontal ||
+        vertical->direction() != RoutingTrackDirection::kTrackVertical) {
+      return corrupt;
+    }
+    RoutingGridGeometry grid_geometry;
+    grid_geometry.ComputeForLayers(*horizontal, *vertical);
+    for (auto *tracks_by_index : {
+             &grid_geometry.horizontal_tracks_by_index(),
+             &grid_geometry.vertical_tracks_by_index()}) {
+      size_t num_indices = reader.GetCount(sizeof(uint64_t));
+      for (size_t j = 0; j < num_indices && reader.ok(); ++j) {
+        tracks_by_index->push_back(get_track());
+      }
+    }
+    auto &by_position = grid_geometry.vertices_by_grid_position();
+    size_t num_columns = reader.GetCount(sizeof(uint64_t));
+    if (num_columns != by_position.size()) {
+      return corrupt;
+    }
+    for (size_t column = 0; column < num_columns && reader.ok(); ++column) {
+      size_t num_rows = reader.GetCount(sizeof(uint64_t));
+      if (num_rows != by_position[column].size()) {
+        return corrupt;
+      }
+      for (size_t row = 0; row < num_rows && reader.ok(); ++row) {
+        uint64_t index = reader.GetIndex(num_vertices);
+        by_position[column][row] = index == kNone ? nullptr : vertices[index];
+      }
+    }
+    geometries.emplace_back(first, second, std::move(grid_geometry));
+  }
+  if (!reader.ok()) {
+    return corrupt;
+  }
+
+  auto get_vertex = [&]() -> RoutingVertex* {
+    uint64_t index = reader.GetIndex(num_vertices);
+    return index == kNone ? nullptr : vertices[index];
+  };
+  auto get_indexed_edge = [&]() -> RoutingEdge* {
+    uint64_t index = reader.GetIndex(edges.size());
+    return index == kNone ? nullptr : edges[index];
+  };
+  auto get_layer_pair = [&]() -> std::optional<RoutingPath::CostedLayerPair> {
+    bool has_value = reader.GetBool();
+    RoutingPath::CostedLayerPair pair;
+    pair.cost = reader.GetDouble();
+    pair.source = reader.Get<geometry::Layer>();
+    pair.target = reader.Get<geometry::Layer>();
+    if (!has_value) {
+      return std::nullopt;
+    }
+    return pair;
+  };
+
+  // Paths only refer to vertices and edges, so they don't touch the grid
+  // until they are handed to it.
+  size_t num_paths = reader.GetCount();
+  std::vector<std::unique_ptr<RoutingPath>> paths;
+  paths.reserve(num_paths);
+  for (size_t i = 0; i < num_paths && reader.ok(); ++i) {
+    std::vector<RoutingVertex*> path_vertices;
+    size_t num_path_vertices = reader.GetCount(sizeof(uint64_t));
+    for (size_t j = 0; j < num_path_vertices && reader.ok(); ++j) {
+      path_vertices.push_back(get_vertex());
+    }
+    std::vector<RoutingEdge*> path_edges;
+    size_t num_path_edges = reader.GetCount(sizeof(uint64_t));
+    for (size_t j = 0; j < num_path_edges && reader.ok(); ++j) {
+      path_edges.push_back(get_indexed_edge());
+    }
+    if (!reader.ok() ||
+        path_vertices.size() != path_edges.size() + 1 ||
+        std::count(path_vertices.begin(), path_vertices.end(), nullptr) ||
+        std::count(path_edges.begin(), path_edges.end(), nullptr)) {
+      return corrupt;
+    }
+    auto path = std::make_unique<RoutingPath>(
+        path_vertices.front(), std::deque<RoutingEdge*>(), grid);
+    path->vertices_ = std::move(path_vertices);
+    path->edges_ = std::move(path_edges);
+    std::string primary = reader.GetString();
+    std::set<std::string> nets;
+    size_t num_nets = reader.GetCount();
+    for (size_t j = 0; j < num_nets && reader.ok(); ++j) {
+      nets.insert(reader.GetString());
+    }
+    path->nets_ = EquivalentNets(primary, nets);
+    path->start_access_layers_ = reader.GetLayers();
+    path->end_access_layers_ = reader.GetLayers();
+    path->picked_start_layers_ = get_layer_pair();
+    path->picked_end_layers_ = get_layer_pair();
+    path->abbreviate_paths_ = reader.GetBool();
+    path->encap_start_port_ = reader.GetBool();
+    path->encap_end_port_ = reader.GetBool();
+    path->legalised_ = reader.GetBool();
+    size_t num_skipped_vias = reader.GetCount(sizeof(uint64_t));
+    for (size_t j = 0; j < num_skipped_vias && reader.ok(); ++j) {
+      RoutingVertex *vertex = get_vertex();
+      if (!vertex) {
+        return corrupt;
+      }
+      path->skipped_vias_.insert(vertex);
+    }
+    paths.push_back(std::move(path));
+  }
+
+  struct VertexInPaths {
+    RoutingVertex *vertex;
+    std::map<RoutingPath*, std::set<RoutingEdge*>> installed_in_paths;
+    std::set<std::pair<RoutingEdge*, RoutingEdge*>> in_out_edges;
+  };
+  std::vector<VertexInPaths> vertices_in_paths;
+  size_t num_vertices_in_paths = reader.GetCount(sizeof(uint64_t));
+  for (size_t i = 0; i < num_vertices_in_paths && reader.ok(); ++i) {
+    VertexInPaths entry;
+    entry.vertex = get_vertex();
+    size_t num_installed = reader.GetCount(sizeof(uint64_t));
+    for (size_t j = 0; j < num_installed && reader.ok(); ++j) {
+      uint64_t index = reader.GetIndex(paths.size());
+      std::set<RoutingEdge*> &path_edges =
+          entry.installed_in_paths[index == kNone ? nullptr :
+                                                    paths[index].get()];
+      size_t num_path_edges = reader.GetCount(sizeof(uint64_t));
+      for (size_t k = 0; k < num_path_edges && reader.ok(); ++k) {
+        path_edges.insert(get_indexed_edge());
+      }
+    }
+    size_t num_in_out_edges = reader.GetCount(2 * sizeof(uint64_t));
+    for (size_t j = 0; j < num_in_out_edges && reader.ok(); ++j) {
+      RoutingEdge *in = get_indexed_edge();
+      RoutingEdge *out = get_indexed_edge();
+      entry.in_out_edges.insert({in, out});
+    }
+    if (!entry.vertex || entry.installed_in_paths.count(nullptr)) {
+      return corrupt;
+    }
+    vertices_in_paths.push_back(std::move(entry));
+  }
+  if (!reader.ok() || !reader.AtEnd()) {
+    return corrupt;
+  }
+
+  // Everything has been read and checked, so it is all handed to the grid.
+  std::move(free_unowned).Cancel();
+  auto must_add = [](const absl::Status &added) {
+    LOG_IF(FATAL, !added.ok())
+        << "Could not restore snapshot contents that were already checked: "
+        << added;
+  };
+  grid->set_use_linear_cost_model(use_linear_cost_model);
+  for (const std::string &net : global_nets) {
+    grid->AddGlobalNet(net);
+  }
+  for (const auto &entry : layer_infos) {
+    must_add(grid->AddRoutingLayerInfo(entry.second));
+  }
+  for (const auto &[lhs, rhs, info] : via_infos) {
+    must_add(grid->AddRoutingViaInfo(lhs, rhs, info));
+  }
+  for (auto &blockage : rectangle_blockages) {
+    grid->RememberBlockage(blockage.release());
+  }
+  for (auto &blockage : polygon_blockages) {
+    grid->RememberBlockage(blockage.release());
+  }
+  for (RoutingTrack *track : tracks) {
+    grid->AddTrackToLayer(track, track->layer());
+  }
+  for (size_t i = 0; i < num_vertices; ++i) {
+    RoutingVertex *vertex = vertices[i];
+    vertex->UpdateCachedStatus(std::nullopt);
+    if (off_grid[i]) {
+      grid->AddOffGridVertex(vertex);
+    } else {
+      grid->AddVertex(vertex);
+    }
+  }
+  for (RoutingEdge *edge : off_grid_edges) {
+    grid->AddOffGridEdge(edge);
+  }
+  for (auto &[first, second, grid_geometry] : geometries) {
+    must_add(grid->AddRoutingGridGeometry(first, second, grid_geometry));
+  }
+  for (VertexInPaths &entry : vertices_in_paths) {
+    entry.vertex->installed_in_paths_ = std::move(entry.installed_in_paths);
+    entry.vertex->in_out_edges_ = std::move(entry.in_out_edges);
+  }
+  for (std::unique_ptr<RoutingPath> &path : paths) {
+    grid->IndexInstalledPath(*path);
+    grid->AddInstalledPath(path.release());
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace routing
+}  // namespace bfg
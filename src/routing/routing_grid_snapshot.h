@@ -0,0 +1,119 @@
+#ifndef ROUTING_GRID_SNAPSHOT_H_
+#define ROUTING_GRID_SNAPSHOT_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+
+#include "routing_layer_info.h"
+#include "routing_via_info.h"
+#include "../geometry/layer.h"
+#include "../geometry/shape_collection.h"
+
+namespace bfg {
+namespace routing {
+
+class RoutingGrid;
+
+// Saves a fully constructed RoutingGrid (layer and via infos, tracks and their
+// blockages, vertices, edges, permanent blockages and the hits they have
+// already made, grid geometries and installed paths) to a compact binary file,
+// and restores it into an empty RoutingGrid without repeating ConnectLayers,
+// any of the blockage hit-testing or any routing.
+//
+// The file is a fixed header followed by a flat, little-endian body:
+//
+//   "BFGRGSNP"  magic
+//   uint32      format version (kVersion)
+//   uint64      the caller's inputs hash
+//   uint64      length of the body
+//   uint64      checksum of the body
+//   ...         body
+//
+// The file is memory-mapped to load it. Files with a different version or a
+// bad checksum are rejected rather than read.
+//
+// Objects are referred to by their index in the order they were written, so a
+// restored grid has the same vertex contextual indices as the original.
+//
+// Installed paths are saved by the indices of their vertices and edges, and
+// come back installed in the restored grid, so a grid can be saved part-way
+// through routing and carry on from where it was. The ports a path was routed
+// between are not kept.
+//
+// Only permanent state is saved: temporary blockages and the status they cause
+// are dropped.
+class RoutingGridSnapshot {
+ public:
+  static constexpr uint32_t kVersion = 2;
+
+  // Accumulates a hash of whatever goes into building a grid, so that callers
+  // can decide whether a snapshot is reusable without building the grid first.
+  // The hash depends only on the content of its inputs, in order.
+  class InputsHasher {
+   public:
+    InputsHasher();
+
+    void Add(const RoutingLayerInfo &info);
+    void Add(const geometry::Layer &lhs,
+             const geometry::Layer &rhs,
+             const RoutingViaInfo &info);
+    void Add(const geometry::ShapeCollection &shapes, int64_t padding);
+    void Add(const std::string &value);
+
+    uint64_t value() const { return value_; }
+
+   private:
+    void AddBytes(const std::string &bytes);
+
+    uint64_t value_;
+  };
+
+  static absl::Status Save(const RoutingGrid &grid,
+                           uint64_t inputs_hash,
+                           const std::string &path);
+
+  // As Save, but returns the snapshot image instead of writing it to a file.
+  // If the grid's objects don't refer to each other consistently (a vertex
+  // with a stale index, an edge the grid doesn't know about, and so on),
+  // InternalError is returned instead.
+  static absl::StatusOr<std::string> SaveToString(const RoutingGrid &grid,
+                                                  uint64_t inputs_hash);
+
+  // Returns the inputs hash stored in the snapshot at path, without reading the
+  // rest of it.
+  static absl::StatusOr<uint64_t> ReadInputsHash(const std::string &path);
+
+  // Restores the snapshot at path into the given grid, which must be newly
+  // constructed (with the same PhysicalPropertiesDatabase as the original). If
+  // expected_inputs_hash is given and does not match the snapshot's,
+  // FailedPreconditionError is returned. The whole snapshot is read and
+  // checked before anything is added to the grid, so the grid is untouched by
+  // any error.
+  static absl::Status Load(const std::string &path,
+                           const std::optional<uint64_t> &expected_inputs_hash,
+                           RoutingGrid *grid);
+
+  // As Load, but from an image made by SaveToString. The image is only read,
+  // so many grids can be loaded from the same one concurrently.
+  static absl::Status LoadFromString(
+      std::string_view image,
+      const std::optional<uint64_t> &expected_inputs_hash,
+      RoutingGrid *grid);
+
+ private:
+  static absl::Status LoadFromBuffer(
+      std::string_view image,
+      const std::string &name,
+      const std::optional<uint64_t> &expected_inputs_hash,
+      RoutingGrid *grid);
+};
+
+}  // namespace routing
+}  // namespace bfg
+
+#endif  // ROUTING_GRID_SNAPSHOT_H_
@@ -0,0 +1,285 @@
+#include "routing_grid_snapshot.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "routing_edge.h"
+#include "routing_grid.h"
+#include "routing_layer_info.h"
+#include "routing_path.h"
+#include "routing_track.h"
+#include "routing_test_grid.h"
+#include "routing_vertex.h"
+#include "routing_via_info.h"
+#include "../design_database.h"
+#include "../equivalent_nets.h"
+#include "../physical_properties_database.h"
+#include "../geometry/layer.h"
+#include "../geometry/point.h"
+#include "../geometry/rectangle.h"
+#include "../geometry/shape_collection.h"
+#include "../dev_pdk_setup.h"
+
+namespace bfg {
+namespace routing {
+namespace {
+
+class RoutingGridSnapshotTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    bfg::PhysicalPropertiesDatabase &physical_db = design_db_.physical_db();
+    design_db_.physical_db().LoadTechnologyFromFile(
+        "test_data/sky130.technology.pb");
+    bfg::SetUpSky130(&physical_db);
+
+    path_ = testing::TempDir() + "/routing_grid_snapshot_test.bin";
+
+    const bfg::PhysicalPropertiesDatabase &db = design_db_.physical_db();
+    met1_ = db.GetLayer("met1.drawing");
+    met2_ = db.GetLayer("met2.drawing");
+
+    met1_layer_info_ = TestGridMet1LayerInfo(
+        db, {geometry::Rectangle({2000, 2000}, {2500, 2500})});
+    met2_layer_info_ = TestGridMet2LayerInfo(db);
+    via_info_ = TestGridViaInfo(db);
+
+    shapes_.rectangles().emplace_back(new geometry::Rectangle(
+        {500, 500}, {700, 650}, met1_, ""));
+    shapes_.rectangles().emplace_back(new geometry::Rectangle(
+        {1200, 300}, {1350, 900}, met2_, "a"));
+  }
+
+  void TearDown() override {
+    std::remove(path_.c_str());
+  }
+
+  std::unique_ptr<RoutingGrid> MakeRoutingGrid() const {
+    std::unique_ptr<RoutingGrid> routing_grid = MakeTestRoutingGrid(
+        design_db_.physical_db(), met1_layer_info_.keep_outs());
+    routing_grid->AddBlockages(shapes_);
+    return routing_grid;
+  }
+
+  uint64_t InputsHash() const {
+    RoutingGridSnapshot::InputsHasher hasher;
+    hasher.Add(met1_layer_info_);
+    hasher.Add(met2_layer_info_);
+    hasher.Add(met1_, met2_, via_info_);
+    hasher.Add(shapes_, 0);
+    return hasher.value();
+  }
+
+  bfg::DesignDatabase design_db_;
+  std::string path_;
+  geometry::Layer met1_;
+  geometry::Layer met2_;
+  RoutingLayerInfo met1_layer_info_;
+  RoutingLayerInfo met2_layer_info_;
+  RoutingViaInfo via_info_;
+  geometry::ShapeCollection shapes_;
+};
+
+TEST_F(RoutingGridSnapshotTest, LoadRestoresGrid) {
+  std::unique_ptr<RoutingGrid> original = MakeRoutingGrid();
+  ASSERT_TRUE(RoutingGridSnapshot::Save(*original, InputsHash(), path_).ok());
+
+  std::unique_ptr<RoutingGrid> restored(
+      new RoutingGrid(design_db_.physical_db()));
+  ASSERT_TRUE(RoutingGridSnapshot::Load(
+      path_, InputsHash(), restored.get()).ok());
+
+  ASSERT_TRUE(restored->GetRoutingViaInfo(met1_, met2_));
+  EXPECT_EQ(via_info_.cost(),
+            restored->GetRoutingViaInfo(met1_, met2_)->get().cost());
+  ASSERT_TRUE(restored->GetRoutingLayerInfo(met1_));
+  EXPECT_EQ(1, restored->GetRoutingLayerInfo(met1_)->get().keep_outs().size());
+
+  std::vector<EquivalentNets> all_nets = {
+      EquivalentNets(), EquivalentNets("a"), EquivalentNets("b")};
+  std::vector<std::optional<geometry::Layer>> all_layers = {
+      std::nullopt, met1_, met2_};
+  auto centres = [](const std::set<RoutingVertex*> &vertices) {
+    std::set<geometry::Point> points;
+    for (RoutingVertex *vertex : vertices) {
+      points.insert(vertex->centre());
+    }
+    return points;
+  };
+
+  size_t num_unavailable = 0;
+  ASSERT_EQ(original->vertices().size(), restored->vertices().size());
+  for (size_t i = 0; i < original->vertices().size(); ++i) {
+    RoutingVertex &expected = *original->vertices()[i];
+    RoutingVertex &actual = *restored->vertices()[i];
+    ASSERT_EQ(expected.centre(), actual.centre());
+    EXPECT_EQ(i, actual.contextual_index());
+    EXPECT_EQ(expected.grid_position_x(), actual.grid_position_x());
+    EXPECT_EQ(expected.grid_position_y(), actual.grid_position_y());
+    EXPECT_EQ(expected.connected_layers(), actual.connected_layers());
+    EXPECT_EQ(expected.cost(), actual.cost());
+    for (auto track : {&RoutingVertex::horizontal_track,
+                       &RoutingVertex::vertical_track}) {
+      ASSERT_EQ((expected.*track)() == nullptr, (actual.*track)() == nullptr);
+      if ((expected.*track)()) {
+        EXPECT_EQ((expected.*track)()->offset(), (actual.*track)()->offset());
+      }
+    }
+    EXPECT_EQ(expected.Available(), actual.Available())
+        << "at " << expected.centre();
+    if (!actual.Available())
+      ++num_unavailable;
+    for (const EquivalentNets &nets : all_nets) {
+      for (const auto &layer : all_layers) {
+        EXPECT_EQ(expected.AvailableForAll(nets, layer),
+                  actual.AvailableForAll(nets, layer))
+            << "at " << expected.centre() << " for " << nets;
+      }
+    }
+    EXPECT_EQ(centres(expected.GetNeighbours()),
+              centres(actual.GetNeighbours()))
+        << "at " << expected.centre();
+    ASSERT_EQ(expected.edges().size(), actual.edges().size())
+        << "at " << expected.centre();
+    std::set<std::pair<geometry::Point, bool>> expected_edges;
+    for (const RoutingEdge *edge : expected.edges()) {
+      expected_edges.insert({edge->OtherVertexThan(&expected)->centre(),
+                             edge->Available()});
+    }
+    std::set<std::pair<geometry::Point, bool>> actual_edges;
+    for (const RoutingEdge *edge : actual.edges()) {
+      ASSERT_NE(nullptr, edge->track());
+      actual_edges.insert({edge->OtherVertexThan(&actual)->centre(),
+                           edge->Available()});
+    }
+    EXPECT_EQ(expected_edges, actual_edges) << "at " << expected.centre();
+  }
+  EXPECT_LT(0, num_unavailable);
+
+  // The restored grid can still be routed on.
+  EXPECT_TRUE(restored->AddRouteBetween(
+      geometry::Port({300, 2800}, {400, 2900}, met1_, "x"),
+      geometry::Port({2800, 300}, {2900, 400}, met1_, "x"),
+      {}, EquivalentNets("x")).ok());
+}
+
+TEST_F(RoutingGridSnapshotTest, RestoresInstalledPaths) {
+  std::unique_ptr<RoutingGrid> original = MakeRoutingGrid();
+  ASSERT_TRUE(original->AddRouteBetween(
+      geometry::Port({300, 2800}, {400, 2900}, met1_, "x"),
+      geometry::Port({2800, 300}, {2900, 400}, met1_, "x"),
+      {}, EquivalentNets("x")).ok());
+  ASSERT_TRUE(original->AddRouteBetween(
+      geometry::Port({300, 300}, {400, 400}, met1_, "y"),
+      geometry::Port({2800, 2800}, {2900, 2900}, met1_, "y"),
+      {}, EquivalentNets("y")).ok());
+  ASSERT_EQ(2, original->paths().size());
+
+  auto image = RoutingGridSnapshot::SaveToString(*original, InputsHash());
+  ASSERT_TRUE(image.ok()) << image.status();
+  std::unique_ptr<RoutingGrid> restored(
+      new RoutingGrid(design_db_.physical_db()));
+  ASSERT_TRUE(RoutingGridSnapshot::LoadFromString(
+      *image, InputsHash(), restored.get()).ok());
+
+  // The restored paths describe the same routes.
+  ASSERT_EQ(original->paths().size(), restored->paths().size());
+  for (size_t i = 0; i < original->paths().size(); ++i) {
+    const RoutingPath &expected = *original->paths()[i];
+    const RoutingPath &actual = *restored->paths()[i];
+    EXPECT_EQ(expected.nets().primary(), actual.nets().primary());
+    EXPECT_EQ(expected.nets().nets(), actual.nets().nets());
+    std::vector<geometry::Point> expected_points;
+    std::vector<geometry::Layer> expected_layers;
+    expected.ToPointsAndLayers(&expected_points, &expected_layers);
+    std::vector<geometry::Point> actual_points;
+    std::vector<geometry::Layer> actual_layers;
+    actual.ToPointsAndLayers(&actual_points, &actual_layers);
+    EXPECT_EQ(expected_points, actual_points);
+    EXPECT_EQ(expected_layers, actual_layers);
+    ASSERT_EQ(expected.vertices().size(), actual.vertices().size());
+    for (size_t j = 0; j < expected.vertices().size(); ++j) {
+      EXPECT_EQ(expected.vertices()[j]->contextual_index(),
+                actual.vertices()[j]->contextual_index());
+      EXPECT_EQ(expected.vertices()[j]->installed_in_paths().size(),
+                actual.vertices()[j]->installed_in_paths().size());
+    }
+  }
+
+  // So does what the paths have used up.
+  ASSERT_EQ(original->vertices().size(), restored->vertices().size());
+  for (size_t i = 0; i < original->vertices().size(); ++i) {
+    RoutingVertex &expected = *original->vertices()[i];
+    RoutingVertex &actual = *restored->vertices()[i];
+    EXPECT_EQ(expected.Available(), actual.Available())
+        << "at " << expected.centre();
+    for (const std::string &net : {"x", "y", "z"}) {
+      EquivalentNets nets(net);
+      EXPECT_EQ(expected.AvailableForAll(nets), actual.AvailableForAll(nets))
+          << "at " << expected.centre() << " for " << net;
+    }
+  }
+
+  // Saving the restored grid gives back the same image.
+  auto second_image = RoutingGridSnapshot::SaveToString(
+      *restored, InputsHash());
+  ASSERT_TRUE(second_image.ok()) << second_image.status();
+  EXPECT_EQ(image->size(), second_image->size());
+
+  // Routing carries on around the restored paths.
+  EXPECT_TRUE(restored->AddRouteBetween(
+      geometry::Port({300, 1500}, {400, 1600}, met1_, "z"),
+      geometry::Port({2800, 1500}, {2900, 1600}, met1_, "z"),
+      {}, EquivalentNets("z")).ok());
+}
+
+TEST_F(RoutingGridSnapshotTest, RejectsDifferentInputs) {
+  std::unique_ptr<RoutingGrid> original = MakeRoutingGrid();
+  ASSERT_TRUE(RoutingGridSnapshot::Save(*original, InputsHash(), path_).ok());
+
+  auto stored = RoutingGridSnapshot::ReadInputsHash(path_);
+  ASSERT_TRUE(stored.ok());
+  EXPECT_EQ(InputsHash(), *stored);
+
+  // Moving a blockage changes the hash.
+  shapes_.rectangles().front()->Translate({10, 0});
+  EXPECT_NE(InputsHash(), *stored);
+
+  RoutingGrid restored(design_db_.physical_db());
+  absl::Status status = RoutingGridSnapshot::Load(
+      path_, InputsHash(), &restored);
+  EXPECT_EQ(absl::StatusCode::kFailedPrecondition, status.code());
+  EXPECT_TRUE(restored.vertices().empty());
+}
+
+TEST_F(RoutingGridSnapshotTest, RejectsCorruptFiles) {
+  std::unique_ptr<RoutingGrid> original = MakeRoutingGrid();
+  ASSERT_TRUE(RoutingGridSnapshot::Save(*original, InputsHash(), path_).ok());
+
+  std::fstream file(path_, std::ios::in | std::ios::out | std::ios::binary);
+  file.seekp(0, std::ios::end);
+  std::streamoff size = file.tellp();
+  file.seekp(size / 2);
+  file.put('\xff');
+  file.seekp(size / 2 + 1);
+  file.put('\x00');
+  file.close();
+
+  RoutingGrid restored(design_db_.physical_db());
+  EXPECT_FALSE(RoutingGridSnapshot::Load(
+      path_, std::nullopt, &restored).ok());
+  EXPECT_TRUE(restored.vertices().empty());
+
+  EXPECT_FALSE(RoutingGridSnapshot::Load(
+      path_ + ".missing", std::nullopt, &restored).ok());
+}
+
+}  // namespace
+}  // namespace routing
+}  // namespace bfg
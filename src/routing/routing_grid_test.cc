@@ -0,0 +1,455 @@
+#include "routing_grid.h"
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <absl/strings/str_cat.h>
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "routing_blockage_cache.h"
+#include "routing_path.h"
+#include "routing_test_grid.h"
+#include "routing_vertex.h"
+#include "../design_database.h"
+#include "../equivalent_nets.h"
+#include "../layout.h"
+#include "../physical_properties_database.h"
+#include "../poly_line_cell.h"
+#include "../geometry/layer.h"
+#include "../geometry/poly_line.h"
+#include "../geometry/point.h"
+#include "../geometry/polygon.h"
+#include "../geometry/rectangle.h"
+#include "../geometry/shape_collection.h"
+#include "../dev_pdk_setup.h"
+
+DECLARE_int32(jobs);
+
+namespace bfg {
+namespace routing {
+namespace {
+
+class RoutingGridTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    bfg::PhysicalPropertiesDatabase &physical_db = design_db_.physical_db();
+    design_db_.physical_db().LoadTechnologyFromFile(
+        "test_data/sky130.technology.pb");
+    bfg::SetUpSky130(&physical_db);
+  }
+
+  std::unique_ptr<RoutingGrid> MakeRoutingGrid(
+      const std::vector<geometry::Rectangle> &met1_keep_outs = {}) const {
+    return MakeTestRoutingGrid(design_db_.physical_db(), met1_keep_outs);
+  }
+
+  bfg::DesignDatabase design_db_;
+};
+
+TEST_F(RoutingGridTest, AddBlockagesInBulkMatchesAddingOneAtATime) {
+  const bfg::PhysicalPropertiesDatabase &db = design_db_.physical_db();
+  geometry::Layer met1 = db.GetLayer("met1.drawing");
+  geometry::Layer met2 = db.GetLayer("met2.drawing");
+
+  geometry::ShapeCollection shapes;
+  for (int64_t i = 0; i < 12; ++i) {
+    // Alternate between shapes with and without nets, on either layer, in
+    // no particular order across the tracks.
+    int64_t x = (i * 770) % 2900;
+    int64_t y = (i * 430) % 2900;
+    std::string net = i % 3 == 0 ? "" : (i % 3 == 1 ? "a" : "b");
+    shapes.rectangles().emplace_back(new geometry::Rectangle(
+        {x, y}, {x + 150 + 20 * i, y + 170}, i % 2 == 0 ? met1 : met2, net));
+  }
+  geometry::Polygon *polygon = new geometry::Polygon(
+      {{1000, 1000}, {1000, 1400}, {1200, 1400}, {1200, 1150},
+       {1500, 1150}, {1500, 1000}});
+  polygon->set_layer(met1);
+  polygon->set_net("c");
+  shapes.polygons().emplace_back(polygon);
+
+  std::unique_ptr<RoutingGrid> bulk = MakeRoutingGrid();
+  std::unique_ptr<RoutingGrid> serial = MakeRoutingGrid();
+
+  int32_t jobs = FLAGS_jobs;
+  FLAGS_jobs = 4;
+  bulk->AddBlockages(shapes);
+  FLAGS_jobs = jobs;
+
+  for (const auto &rectangle : shapes.rectangles()) {
+    serial->AddBlockage(*rectangle);
+  }
+  for (const auto &polygon : shapes.polygons()) {
+    serial->AddBlockage(*polygon);
+  }
+
+  ASSERT_EQ(serial->vertices().size(), bulk->vertices().size());
+
+  std::vector<EquivalentNets> all_nets = {
+      EquivalentNets(), EquivalentNets("a"), EquivalentNets("c")};
+  std::vector<std::optional<geometry::Layer>> all_layers = {
+      std::nullopt, met1, met2};
+  for (size_t i = 0; i < serial->vertices().size(); ++i) {
+    const RoutingVertex &expected = *serial->vertices()[i];
+    const RoutingVertex &actual = *bulk->vertices()[i];
+    ASSERT_EQ(expected.centre(), actual.centre());
+    EXPECT_EQ(expected.Available(), actual.Available())
+        << "at " << expected.centre();
+    for (const EquivalentNets &nets : all_nets) {
+      for (const auto &layer : all_layers) {
+        EXPECT_EQ(expected.AvailableForAll(nets, layer),
+                  actual.AvailableForAll(nets, layer))
+            << "at " << expected.centre() << " for " << nets;
+      }
+    }
+  }
+}
+
+TEST_F(RoutingGridTest, ConnectLayers_ParallelMatchesSerial) {
+  int32_t jobs = FLAGS_jobs;
+  FLAGS_jobs = 1;
+  std::unique_ptr<RoutingGrid> serial = MakeRoutingGrid();
+  FLAGS_jobs = 4;
+  std::unique_ptr<RoutingGrid> parallel = MakeRoutingGrid();
+  FLAGS_jobs = jobs;
+
+  auto centres = [](const std::set<RoutingVertex*> &vertices) {
+    std::set<geometry::Point> points;
+    for (RoutingVertex *vertex : vertices) {
+      points.insert(vertex->centre());
+    }
+    return points;
+  };
+
+  ASSERT_EQ(serial->vertices().size(), parallel->vertices().size());
+  for (size_t i = 0; i < serial->vertices().size(); ++i) {
+    const RoutingVertex &expected = *serial->vertices()[i];
+    const RoutingVertex &actual = *parallel->vertices()[i];
+    ASSERT_EQ(expected.centre(), actual.centre());
+    EXPECT_EQ(expected.grid_position_x(), actual.grid_position_x());
+    EXPECT_EQ(expected.grid_position_y(), actual.grid_position_y());
+    EXPECT_NE(nullptr, actual.horizontal_track());
+    EXPECT_NE(nullptr, actual.vertical_track());
+    EXPECT_EQ(expected.edges().size(), actual.edges().size())
+        << "at " << expected.centre();
+    EXPECT_EQ(centres(expected.GetNeighbours()),
+              centres(actual.GetNeighbours()))
+        << "at " << expected.centre();
+  }
+}
+
+TEST_F(RoutingGridTest, ConnectLayers_SkipsKeepOuts) {
+  const bfg::PhysicalPropertiesDatabase &db = design_db_.physical_db();
+  geometry::Layer met1 = db.GetLayer("met1.drawing");
+
+  geometry::Rectangle keep_out({1000, 1000}, {2000, 2000});
+  std::unique_ptr<RoutingGrid> unrestricted = MakeRoutingGrid();
+  std::unique_ptr<RoutingGrid> restricted = MakeRoutingGrid({keep_out});
+
+  EXPECT_LT(restricted->vertices().size(), unrestricted->vertices().size());
+
+  for (RoutingVertex *vertex : restricted->vertices()) {
+    EXPECT_FALSE(keep_out.Intersects(vertex->centre()))
+        << "vertex at " << vertex->centre();
+    for (RoutingEdge *edge : vertex->edges()) {
+      if (edge->layer() != met1)
+        continue;
+      geometry::Rectangle span(
+          {std::min(edge->first()->centre().x(), edge->second()->centre().x()),
+           edge->first()->centre().y()},
+          {std::max(edge->first()->centre().x(), edge->second()->centre().x()),
+           edge->first()->centre().y()});
+      EXPECT_FALSE(keep_out.Overlaps(span))
+          << "edge from " << edge->first()->centre() << " to "
+          << edge->second()->centre();
+    }
+  }
+
+  // Shapes deep inside the keep-out are skipped, but those near its edge still
+  // block the vertices around it.
+  geometry::ShapeCollection shapes;
+  shapes.rectangles().emplace_back(new geometry::Rectangle(
+      {1400, 1400}, {1600, 1600}, met1, ""));
+  shapes.rectangles().emplace_back(new geometry::Rectangle(
+      {1900, 1100}, {2100, 1300}, met1, ""));
+  restricted->AddBlockages(shapes);
+  unrestricted->AddBlockages(shapes);
+
+  size_t num_blocked = 0;
+  for (size_t i = 0, j = 0; i < unrestricted->vertices().size(); ++i) {
+    const RoutingVertex &expected = *unrestricted->vertices()[i];
+    if (keep_out.Intersects(expected.centre()))
+      continue;
+    ASSERT_LT(j, restricted->vertices().size());
+    const RoutingVertex &actual = *restricted->vertices()[j++];
+    ASSERT_EQ(expected.centre(), actual.centre());
+    EXPECT_EQ(expected.Available(), actual.Available())
+        << "at " << expected.centre();
+    if (!actual.Available())
+      ++num_blocked;
+  }
+  EXPECT_LT(0, num_blocked);
+
+}
+
+TEST_F(RoutingGridTest, AddBlockage_SkipsShapesDeepInKeepOuts) {
+  const bfg::PhysicalPropertiesDatabase &db = design_db_.physical_db();
+  geometry::Layer met1 = db.GetLayer("met1.drawing");
+
+  std::unique_ptr<RoutingGrid> routing_grid =
+      MakeRoutingGrid({geometry::Rectangle({500, 500}, {2500, 2500})});
+
+  EXPECT_EQ(nullptr, routing_grid->AddBlockage(
+      geometry::Rectangle({1400, 1400}, {1600, 1600}, met1, "")));
+  geometry::Polygon polygon(
+      {{1400, 1400}, {1400, 1600}, {1600, 1600}, {1600, 1400}});
+  polygon.set_layer(met1);
+  EXPECT_EQ(nullptr, routing_grid->AddBlockage(polygon));
+
+  EXPECT_NE(nullptr, routing_grid->AddBlockage(
+      geometry::Rectangle({2400, 1500}, {2600, 1600}, met1, "")));
+}
+
+TEST_F(RoutingGridTest, FindViaStack_UpdatedByAddRoutingViaInfo) {
+  const bfg::PhysicalPropertiesDatabase &db = design_db_.physical_db();
+  geometry::Layer li = db.GetLayer("li.drawing");
+  geometry::Layer met1 = db.GetLayer("met1.drawing");
+  geometry::Layer met2 = db.GetLayer("met2.drawing");
+  geometry::Layer met3 = db.GetLayer("met3.drawing");
+
+  RoutingGrid routing_grid(db);
+  EXPECT_EQ(0.0, routing_grid.FindViaStackCost(met1, met1));
+  EXPECT_FALSE(routing_grid.FindViaStackCost(met1, met2));
+
+  RoutingViaInfo met1_met2 = db.GetRoutingViaInfoOrDie(
+      "met1.drawing", "met2.drawing");
+  met1_met2.set_cost(0.5);
+  RoutingViaInfo met2_met3 = db.GetRoutingViaInfoOrDie(
+      "met2.drawing", "met3.drawing");
+  met2_met3.set_cost(1.0);
+  ASSERT_TRUE(routing_grid.AddRoutingViaInfo(met1, met2, met1_met2).ok());
+  ASSERT_TRUE(routing_grid.AddRoutingViaInfo(met2, met3, met2_met3).ok());
+
+  EXPECT_EQ(1.5, routing_grid.FindViaStackCost(met1, met3));
+  EXPECT_EQ(1.5, routing_grid.FindViaStackCost(met3, met1));
+  auto stack = routing_grid.FindViaStack(met3, met1);
+  ASSERT_TRUE(stack);
+  ASSERT_EQ(2, stack->size());
+  EXPECT_EQ(0.5, stack->at(0).cost());
+  EXPECT_EQ(1.0, stack->at(1).cost());
+  EXPECT_FALSE(routing_grid.FindViaStackCost(li, met3));
+
+  // Adding a via info extends the table.
+  RoutingViaInfo li_met1 = db.GetRoutingViaInfoOrDie(
+      "li.drawing", "met1.drawing");
+  li_met1.set_cost(0.25);
+  ASSERT_TRUE(routing_grid.AddRoutingViaInfo(li, met1, li_met1).ok());
+  EXPECT_EQ(1.75, routing_grid.FindViaStackCost(li, met3));
+  stack = routing_grid.FindViaStack(li, met3);
+  ASSERT_TRUE(stack);
+  EXPECT_EQ(3, stack->size());
+}
+
+TEST_F(RoutingGridTest, PrecomputePinAccess_ReusedAndInvalidated) {
+  const bfg::PhysicalPropertiesDatabase &db = design_db_.physical_db();
+  geometry::Layer met1 = db.GetLayer("met1.drawing");
+
+  std::unique_ptr<RoutingGrid> routing_grid = MakeRoutingGrid();
+
+  // Neither port is on the grid, so each needs an off-grid access vertex.
+  geometry::Port start({310, 2710}, {410, 2810}, met1, "x");
+  geometry::Port end({2610, 310}, {2710, 410}, met1, "x");
+  EXPECT_FALSE(routing_grid->HasPinAccess(start));
+
+  geometry::PortSet ports = geometry::Port::MakePortSet();
+  ports.insert(&start);
+  ports.insert(&end);
+  routing_grid->PrecomputePinAccess(ports);
+  EXPECT_TRUE(routing_grid->HasPinAccess(start));
+  EXPECT_TRUE(routing_grid->HasPinAccess(end));
+
+  // A new blockage near a port invalidates its analysis, but not that of the
+  // port far away.
+  routing_grid->AddBlockage(
+      geometry::Rectangle({500, 2500}, {600, 2600}, met1, ""));
+  EXPECT_FALSE(routing_grid->HasPinAccess(start));
+  EXPECT_TRUE(routing_grid->HasPinAccess(end));
+
+  // Each candidate route from the start port uses the same access vertex.
+  geometry::Port other_end({2610, 1310}, {2710, 1410}, met1, "x");
+  geometry::PortSet begin_ports = geometry::Port::MakePortSet();
+  begin_ports.insert(&start);
+  geometry::PortSet end_ports = geometry::Port::MakePortSet();
+  end_ports.insert(&end);
+  end_ports.insert(&other_end);
+  ASSERT_TRUE(routing_grid->AddBestRouteBetween(
+      begin_ports, end_ports, RoutingBlockageCache(*routing_grid),
+      EquivalentNets("x")).ok());
+  EXPECT_EQ(1, std::count_if(
+      routing_grid->vertices().begin(), routing_grid->vertices().end(),
+      [&](RoutingVertex *vertex) {
+        return vertex->centre() == start.centre();
+      }));
+
+  // Installing a path invalidates the analyses along it.
+  EXPECT_FALSE(routing_grid->HasPinAccess(start));
+}
+
+TEST_F(RoutingGridTest, ValidAgainstInstalledPaths_OnlyNearbyPathsConflict) {
+  const bfg::PhysicalPropertiesDatabase &db = design_db_.physical_db();
+  geometry::Layer met1 = db.GetLayer("met1.drawing");
+  geometry::Layer met2 = db.GetLayer("met2.drawing");
+
+  std::unique_ptr<RoutingGrid> routing_grid = MakeRoutingGrid();
+
+  auto make_candidate = [&](const geometry::Point &centre) {
+    std::unique_ptr<RoutingVertex> candidate(new RoutingVertex(centre));
+    candidate->AddConnectedLayer(met1);
+    candidate->AddConnectedLayer(met2);
+    return candidate;
+  };
+
+  auto path = routing_grid->AddRouteBetween(
+      geometry::Port({310, 310}, {410, 410}, met1, "x"),
+      geometry::Port({1010, 310}, {1110, 410}, met1, "x"),
+      {}, EquivalentNets("x"));
+  ASSERT_TRUE(path.ok());
+  ASSERT_LT(2, (*path)->vertices().size());
+
+  // Right next to a vertex in the path.
+  geometry::Point near = (*path)->vertices()[1]->centre() + geometry::Point(
+      0, 100);
+  EXPECT_FALSE(routing_grid->ValidAgainstInstalledPaths(
+      *make_candidate(near), EquivalentNets("y")).ok());
+
+  // Far from anything.
+  EXPECT_TRUE(routing_grid->ValidAgainstInstalledPaths(
+      *make_candidate({2500, 2500}), EquivalentNets("y")).ok());
+}
+
+TEST_F(RoutingGridTest, ApproximateMemoryUsage_GrowsWithContent) {
+  const bfg::PhysicalPropertiesDatabase &db = design_db_.physical_db();
+  geometry::Layer met1 = db.GetLayer("met1.drawing");
+
+  RoutingGrid empty_grid(db);
+  EXPECT_EQ(0, empty_grid.ApproximateMemoryUsage());
+
+  std::unique_ptr<RoutingGrid> routing_grid = MakeRoutingGrid();
+  size_t connected = routing_grid->ApproximateMemoryUsage();
+  EXPECT_LE(routing_grid->vertices().size() * sizeof(RoutingVertex),
+            connected);
+
+  ASSERT_TRUE(routing_grid->AddRouteBetween(
+      geometry::Port({310, 310}, {410, 410}, met1, "x"),
+      geometry::Port({1010, 310}, {1110, 410}, met1, "x"),
+      {}, EquivalentNets("x")).ok());
+  EXPECT_LT(connected, routing_grid->ApproximateMemoryUsage());
+}
+
+TEST_F(RoutingGridTest, GetStatistics_CountsLayersAndPaths) {
+  const bfg::PhysicalPropertiesDatabase &db = design_db_.physical_db();
+  geometry::Layer met1 = db.GetLayer("met1.drawing");
+  geometry::Layer met2 = db.GetLayer("met2.drawing");
+
+  std::unique_ptr<RoutingGrid> routing_grid = MakeRoutingGrid();
+  RoutingGrid::Statistics before = routing_grid->GetStatistics();
+  ASSERT_EQ(2, before.layers.size());
+  for (const geometry::Layer &layer : {met1, met2}) {
+    const RoutingGrid::LayerStatistics &layer_statistics =
+        before.layers.at(layer);
+    EXPECT_LT(0, layer_statistics.num_tracks);
+    EXPECT_LT(0, layer_statistics.num_edges);
+    // Every on-grid vertex is a met1/met2 crossing.
+    EXPECT_EQ(routing_grid->vertices().size(), layer_statistics.num_vertices);
+  }
+  EXPECT_EQ(0, before.num_paths);
+  EXPECT_EQ(0.0, before.total_wirelength);
+  EXPECT_EQ(routing_grid->ApproximateMemoryUsage(),
+            before.approximate_memory_usage);
+
+  ASSERT_TRUE(routing_grid->AddRouteBetween(
+      geometry::Port({310, 310}, {410, 410}, met1, "x"),
+      geometry::Port({1010, 310}, {1110, 410}, met1, "x"),
+      {}, EquivalentNets("x")).ok());
+  RoutingGrid::Statistics after = routing_grid->GetStatistics();
+  EXPECT_EQ(1, after.num_paths);
+  // The port centres are 700 apart.
+  EXPECT_LE(700.0, after.total_wirelength);
+}
+
+TEST_F(RoutingGridTest, GetCongestionMap_FollowsInstalledPaths) {
+  const bfg::PhysicalPropertiesDatabase &db = design_db_.physical_db();
+  geometry::Layer met1 = db.GetLayer("met1.drawing");
+
+  std::unique_ptr<RoutingGrid> routing_grid = MakeRoutingGrid();
+  std::optional<geometry::Rectangle> bounds = routing_grid->GetBounds();
+  ASSERT_TRUE(bounds);
+  EXPECT_EQ(geometry::Rectangle({0, 0}, {3000, 3000}), *bounds);
+
+  EXPECT_TRUE(routing_grid->GetCongestionMap(*bounds, 0, 0).empty());
+  EXPECT_EQ(std::vector<double>(4, 0.0),
+            routing_grid->GetCongestionMap(*bounds, 2, 2));
+
+  ASSERT_TRUE(routing_grid->AddRouteBetween(
+      geometry::Port({310, 310}, {410, 410}, met1, "x"),
+      geometry::Port({1010, 310}, {1110, 410}, met1, "x"),
+      {}, EquivalentNets("x")).ok());
+
+  // The route is entirely within the lower-left region.
+  std::vector<double> utilisation =
+      routing_grid->GetCongestionMap(*bounds, 2, 2);
+  ASSERT_EQ(4, utilisation.size());
+  EXPECT_LT(0.0, utilisation[0]);
+  EXPECT_GE(1.0, utilisation[0]);
+  EXPECT_EQ(0.0, utilisation[3]);
+}
+
+TEST_F(RoutingGridTest, CreatePolyLineCell_ParallelMatchesSerial) {
+  const bfg::PhysicalPropertiesDatabase &db = design_db_.physical_db();
+  geometry::Layer met1 = db.GetLayer("met1.drawing");
+
+  std::unique_ptr<RoutingGrid> routing_grid = MakeRoutingGrid();
+  for (int64_t i = 0; i < 6; ++i) {
+    std::string net = absl::StrCat("n", i);
+    int64_t y = 310 + 460 * i;
+    ASSERT_TRUE(routing_grid->AddRouteBetween(
+        geometry::Port({310, y}, {410, y + 100}, met1, net),
+        geometry::Port({2510, y}, {2610, y + 100}, met1, net),
+        {}, EquivalentNets(net)).ok());
+  }
+
+  int32_t jobs = FLAGS_jobs;
+  FLAGS_jobs = 1;
+  std::unique_ptr<PolyLineCell> serial(routing_grid->CreatePolyLineCell());
+  std::unique_ptr<Layout> serial_layout(routing_grid->GenerateLayout());
+  FLAGS_jobs = 4;
+  std::unique_ptr<PolyLineCell> parallel(routing_grid->CreatePolyLineCell());
+  std::unique_ptr<Layout> parallel_layout(routing_grid->GenerateLayout());
+  FLAGS_jobs = jobs;
+
+  ASSERT_EQ(serial->poly_lines().size(), parallel->poly_lines().size());
+  for (size_t i = 0; i < serial->poly_lines().size(); ++i) {
+    const geometry::PolyLine &expected = *serial->poly_lines()[i];
+    const geometry::PolyLine &actual = *parallel->poly_lines()[i];
+    EXPECT_EQ(expected.layer(), actual.layer());
+    EXPECT_EQ(expected.start(), actual.start());
+    EXPECT_EQ(expected.segments().size(), actual.segments().size());
+  }
+  ASSERT_EQ(serial->vias().size(), parallel->vias().size());
+  for (size_t i = 0; i < serial->vias().size(); ++i) {
+    EXPECT_EQ(serial->vias()[i]->centre(), parallel->vias()[i]->centre());
+  }
+
+  EXPECT_EQ(serial_layout->GetBoundingBox(),
+            parallel_layout->GetBoundingBox());
+}
+
+}  // namespace
+}  // namespace routing
+}  // namespace bfg
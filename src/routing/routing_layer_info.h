@@ -2,9 +2,11 @@
 #define ROUTING_LAYER_INFO_H_
 
 #include <cstdint>
+#include <vector>
 
 #include "../physical_properties_database.h"
 #include "../geometry/layer.h"
+#include "../geometry/point.h"
 #include "../geometry/rectangle.h"
 
 namespace bfg {
@@ -44,6 +46,37 @@ class RoutingLayerInfo {
     min_separation_ = min_separation;
   }
 
+  // Keep-outs are regions of area() in which no routing should happen on this
+  // layer. RoutingGrid::ConnectLayers does not create vertices inside them (nor
+  // tracks entirely covered by them), does not let edges cross them, and skips
+  // blockages that sit entirely inside them. Keep-outs include their
+  // boundaries.
+  const std::vector<geometry::Rectangle> &keep_outs() const {
+    return keep_outs_;
+  }
+  void AddKeepOut(const geometry::Rectangle &keep_out) {
+    keep_outs_.push_back(keep_out);
+  }
+  void ClearKeepOuts() { keep_outs_.clear(); }
+
+  bool IsKeptOut(const geometry::Point &point) const {
+    for (const geometry::Rectangle &keep_out : keep_outs_) {
+      if (keep_out.Intersects(point))
+        return true;
+    }
+    return false;
+  }
+
+  // True if the rectangle lies entirely inside one of the keep-outs.
+  bool IsKeptOut(const geometry::Rectangle &rectangle) const {
+    for (const geometry::Rectangle &keep_out : keep_outs_) {
+      if (keep_out.Intersects(rectangle.lower_left()) &&
+          keep_out.Intersects(rectangle.upper_right()))
+        return true;
+    }
+    return false;
+  }
+
  private:
   geometry::Layer layer_;
   std::optional<geometry::Layer> pin_layer_;
@@ -53,6 +86,7 @@ class RoutingLayerInfo {
   RoutingTrackDirection direction_;
   int64_t pitch_;
   int64_t min_separation_;
+  std::vector<geometry::Rectangle> keep_outs_;
 };
 
 }  // namespace routing
@@ -0,0 +1,209 @@
+#ifndef ROUTING_OBJECT_ARENA_H_
+#define ROUTING_OBJECT_ARENA_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace bfg {
+namespace routing {
+
+// A slab allocator for the many small objects making up a RoutingGrid
+// (RoutingVertex, RoutingEdge, RoutingTrack).
+//
+// Building a large grid otherwise means millions of individual calls to new and
+// delete, with objects scattered across the heap. Objects are instead
+// placement-constructed into contiguous slabs, so that objects created one
+// after another (e.g. the vertices in ConnectLayers) sit next to each other in
+// memory in creation order. Deleted objects have their destructor run and their
+// slot recycled; the memory itself is only returned when the whole arena is
+// cleared or destroyed, which frees every slab at once.
+//
+// Slabs start small and double in size up to objects_per_slab, so that arenas
+// holding only a few objects (e.g. the edges of a short RoutingTrack) stay
+// small. Reserve() can be used to allocate one large slab up front when the
+// number of objects is known.
+//
+// The arena is not itself thread-safe. Callers must hold whatever lock guards
+// the owner (the RoutingGrid's lock_, a RoutingTrack's lock_) when calling
+// New() or Delete().
+template<typename T>
+class RoutingObjectArena {
+ public:
+  static constexpr size_t kDefaultObjectsPerSlab = 1024;
+  static constexpr size_t kInitialObjectsPerSlab = 16;
+
+  explicit RoutingObjectArena(
+      size_t objects_per_slab = kDefaultObjectsPerSlab)
+      : objects_per_slab_(objects_per_slab),
+        next_slab_size_(std::min(kInitialObjectsPerSlab, objects_per_slab)),
+        num_live_(0) {
+    LOG_IF(FATAL, objects_per_slab_ == 0)
+        << "RoutingObjectArena slab size must be non-zero";
+  }
+
+  ~RoutingObjectArena() {
+    Clear();
+  }
+
+  RoutingObjectArena(const RoutingObjectArena &other) = delete;
+  RoutingObjectArena &operator=(const RoutingObjectArena &other) = delete;
+
+  // Construct a new T in the arena with the given constructor arguments. The
+  // arena retains ownership; release the object with Delete().
+  template<typename... Args>
+  T *New(Args&&... args) {
+    Slot *slot = NextFreeSlot();
+    T *object = new (slot->bytes) T(std::forward<Args>(args)...);
+    SetLive(slot, true);
+    ++num_live_;
+    return object;
+  }
+
+  // Run the object's destructor and make its slot available for reuse. The
+  // object must have been created by this arena.
+  void Delete(T *object) {
+    if (!object)
+      return;
+    Slot *slot = reinterpret_cast<Slot*>(object);
+    DCHECK(Owns(object)) << "Object " << object << " is not in this arena";
+    object->~T();
+    SetLive(slot, false);
+    free_slots_.push_back(slot);
+    --num_live_;
+  }
+
+  // True if the object lives in one of this arena's slabs. O(log(#slabs)).
+  bool Owns(const T *object) const {
+    return FindSlab(reinterpret_cast<const Slot*>(object)) != nullptr;
+  }
+
+  // Make sure there is room for at least num_objects more objects without
+  // having to allocate another slab on the way. Space is allocated as a single
+  // slab, so unless there are recycled slots to use up first the next
+  // num_objects allocations are contiguous.
+  void Reserve(size_t num_objects) {
+    size_t available = free_slots_.size();
+    if (!slabs_.empty()) {
+      available += slabs_.back().capacity - slabs_.back().used;
+    }
+    if (available >= num_objects)
+      return;
+    AllocateSlab(std::max(num_objects, next_slab_size_));
+  }
+
+  // Destroy every live object and release all slabs in bulk.
+  void Clear() {
+    for (Slab &slab : slabs_) {
+      for (size_t i = 0; i < slab.used; ++i) {
+        if (slab.live[i]) {
+          reinterpret_cast<T*>(slab.slots[i].bytes)->~T();
+        }
+      }
+    }
+    slabs_.clear();
+    slabs_by_address_.clear();
+    free_slots_.clear();
+    next_slab_size_ = std::min(kInitialObjectsPerSlab, objects_per_slab_);
+    num_live_ = 0;
+  }
+
+  size_t num_live() const { return num_live_; }
+  size_t num_slabs() const { return slabs_.size(); }
+
+  size_t capacity() const {
+    size_t total = 0;
+    for (const Slab &slab : slabs_) {
+      total += slab.capacity;
+    }
+    return total;
+  }
+
+ private:
+  struct alignas(T) Slot {
+    unsigned char bytes[sizeof(T)];
+  };
+
+  struct Slab {
+    std::unique_ptr<Slot[]> slots;
+    std::vector<bool> live;
+    size_t capacity;
+    size_t used;
+  };
+
+  Slot *NextFreeSlot() {
+    if (!free_slots_.empty()) {
+      Slot *slot = free_slots_.back();
+      free_slots_.pop_back();
+      return slot;
+    }
+    if (slabs_.empty() || slabs_.back().used == slabs_.back().capacity) {
+      AllocateSlab(next_slab_size_);
+      next_slab_size_ = std::min(2 * next_slab_size_, objects_per_slab_);
+    }
+    Slab &slab = slabs_.back();
+    return &slab.slots[slab.used++];
+  }
+
+  void AllocateSlab(size_t capacity) {
+    // Any unused tail of the current slab is put on the free list, otherwise
+    // it would be lost until Clear().
+    if (!slabs_.empty()) {
+      Slab &last = slabs_.back();
+      for (size_t i = last.capacity; i > last.used; --i) {
+        free_slots_.push_back(&last.slots[i - 1]);
+      }
+      last.used = last.capacity;
+    }
+    Slab slab;
+    slab.slots.reset(new Slot[capacity]);
+    slab.live.resize(capacity, false);
+    slab.capacity = capacity;
+    slab.used = 0;
+    slabs_by_address_[slab.slots.get()] = slabs_.size();
+    slabs_.push_back(std::move(slab));
+  }
+
+  const Slab *FindSlab(const Slot *slot) const {
+    auto it = slabs_by_address_.upper_bound(slot);
+    if (it == slabs_by_address_.begin())
+      return nullptr;
+    --it;
+    const Slab &slab = slabs_[it->second];
+    if (slot >= slab.slots.get() + slab.capacity)
+      return nullptr;
+    return &slab;
+  }
+
+  void SetLive(Slot *slot, bool live) {
+    Slab *slab = const_cast<Slab*>(FindSlab(slot));
+    DCHECK(slab);
+    slab->live[slot - slab->slots.get()] = live;
+  }
+
+  // The largest slab we will allocate without being asked to Reserve() more.
+  size_t objects_per_slab_;
+  size_t next_slab_size_;
+  size_t num_live_;
+
+  std::vector<Slab> slabs_;
+
+  // Maps the start of each slab's storage to its index in slabs_, so that we
+  // can find the slab containing any object.
+  std::map<const Slot*, size_t> slabs_by_address_;
+
+  // Slots whose objects have been deleted, available for reuse.
+  std::vector<Slot*> free_slots_;
+};
+
+}  // namespace routing
+}  // namespace bfg
+
+#endif  // ROUTING_OBJECT_ARENA_H_
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "routing_object_arena.h"
+#include "routing_vertex.h"
+#include "../geometry/point.h"
+
+namespace bfg {
+namespace routing {
+namespace {
+
+// Counts live instances so that we can check destructors are run.
+class Counted {
+ public:
+  Counted(int *count) : count_(count) { ++*count_; }
+  ~Counted() { --*count_; }
+
+ private:
+  int *count_;
+};
+
+TEST(RoutingObjectArenaTest, NewConstructsObject) {
+  RoutingObjectArena<RoutingVertex> arena;
+  RoutingVertex *vertex = arena.New(geometry::Point(3, 4));
+  EXPECT_EQ(geometry::Point(3, 4), vertex->centre());
+  EXPECT_EQ(1, arena.num_live());
+  EXPECT_TRUE(arena.Owns(vertex));
+}
+
+TEST(RoutingObjectArenaTest, DoesNotOwnOtherObjects) {
+  RoutingObjectArena<RoutingVertex> arena;
+  arena.New(geometry::Point(0, 0));
+  RoutingVertex outside({0, 0});
+  EXPECT_FALSE(arena.Owns(&outside));
+}
+
+TEST(RoutingObjectArenaTest, ReservedObjectsAreContiguous) {
+  RoutingObjectArena<RoutingVertex> arena(4);
+  arena.Reserve(100);
+  EXPECT_EQ(1, arena.num_slabs());
+
+  std::vector<RoutingVertex*> vertices;
+  for (int i = 0; i < 100; ++i) {
+    vertices.push_back(arena.New(geometry::Point(i, 0)));
+  }
+  EXPECT_EQ(1, arena.num_slabs());
+  for (int i = 1; i < 100; ++i) {
+    EXPECT_EQ(vertices[i - 1] + 1, vertices[i]);
+  }
+}
+
+TEST(RoutingObjectArenaTest, DeleteRunsDestructorAndRecyclesSlot) {
+  int count = 0;
+  RoutingObjectArena<Counted> arena;
+  Counted *first = arena.New(&count);
+  arena.New(&count);
+  EXPECT_EQ(2, count);
+
+  arena.Delete(first);
+  EXPECT_EQ(1, count);
+  EXPECT_EQ(1, arena.num_live());
+
+  Counted *replacement = arena.New(&count);
+  EXPECT_EQ(first, replacement);
+  EXPECT_EQ(2, count);
+}
+
+TEST(RoutingObjectArenaTest, ClearDestroysLiveObjects) {
+  int count = 0;
+  RoutingObjectArena<Counted> arena(8);
+  std::vector<Counted*> objects;
+  for (int i = 0; i < 50; ++i) {
+    objects.push_back(arena.New(&count));
+  }
+  arena.Delete(objects[7]);
+  arena.Delete(objects[20]);
+  EXPECT_EQ(48, count);
+
+  arena.Clear();
+  EXPECT_EQ(0, count);
+  EXPECT_EQ(0, arena.num_live());
+  EXPECT_EQ(0, arena.num_slabs());
+}
+
+TEST(RoutingObjectArenaTest, DestructorDestroysLiveObjects) {
+  int count = 0;
+  {
+    RoutingObjectArena<Counted> arena;
+    for (int i = 0; i < 20; ++i) {
+      arena.New(&count);
+    }
+    EXPECT_EQ(20, count);
+  }
+  EXPECT_EQ(0, count);
+}
+
+}  // namespace
+}  // namespace routing
+}  // namespace bfg
@@ -312,6 +312,8 @@ class RoutingPath {
   std::set<RoutingVertex*> skipped_vias_;
 
   RoutingGrid *routing_grid_;
+
+  friend class RoutingGridSnapshot;
 };
 
 std::ostream &operator<<(std::ostream &os, const RoutingPath &path);
@@ -0,0 +1,65 @@
+#include "routing_test_grid.h"
+
+#include <memory>
+#include <vector>
+
+#include "routing_grid.h"
+#include "routing_layer_info.h"
+#include "routing_track_direction.h"
+#include "routing_via_info.h"
+#include "../physical_properties_database.h"
+#include "../geometry/rectangle.h"
+
+namespace bfg {
+namespace routing {
+
+RoutingLayerInfo TestGridMet1LayerInfo(
+    const PhysicalPropertiesDatabase &db,
+    const std::vector<geometry::Rectangle> &met1_keep_outs) {
+  RoutingLayerInfo info = db.GetRoutingLayerInfoOrDie("met1.drawing");
+  info.set_direction(RoutingTrackDirection::kTrackHorizontal);
+  info.set_area(geometry::Rectangle({0, 0}, {3000, 3000}));
+  info.set_offset(170);  // Half a pitch.
+  for (const geometry::Rectangle &keep_out : met1_keep_outs) {
+    info.AddKeepOut(keep_out);
+  }
+  return info;
+}
+
+RoutingLayerInfo TestGridMet2LayerInfo(const PhysicalPropertiesDatabase &db) {
+  RoutingLayerInfo info = db.GetRoutingLayerInfoOrDie("met2.drawing");
+  info.set_direction(RoutingTrackDirection::kTrackVertical);
+  info.set_area(geometry::Rectangle({0, 0}, {3000, 3000}));
+  info.set_offset(0);
+  return info;
+}
+
+RoutingViaInfo TestGridViaInfo(const PhysicalPropertiesDatabase &db) {
+  RoutingViaInfo info = db.GetRoutingViaInfoOrDie(
+      "met1.drawing", "met2.drawing");
+  info.set_cost(0.5);
+  return info;
+}
+
+std::unique_ptr<RoutingGrid> MakeTestRoutingGrid(
+    const PhysicalPropertiesDatabase &db,
+    const std::vector<geometry::Rectangle> &met1_keep_outs) {
+  std::unique_ptr<RoutingGrid> routing_grid(new RoutingGrid(db));
+
+  RoutingLayerInfo met1_layer_info = TestGridMet1LayerInfo(db, met1_keep_outs);
+  RoutingLayerInfo met2_layer_info = TestGridMet2LayerInfo(db);
+
+  routing_grid->AddRoutingViaInfo(
+      met1_layer_info.layer(), met2_layer_info.layer(), TestGridViaInfo(db))
+      .IgnoreError();
+
+  routing_grid->AddRoutingLayerInfo(met1_layer_info).IgnoreError();
+  routing_grid->AddRoutingLayerInfo(met2_layer_info).IgnoreError();
+
+  routing_grid->ConnectLayers(
+      met1_layer_info.layer(), met2_layer_info.layer()).IgnoreError();
+  return routing_grid;
+}
+
+}  // namespace routing
+}  // namespace bfg
@@ -0,0 +1,38 @@
+#ifndef ROUTING_TEST_GRID_H_
+#define ROUTING_TEST_GRID_H_
+
+#include <memory>
+#include <vector>
+
+#include "routing_grid.h"
+#include "routing_layer_info.h"
+#include "routing_via_info.h"
+#include "../physical_properties_database.h"
+#include "../geometry/rectangle.h"
+
+namespace bfg {
+namespace routing {
+
+// The small two-layer grid that the routing tests share. met1 and met2 both
+// cover (0, 0) to (3000, 3000). met1 tracks are horizontal and offset by half
+// a pitch, met2 tracks are vertical, and vias between them cost 0.5. db must
+// already have the sky130 technology loaded.
+//
+// The layer and via infos are available separately so that tests can hash
+// or compare against exactly what the grid was built with.
+RoutingLayerInfo TestGridMet1LayerInfo(
+    const PhysicalPropertiesDatabase &db,
+    const std::vector<geometry::Rectangle> &met1_keep_outs = {});
+RoutingLayerInfo TestGridMet2LayerInfo(const PhysicalPropertiesDatabase &db);
+RoutingViaInfo TestGridViaInfo(const PhysicalPropertiesDatabase &db);
+
+// Builds the grid above, with met1_keep_outs kept out of met1, and connects
+// the two layers. No blockages are added.
+std::unique_ptr<RoutingGrid> MakeTestRoutingGrid(
+    const PhysicalPropertiesDatabase &db,
+    const std::vector<geometry::Rectangle> &met1_keep_outs = {});
+
+}  // namespace routing
+}  // namespace bfg
+
+#endif  // ROUTING_TEST_GRID_H_
@@ -1,7 +1,7 @@
 #include "routing_track.h"
 
 #include <algorithm>
-#include <queue>
+#include <iterator>
 #include <set>
 #include <vector>
 
@@ -128,7 +128,8 @@ RoutingTrackDirection RoutingTrack::AngleToDirection(
 }
 
 RoutingTrack::~RoutingTrack() {
-  for (RoutingEdge *edge : edges_) { delete edge; }
+  // Edges are freed in bulk with edge_arena_.
+  edge_arena_.Clear();
   for (RoutingTrackBlockage *blockage : blockages_.vertex_blockages) {
     delete blockage;
   }
@@ -148,11 +149,19 @@ bool RoutingTrack::RemoveEdge(RoutingEdge *edge, bool and_delete) {
   if (edges_.erase(edge) == 0)
     return false;
 
-  if (and_delete)
-    delete edge;
+  if (and_delete) {
+    NotifyEdgeChanged(*edge);
+    edge_arena_.Delete(edge);
+  }
   return true;
 }
 
+void RoutingTrack::NotifyEdgeChanged(const RoutingEdge &edge) const {
+  if (on_edge_changed_) {
+    on_edge_changed_(edge);
+  }
+}
+
 RoutingEdge *RoutingTrack::GetEdgeBetween(
     RoutingVertex *lhs, RoutingVertex *rhs) const {
   for (RoutingEdge *edge : edges_) {
@@ -169,6 +178,9 @@ bool RoutingTrack::MaybeAddEdgeBetween(
     RoutingVertex *the_other,
     const RoutingBlockageCache &blockage_cache,
     const std::optional<EquivalentNets> &for_nets) {
+  if (CrossesKeepOut(one->centre(), the_other->centre()))
+    return false;
+
   std::vector<RoutingTrackBlockage*> same_net_collisions;
   std::vector<RoutingTrackBlockage*> temporary_same_net_collisions;
   if (IsEdgeBlockedBetween(one->centre(),
@@ -179,20 +191,21 @@ bool RoutingTrack::MaybeAddEdgeBetween(
                            &temporary_same_net_collisions))
     return false;
 
-  RoutingEdge *edge = new RoutingEdge(one, the_other);
+  RoutingEdge *edge = edge_arena_.New(one, the_other);
   edge->set_track(this);
   edge->set_layer(layer_);
 
   auto cache_check = blockage_cache.ValidAgainstKnownBlockages(
       *edge, for_nets);
   if (!cache_check.ok()) {
-    delete edge;
+    edge_arena_.Delete(edge);
     return false;
   }
 
   edge->first()->AddEdge(edge);
   edge->second()->AddEdge(edge);
   edges_.insert(edge);
+  NotifyEdgeChanged(*edge);
 
   for (RoutingTrackBlockage *blockage : same_net_collisions) {
     ApplyEdgeBlockageToSingleEdge(*blockage,
@@ -211,6 +224,29 @@ bool RoutingTrack::MaybeAddEdgeBetween(
   return true;
 }
 
+bool RoutingTrack::AddKeepOut(const geometry::Rectangle &region) {
+  // The region's extent across the track, which has to include our offset, and
+  // along it, which is what we record.
+  std::pair<int64_t, int64_t> across = ProjectOntoAxis(
+      region.lower_left(), region.upper_right(),
+      OrthogonalDirectionTo(direction_));
+  if (offset_ < across.first || offset_ > across.second)
+    return false;
+  keep_outs_.push_back(ProjectOntoAxis(
+      region.lower_left(), region.upper_right(), direction_));
+  return true;
+}
+
+bool RoutingTrack::CrossesKeepOut(
+    const geometry::Point &one_end, const geometry::Point &other_end) const {
+  auto [low, high] = ProjectOntoAxis(one_end, other_end, direction_);
+  for (const auto &keep_out : keep_outs_) {
+    if (low <= keep_out.second && high >= keep_out.first)
+      return true;
+  }
+  return false;
+}
+
 // FIXME(aryap): Why isn't this called anywhere?
 void RoutingTrack::HealEdges(const RoutingBlockageCache &blockage_cache) {
   for (RoutingVertex *vertex : vertices_) {
@@ -373,7 +409,8 @@ bool RoutingTrack::RemoveVertex(
                << " because it includes vertex " << vertex;
       // This will remove the edge from the spanning_ set too.
       edge->PrepareForRemoval();
-      delete edge;
+      NotifyEdgeChanged(*edge);
+      edge_arena_.Delete(edge);
       it = edges_.erase(it);
     } else {
       ++it;
@@ -855,28 +892,15 @@ std::vector<RoutingVertex*> RoutingTrack::VerticesInSpan(
     const geometry::Point &other_end) const {
   auto low_high = ProjectOntoTrack(one_end, other_end);
 
-  // Since we don't have a geometric index for the vertex list, we have to check
-  // every single one, O(n). So we might as well do it this way.
-  auto vertex_sort_fn = [&](RoutingVertex *a, RoutingVertex *b) {
-    int64_t projection_a = ProjectOntoTrack(a->centre());
-    int64_t projection_b = ProjectOntoTrack(b->centre());
-    return projection_a < projection_b;
-  };
-  std::priority_queue<RoutingVertex*,
-                      std::vector<RoutingVertex*>,
-                      decltype(vertex_sort_fn)> spanned(vertex_sort_fn);
-  for (const auto &entry : vertices_by_offset_) {
-    RoutingVertex *vertex = entry.second;
-    int64_t position = entry.first;
-    if (position >= low_high.first && position <= low_high.second) {
-      spanned.push(vertex);
-    }
-  }
-  // TODO(aryap): With internet: is there a nicer API for this?
+  // vertices_by_offset_ is sorted by offset, so only the vertices in the span
+  // are visited. They are returned from the highest offset to the lowest.
+  auto first = vertices_by_offset_.lower_bound(low_high.first);
+  auto last = vertices_by_offset_.upper_bound(low_high.second);
   std::vector<RoutingVertex*> spanned_as_vector;
-  while (!spanned.empty()) {
-    spanned_as_vector.push_back(spanned.top());
-    spanned.pop();
+  for (auto it = std::make_reverse_iterator(last);
+       it != std::make_reverse_iterator(first);
+       ++it) {
+    spanned_as_vector.push_back(it->second);
   }
   return spanned_as_vector;
 }
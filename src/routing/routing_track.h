@@ -2,6 +2,7 @@
 #define ROUTING_TRACK_H_
 
 #include <algorithm>
+#include <functional>
 #include <set>
 #include <shared_mutex>
 #include <utility>
@@ -17,6 +18,7 @@
 #include "../geometry/rectangle.h"
 #include "routing_blockage_cache.h"
 #include "routing_edge.h"
+#include "routing_object_arena.h"
 #include "routing_vertex.h"
 #include "../physical_properties_database.h"
 
@@ -77,6 +79,15 @@ class RoutingTrack {
 
   ~RoutingTrack();
 
+  typedef std::function<void(const RoutingEdge&)> EdgeCallback;
+
+  // Called with each edge the track creates, once it is connected, and with
+  // each edge the track frees, before it is freed. The RoutingGrid uses this
+  // to keep its RoutingBlockageHitCache up to date.
+  void set_on_edge_changed(const EdgeCallback &on_edge_changed) {
+    on_edge_changed_ = on_edge_changed;
+  }
+
   // Tries to add an edge between the two vertices, returning true if
   // successful and false if no edge could be added (it was blocked).
   bool MaybeAddEdgeBetween(
@@ -223,6 +234,16 @@ class RoutingTrack {
 
   bool RemoveTemporaryBlockage(RoutingTrackBlockage *blockage);
 
+  // Records a region that edges on this track must not enter (see
+  // RoutingLayerInfo::keep_outs). Regions the track doesn't pass through are
+  // ignored. Returns true if the region was recorded.
+  bool AddKeepOut(const geometry::Rectangle &region);
+
+  // True if the span between the two points (projected onto the track) touches
+  // any keep-out.
+  bool CrossesKeepOut(const geometry::Point &one_end,
+                      const geometry::Point &other_end) const;
+
   // Returning an optional here in case it's faster than returning an empty
   // vector. I wonder?
   template<typename T>
@@ -255,6 +276,15 @@ class RoutingTrack {
   int64_t width() const { return width_; }
   void set_width(int64_t width) { width_ = width; }
 
+  // The furthest the edge of a shape can be from the track's offset, across
+  // the track, while still intersecting its vertices or edges (before any
+  // padding is added). Shapes further away than this can be skipped without
+  // calling Intersects*.
+  int64_t MaxTransverseReach() const {
+    return std::max(edges_min_transverse_separation_,
+                    vertices_min_transverse_separation_) - 1;
+  }
+
  private:
   // TODO(aryap): Maybe we sort edges and vertices by their starting/centre
   // positions?
@@ -426,10 +456,17 @@ class RoutingTrack {
 
   void SortBlockages(std::vector<RoutingTrackBlockage*> *container);
 
+  void NotifyEdgeChanged(const RoutingEdge &edge) const;
+
   // The edges generated for vertices on this track. These are OWNED by
-  // RoutingTrack.
+  // RoutingTrack, and allocated from edge_arena_.
   std::set<RoutingEdge*> edges_;
 
+  // Backing storage for edges_. Edges are added and removed under lock_.
+  RoutingObjectArena<RoutingEdge> edge_arena_;
+
+  EdgeCallback on_edge_changed_;
+
   // The vertices on this track. Vertices are NOT OWNED by RoutingTrack.
   std::set<RoutingVertex*> vertices_;
 
@@ -500,8 +537,15 @@ class RoutingTrack {
   // of the object, we DO NOT OWN temporary blockages.
   BlockageGroup temporary_blockages_;
 
+  // The [low, high] spans of keep-out regions along this track, in offsets
+  // projected onto the track. There are only ever a handful of these so they
+  // are not sorted.
+  std::vector<std::pair<int64_t, int64_t>> keep_outs_;
+
   std::shared_mutex lock_;
 
+  friend class RoutingGridSnapshot;
+
   FRIEND_TEST(RoutingTrackTest, MergesBlockages);
   FRIEND_TEST(RoutingTrackTest, DoesNotMergeDifferingNets);
 };
@@ -279,5 +279,56 @@ TEST(RoutingTrackTest, GetImmediateNeighbours) {
   EXPECT_TRUE(track.GetImmediateNeighbours(*test, true).empty());
 }
 
+TEST(RoutingTrackTest, VerticesInSpan) {
+  int64_t y = 50;
+
+  RoutingTrack track = RoutingTrack(
+      0,                                        // Layer
+      RoutingTrackDirection::kTrackHorizontal,  // Direction
+      100,                                      // Pitch
+      50,                                       // Width
+      25,                                       // Vertex via width
+      25,                                       // Vertex via length
+      50,                                       // Minimum separation
+      y,                                        // Offset
+      false);                                   // Neighbours only
+
+  int64_t pitch = 200;
+
+  std::vector<std::unique_ptr<RoutingVertex>> vertices;
+  for (int64_t i = 0; i < 10; ++i) {
+    RoutingVertex *vertex = new RoutingVertex({i * pitch, y});
+    vertices.emplace_back(vertex);
+  }
+
+  bfg::PhysicalPropertiesDatabase physical_db;
+  RoutingGrid routing_grid(physical_db);
+  RoutingBlockageCache empty_blockage_cache(routing_grid);
+
+  EXPECT_TRUE(track.VerticesInSpan({0, y}, {9 * pitch, y}).empty());
+
+  for (auto &vertex : vertices) {
+    track.AddVertex(vertex.get(), empty_blockage_cache);
+  }
+
+  // The ends are included, and the order of the ends doesn't matter.
+  std::vector<RoutingVertex*> expected = {
+    vertices[5].get(), vertices[4].get(), vertices[3].get()
+  };
+  EXPECT_THAT(track.VerticesInSpan({3 * pitch, y}, {5 * pitch, y}),
+              testing::ContainerEq(expected));
+  EXPECT_THAT(track.VerticesInSpan({5 * pitch, y}, {3 * pitch, y}),
+              testing::ContainerEq(expected));
+
+  // Ends between vertices.
+  EXPECT_THAT(track.VerticesInSpan({3 * pitch - 1, y}, {5 * pitch + 1, y}),
+              testing::ContainerEq(expected));
+  EXPECT_TRUE(
+      track.VerticesInSpan({3 * pitch + 1, y}, {4 * pitch - 1, y}).empty());
+
+  // Off the ends.
+  EXPECT_EQ(10, track.VerticesInSpan({-pitch, y}, {20 * pitch, y}).size());
+}
+
 }  // namespace routing
 }  // namespace bfg
@@ -16,6 +16,7 @@
 #include "routing_edge.h"
 #include "routing_track.h"
 #include "routing_path.h"
+#include "routing_vertex_availability.h"
 
 #include <absl/cleanup/cleanup.h>
 #include <absl/strings/str_join.h>
@@ -92,6 +93,10 @@ void RoutingVertex::UpdateCachedStatus(
                        in_use_by_nets_.empty() &&
                        blocked_by_nearby_nets_.empty();
 
+  if (availability_) {
+    availability_->Update(*this);
+  }
+
   // TODO(aryap): This is dumb because if the RoutingVertex was just blocked,
   // at least one of these tracks will definitely fail to heal around the
   // blockage. And we count on that. Otherwise we're creating an edge to replace
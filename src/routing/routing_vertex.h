@@ -28,6 +28,7 @@ class RoutingBlockageCache;
 class RoutingEdge;
 class RoutingTrack;
 class RoutingPath;
+class RoutingVertexAvailability;
 
 class RoutingVertex {
  public:
@@ -43,6 +44,7 @@ class RoutingVertex {
         horizontal_track_(nullptr),
         vertical_track_(nullptr),
         contextual_index_(-1),
+        availability_(nullptr),
         grid_position_x_(std::nullopt),
         grid_position_y_(std::nullopt),
         centre_(centre) {
@@ -273,6 +275,15 @@ class RoutingVertex {
   void set_contextual_index(size_t index) { contextual_index_ = index; }
   size_t contextual_index() const { return contextual_index_; }
 
+  // The summary (if any) that must be told when this vertex's availability
+  // changes. See RoutingVertexAvailability.
+  void set_availability(RoutingVertexAvailability *availability) {
+    availability_ = availability;
+  }
+  const RoutingVertexAvailability *availability() const {
+    return availability_;
+  }
+
   void set_update_tracks_on_blockage(bool update_tracks_on_blockage) {
     update_tracks_on_blockage_ = update_tracks_on_blockage;
   }
@@ -453,6 +464,9 @@ class RoutingVertex {
   // RoutingVertex for the duration of whatever process requires it.
   size_t contextual_index_;
 
+  // Not owned. Indexed by contextual_index_.
+  RoutingVertexAvailability *availability_;
+
   // Likewise, these are indices to track the vertex on a grid between two
   // layers. Vertices only actually connect two layers.
   std::optional<size_t> grid_position_x_;
@@ -488,6 +502,8 @@ class RoutingVertex {
   // vertex connecting to the host_port_;
   std::optional<std::string> hosts_port_;
 
+  friend class RoutingVertexAvailability;
+  friend class RoutingGridSnapshot;
   friend std::ostream &operator<<(
       std::ostream &os, const RoutingVertex &vertex);
 };
@@ -0,0 +1,247 @@
+#include "routing_vertex_availability.h"
+
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "../equivalent_nets.h"
+#include "../geometry/layer.h"
+#include "../geometry/point.h"
+#include "../geometry/rectangle.h"
+#include "routing_vertex.h"
+
+namespace bfg {
+namespace routing {
+
+void RoutingVertexAvailability::Add(RoutingVertex *vertex) {
+  vertex->set_availability(this);
+  // Vertices count as available until Update finds otherwise.
+  CountInTile(*vertex, 1, 0);
+  Update(*vertex);
+}
+
+void RoutingVertexAvailability::Erase(RoutingVertex *vertex) {
+  if (!Tracks(*vertex)) {
+    return;
+  }
+  size_t index = vertex->contextual_index();
+  SetFree(index, false);
+  size_t num_erased = exceptions_.erase(index);
+  CountInTile(*vertex, -1, num_erased > 0 ? -1 : 0);
+  vertex->set_availability(nullptr);
+}
+
+void RoutingVertexAvailability::Move(size_t from, size_t to) {
+  if (from == to) {
+    return;
+  }
+  SetFree(to, IsFree(from));
+  SetFree(from, false);
+
+  auto it = exceptions_.find(from);
+  if (it == exceptions_.end()) {
+    exceptions_.erase(to);
+    return;
+  }
+  Exceptions moved = std::move(it->second);
+  exceptions_.erase(it);
+  exceptions_[to] = std::move(moved);
+}
+
+void RoutingVertexAvailability::Update(const RoutingVertex &vertex) {
+  size_t index = vertex.contextual_index();
+  // Exactly the vertices that are not totally available have exceptions.
+  if (vertex.Available()) {
+    SetFree(index, true);
+    if (exceptions_.erase(index) > 0) {
+      CountInTile(vertex, 0, -1);
+    }
+    return;
+  }
+  SetFree(index, false);
+  auto [it, inserted] = exceptions_.insert_or_assign(index, Summarise(vertex));
+  if (inserted) {
+    CountInTile(vertex, 0, 1);
+  }
+}
+
+void RoutingVertexAvailability::Clear() {
+  free_.clear();
+  exceptions_.clear();
+  std::fill(tiles_.begin(), tiles_.end(), TileCounts());
+}
+
+void RoutingVertexAvailability::SetTiling(
+    const geometry::Rectangle &area,
+    int64_t min_tile_side,
+    const std::vector<RoutingVertex*> &vertices) {
+  auto count_tiles = [&](int64_t length) -> std::pair<size_t, int64_t> {
+    int64_t side = std::max(min_tile_side, int64_t{1});
+    side = std::max(
+        side, (length + static_cast<int64_t>(kMaxTilesPerSide) - 1) /
+            static_cast<int64_t>(kMaxTilesPerSide));
+    size_t count = std::max(static_cast<size_t>((length + side - 1) / side),
+                            size_t{1});
+    return {count, side};
+  };
+  std::tie(num_tile_columns_, tile_width_) = count_tiles(area.Width());
+  std::tie(num_tile_rows_, tile_height_) = count_tiles(area.Height());
+  tiled_area_ = area;
+  tiles_.assign(num_tile_columns_ * num_tile_rows_, TileCounts());
+
+  for (const RoutingVertex *vertex : vertices) {
+    if (!Tracks(*vertex)) {
+      continue;
+    }
+    bool unavailable =
+        exceptions_.find(vertex->contextual_index()) != exceptions_.end();
+    CountInTile(*vertex, 1, unavailable ? 1 : 0);
+  }
+}
+
+geometry::Point RoutingVertexAvailability::TileCentre(size_t tile) const {
+  size_t column = tile % num_tile_columns_;
+  size_t row = tile / num_tile_columns_;
+  return geometry::Point(
+      tiled_area_->lower_left().x() +
+          static_cast<int64_t>(column) * tile_width_ + tile_width_ / 2,
+      tiled_area_->lower_left().y() +
+          static_cast<int64_t>(row) * tile_height_ + tile_height_ / 2);
+}
+
+void RoutingVertexAvailability::CountInTile(const RoutingVertex &vertex,
+                                            int32_t num_vertices,
+                                            int32_t num_unavailable) {
+  if (!tiled_area_ || !tiled_area_->Intersects(vertex.centre())) {
+    return;
+  }
+  // Points on the upper and right edges belong to the last tile.
+  const geometry::Point &lower_left = tiled_area_->lower_left();
+  size_t column = std::min(
+      static_cast<size_t>((vertex.centre().x() - lower_left.x()) / tile_width_),
+      num_tile_columns_ - 1);
+  size_t row = std::min(
+      static_cast<size_t>(
+          (vertex.centre().y() - lower_left.y()) / tile_height_),
+      num_tile_rows_ - 1);
+  TileCounts &counts = tiles_[row * num_tile_columns_ + column];
+  counts.num_vertices += num_vertices;
+  counts.num_unavailable += num_unavailable;
+}
+
+bool RoutingVertexAvailability::Tracks(const RoutingVertex &vertex) const {
+  return vertex.availability() == this;
+}
+
+void RoutingVertexAvailability::SetFree(size_t index, bool free) {
+  size_t word = index / 64;
+  if (word >= free_.size()) {
+    if (!free) {
+      return;
+    }
+    // Grow geometrically, since vertices are added one at a time.
+    free_.resize(std::max(word + 1, 2 * free_.size()), 0);
+  }
+  uint64_t mask = uint64_t{1} << (index % 64);
+  if (free) {
+    free_[word] |= mask;
+  } else {
+    free_[word] &= ~mask;
+  }
+}
+
+RoutingVertexAvailability::Exceptions RoutingVertexAvailability::Summarise(
+    const RoutingVertex &vertex) {
+  Exceptions exceptions;
+  std::set_union(vertex.forced_blockages_.begin(),
+                 vertex.forced_blockages_.end(),
+                 vertex.temporary_forced_blockages_.begin(),
+                 vertex.temporary_forced_blockages_.end(),
+                 std::back_inserter(exceptions.forced_blocked_layers));
+
+  auto add_hazards = [&](const auto &source) {
+    for (const auto &[net, hazards] : source) {
+      for (const auto &hazard_info : hazards) {
+        auto it = std::find_if(
+            exceptions.hazards.begin(), exceptions.hazards.end(),
+            [&](const Hazard &hazard) {
+              return hazard.net == net && hazard.layer == hazard_info.layer;
+            });
+        if (it != exceptions.hazards.end()) {
+          continue;
+        }
+        exceptions.hazards.push_back({net, hazard_info.layer});
+      }
+    }
+  };
+  add_hazards(vertex.in_use_by_nets_);
+  add_hazards(vertex.blocked_by_nearby_nets_);
+  return exceptions;
+}
+
+bool RoutingVertexAvailability::AvailableForAll(
+    const RoutingVertex &vertex,
+    const EquivalentNets &for_nets,
+    const std::optional<geometry::Layer> &on_layer) const {
+  if (!Tracks(vertex)) {
+    return vertex.AvailableForAll(for_nets, on_layer);
+  }
+  return AvailableForAll(vertex.contextual_index(), for_nets, on_layer);
+}
+
+bool RoutingVertexAvailability::AvailableForNetsOnAnyLayer(
+    const RoutingVertex &vertex, const EquivalentNets &for_nets) const {
+  if (!Tracks(vertex)) {
+    return vertex.AvailableForNetsOnAnyLayer(for_nets);
+  }
+  size_t index = vertex.contextual_index();
+  for (const geometry::Layer &layer : vertex.connected_layers()) {
+    if (AvailableForAll(index, for_nets, layer)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// This must agree with RoutingVertex::AvailableForAll.
+bool RoutingVertexAvailability::AvailableForAll(
+    size_t index,
+    const EquivalentNets &for_nets,
+    const std::optional<geometry::Layer> &on_layer) const {
+  if (IsFree(index)) {
+    return true;
+  }
+
+  auto it = exceptions_.find(index);
+  LOG_IF(FATAL, it == exceptions_.end())
+      << "Vertex " << index << " is not free but has no availability summary";
+  const Exceptions &exceptions = it->second;
+
+  const auto &forced = exceptions.forced_blocked_layers;
+  if (on_layer) {
+    if (std::binary_search(forced.begin(), forced.end(), *on_layer)) {
+      return false;
+    }
+  } else if (!forced.empty()) {
+    return false;
+  }
+
+  for (const Hazard &hazard : exceptions.hazards) {
+    if (on_layer && hazard.layer && *hazard.layer != *on_layer) {
+      continue;
+    }
+    if (!for_nets.Contains(hazard.net)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace routing
+}  // namespace bfg
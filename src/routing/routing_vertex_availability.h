@@ -0,0 +1,162 @@
+#ifndef ROUTING_VERTEX_AVAILABILITY_H_
+#define ROUTING_VERTEX_AVAILABILITY_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../equivalent_nets.h"
+#include "../geometry/layer.h"
+#include "../geometry/point.h"
+#include "../geometry/rectangle.h"
+
+namespace bfg {
+namespace routing {
+
+class RoutingVertex;
+
+// A dense summary of the availability of every RoutingVertex in a RoutingGrid,
+// indexed by the vertex's contextual_index().
+//
+// Path search asks whether some net can use a vertex many millions of times,
+// and RoutingVertex::AvailableForAll answers that by summarising all of the
+// nets using and blocking the vertex into fresh maps every time it is asked.
+// Most vertices are completely free, which RoutingVertex already caches, but
+// we still have to chase a pointer into the vertex to find that out.
+//
+// Here we keep one bit per vertex, set iff the vertex is totally available.
+// Only the (comparatively few) vertices that are not totally available get an
+// entry in a side table, which records just what AvailableForAll needs: the
+// layers on which the vertex is forced blocked and the distinct (net, layer)
+// pairs of the nets using or blocking it. So the common case is a bit test and
+// the uncommon case is a short scan of a flat list.
+//
+// Tracked vertices point back at this object and call Update() on themselves
+// whenever their status changes (see RoutingVertex::UpdateCachedStatus), so the
+// summary follows InstallPath, AddBlockage and friends without the grid having
+// to do anything else.
+//
+// The same updates keep a count of the vertices, and of those that are not
+// totally available, in each tile of a coarse tiling of the grid (see
+// SetTiling). Congestion can then be mapped from the tiles without visiting
+// every vertex.
+//
+// Queries are const and can be made from many threads at once. Like the
+// vertices themselves, updates must happen under the RoutingGrid's exclusive
+// lock_.
+class RoutingVertexAvailability {
+ public:
+  // Enough for the largest congestion map a RouterSession will make.
+  static constexpr size_t kMaxTilesPerSide = 1024;
+
+  struct TileCounts {
+    uint32_t num_vertices = 0;
+    // Those of num_vertices that are not totally available.
+    uint32_t num_unavailable = 0;
+  };
+
+  RoutingVertexAvailability() = default;
+
+  RoutingVertexAvailability(const RoutingVertexAvailability &other) = delete;
+  RoutingVertexAvailability &operator=(
+      const RoutingVertexAvailability &other) = delete;
+
+  // Start tracking the vertex at its current contextual_index().
+  void Add(RoutingVertex *vertex);
+
+  // Stop tracking the vertex. Its slot is left free.
+  void Erase(RoutingVertex *vertex);
+
+  // Move the summary of the vertex at index `from` to index `to`, for when the
+  // owner re-indexes its vertices. Whatever was at `to` is overwritten and
+  // `from` is left empty. The caller must also update the vertex's
+  // contextual_index().
+  void Move(size_t from, size_t to);
+
+  // Recompute the summary for the given (tracked) vertex.
+  void Update(const RoutingVertex &vertex);
+
+  void Clear();
+
+  // True if the vertex's availability is summarised here.
+  bool Tracks(const RoutingVertex &vertex) const;
+
+  // Equivalent to vertex.AvailableForAll(for_nets, on_layer). If the vertex is
+  // not tracked by this object, we defer to the vertex.
+  bool AvailableForAll(
+      const RoutingVertex &vertex,
+      const EquivalentNets &for_nets,
+      const std::optional<geometry::Layer> &on_layer) const;
+
+  // Equivalent to vertex.AvailableForNetsOnAnyLayer(for_nets).
+  bool AvailableForNetsOnAnyLayer(
+      const RoutingVertex &vertex, const EquivalentNets &for_nets) const;
+
+  size_t NumUnavailable() const { return exceptions_.size(); }
+
+  // Tiles the area with tiles at least min_tile_side wide and high, and no
+  // more than kMaxTilesPerSide of them in each direction, replacing any
+  // previous tiling. The tracked vertices in each tile are counted from then
+  // on; vertices outside the area are not counted. vertices must be all of the
+  // tracked vertices, so that those tracked already can be counted now.
+  void SetTiling(const geometry::Rectangle &area,
+                 int64_t min_tile_side,
+                 const std::vector<RoutingVertex*> &vertices);
+
+  // Tiles are listed row by row, starting from the lower left.
+  const std::vector<TileCounts> &tiles() const { return tiles_; }
+  geometry::Point TileCentre(size_t tile) const;
+
+ private:
+  struct Hazard {
+    std::string net;
+    // An unspecified layer indicates that the hazard applies to ALL layers.
+    std::optional<geometry::Layer> layer;
+  };
+
+  struct Exceptions {
+    // Sorted.
+    std::vector<geometry::Layer> forced_blocked_layers;
+    // Unique (net, layer) pairs across both using and blocking nets.
+    std::vector<Hazard> hazards;
+  };
+
+  static Exceptions Summarise(const RoutingVertex &vertex);
+
+  bool AvailableForAll(
+      size_t index,
+      const EquivalentNets &for_nets,
+      const std::optional<geometry::Layer> &on_layer) const;
+
+  bool IsFree(size_t index) const {
+    size_t word = index / 64;
+    return word < free_.size() && (free_[word] >> (index % 64)) & 1;
+  }
+
+  void SetFree(size_t index, bool free);
+
+  // Adds the deltas to the counts for the tile containing the vertex, if any.
+  void CountInTile(const RoutingVertex &vertex,
+                   int32_t num_vertices,
+                   int32_t num_unavailable);
+
+  // Bit i is set iff vertex i is totally available.
+  std::vector<uint64_t> free_;
+
+  // Summaries of the vertices that are not totally available, by index.
+  std::unordered_map<size_t, Exceptions> exceptions_;
+
+  std::optional<geometry::Rectangle> tiled_area_;
+  int64_t tile_width_ = 0;
+  int64_t tile_height_ = 0;
+  size_t num_tile_columns_ = 0;
+  size_t num_tile_rows_ = 0;
+  std::vector<TileCounts> tiles_;
+};
+
+}  // namespace routing
+}  // namespace bfg
+
+#endif  // ROUTING_VERTEX_AVAILABILITY_H_
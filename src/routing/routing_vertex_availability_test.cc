@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "routing_vertex.h"
+#include "routing_vertex_availability.h"
+#include "../equivalent_nets.h"
+#include "../geometry/layer.h"
+#include "../geometry/point.h"
+#include "../geometry/rectangle.h"
+
+namespace bfg {
+namespace routing {
+namespace {
+
+// Checks that the summary gives the same answer as the vertex itself for a
+// handful of nets on every layer.
+void ExpectAgreesWithVertex(const RoutingVertexAvailability &availability,
+                            const RoutingVertex &vertex) {
+  std::vector<EquivalentNets> all_nets = {
+      EquivalentNets(),
+      EquivalentNets("a"),
+      EquivalentNets("b"),
+      EquivalentNets(std::set<std::string>{"a", "b"})};
+  std::vector<std::optional<geometry::Layer>> all_layers = {
+      std::nullopt, 0, 1, 2};
+  for (const EquivalentNets &nets : all_nets) {
+    for (const auto &layer : all_layers) {
+      EXPECT_EQ(vertex.AvailableForAll(nets, layer),
+                availability.AvailableForAll(vertex, nets, layer))
+          << "nets: " << nets << " layer: "
+          << (layer ? std::to_string(*layer) : "any");
+    }
+    EXPECT_EQ(vertex.AvailableForNetsOnAnyLayer(nets),
+              availability.AvailableForNetsOnAnyLayer(vertex, nets))
+        << "nets: " << nets;
+  }
+}
+
+RoutingVertex MakeVertex(size_t index) {
+  RoutingVertex vertex({0, 0});
+  vertex.AddConnectedLayer(0);
+  vertex.AddConnectedLayer(1);
+  vertex.set_contextual_index(index);
+  return vertex;
+}
+
+TEST(RoutingVertexAvailabilityTest, NewVertexIsFree) {
+  RoutingVertexAvailability availability;
+  RoutingVertex vertex = MakeVertex(0);
+  availability.Add(&vertex);
+
+  EXPECT_TRUE(availability.Tracks(vertex));
+  EXPECT_TRUE(availability.AvailableForAll(vertex, {}, std::nullopt));
+  EXPECT_EQ(0, availability.NumUnavailable());
+}
+
+TEST(RoutingVertexAvailabilityTest, FollowsUsingNets) {
+  RoutingVertexAvailability availability;
+  RoutingVertex vertex = MakeVertex(70);
+  availability.Add(&vertex);
+
+  vertex.AddUsingNet("a", false, std::nullopt, 0);
+  EXPECT_EQ(1, availability.NumUnavailable());
+
+  EXPECT_TRUE(availability.AvailableForAll(vertex, EquivalentNets("a"), 0));
+  EXPECT_FALSE(availability.AvailableForAll(vertex, EquivalentNets("b"), 0));
+  EXPECT_TRUE(availability.AvailableForAll(vertex, EquivalentNets("b"), 1));
+  EXPECT_FALSE(
+      availability.AvailableForAll(vertex, EquivalentNets("b"), std::nullopt));
+  ExpectAgreesWithVertex(availability, vertex);
+}
+
+TEST(RoutingVertexAvailabilityTest, FollowsForcedBlockages) {
+  RoutingVertexAvailability availability;
+  RoutingVertex vertex = MakeVertex(3);
+  availability.Add(&vertex);
+
+  vertex.SetForcedBlocked(true, false, std::nullopt, 1);
+  EXPECT_TRUE(availability.AvailableForAll(vertex, {}, 0));
+  EXPECT_FALSE(availability.AvailableForAll(vertex, EquivalentNets("a"), 1));
+  EXPECT_FALSE(availability.AvailableForAll(vertex, {}, std::nullopt));
+  ExpectAgreesWithVertex(availability, vertex);
+
+  vertex.SetForcedBlocked(false, false, std::nullopt, 1);
+  EXPECT_TRUE(availability.AvailableForAll(vertex, {}, std::nullopt));
+  EXPECT_EQ(0, availability.NumUnavailable());
+}
+
+TEST(RoutingVertexAvailabilityTest, ResetTemporaryStatusRestoresFree) {
+  RoutingVertexAvailability availability;
+  RoutingVertex vertex = MakeVertex(5);
+  availability.Add(&vertex);
+
+  vertex.AddBlockingNet("a", true);
+  vertex.SetForcedBlocked(true, true, std::nullopt, 0);
+  EXPECT_FALSE(availability.AvailableForAll(vertex, {}, std::nullopt));
+  ExpectAgreesWithVertex(availability, vertex);
+
+  vertex.ResetTemporaryStatus(std::nullopt);
+  EXPECT_TRUE(availability.AvailableForAll(vertex, {}, std::nullopt));
+  EXPECT_EQ(0, availability.NumUnavailable());
+}
+
+TEST(RoutingVertexAvailabilityTest, AgreesWithVertexForMixedHazards) {
+  RoutingVertexAvailability availability;
+  RoutingVertex vertex = MakeVertex(1);
+  availability.Add(&vertex);
+
+  vertex.AddUsingNet("a", false, std::nullopt, 0);
+  ExpectAgreesWithVertex(availability, vertex);
+  vertex.AddBlockingNet("b", false, std::nullopt, 1);
+  ExpectAgreesWithVertex(availability, vertex);
+  vertex.AddBlockingNet("a", true);
+  ExpectAgreesWithVertex(availability, vertex);
+  vertex.SetForcedBlocked(true, true, std::nullopt, 2);
+  ExpectAgreesWithVertex(availability, vertex);
+  vertex.ResetTemporaryStatus(std::nullopt);
+  ExpectAgreesWithVertex(availability, vertex);
+}
+
+TEST(RoutingVertexAvailabilityTest, MoveKeepsSummary) {
+  RoutingVertexAvailability availability;
+  RoutingVertex free_vertex = MakeVertex(0);
+  RoutingVertex used_vertex = MakeVertex(130);
+  availability.Add(&free_vertex);
+  availability.Add(&used_vertex);
+  used_vertex.AddUsingNet("a", false);
+
+  availability.Move(130, 1);
+  used_vertex.set_contextual_index(1);
+
+  EXPECT_TRUE(availability.AvailableForAll(free_vertex, {}, std::nullopt));
+  EXPECT_FALSE(availability.AvailableForAll(used_vertex, {}, std::nullopt));
+  EXPECT_TRUE(availability.AvailableForAll(
+      used_vertex, EquivalentNets("a"), std::nullopt));
+  EXPECT_EQ(1, availability.NumUnavailable());
+}
+
+TEST(RoutingVertexAvailabilityTest, ErasedVertexDefersToVertex) {
+  RoutingVertexAvailability availability;
+  RoutingVertex vertex = MakeVertex(0);
+  availability.Add(&vertex);
+  availability.Erase(&vertex);
+  EXPECT_FALSE(availability.Tracks(vertex));
+
+  // Changes are no longer reported, but queries still work.
+  vertex.AddUsingNet("a", false);
+  EXPECT_EQ(0, availability.NumUnavailable());
+  EXPECT_FALSE(availability.AvailableForAll(vertex, {}, std::nullopt));
+  ExpectAgreesWithVertex(availability, vertex);
+}
+
+TEST(RoutingVertexAvailabilityTest, CountsVerticesInTiles) {
+  RoutingVertexAvailability availability;
+  RoutingVertex lower_left({100, 100});
+  lower_left.set_contextual_index(0);
+  RoutingVertex upper_right({900, 900});
+  upper_right.set_contextual_index(1);
+  RoutingVertex outside({2000, 2000});
+  outside.set_contextual_index(2);
+
+  // Vertices tracked before the tiling is set are counted too.
+  availability.Add(&lower_left);
+  availability.SetTiling(geometry::Rectangle({0, 0}, {1000, 1000}), 500,
+                         {&lower_left});
+  availability.Add(&upper_right);
+  availability.Add(&outside);
+
+  const std::vector<RoutingVertexAvailability::TileCounts> &tiles =
+      availability.tiles();
+  ASSERT_EQ(4, tiles.size());
+  EXPECT_EQ(geometry::Point(250, 250), availability.TileCentre(0));
+  EXPECT_EQ(geometry::Point(750, 750), availability.TileCentre(3));
+  EXPECT_EQ(1, tiles[0].num_vertices);
+  EXPECT_EQ(0, tiles[1].num_vertices);
+  EXPECT_EQ(0, tiles[2].num_vertices);
+  EXPECT_EQ(1, tiles[3].num_vertices);
+
+  upper_right.AddUsingNet("a", false);
+  upper_right.AddBlockingNet("b", false);
+  EXPECT_EQ(1, tiles[3].num_unavailable);
+  EXPECT_EQ(0, tiles[0].num_unavailable);
+
+  upper_right.ResetTemporaryStatus(std::nullopt);
+  EXPECT_EQ(1, tiles[3].num_unavailable);
+
+  availability.Erase(&upper_right);
+  EXPECT_EQ(0, tiles[3].num_vertices);
+  EXPECT_EQ(0, tiles[3].num_unavailable);
+}
+
+}  // namespace
+}  // namespace routing
+}  // namespace bfg
@@ -0,0 +1,260 @@
+#include "routing_vertex_spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "routing_vertex.h"
+#include "../geometry/point.h"
+#include "../geometry/rectangle.h"
+
+namespace bfg {
+namespace routing {
+
+namespace {
+
+// Floor division, since C++ rounds towards zero and our coordinates can be
+// negative.
+int64_t FloorDiv(int64_t numerator, int64_t denominator) {
+  int64_t quotient = numerator / denominator;
+  if ((numerator % denominator != 0) && ((numerator < 0) != (denominator < 0)))
+    --quotient;
+  return quotient;
+}
+
+}   // namespace
+
+RoutingVertexSpatialIndex::RoutingVertexSpatialIndex()
+    : origin_x_(0),
+      origin_y_(0),
+      cell_size_(1),
+      num_cells_x_(0),
+      num_cells_y_(0),
+      cell_start_({0}),
+      num_live_(0),
+      num_tombstones_(0) {}
+
+void RoutingVertexSpatialIndex::Add(RoutingVertex *vertex) {
+  overflow_.push_back(
+      {vertex->centre().x(), vertex->centre().y(), vertex});
+  ++num_live_;
+  MaybeRebuild();
+}
+
+void RoutingVertexSpatialIndex::Add(
+    const std::vector<RoutingVertex*> &vertices) {
+  overflow_.reserve(overflow_.size() + vertices.size());
+  for (RoutingVertex *vertex : vertices) {
+    overflow_.push_back(
+        {vertex->centre().x(), vertex->centre().y(), vertex});
+  }
+  num_live_ += vertices.size();
+  Rebuild();
+}
+
+void RoutingVertexSpatialIndex::Erase(RoutingVertex *vertex) {
+  const geometry::Point &centre = vertex->centre();
+
+  // The overflow list is unordered, so we can swap the last element into the
+  // erased one's place.
+  for (auto it = overflow_.begin(); it != overflow_.end(); ++it) {
+    if (it->vertex == vertex) {
+      *it = overflow_.back();
+      overflow_.pop_back();
+      --num_live_;
+      return;
+    }
+  }
+
+  int64_t min_cell_x, min_cell_y, max_cell_x, max_cell_y;
+  if (!CellRange(centre.x(), centre.y(), centre.x(), centre.y(),
+                 &min_cell_x, &min_cell_y, &max_cell_x, &max_cell_y)) {
+    // We don't know about this vertex.
+    return;
+  }
+  size_t cell = CellIndex(min_cell_x, min_cell_y);
+  for (size_t i = cell_start_[cell]; i < cell_start_[cell + 1]; ++i) {
+    Entry &entry = packed_[i];
+    if (entry.vertex == vertex) {
+      entry.vertex = nullptr;
+      --num_live_;
+      ++num_tombstones_;
+      MaybeRebuild();
+      return;
+    }
+  }
+}
+
+void RoutingVertexSpatialIndex::MaybeRebuild() {
+  size_t threshold = std::max(kMinOverflowBeforeRebuild, packed_.size() / 4);
+  if (overflow_.size() > threshold || num_tombstones_ > threshold) {
+    Rebuild();
+  }
+}
+
+void RoutingVertexSpatialIndex::Rebuild() {
+  std::vector<Entry> entries;
+  entries.reserve(num_live_);
+  for (const Entry &entry : packed_) {
+    if (entry.vertex) {
+      entries.push_back(entry);
+    }
+  }
+  entries.insert(entries.end(), overflow_.begin(), overflow_.end());
+  overflow_.clear();
+  num_tombstones_ = 0;
+
+  if (entries.empty()) {
+    num_cells_x_ = 0;
+    num_cells_y_ = 0;
+    cell_start_ = {0};
+    packed_.clear();
+    return;
+  }
+
+  int64_t min_x = std::numeric_limits<int64_t>::max();
+  int64_t min_y = std::numeric_limits<int64_t>::max();
+  int64_t max_x = std::numeric_limits<int64_t>::min();
+  int64_t max_y = std::numeric_limits<int64_t>::min();
+  for (const Entry &entry : entries) {
+    min_x = std::min(min_x, entry.x);
+    min_y = std::min(min_y, entry.y);
+    max_x = std::max(max_x, entry.x);
+    max_y = std::max(max_y, entry.y);
+  }
+
+  // Pick a square cell size so that, if the vertices were evenly spread over
+  // their bounding box, there would be about kTargetEntriesPerCell of them in
+  // each cell.
+  double width = static_cast<double>(max_x - min_x) + 1;
+  double height = static_cast<double>(max_y - min_y) + 1;
+  double area_per_cell =
+      width * height * kTargetEntriesPerCell / entries.size();
+  cell_size_ = std::max(
+      static_cast<int64_t>(std::ceil(std::sqrt(area_per_cell))), int64_t{1});
+  // That still leaves many empty cells along the long side of a long, thin
+  // distribution, so we also bound the number of cells per side.
+  int64_t min_cell_size = static_cast<int64_t>(
+      std::ceil(std::max(width, height) / entries.size()));
+  cell_size_ = std::max(cell_size_, min_cell_size);
+
+  origin_x_ = min_x;
+  origin_y_ = min_y;
+  num_cells_x_ = (max_x - min_x) / cell_size_ + 1;
+  num_cells_y_ = (max_y - min_y) / cell_size_ + 1;
+
+  // Counting sort of the entries into cells.
+  size_t num_cells = static_cast<size_t>(num_cells_x_ * num_cells_y_);
+  cell_start_.assign(num_cells + 1, 0);
+  for (const Entry &entry : entries) {
+    ++cell_start_[CellIndex(CellX(entry.x), CellY(entry.y)) + 1];
+  }
+  for (size_t i = 1; i <= num_cells; ++i) {
+    cell_start_[i] += cell_start_[i - 1];
+  }
+  std::vector<size_t> next(cell_start_.begin(), cell_start_.end() - 1);
+  packed_.resize(entries.size());
+  for (const Entry &entry : entries) {
+    size_t cell = CellIndex(CellX(entry.x), CellY(entry.y));
+    packed_[next[cell]++] = entry;
+  }
+
+  VLOG(15) << "Rebuilt RoutingVertexSpatialIndex with " << packed_.size()
+           << " vertices in " << num_cells_x_ << " x " << num_cells_y_
+           << " cells of size " << cell_size_;
+}
+
+int64_t RoutingVertexSpatialIndex::CellX(int64_t x) const {
+  return FloorDiv(x - origin_x_, cell_size_);
+}
+
+int64_t RoutingVertexSpatialIndex::CellY(int64_t y) const {
+  return FloorDiv(y - origin_y_, cell_size_);
+}
+
+bool RoutingVertexSpatialIndex::CellRange(
+    int64_t min_x, int64_t min_y,
+    int64_t max_x, int64_t max_y,
+    int64_t *min_cell_x, int64_t *min_cell_y,
+    int64_t *max_cell_x, int64_t *max_cell_y) const {
+  if (num_cells_x_ == 0 || num_cells_y_ == 0) {
+    return false;
+  }
+  int64_t low_x = CellX(min_x);
+  int64_t low_y = CellY(min_y);
+  int64_t high_x = CellX(max_x);
+  int64_t high_y = CellY(max_y);
+  if (high_x < 0 || high_y < 0 ||
+      low_x >= num_cells_x_ || low_y >= num_cells_y_) {
+    return false;
+  }
+  *min_cell_x = std::max(low_x, int64_t{0});
+  *min_cell_y = std::max(low_y, int64_t{0});
+  *max_cell_x = std::min(high_x, num_cells_x_ - 1);
+  *max_cell_y = std::min(high_y, num_cells_y_ - 1);
+  return true;
+}
+
+template<typename F>
+void RoutingVertexSpatialIndex::VisitWithin(
+    int64_t min_x, int64_t min_y,
+    int64_t max_x, int64_t max_y,
+    F visitor) const {
+  auto inside = [&](const Entry &entry) {
+    return entry.vertex != nullptr &&
+           entry.x >= min_x && entry.x <= max_x &&
+           entry.y >= min_y && entry.y <= max_y;
+  };
+
+  int64_t min_cell_x, min_cell_y, max_cell_x, max_cell_y;
+  if (CellRange(min_x, min_y, max_x, max_y,
+                &min_cell_x, &min_cell_y, &max_cell_x, &max_cell_y)) {
+    for (int64_t cell_y = min_cell_y; cell_y <= max_cell_y; ++cell_y) {
+      // Cells in a row are adjacent, so their entries form one contiguous
+      // run.
+      size_t begin = cell_start_[CellIndex(min_cell_x, cell_y)];
+      size_t end = cell_start_[CellIndex(max_cell_x, cell_y) + 1];
+      for (size_t i = begin; i < end; ++i) {
+        if (inside(packed_[i])) {
+          visitor(packed_[i].vertex);
+        }
+      }
+    }
+  }
+
+  for (const Entry &entry : overflow_) {
+    if (inside(entry)) {
+      visitor(entry.vertex);
+    }
+  }
+}
+
+std::vector<RoutingVertex*> RoutingVertexSpatialIndex::FindNearby(
+    const geometry::Point &reference, int64_t radius) const {
+  std::vector<RoutingVertex*> nearby;
+  FindNearby(reference, radius, &nearby);
+  return nearby;
+}
+
+void RoutingVertexSpatialIndex::FindNearby(
+    const geometry::Point &reference,
+    int64_t radius,
+    std::vector<RoutingVertex*> *nearby) const {
+  VisitWithin(reference.x() - radius, reference.y() - radius,
+              reference.x() + radius, reference.y() + radius,
+              [&](RoutingVertex *vertex) { nearby->push_back(vertex); });
+}
+
+void RoutingVertexSpatialIndex::FindWithin(
+    const geometry::Rectangle &box,
+    std::vector<RoutingVertex*> *within) const {
+  VisitWithin(box.lower_left().x(), box.lower_left().y(),
+              box.upper_right().x(), box.upper_right().y(),
+              [&](RoutingVertex *vertex) { within->push_back(vertex); });
+}
+
+}  // namespace routing
+}  // namespace bfg
@@ -0,0 +1,133 @@
+#ifndef ROUTING_VERTEX_SPATIAL_INDEX_H_
+#define ROUTING_VERTEX_SPATIAL_INDEX_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "routing_vertex.h"
+#include "../geometry/point.h"
+#include "../geometry/rectangle.h"
+
+namespace bfg {
+namespace routing {
+
+// Manages a collection of RoutingVertex pointers (we do not take ownership!)
+// for fast spatial lookups. This is used for the off-grid vertices in a
+// RoutingGrid, which are few compared to the on-grid vertices but are looked
+// up every time a blockage is added.
+//
+// Vertices are bucketed into a uniform grid of cells, packed so that the
+// entries for each cell are contiguous in one array (like a CSR matrix). Each
+// entry keeps a copy of the vertex position so that scanning a cell does not
+// need to touch the vertices themselves. The cell size is chosen from the
+// density of the vertices whenever the index is rebuilt.
+//
+// Vertices added after the last rebuild go into a small unsorted overflow list
+// and erased vertices are left as tombstones. Once either gets too big
+// (relative to the packed size) the index is repacked. This happens on the
+// mutating side (Add/Erase), never in a query.
+//
+// Queries are const and do not mutate anything, so any number of threads can
+// query concurrently without taking a lock. Mutations are NOT safe to run
+// concurrently with queries or with each other; in the RoutingGrid they only
+// happen under an exclusive lock_.
+//
+// "Nearby" means within the axis-aligned box reference +/- radius, inclusive;
+// i.e. the L-infinity distance is at most radius.
+class RoutingVertexSpatialIndex {
+ public:
+  RoutingVertexSpatialIndex();
+
+  void Add(RoutingVertex *vertex);
+
+  // Add many vertices at once and repack, which is cheaper than adding them
+  // one at a time.
+  void Add(const std::vector<RoutingVertex*> &vertices);
+
+  void Erase(RoutingVertex *vertex);
+
+  // Pack all vertices, including those in the overflow list, into cells and
+  // drop tombstones.
+  void Rebuild();
+
+  std::vector<RoutingVertex*> FindNearby(
+      const geometry::Point &reference, int64_t radius) const;
+
+  // Append nearby vertices to *nearby instead of returning a new vector, so
+  // that callers doing many queries can reuse a buffer.
+  void FindNearby(const geometry::Point &reference,
+                  int64_t radius,
+                  std::vector<RoutingVertex*> *nearby) const;
+
+  // Append all vertices whose centres are in the given box (inclusive of its
+  // boundary) to *within.
+  void FindWithin(const geometry::Rectangle &box,
+                  std::vector<RoutingVertex*> *within) const;
+
+  size_t Size() const {
+    return num_live_;
+  }
+
+ private:
+  struct Entry {
+    int64_t x;
+    int64_t y;
+    // nullptr when erased.
+    RoutingVertex *vertex;
+  };
+
+  // We aim for roughly this many vertices per cell when picking a cell size.
+  static constexpr int64_t kTargetEntriesPerCell = 4;
+
+  // The overflow list is scanned linearly in every query, so we repack once it
+  // gets bigger than this (or bigger than some fraction of the packed
+  // entries).
+  static constexpr size_t kMinOverflowBeforeRebuild = 64;
+
+  // Find the range of cells [*min_cell_x, *max_cell_x] x [*min_cell_y,
+  // *max_cell_y] overlapping the box. Returns false if the box misses the
+  // packed region entirely.
+  bool CellRange(int64_t min_x, int64_t min_y,
+                 int64_t max_x, int64_t max_y,
+                 int64_t *min_cell_x, int64_t *min_cell_y,
+                 int64_t *max_cell_x, int64_t *max_cell_y) const;
+
+  size_t CellIndex(int64_t cell_x, int64_t cell_y) const {
+    return static_cast<size_t>(cell_y * num_cells_x_ + cell_x);
+  }
+
+  int64_t CellX(int64_t x) const;
+  int64_t CellY(int64_t y) const;
+
+  template<typename F>
+  void VisitWithin(int64_t min_x, int64_t min_y,
+                   int64_t max_x, int64_t max_y,
+                   F visitor) const;
+
+  void MaybeRebuild();
+
+  // The packed region covers [origin_x_, origin_x_ + num_cells_x_ *
+  // cell_size_) (and similarly in y). Entries outside it (which can only
+  // happen for vertices added since the last rebuild) live in overflow_.
+  int64_t origin_x_;
+  int64_t origin_y_;
+  int64_t cell_size_;
+  int64_t num_cells_x_;
+  int64_t num_cells_y_;
+
+  // The entries in cell i are packed_[cell_start_[i]] up to (but not
+  // including) packed_[cell_start_[i + 1]]. Cells are in row-major order.
+  std::vector<size_t> cell_start_;
+  std::vector<Entry> packed_;
+
+  // Entries added since the last rebuild.
+  std::vector<Entry> overflow_;
+
+  size_t num_live_;
+  size_t num_tombstones_;
+};
+
+}  // namespace routing
+}  // namespace bfg
+
+#endif  // ROUTING_VERTEX_SPATIAL_INDEX_H_
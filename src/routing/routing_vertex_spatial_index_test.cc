@@ -0,0 +1,369 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "routing_vertex_spatial_index.h"
+#include "routing_vertex.h"
+#include "../geometry/point.h"
+#include "../geometry/rectangle.h"
+
+namespace bfg {
+namespace routing {
+namespace {
+
+using testing::IsEmpty;
+using testing::UnorderedElementsAre;
+
+TEST(RoutingVertexSpatialIndexTest, EmptyTree_SizeIsZero) {
+  RoutingVertexSpatialIndex index;
+  EXPECT_EQ(index.Size(), 0);
+}
+
+TEST(RoutingVertexSpatialIndexTest, Add_IncreasesSize) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({0, 0});
+  RoutingVertex v1({100, 100});
+
+  index.Add(&v0);
+  EXPECT_EQ(index.Size(), 1);
+
+  index.Add(&v1);
+  EXPECT_EQ(index.Size(), 2);
+}
+
+TEST(RoutingVertexSpatialIndexTest, Erase_DecreasesSize) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({0, 0});
+  RoutingVertex v1({100, 100});
+
+  index.Add(&v0);
+  index.Add(&v1);
+  EXPECT_EQ(index.Size(), 2);
+
+  index.Erase(&v0);
+  EXPECT_EQ(index.Size(), 1);
+
+  index.Erase(&v1);
+  EXPECT_EQ(index.Size(), 0);
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindNearby_EmptyTree_ReturnsEmpty) {
+  RoutingVertexSpatialIndex index;
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(0, 0), 1000);
+  EXPECT_THAT(results, IsEmpty());
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindNearby_SingleVertex_WithinRadius) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({50, 50});
+  index.Add(&v0);
+
+  // Distance is 0 (same point), threshold = 1. 0 <= 1 -> found.
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(50, 50), 1);
+  EXPECT_THAT(results, UnorderedElementsAre(&v0));
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindNearby_SingleVertex_OutsideRadius) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({500, 500});
+  index.Add(&v0);
+
+  // FindNearby checks per-axis: |500 - 0| = 500 > 10 -> not found.
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(0, 0), 10);
+  EXPECT_THAT(results, IsEmpty());
+}
+
+TEST(RoutingVertexSpatialIndexTest,
+     FindNearby_MultipleVertices_FiltersCorrectly) {
+  RoutingVertexSpatialIndex index;
+  // FindNearby uses a per-axis bounding box with half-width radius.
+  RoutingVertex v_close_0({10, 10});    // max per-axis dist from origin = 10
+  RoutingVertex v_close_1({-10, -10});  // max per-axis dist from origin = 10
+  RoutingVertex v_far({1000, 1000});    // max per-axis dist from origin = 1000
+
+  index.Add(&v_close_0);
+  index.Add(&v_close_1);
+  index.Add(&v_far);
+
+  // radius=15. 10 <= 15 (close in), 1000 > 15 (far out).
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(0, 0), 15);
+
+  EXPECT_THAT(results, UnorderedElementsAre(&v_close_0, &v_close_1));
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindNearby_ExactlyAtThreshold) {
+  // Vertex at (25, 0): per-axis distance = 25. radius = 25.
+  // 25 <= 25 -> found.
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({25, 0});
+  index.Add(&v0);
+
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(0, 0), 25);
+  EXPECT_THAT(results, UnorderedElementsAre(&v0));
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindNearby_JustOutsideThreshold) {
+  // Vertex at (26, 0): per-axis distance = 26. radius = 25.
+  // 26 > 25 -> not found.
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({26, 0});
+  index.Add(&v0);
+
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(0, 0), 25);
+  EXPECT_THAT(results, IsEmpty());
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindNearby_AfterErase_DoesNotReturnErased) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({10, 10});
+  RoutingVertex v1({20, 20});
+
+  index.Add(&v0);
+  index.Add(&v1);
+  index.Erase(&v0);
+
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(0, 0), 1000);
+  EXPECT_THAT(results, UnorderedElementsAre(&v1));
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindNearby_NonOriginReference) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({500, 500});  // per-axis dist from (505,505): max(5,5) = 5
+  RoutingVertex v1({510, 510});  // per-axis dist from (505,505): max(5,5) = 5
+  RoutingVertex v2({0, 0});      // per-axis dist from (505,505): max(505,505) = 505
+
+  index.Add(&v0);
+  index.Add(&v1);
+  index.Add(&v2);
+
+  // radius=6. 5 <= 6 (nearby in), 505 > 6 (far out).
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(505, 505), 6);
+  EXPECT_THAT(results, UnorderedElementsAre(&v0, &v1));
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindNearby_NegativeCoordinates) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({-100, -100});  // per-axis dist from (-105,-95): max(5,5) = 5
+  RoutingVertex v1({-110, -90});   // per-axis dist from (-105,-95): max(5,5) = 5
+  RoutingVertex v2({100, 100});    // per-axis dist from (-105,-95): max(205,195) = 205
+
+  index.Add(&v0);
+  index.Add(&v1);
+  index.Add(&v2);
+
+  // radius=6. 5 <= 6 (nearby in), 205 > 6 (far out).
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(-105, -95), 6);
+  EXPECT_THAT(results, UnorderedElementsAre(&v0, &v1));
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindNearby_ZeroRadius_OnlyExactMatch) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({100, 200});
+  RoutingVertex v1({101, 200});
+
+  index.Add(&v0);
+  index.Add(&v1);
+
+  // radius=0, threshold = 0. v0 distance = 0, v1 distance = 1. Only v0 found.
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(100, 200), 0);
+  EXPECT_THAT(results, UnorderedElementsAre(&v0));
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindNearby_ManyVertices) {
+  RoutingVertexSpatialIndex index;
+
+  // Create a grid of vertices spaced 100 apart.
+  std::vector<std::unique_ptr<RoutingVertex>> vertices;
+  for (int x = 0; x < 1000; x += 100) {
+    for (int y = 0; y < 1000; y += 100) {
+      vertices.push_back(std::make_unique<RoutingVertex>(
+          geometry::Point(x, y)));
+      index.Add(vertices.back().get());
+    }
+  }
+  EXPECT_EQ(index.Size(), 100);
+
+  // radius=144.
+  // FindNearby uses a per-axis bounding box [ref - 144, ref + 144]:
+  //   (0,0):     max(0,0) = 0     <= 144 -> in
+  //   (100,0):   max(100,0) = 100 <= 144 -> in
+  //   (0,100):   max(0,100) = 100 <= 144 -> in
+  //   (100,100): max(100,100)=100 <= 144 -> in
+  //   (200,0):   max(200,0) = 200 > 144  -> out
+  //   (0,200):   max(0,200) = 200 > 144  -> out
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(0, 0), 144);
+  EXPECT_EQ(results.size(), 4);
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindNearby_CoincidentVertices) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({42, 42});
+  RoutingVertex v1({42, 42});
+
+  index.Add(&v0);
+  index.Add(&v1);
+
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(42, 42), 1);
+  EXPECT_THAT(results, UnorderedElementsAre(&v0, &v1));
+}
+
+TEST(RoutingVertexSpatialIndexTest, AddAfterFind_ReturnsNewVertex) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({10, 10});
+  index.Add(&v0);
+
+  // Search before adding more.
+  index.FindNearby(geometry::Point(0, 0), 100);
+
+  // Add another and search again; the new vertex is in the overflow list.
+  RoutingVertex v1({20, 20});
+  index.Add(&v1);
+
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(0, 0), 100);
+  EXPECT_THAT(results, UnorderedElementsAre(&v0, &v1));
+}
+
+TEST(RoutingVertexSpatialIndexTest, EraseAfterFind_DoesNotReturnErased) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({10, 10});
+  RoutingVertex v1({20, 20});
+  index.Add(&v0);
+  index.Add(&v1);
+
+  // Search before erasing.
+  index.FindNearby(geometry::Point(0, 0), 100);
+
+  // Erase and search again.
+  index.Erase(&v0);
+
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(0, 0), 100);
+  EXPECT_THAT(results, UnorderedElementsAre(&v1));
+}
+
+TEST(RoutingVertexSpatialIndexTest, ExplicitRebuild_KeepsAllVertices) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({10, 10});
+  RoutingVertex v1({-20, 300});
+  index.Add(&v0);
+  index.Add(&v1);
+
+  index.Rebuild();
+  EXPECT_EQ(index.Size(), 2);
+
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(0, 0), 1000);
+  EXPECT_THAT(results, UnorderedElementsAre(&v0, &v1));
+}
+
+TEST(RoutingVertexSpatialIndexTest, AddBatch_FindsOnlyNearby) {
+  RoutingVertexSpatialIndex index;
+
+  std::vector<std::unique_ptr<RoutingVertex>> vertices;
+  std::vector<RoutingVertex*> pointers;
+  for (int x = -5000; x < 5000; x += 100) {
+    for (int y = -5000; y < 5000; y += 100) {
+      vertices.push_back(std::make_unique<RoutingVertex>(
+          geometry::Point(x, y)));
+      pointers.push_back(vertices.back().get());
+    }
+  }
+  index.Add(pointers);
+  EXPECT_EQ(index.Size(), 10000);
+
+  // (-100, -100) through (100, 100) in steps of 100.
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(0, 0), 150);
+  EXPECT_EQ(results.size(), 9);
+  for (RoutingVertex *vertex : results) {
+    EXPECT_LE(std::abs(vertex->centre().x()), 150);
+    EXPECT_LE(std::abs(vertex->centre().y()), 150);
+  }
+}
+
+TEST(RoutingVertexSpatialIndexTest, ManyAddsAndErases) {
+  RoutingVertexSpatialIndex index;
+
+  // Enough vertices to force several automatic rebuilds.
+  std::vector<std::unique_ptr<RoutingVertex>> vertices;
+  for (int i = 0; i < 1000; ++i) {
+    vertices.push_back(std::make_unique<RoutingVertex>(
+        geometry::Point(i * 7, -i * 3)));
+    index.Add(vertices.back().get());
+  }
+  for (int i = 0; i < 1000; i += 2) {
+    index.Erase(vertices[i].get());
+  }
+  EXPECT_EQ(index.Size(), 500);
+
+  std::vector<RoutingVertex*> results =
+      index.FindNearby(geometry::Point(0, 0), 100000);
+  EXPECT_EQ(results.size(), 500);
+
+  // Only vertex 1 at (7, -3).
+  results = index.FindNearby(geometry::Point(7, -3), 5);
+  EXPECT_THAT(results, UnorderedElementsAre(vertices[1].get()));
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindWithin_IncludesBoundary) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v_corner({0, 0});
+  RoutingVertex v_edge({100, 50});
+  RoutingVertex v_inside({40, 40});
+  RoutingVertex v_outside({101, 50});
+  index.Add(&v_corner);
+  index.Add(&v_edge);
+  index.Add(&v_inside);
+  index.Add(&v_outside);
+
+  std::vector<RoutingVertex*> results;
+  index.FindWithin(
+      geometry::Rectangle(geometry::Point(0, 0), geometry::Point(100, 100)),
+      &results);
+  EXPECT_THAT(results, UnorderedElementsAre(&v_corner, &v_edge, &v_inside));
+}
+
+TEST(RoutingVertexSpatialIndexTest, FindNearby_AppendsToBuffer) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({0, 0});
+  RoutingVertex v1({1000, 1000});
+  index.Add(&v0);
+  index.Add(&v1);
+
+  std::vector<RoutingVertex*> results;
+  index.FindNearby(geometry::Point(0, 0), 10, &results);
+  index.FindNearby(geometry::Point(1000, 1000), 10, &results);
+  EXPECT_THAT(results, UnorderedElementsAre(&v0, &v1));
+}
+
+TEST(RoutingVertexSpatialIndexTest, Erase_UnknownVertex_DoesNothing) {
+  RoutingVertexSpatialIndex index;
+  RoutingVertex v0({0, 0});
+  RoutingVertex unknown({0, 0});
+  index.Add(&v0);
+  index.Rebuild();
+
+  index.Erase(&unknown);
+  EXPECT_EQ(index.Size(), 1);
+}
+
+}  // namespace
+}  // namespace routing
+}  // namespace bfg
@@ -971,8 +971,10 @@ void ReducedTile::ConfigureRoutingGrid(
       .IgnoreError();
 
   // TODO(aryap): We will restrict routing to routing channels so that adding
-  // blockages isn't as slow. We can also ignore met1 shapes entirely within
-  // the keep-outs.
+  // blockages isn't as slow. Adding the LUT footprints as keep-outs
+  // (RoutingLayerInfo::AddKeepOut) before ConnectLayers does that, and met1
+  // shapes entirely within the keep-outs are then ignored, but the LUT pins
+  // inside them must still be reachable first.
   //
   // As a hack for now, we can use named saved points for the ll and ur corners
   // of the routing keep out region.